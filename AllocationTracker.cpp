@@ -0,0 +1,301 @@
+//
+// Created by Krisu on 2020/4/5.
+//
+
+#include "AllocationTracker.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+
+namespace {
+
+// stored right in front of every pointer handed back to the driver
+struct BlockHeader {
+    void    *block;
+    uint64_t size;
+    uint8_t  scope;
+    uint8_t  objectBucket;
+    uint8_t  poolIndex;
+};
+
+constexpr uint8_t NOT_POOLED = 0xff;
+constexpr size_t  HEADER_SIZE = (sizeof(BlockHeader) + 15) & ~size_t(15);
+
+thread_local VkObjectType tCurrentObjectType = VK_OBJECT_TYPE_UNKNOWN;
+
+const char *ScopeName(size_t scope) {
+    switch (scope) {
+        case VK_SYSTEM_ALLOCATION_SCOPE_COMMAND:  return "command";
+        case VK_SYSTEM_ALLOCATION_SCOPE_OBJECT:   return "object";
+        case VK_SYSTEM_ALLOCATION_SCOPE_CACHE:    return "cache";
+        case VK_SYSTEM_ALLOCATION_SCOPE_DEVICE:   return "device";
+        case VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE: return "instance";
+        default:                                  return "?";
+    }
+}
+
+const char *ObjectTypeName(size_t bucket) {
+    static const char *names[] = {
+            "unknown", "instance", "physical device", "device", "queue",
+            "semaphore", "command buffer", "fence", "device memory",
+            "buffer", "image", "event", "query pool", "buffer view",
+            "image view", "shader module", "pipeline cache",
+            "pipeline layout", "render pass", "pipeline",
+            "descriptor set layout", "sampler", "descriptor pool",
+            "descriptor set", "framebuffer", "command pool", "extension"
+    };
+    return bucket < std::size(names) ? names[bucket] : "?";
+}
+
+void PrintCounters(std::ostream &os, const char *name,
+                   const AllocationTracker::Counters &counters) {
+    os << "  " << std::left << std::setw(24) << name << std::right
+       << " live " << std::setw(10) << counters.liveBytes
+       << " B  peak " << std::setw(10) << counters.peakBytes
+       << " B  allocations " << counters.totalAllocations << "\n";
+}
+
+} // namespace
+
+AllocationTracker::AllocationTracker(bool usePooledArenas)
+        : mUsePooledArenas(usePooledArenas),
+          mLastSampleTime(std::chrono::steady_clock::now()) {
+    mCallbacks.pUserData = this;
+    mCallbacks.pfnAllocation = AllocationCallback;
+    mCallbacks.pfnReallocation = ReallocationCallback;
+    mCallbacks.pfnFree = FreeCallback;
+    mCallbacks.pfnInternalAllocation = InternalAllocationCallback;
+    mCallbacks.pfnInternalFree = InternalFreeCallback;
+}
+
+AllocationTracker::~AllocationTracker() {
+    for (void *arena : mArenas) {
+        std::free(arena);
+    }
+}
+
+AllocationTracker::Stats AllocationTracker::Sample() {
+    Stats stats;
+    stats.total = mTotal.Load();
+    for (size_t i = 0; i < SCOPE_BUCKETS; i++) {
+        stats.perScope[i] = mPerScope[i].Load();
+    }
+    for (size_t i = 0; i < OBJECT_TYPE_BUCKETS; i++) {
+        stats.perObjectType[i] = mPerObjectType[i].Load();
+    }
+    stats.internalBytes = mInternalBytes.load(std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(mSampleMutex);
+    auto now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - mLastSampleTime).count();
+    if (seconds > 0.0) {
+        stats.allocationsPerSecond =
+                (stats.total.totalAllocations - mLastSampleAllocations) /
+                seconds;
+    }
+    mLastSampleTime = now;
+    mLastSampleAllocations = stats.total.totalAllocations;
+    return stats;
+}
+
+void AllocationTracker::PrintReport(std::ostream &os) {
+    Stats stats = Sample();
+
+    os << "Host allocations (" << stats.allocationsPerSecond
+       << " allocations/s, " << stats.internalBytes
+       << " B internal):\n";
+    PrintCounters(os, "total", stats.total);
+    for (size_t i = 0; i < SCOPE_BUCKETS; i++) {
+        if (stats.perScope[i].totalAllocations != 0) {
+            PrintCounters(os, ScopeName(i), stats.perScope[i]);
+        }
+    }
+    for (size_t i = 0; i < OBJECT_TYPE_BUCKETS; i++) {
+        if (stats.perObjectType[i].totalAllocations != 0) {
+            PrintCounters(os, ObjectTypeName(i), stats.perObjectType[i]);
+        }
+    }
+}
+
+AllocationTracker::ScopedTag::ScopedTag(VkObjectType objectType)
+        : mPrevious(tCurrentObjectType) {
+    tCurrentObjectType = objectType;
+}
+
+AllocationTracker::ScopedTag::~ScopedTag() {
+    tCurrentObjectType = mPrevious;
+}
+
+void AllocationTracker::Counter::Add(uint64_t size) {
+    uint64_t live = liveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+    uint64_t peak = peakBytes.load(std::memory_order_relaxed);
+    while (live > peak &&
+           !peakBytes.compare_exchange_weak(peak, live,
+                                            std::memory_order_relaxed)) {
+    }
+    liveAllocations.fetch_add(1, std::memory_order_relaxed);
+    totalAllocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+void AllocationTracker::Counter::Remove(uint64_t size) {
+    liveBytes.fetch_sub(size, std::memory_order_relaxed);
+    liveAllocations.fetch_sub(1, std::memory_order_relaxed);
+}
+
+AllocationTracker::Counters AllocationTracker::Counter::Load() const {
+    Counters counters;
+    counters.liveBytes = liveBytes.load(std::memory_order_relaxed);
+    counters.peakBytes = peakBytes.load(std::memory_order_relaxed);
+    counters.liveAllocations = liveAllocations.load(std::memory_order_relaxed);
+    counters.totalAllocations = totalAllocations.load(std::memory_order_relaxed);
+    return counters;
+}
+
+void *AllocationTracker::Allocate(size_t size, size_t alignment,
+                                  VkSystemAllocationScope scope) {
+    if (size == 0) {
+        return nullptr;
+    }
+    alignment = std::max(alignment, alignof(std::max_align_t));
+
+    // room for the header plus worst case padding up to the alignment
+    uint8_t poolIndex;
+    void *block = AllocateBlock(HEADER_SIZE + alignment - 1 + size, poolIndex);
+    if (block == nullptr) {
+        return nullptr;
+    }
+
+    auto address = reinterpret_cast<uintptr_t>(block) + HEADER_SIZE;
+    address = (address + alignment - 1) & ~uintptr_t(alignment - 1);
+    auto *header = reinterpret_cast<BlockHeader *>(address) - 1;
+    header->block = block;
+    header->size = size;
+    header->scope = static_cast<uint8_t>(scope);
+    header->objectBucket = static_cast<uint8_t>(
+            ObjectTypeBucket(tCurrentObjectType));
+    header->poolIndex = poolIndex;
+
+    mTotal.Add(size);
+    mPerScope[header->scope].Add(size);
+    mPerObjectType[header->objectBucket].Add(size);
+
+    return reinterpret_cast<void *>(address);
+}
+
+void *AllocationTracker::Reallocate(void *pOriginal, size_t size,
+                                    size_t alignment,
+                                    VkSystemAllocationScope scope) {
+    if (pOriginal == nullptr) {
+        return Allocate(size, alignment, scope);
+    }
+    if (size == 0) {
+        Free(pOriginal);
+        return nullptr;
+    }
+
+    // on failure the original allocation must stay untouched
+    void *pMemory = Allocate(size, alignment, scope);
+    if (pMemory == nullptr) {
+        return nullptr;
+    }
+    auto *header = static_cast<BlockHeader *>(pOriginal) - 1;
+    std::memcpy(pMemory, pOriginal, std::min<size_t>(header->size, size));
+    Free(pOriginal);
+    return pMemory;
+}
+
+void AllocationTracker::Free(void *pMemory) {
+    if (pMemory == nullptr) {
+        return;
+    }
+    auto *header = static_cast<BlockHeader *>(pMemory) - 1;
+    mTotal.Remove(header->size);
+    mPerScope[header->scope].Remove(header->size);
+    mPerObjectType[header->objectBucket].Remove(header->size);
+
+    FreeBlock(header->block, header->poolIndex);
+}
+
+void *AllocationTracker::AllocateBlock(size_t blockSize, uint8_t &poolIndex) {
+    poolIndex = NOT_POOLED;
+    size_t poolBlockSize = 64;
+    size_t index = 0;
+    while (poolBlockSize < blockSize) {
+        poolBlockSize <<= 1;
+        index++;
+    }
+    if (!mUsePooledArenas || index >= POOL_COUNT) {
+        return std::malloc(blockSize);
+    }
+
+    Pool &pool = mPools[index];
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    if (pool.freeList.empty()) {
+        // carve a fresh arena into blocks of this size class
+        void *arena = std::malloc(ARENA_SIZE);
+        if (arena == nullptr) {
+            return nullptr;
+        }
+        {
+            std::lock_guard<std::mutex> arenaLock(mArenaMutex);
+            mArenas.push_back(arena);
+        }
+        for (size_t offset = 0; offset + poolBlockSize <= ARENA_SIZE;
+             offset += poolBlockSize) {
+            pool.freeList.push_back(static_cast<char *>(arena) + offset);
+        }
+    }
+    void *block = pool.freeList.back();
+    pool.freeList.pop_back();
+    poolIndex = static_cast<uint8_t>(index);
+    return block;
+}
+
+void AllocationTracker::FreeBlock(void *block, uint8_t poolIndex) {
+    if (poolIndex == NOT_POOLED) {
+        std::free(block);
+        return;
+    }
+    Pool &pool = mPools[poolIndex];
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    pool.freeList.push_back(block);
+}
+
+size_t AllocationTracker::ObjectTypeBucket(VkObjectType objectType) {
+    auto value = static_cast<size_t>(objectType);
+    return value < OBJECT_TYPE_BUCKETS - 1 ? value : OBJECT_TYPE_BUCKETS - 1;
+}
+
+void *AllocationTracker::AllocationCallback(
+        void *pUserData, size_t size, size_t alignment,
+        VkSystemAllocationScope allocationScope) {
+    return static_cast<AllocationTracker *>(pUserData)->Allocate(
+            size, alignment, allocationScope);
+}
+
+void *AllocationTracker::ReallocationCallback(
+        void *pUserData, void *pOriginal, size_t size, size_t alignment,
+        VkSystemAllocationScope allocationScope) {
+    return static_cast<AllocationTracker *>(pUserData)->Reallocate(
+            pOriginal, size, alignment, allocationScope);
+}
+
+void AllocationTracker::FreeCallback(void *pUserData, void *pMemory) {
+    static_cast<AllocationTracker *>(pUserData)->Free(pMemory);
+}
+
+void AllocationTracker::InternalAllocationCallback(
+        void *pUserData, size_t size, VkInternalAllocationType,
+        VkSystemAllocationScope) {
+    static_cast<AllocationTracker *>(pUserData)->mInternalBytes.fetch_add(
+            size, std::memory_order_relaxed);
+}
+
+void AllocationTracker::InternalFreeCallback(
+        void *pUserData, size_t size, VkInternalAllocationType,
+        VkSystemAllocationScope) {
+    static_cast<AllocationTracker *>(pUserData)->mInternalBytes.fetch_sub(
+            size, std::memory_order_relaxed);
+}
@@ -0,0 +1,152 @@
+//
+// Created by Krisu on 2020/4/5.
+//
+
+#ifndef VULKAN_TEST_ALLOCATIONTRACKER_HPP
+#define VULKAN_TEST_ALLOCATIONTRACKER_HPP
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+
+/* Routes driver host allocations through our own allocator and keeps
+ * per-scope / per-object-type accounting of them. */
+class AllocationTracker {
+public:
+    // core object types fit in [0, 25], extension types share one bucket
+    constexpr static const size_t OBJECT_TYPE_BUCKETS = 27;
+    constexpr static const size_t SCOPE_BUCKETS =
+            VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1;
+
+    struct Counters {
+        uint64_t liveBytes = 0;
+        uint64_t peakBytes = 0;
+        uint64_t liveAllocations = 0;
+        uint64_t totalAllocations = 0;
+    };
+
+    struct Stats {
+        Counters total;
+        std::array<Counters, SCOPE_BUCKETS> perScope;
+        std::array<Counters, OBJECT_TYPE_BUCKETS> perObjectType;
+        uint64_t internalBytes = 0;
+        double allocationsPerSecond = 0.0;
+    };
+
+    /* usePooledArenas: serve small allocations from size-class free lists
+     * instead of hitting malloc on every driver request */
+    explicit AllocationTracker(bool usePooledArenas = false);
+
+    ~AllocationTracker();
+
+    AllocationTracker(const AllocationTracker &) = delete;
+
+    AllocationTracker &operator=(const AllocationTracker &) = delete;
+
+    /* Callbacks to hand to vkCreate* / vkDestroy* as pAllocator */
+    const VkAllocationCallbacks *GetCallbacks() const {
+        return &mCallbacks;
+    }
+
+    /* Snapshot of all counters. The allocation rate is measured since the
+     * previous call. */
+    Stats Sample();
+
+    void PrintReport(std::ostream &os);
+
+    /* Allocations made on this thread are tagged with objectType while the
+     * tag is alive. Wrap vkCreate* calls with it. */
+    class ScopedTag {
+    public:
+        explicit ScopedTag(VkObjectType objectType);
+
+        ~ScopedTag();
+
+    private:
+        VkObjectType mPrevious;
+    };
+
+private:
+    struct Counter {
+        std::atomic<uint64_t> liveBytes{0};
+        std::atomic<uint64_t> peakBytes{0};
+        std::atomic<uint64_t> liveAllocations{0};
+        std::atomic<uint64_t> totalAllocations{0};
+
+        void Add(uint64_t size);
+
+        void Remove(uint64_t size);
+
+        Counters Load() const;
+    };
+
+    struct Pool {
+        std::mutex mutex;
+        std::vector<void *> freeList;
+    };
+
+    void *Allocate(size_t size, size_t alignment,
+                   VkSystemAllocationScope scope);
+
+    void *Reallocate(void *pOriginal, size_t size, size_t alignment,
+                     VkSystemAllocationScope scope);
+
+    void Free(void *pMemory);
+
+    void *AllocateBlock(size_t blockSize, uint8_t &poolIndex);
+
+    void FreeBlock(void *block, uint8_t poolIndex);
+
+    static size_t ObjectTypeBucket(VkObjectType objectType);
+
+    static VKAPI_ATTR void *VKAPI_CALL AllocationCallback(
+            void *pUserData, size_t size, size_t alignment,
+            VkSystemAllocationScope allocationScope);
+
+    static VKAPI_ATTR void *VKAPI_CALL ReallocationCallback(
+            void *pUserData, void *pOriginal, size_t size, size_t alignment,
+            VkSystemAllocationScope allocationScope);
+
+    static VKAPI_ATTR void VKAPI_CALL FreeCallback(void *pUserData,
+                                                   void *pMemory);
+
+    static VKAPI_ATTR void VKAPI_CALL InternalAllocationCallback(
+            void *pUserData, size_t size,
+            VkInternalAllocationType allocationType,
+            VkSystemAllocationScope allocationScope);
+
+    static VKAPI_ATTR void VKAPI_CALL InternalFreeCallback(
+            void *pUserData, size_t size,
+            VkInternalAllocationType allocationType,
+            VkSystemAllocationScope allocationScope);
+
+private:
+    VkAllocationCallbacks mCallbacks{};
+    bool                  mUsePooledArenas;
+
+    Counter                                mTotal;
+    std::array<Counter, SCOPE_BUCKETS>     mPerScope;
+    std::array<Counter, OBJECT_TYPE_BUCKETS> mPerObjectType;
+    std::atomic<uint64_t>                  mInternalBytes{0};
+
+    // pooled arenas: power of two block sizes from 64 bytes to 4 KiB
+    constexpr static const size_t POOL_COUNT = 7;
+    constexpr static const size_t ARENA_SIZE = 64 * 1024;
+    std::array<Pool, POOL_COUNT> mPools;
+    std::mutex                   mArenaMutex;
+    std::vector<void *>          mArenas;
+
+    std::mutex                            mSampleMutex;
+    std::chrono::steady_clock::time_point mLastSampleTime;
+    uint64_t                              mLastSampleAllocations = 0;
+};
+
+#endif //VULKAN_TEST_ALLOCATIONTRACKER_HPP
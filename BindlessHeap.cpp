@@ -0,0 +1,204 @@
+//
+// Created by Krisu on 2020/4/11.
+//
+
+#include "BindlessHeap.hpp"
+#include "AllocationTracker.hpp"
+
+#include <stdexcept>
+
+BindlessHandle BindlessHeap::Slots::Acquire() {
+    if (!freeList.empty()) {
+        BindlessHandle handle = freeList.back();
+        freeList.pop_back();
+        return handle;
+    }
+    if (next == capacity) {
+        throw std::runtime_error("bindless heap is full");
+    }
+    return next++;
+}
+
+void BindlessHeap::Slots::Release(BindlessHandle handle,
+                                  uint32_t framesInFlight) {
+    pending.emplace_back(handle, framesInFlight);
+}
+
+void BindlessHeap::Slots::NextFrame() {
+    for (auto it = pending.begin(); it != pending.end();) {
+        if (it->second == 0) {
+            freeList.push_back(it->first);
+            it = pending.erase(it);
+        } else {
+            it->second--;
+            ++it;
+        }
+    }
+}
+
+void BindlessHeap::Init(VkDevice device,
+                        const VkAllocationCallbacks *pAllocator,
+                        const Capacity &capacity, uint32_t framesInFlight) {
+    mDevice = device;
+    mAllocator = pAllocator;
+    mFramesInFlight = framesInFlight;
+    mSampledImages.capacity = capacity.sampledImages;
+    mStorageBuffers.capacity = capacity.storageBuffers;
+    mSamplers.capacity = capacity.samplers;
+
+    VkDescriptorSetLayoutBinding bindings[3]{};
+    bindings[0].binding = SAMPLED_IMAGE_BINDING;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+    bindings[0].descriptorCount = capacity.sampledImages;
+    bindings[0].stageFlags = VK_SHADER_STAGE_ALL;
+    bindings[1].binding = STORAGE_BUFFER_BINDING;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[1].descriptorCount = capacity.storageBuffers;
+    bindings[1].stageFlags = VK_SHADER_STAGE_ALL;
+    bindings[2].binding = SAMPLER_BINDING;
+    bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+    bindings[2].descriptorCount = capacity.samplers;
+    bindings[2].stageFlags = VK_SHADER_STAGE_ALL;
+
+    // unused slots may stay empty, and slots may be written while the set
+    // is bound in command buffers that are still pending
+    VkDescriptorBindingFlagsEXT bindingFlags[3];
+    for (auto &flags : bindingFlags) {
+        flags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT |
+                VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT |
+                VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT;
+    }
+    VkDescriptorSetLayoutBindingFlagsCreateInfoEXT bindingFlagsCreateInfo{};
+    bindingFlagsCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+    bindingFlagsCreateInfo.bindingCount = 3;
+    bindingFlagsCreateInfo.pBindingFlags = bindingFlags;
+
+    VkDescriptorSetLayoutCreateInfo layoutCreateInfo{};
+    layoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutCreateInfo.pNext = &bindingFlagsCreateInfo;
+    layoutCreateInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+    layoutCreateInfo.bindingCount = 3;
+    layoutCreateInfo.pBindings = bindings;
+
+    {
+        AllocationTracker::ScopedTag tag(VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT);
+        if (vkCreateDescriptorSetLayout(mDevice, &layoutCreateInfo,
+                                        mAllocator, &mLayout) != VK_SUCCESS) {
+            throw std::runtime_error(
+                    "failed to create bindless descriptor set layout");
+        }
+    }
+
+    VkDescriptorPoolSize poolSizes[3]{
+            {VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,  capacity.sampledImages},
+            {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, capacity.storageBuffers},
+            {VK_DESCRIPTOR_TYPE_SAMPLER,        capacity.samplers}
+    };
+    VkDescriptorPoolCreateInfo poolCreateInfo{};
+    poolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolCreateInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+    poolCreateInfo.maxSets = 1;
+    poolCreateInfo.poolSizeCount = 3;
+    poolCreateInfo.pPoolSizes = poolSizes;
+
+    {
+        AllocationTracker::ScopedTag tag(VK_OBJECT_TYPE_DESCRIPTOR_POOL);
+        if (vkCreateDescriptorPool(mDevice, &poolCreateInfo, mAllocator,
+                                   &mPool) != VK_SUCCESS) {
+            throw std::runtime_error(
+                    "failed to create bindless descriptor pool");
+        }
+    }
+
+    VkDescriptorSetAllocateInfo allocateInfo{};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocateInfo.descriptorPool = mPool;
+    allocateInfo.descriptorSetCount = 1;
+    allocateInfo.pSetLayouts = &mLayout;
+    if (vkAllocateDescriptorSets(mDevice, &allocateInfo, &mDescriptorSet) !=
+        VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate bindless descriptor set");
+    }
+}
+
+void BindlessHeap::Destroy() {
+    if (mDevice == VK_NULL_HANDLE) {
+        return;
+    }
+    // the set goes away with its pool
+    vkDestroyDescriptorPool(mDevice, mPool, mAllocator);
+    vkDestroyDescriptorSetLayout(mDevice, mLayout, mAllocator);
+    mPool = VK_NULL_HANDLE;
+    mLayout = VK_NULL_HANDLE;
+    mDescriptorSet = VK_NULL_HANDLE;
+}
+
+BindlessHandle BindlessHeap::AddSampledImage(VkImageView imageView,
+                                             VkImageLayout layout) {
+    BindlessHandle handle = mSampledImages.Acquire();
+    VkDescriptorImageInfo imageInfo{VK_NULL_HANDLE, imageView, layout};
+    Write(SAMPLED_IMAGE_BINDING, handle, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+          &imageInfo, nullptr);
+    return handle;
+}
+
+BindlessHandle BindlessHeap::AddStorageBuffer(VkBuffer buffer,
+                                              VkDeviceSize offset,
+                                              VkDeviceSize range) {
+    BindlessHandle handle = mStorageBuffers.Acquire();
+    VkDescriptorBufferInfo bufferInfo{buffer, offset, range};
+    Write(STORAGE_BUFFER_BINDING, handle, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+          nullptr, &bufferInfo);
+    return handle;
+}
+
+BindlessHandle BindlessHeap::AddSampler(VkSampler sampler) {
+    BindlessHandle handle = mSamplers.Acquire();
+    VkDescriptorImageInfo imageInfo{sampler, VK_NULL_HANDLE,
+                                    VK_IMAGE_LAYOUT_UNDEFINED};
+    Write(SAMPLER_BINDING, handle, VK_DESCRIPTOR_TYPE_SAMPLER,
+          &imageInfo, nullptr);
+    return handle;
+}
+
+void BindlessHeap::RemoveSampledImage(BindlessHandle handle) {
+    mSampledImages.Release(handle, mFramesInFlight);
+}
+
+void BindlessHeap::RemoveStorageBuffer(BindlessHandle handle) {
+    mStorageBuffers.Release(handle, mFramesInFlight);
+}
+
+void BindlessHeap::RemoveSampler(BindlessHandle handle) {
+    mSamplers.Release(handle, mFramesInFlight);
+}
+
+void BindlessHeap::NextFrame() {
+    mSampledImages.NextFrame();
+    mStorageBuffers.NextFrame();
+    mSamplers.NextFrame();
+}
+
+void BindlessHeap::Bind(VkCommandBuffer commandBuffer,
+                        VkPipelineBindPoint bindPoint,
+                        VkPipelineLayout pipelineLayout,
+                        uint32_t setIndex) const {
+    vkCmdBindDescriptorSets(commandBuffer, bindPoint, pipelineLayout,
+                            setIndex, 1, &mDescriptorSet, 0, nullptr);
+}
+
+void BindlessHeap::Write(uint32_t binding, BindlessHandle handle,
+                         VkDescriptorType type,
+                         const VkDescriptorImageInfo *pImageInfo,
+                         const VkDescriptorBufferInfo *pBufferInfo) {
+    VkWriteDescriptorSet write{};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = mDescriptorSet;
+    write.dstBinding = binding;
+    write.dstArrayElement = handle;
+    write.descriptorCount = 1;
+    write.descriptorType = type;
+    write.pImageInfo = pImageInfo;
+    write.pBufferInfo = pBufferInfo;
+    vkUpdateDescriptorSets(mDevice, 1, &write, 0, nullptr);
+}
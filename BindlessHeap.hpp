@@ -0,0 +1,102 @@
+//
+// Created by Krisu on 2020/4/11.
+//
+
+#ifndef VULKAN_TEST_BINDLESSHEAP_HPP
+#define VULKAN_TEST_BINDLESSHEAP_HPP
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+
+using BindlessHandle = uint32_t;
+
+constexpr BindlessHandle INVALID_BINDLESS_HANDLE = UINT32_MAX;
+
+/* One global descriptor set holding big partially bound, update-after-bind
+ * arrays. Resources get a stable index into their array which shaders
+ * read from push constants or instance data (see shaders/bindless.glsl),
+ * so nothing is bound per draw. Needs VK_EXT_descriptor_indexing or
+ * Vulkan 1.2. */
+class BindlessHeap {
+public:
+    // binding numbers, keep in sync with shaders/bindless.glsl
+    constexpr static const uint32_t SAMPLED_IMAGE_BINDING = 0;
+    constexpr static const uint32_t STORAGE_BUFFER_BINDING = 1;
+    constexpr static const uint32_t SAMPLER_BINDING = 2;
+
+    struct Capacity {
+        uint32_t sampledImages = 16384;
+        uint32_t storageBuffers = 4096;
+        uint32_t samplers = 128;
+    };
+
+    /* framesInFlight: how long a removed handle stays unused */
+    void Init(VkDevice device, const VkAllocationCallbacks *pAllocator,
+              const Capacity &capacity, uint32_t framesInFlight);
+
+    void Destroy();
+
+    BindlessHandle AddSampledImage(VkImageView imageView,
+                                   VkImageLayout layout =
+                                   VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+    BindlessHandle AddStorageBuffer(VkBuffer buffer, VkDeviceSize offset = 0,
+                                    VkDeviceSize range = VK_WHOLE_SIZE);
+
+    BindlessHandle AddSampler(VkSampler sampler);
+
+    /* The slot is recycled once the frames in flight are done with it */
+    void RemoveSampledImage(BindlessHandle handle);
+
+    void RemoveStorageBuffer(BindlessHandle handle);
+
+    void RemoveSampler(BindlessHandle handle);
+
+    /* Call once per frame after the frame's fence was waited on */
+    void NextFrame();
+
+    void Bind(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint,
+              VkPipelineLayout pipelineLayout, uint32_t setIndex = 0) const;
+
+    VkDescriptorSetLayout GetLayout() const { return mLayout; }
+
+    VkDescriptorSet GetDescriptorSet() const { return mDescriptorSet; }
+
+private:
+    struct Slots {
+        uint32_t              capacity = 0;
+        uint32_t              next = 0;
+        std::vector<uint32_t> freeList;
+        // handle and frames to wait before it may be handed out again
+        std::vector<std::pair<uint32_t, uint32_t>> pending;
+
+        BindlessHandle Acquire();
+
+        void Release(BindlessHandle handle, uint32_t framesInFlight);
+
+        void NextFrame();
+    };
+
+    void Write(uint32_t binding, BindlessHandle handle, VkDescriptorType type,
+               const VkDescriptorImageInfo *pImageInfo,
+               const VkDescriptorBufferInfo *pBufferInfo);
+
+private:
+    VkDevice                     mDevice = VK_NULL_HANDLE;
+    const VkAllocationCallbacks *mAllocator = nullptr;
+    uint32_t                     mFramesInFlight = 1;
+
+    VkDescriptorSetLayout mLayout = VK_NULL_HANDLE;
+    VkDescriptorPool      mPool = VK_NULL_HANDLE;
+    VkDescriptorSet       mDescriptorSet = VK_NULL_HANDLE;
+
+    Slots mSampledImages;
+    Slots mStorageBuffers;
+    Slots mSamplers;
+};
+
+#endif //VULKAN_TEST_BINDLESSHEAP_HPP
@@ -0,0 +1,424 @@
+//
+// Created by Krisu on 2020/4/16.
+//
+
+#include "BlockDecoder.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+// a decoded 4x4 block, row major, always 4 channels
+using Texels = uint8_t[16][4];
+
+uint8_t Clamp255(int value) {
+    return static_cast<uint8_t>(std::clamp(value, 0, 255));
+}
+
+void Decode565(uint16_t color, int rgb[3]) {
+    int r = color >> 11;
+    int g = (color >> 5) & 0x3f;
+    int b = color & 0x1f;
+    rgb[0] = (r << 3) | (r >> 2);
+    rgb[1] = (g << 2) | (g >> 4);
+    rgb[2] = (b << 3) | (b >> 2);
+}
+
+// the color half of BC1-3, only BC1 has the 3 color mode
+void DecodeBc1(const uint8_t *block, Texels &out, bool allowThreeColors) {
+    uint16_t color0 = block[0] | (block[1] << 8);
+    uint16_t color1 = block[2] | (block[3] << 8);
+    int palette[4][4];
+    Decode565(color0, palette[0]);
+    Decode565(color1, palette[1]);
+    palette[0][3] = palette[1][3] = 255;
+    bool fourColors = color0 > color1 || !allowThreeColors;
+    for (int c = 0; c < 3; c++) {
+        if (fourColors) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        } else {
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+            palette[3][c] = 0;
+        }
+    }
+    palette[2][3] = 255;
+    palette[3][3] = fourColors ? 255 : 0;
+
+    uint32_t indices = block[4] | (block[5] << 8) | (block[6] << 16) |
+                       (uint32_t(block[7]) << 24);
+    for (int i = 0; i < 16; i++) {
+        const int *color = palette[(indices >> (2 * i)) & 3];
+        for (int c = 0; c < 4; c++) {
+            out[i][c] = static_cast<uint8_t>(color[c]);
+        }
+    }
+}
+
+// BC4 and the alpha of BC3, one channel of out
+void DecodeBc4(const uint8_t *block, Texels &out, int channel) {
+    int value0 = block[0];
+    int value1 = block[1];
+    int palette[8]{value0, value1};
+    if (value0 > value1) {
+        for (int i = 1; i < 7; i++) {
+            palette[i + 1] = ((7 - i) * value0 + i * value1) / 7;
+        }
+    } else {
+        for (int i = 1; i < 5; i++) {
+            palette[i + 1] = ((5 - i) * value0 + i * value1) / 5;
+        }
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+
+    uint64_t indices = 0;
+    for (int i = 0; i < 6; i++) {
+        indices |= uint64_t(block[2 + i]) << (8 * i);
+    }
+    for (int i = 0; i < 16; i++) {
+        out[i][channel] = static_cast<uint8_t>(
+                palette[(indices >> (3 * i)) & 7]);
+    }
+}
+
+void DecodeBc2Alpha(const uint8_t *block, Texels &out) {
+    for (int i = 0; i < 16; i++) {
+        int alpha = (block[i / 2] >> (4 * (i % 2))) & 0xf;
+        out[i][3] = static_cast<uint8_t>(alpha * 17);
+    }
+}
+
+// ETC blocks are big endian and their texels column major
+constexpr int ETC_MODIFIERS[8][2]{
+        {2, 8}, {5, 17}, {9, 29}, {13, 42}, {18, 60}, {24, 80}, {33, 106},
+        {47, 183}
+};
+constexpr int ETC_DISTANCES[8]{3, 6, 11, 16, 23, 32, 41, 64};
+
+int Extend4(int value) { return value * 17; }
+
+int Extend5(int value) { return (value << 3) | (value >> 2); }
+
+int Extend6(int value) { return (value << 2) | (value >> 4); }
+
+int Extend7(int value) { return (value << 1) | (value >> 6); }
+
+int SignExtend3(int value) { return value >= 4 ? value - 8 : value; }
+
+void DecodeEtcPlanar(const uint8_t *b, Texels &out) {
+    int ro = Extend6((b[0] >> 1) & 0x3f);
+    int go = Extend7(((b[0] & 1) << 6) | ((b[1] >> 1) & 0x3f));
+    int bo = Extend6(((b[1] & 1) << 5) | (b[2] & 0x18) | ((b[2] & 3) << 1) |
+                     (b[3] >> 7));
+    int rh = Extend6((((b[3] >> 2) & 0x1f) << 1) | (b[3] & 1));
+    int gh = Extend7(b[4] >> 1);
+    int bh = Extend6(((b[4] & 1) << 5) | (b[5] >> 3));
+    int rv = Extend6(((b[5] & 7) << 3) | (b[6] >> 5));
+    int gv = Extend7(((b[6] & 0x1f) << 2) | (b[7] >> 6));
+    int bv = Extend6(b[7] & 0x3f);
+    for (int y = 0; y < 4; y++) {
+        for (int x = 0; x < 4; x++) {
+            uint8_t *texel = out[y * 4 + x];
+            texel[0] = Clamp255((x * (rh - ro) + y * (rv - ro) + 4 * ro + 2)
+                                        >> 2);
+            texel[1] = Clamp255((x * (gh - go) + y * (gv - go) + 4 * go + 2)
+                                        >> 2);
+            texel[2] = Clamp255((x * (bh - bo) + y * (bv - bo) + 4 * bo + 2)
+                                        >> 2);
+            texel[3] = 255;
+        }
+    }
+}
+
+// T and H modes pick one of four paint colors per texel
+void DecodeEtcPaint(const uint8_t *b, Texels &out, bool hMode,
+                    bool punchthrough) {
+    int color1[3];
+    int color2[3];
+    int distance;
+    if (!hMode) {
+        color1[0] = Extend4((((b[0] >> 3) & 3) << 2) | (b[0] & 3));
+        color1[1] = Extend4(b[1] >> 4);
+        color1[2] = Extend4(b[1] & 0xf);
+        color2[0] = Extend4(b[2] >> 4);
+        color2[1] = Extend4(b[2] & 0xf);
+        color2[2] = Extend4(b[3] >> 4);
+        distance = ETC_DISTANCES[(((b[3] >> 2) & 3) << 1) | (b[3] & 1)];
+    } else {
+        int r1 = (b[0] >> 3) & 0xf;
+        int g1 = ((b[0] & 7) << 1) | ((b[1] >> 4) & 1);
+        int b1 = (b[1] & 8) | ((b[1] & 3) << 1) | (b[2] >> 7);
+        int r2 = (b[2] >> 3) & 0xf;
+        int g2 = ((b[2] & 7) << 1) | (b[3] >> 7);
+        int b2 = (b[3] >> 3) & 0xf;
+        // the order of the two colors holds the last distance bit
+        int order = ((r1 << 8) | (g1 << 4) | b1) >= ((r2 << 8) | (g2 << 4) | b2);
+        distance = ETC_DISTANCES[(b[3] & 4) | ((b[3] & 1) << 1) | order];
+        color1[0] = Extend4(r1);
+        color1[1] = Extend4(g1);
+        color1[2] = Extend4(b1);
+        color2[0] = Extend4(r2);
+        color2[1] = Extend4(g2);
+        color2[2] = Extend4(b2);
+    }
+
+    int paint[4][3];
+    for (int c = 0; c < 3; c++) {
+        if (!hMode) {
+            paint[0][c] = color1[c];
+            paint[1][c] = Clamp255(color2[c] + distance);
+            paint[2][c] = color2[c];
+            paint[3][c] = Clamp255(color2[c] - distance);
+        } else {
+            paint[0][c] = Clamp255(color1[c] + distance);
+            paint[1][c] = Clamp255(color1[c] - distance);
+            paint[2][c] = Clamp255(color2[c] + distance);
+            paint[3][c] = Clamp255(color2[c] - distance);
+        }
+    }
+
+    for (int x = 0; x < 4; x++) {
+        for (int y = 0; y < 4; y++) {
+            int bit = x * 4 + y;
+            int msb = (b[5 - bit / 8] >> (bit % 8)) & 1;
+            int lsb = (b[7 - bit / 8] >> (bit % 8)) & 1;
+            int index = (msb << 1) | lsb;
+            uint8_t *texel = out[y * 4 + x];
+            if (punchthrough && index == 2) {
+                texel[0] = texel[1] = texel[2] = texel[3] = 0;
+                continue;
+            }
+            for (int c = 0; c < 3; c++) {
+                texel[c] = static_cast<uint8_t>(paint[index][c]);
+            }
+            texel[3] = 255;
+        }
+    }
+}
+
+/* ETC2 RGB, punchthrough is the RGB8A1 variant where the differential
+ * bit says whether the block is opaque */
+void DecodeEtc2(const uint8_t *b, Texels &out, bool punchthrough) {
+    bool differential = (b[3] & 2) != 0;
+    bool flip = (b[3] & 1) != 0;
+    bool transparent = false;
+    int base[2][3];
+    if (punchthrough) {
+        transparent = !differential;
+        differential = true;
+    }
+
+    if (differential) {
+        int r = b[0] >> 3;
+        int g = b[1] >> 3;
+        int bl = b[2] >> 3;
+        int r2 = r + SignExtend3(b[0] & 7);
+        int g2 = g + SignExtend3(b[1] & 7);
+        int b2 = bl + SignExtend3(b[2] & 7);
+        // overflowing the 5 bits selects the ETC2 modes
+        if (r2 < 0 || r2 > 31) {
+            DecodeEtcPaint(b, out, false, transparent);
+            return;
+        }
+        if (g2 < 0 || g2 > 31) {
+            DecodeEtcPaint(b, out, true, transparent);
+            return;
+        }
+        if (b2 < 0 || b2 > 31) {
+            DecodeEtcPlanar(b, out);
+            return;
+        }
+        base[0][0] = Extend5(r);
+        base[0][1] = Extend5(g);
+        base[0][2] = Extend5(bl);
+        base[1][0] = Extend5(r2);
+        base[1][1] = Extend5(g2);
+        base[1][2] = Extend5(b2);
+    } else {
+        for (int c = 0; c < 3; c++) {
+            base[0][c] = Extend4(b[c] >> 4);
+            base[1][c] = Extend4(b[c] & 0xf);
+        }
+    }
+    int table[2]{b[3] >> 5, (b[3] >> 2) & 7};
+
+    for (int x = 0; x < 4; x++) {
+        for (int y = 0; y < 4; y++) {
+            int subblock = flip ? (y >= 2) : (x >= 2);
+            int bit = x * 4 + y;
+            int msb = (b[5 - bit / 8] >> (bit % 8)) & 1;
+            int lsb = (b[7 - bit / 8] >> (bit % 8)) & 1;
+            uint8_t *texel = out[y * 4 + x];
+            if (transparent && msb && !lsb) {
+                texel[0] = texel[1] = texel[2] = texel[3] = 0;
+                continue;
+            }
+            int modifier = ETC_MODIFIERS[table[subblock]][lsb];
+            if (transparent && !lsb) {
+                modifier = 0;
+            }
+            if (msb) {
+                modifier = -modifier;
+            }
+            for (int c = 0; c < 3; c++) {
+                texel[c] = Clamp255(base[subblock][c] + modifier);
+            }
+            texel[3] = 255;
+        }
+    }
+}
+
+constexpr int EAC_MODIFIERS[16][8]{
+        {-3, -6, -9, -15, 2, 5, 8, 14},
+        {-3, -7, -10, -13, 2, 6, 9, 12},
+        {-2, -5, -8, -13, 1, 4, 7, 12},
+        {-2, -4, -6, -13, 1, 3, 5, 12},
+        {-3, -6, -8, -12, 2, 5, 7, 11},
+        {-3, -7, -9, -11, 2, 6, 8, 10},
+        {-4, -7, -8, -11, 3, 6, 7, 10},
+        {-3, -5, -8, -11, 2, 4, 7, 10},
+        {-2, -6, -8, -10, 1, 5, 7, 9},
+        {-2, -5, -8, -10, 1, 4, 7, 9},
+        {-2, -4, -8, -10, 1, 3, 7, 9},
+        {-2, -5, -7, -10, 1, 4, 6, 9},
+        {-3, -4, -7, -10, 2, 3, 6, 9},
+        {-1, -2, -3, -10, 0, 1, 2, 9},
+        {-4, -6, -8, -9, 3, 5, 7, 8},
+        {-3, -5, -7, -9, 2, 4, 6, 8}
+};
+
+void DecodeEacAlpha(const uint8_t *b, Texels &out) {
+    int base = b[0];
+    int multiplier = b[1] >> 4;
+    const int *modifiers = EAC_MODIFIERS[b[1] & 0xf];
+    uint64_t indices = 0;
+    for (int i = 2; i < 8; i++) {
+        indices = (indices << 8) | b[i];
+    }
+    // 3 bit indices, first texel in the top bits
+    for (int x = 0; x < 4; x++) {
+        for (int y = 0; y < 4; y++) {
+            int index = (indices >> (45 - 3 * (x * 4 + y))) & 7;
+            out[y * 4 + x][3] = Clamp255(base + modifiers[index] * multiplier);
+        }
+    }
+}
+
+}
+
+VkFormat GetDecodedFormat(VkFormat format) {
+    switch (format) {
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+        case VK_FORMAT_BC2_UNORM_BLOCK:
+        case VK_FORMAT_BC3_UNORM_BLOCK:
+        case VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK:
+        case VK_FORMAT_ETC2_R8G8B8A1_UNORM_BLOCK:
+        case VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK:
+            return VK_FORMAT_R8G8B8A8_UNORM;
+        case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+        case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+        case VK_FORMAT_BC2_SRGB_BLOCK:
+        case VK_FORMAT_BC3_SRGB_BLOCK:
+        case VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK:
+        case VK_FORMAT_ETC2_R8G8B8A1_SRGB_BLOCK:
+        case VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK:
+            return VK_FORMAT_R8G8B8A8_SRGB;
+        case VK_FORMAT_BC4_UNORM_BLOCK:
+            return VK_FORMAT_R8_UNORM;
+        case VK_FORMAT_BC5_UNORM_BLOCK:
+            return VK_FORMAT_R8G8_UNORM;
+        default:
+            return VK_FORMAT_UNDEFINED;
+    }
+}
+
+void DecodeBlocks(VkFormat format, const uint8_t *src, uint32_t width,
+                  uint32_t height, uint8_t *dst) {
+    uint32_t channels;
+    switch (GetDecodedFormat(format)) {
+        case VK_FORMAT_R8_UNORM:
+            channels = 1;
+            break;
+        case VK_FORMAT_R8G8_UNORM:
+            channels = 2;
+            break;
+        case VK_FORMAT_R8G8B8A8_UNORM:
+        case VK_FORMAT_R8G8B8A8_SRGB:
+            channels = 4;
+            break;
+        default:
+            throw std::runtime_error("format can not be decoded");
+    }
+
+    for (uint32_t blockY = 0; blockY < (height + 3) / 4; blockY++) {
+        for (uint32_t blockX = 0; blockX < (width + 3) / 4; blockX++) {
+            Texels texels{};
+            switch (format) {
+                case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+                case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+                    DecodeBc1(src, texels, true);
+                    // no alpha, the 4th color is black
+                    for (auto &texel : texels) {
+                        texel[3] = 255;
+                    }
+                    src += 8;
+                    break;
+                case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+                case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+                    DecodeBc1(src, texels, true);
+                    src += 8;
+                    break;
+                case VK_FORMAT_BC2_UNORM_BLOCK:
+                case VK_FORMAT_BC2_SRGB_BLOCK:
+                    DecodeBc1(src + 8, texels, false);
+                    DecodeBc2Alpha(src, texels);
+                    src += 16;
+                    break;
+                case VK_FORMAT_BC3_UNORM_BLOCK:
+                case VK_FORMAT_BC3_SRGB_BLOCK:
+                    DecodeBc1(src + 8, texels, false);
+                    DecodeBc4(src, texels, 3);
+                    src += 16;
+                    break;
+                case VK_FORMAT_BC4_UNORM_BLOCK:
+                    DecodeBc4(src, texels, 0);
+                    src += 8;
+                    break;
+                case VK_FORMAT_BC5_UNORM_BLOCK:
+                    DecodeBc4(src, texels, 0);
+                    DecodeBc4(src + 8, texels, 1);
+                    src += 16;
+                    break;
+                case VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK:
+                case VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK:
+                    DecodeEtc2(src, texels, false);
+                    src += 8;
+                    break;
+                case VK_FORMAT_ETC2_R8G8B8A1_UNORM_BLOCK:
+                case VK_FORMAT_ETC2_R8G8B8A1_SRGB_BLOCK:
+                    DecodeEtc2(src, texels, true);
+                    src += 8;
+                    break;
+                default:
+                    // ETC2 RGBA, EAC alpha then the color
+                    DecodeEtc2(src + 8, texels, false);
+                    DecodeEacAlpha(src, texels);
+                    src += 16;
+                    break;
+            }
+
+            // blocks on the right and bottom edge may hang over
+            for (uint32_t y = 0; y < 4 && blockY * 4 + y < height; y++) {
+                for (uint32_t x = 0; x < 4 && blockX * 4 + x < width; x++) {
+                    uint8_t *texel = dst + ((blockY * 4 + y) * width +
+                                            blockX * 4 + x) * channels;
+                    std::memcpy(texel, texels[y * 4 + x], channels);
+                }
+            }
+        }
+    }
+}
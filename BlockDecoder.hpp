@@ -0,0 +1,25 @@
+//
+// Created by Krisu on 2020/4/16.
+//
+
+#ifndef VULKAN_TEST_BLOCKDECODER_HPP
+#define VULKAN_TEST_BLOCKDECODER_HPP
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+
+
+/* CPU decoding of block compressed images, for devices that can not
+ * sample a format the asset ships in. BC1-5 and ETC2 / EAC RGBA decode,
+ * BC6H, BC7, EAC R11 and ASTC do not. */
+
+/* Format format decodes to, VK_FORMAT_UNDEFINED when it does not */
+VkFormat GetDecodedFormat(VkFormat format);
+
+/* Decode a width x height image, dst receives tightly packed texels of
+ * GetDecodedFormat(format) */
+void DecodeBlocks(VkFormat format, const uint8_t *src, uint32_t width,
+                  uint32_t height, uint8_t *dst);
+
+#endif //VULKAN_TEST_BLOCKDECODER_HPP
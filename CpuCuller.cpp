@@ -0,0 +1,269 @@
+//
+// Created by Krisu on 2020/4/16.
+//
+
+#include "CpuCuller.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || \
+    defined(_M_IX86)
+#define CPU_CULLER_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+// MSVC compiles any intrinsic without flags
+#define CPU_CULLER_TARGET(features)
+#else
+// the kernels are built for their instruction set while the rest of the
+// program is not, they only run once GetCpuCullLevel allows them
+#define CPU_CULLER_TARGET(features) __attribute__((target(features)))
+#endif
+#endif
+
+namespace {
+
+/* Where the lanes of a visibility mask go when the visible ones are
+ * packed to the front */
+struct CompactTables {
+    // lanes[mask] lists the set bits of an 8 lane mask
+    uint32_t lanes[256][8]{};
+    // the first four of them as _mm_shuffle_epi8 bytes
+    uint8_t  bytes[16][16]{};
+    uint8_t  counts[256]{};
+
+    CompactTables() {
+        for (uint32_t mask = 0; mask < 256; mask++) {
+            for (uint32_t lane = 0; lane < 8; lane++) {
+                if (mask & (1u << lane)) {
+                    lanes[mask][counts[mask]++] = lane;
+                }
+            }
+        }
+        for (uint32_t mask = 0; mask < 16; mask++) {
+            for (uint32_t i = 0; i < 16; i++) {
+                bytes[mask][i] = lanes[mask][i / 4] * 4 + i % 4;
+            }
+        }
+    }
+};
+
+const CompactTables &GetCompactTables() {
+    static const CompactTables tables;
+    return tables;
+}
+
+template<typename Bounds>
+constexpr bool IS_BOX = std::is_same<Bounds, CullBoxBounds>::value;
+
+/* Objects [first, bounds.count), appended after the visibleCount already
+ * in visible. The order of operations is the one of the SIMD kernels. */
+template<typename Bounds>
+uint32_t CullScalar(const CullFrustum &frustum, const Bounds &bounds,
+                    size_t first, uint32_t *visible, uint32_t visibleCount) {
+    for (size_t i = first; i < bounds.count; i++) {
+        bool inside = true;
+        for (const auto &plane : frustum.planes) {
+            float distance = (bounds.centerX[i] * plane[0] +
+                              bounds.centerY[i] * plane[1]) +
+                             (bounds.centerZ[i] * plane[2] + plane[3]);
+            float radius;
+            if constexpr (IS_BOX<Bounds>) {
+                radius = (bounds.extentX[i] * std::fabs(plane[0]) +
+                          bounds.extentY[i] * std::fabs(plane[1])) +
+                         bounds.extentZ[i] * std::fabs(plane[2]);
+            } else {
+                radius = bounds.radius[i];
+            }
+            inside &= distance + radius >= 0.0f;
+        }
+        // no more are visible than were tested, so this stays in range
+        visible[visibleCount] = static_cast<uint32_t>(i);
+        visibleCount += inside;
+    }
+    return visibleCount;
+}
+
+#if defined(CPU_CULLER_X86)
+/* Objects [0, end), end a multiple of 4. Every batch stores four indices
+ * and keeps the visible ones, which never writes past end. */
+template<typename Bounds>
+CPU_CULLER_TARGET("sse4.1")
+uint32_t CullSse41(const CullFrustum &frustum, const Bounds &bounds,
+                   size_t end, uint32_t *visible) {
+    const CompactTables &tables = GetCompactTables();
+    const __m128 zero = _mm_setzero_ps();
+    const __m128i laneIndices = _mm_setr_epi32(0, 1, 2, 3);
+    uint32_t visibleCount = 0;
+    for (size_t i = 0; i < end; i += 4) {
+        __m128 x = _mm_loadu_ps(bounds.centerX + i);
+        __m128 y = _mm_loadu_ps(bounds.centerY + i);
+        __m128 z = _mm_loadu_ps(bounds.centerZ + i);
+        __m128 extentX = zero, extentY = zero, extentZ = zero, radius = zero;
+        if constexpr (IS_BOX<Bounds>) {
+            extentX = _mm_loadu_ps(bounds.extentX + i);
+            extentY = _mm_loadu_ps(bounds.extentY + i);
+            extentZ = _mm_loadu_ps(bounds.extentZ + i);
+        } else {
+            radius = _mm_loadu_ps(bounds.radius + i);
+        }
+
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (const auto &plane : frustum.planes) {
+            __m128 distance = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane[0])),
+                               _mm_mul_ps(y, _mm_set1_ps(plane[1]))),
+                    _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(plane[2])),
+                               _mm_set1_ps(plane[3])));
+            if constexpr (IS_BOX<Bounds>) {
+                radius = _mm_add_ps(
+                        _mm_add_ps(
+                                _mm_mul_ps(extentX,
+                                           _mm_set1_ps(std::fabs(plane[0]))),
+                                _mm_mul_ps(extentY,
+                                           _mm_set1_ps(std::fabs(plane[1])))),
+                        _mm_mul_ps(extentZ,
+                                   _mm_set1_ps(std::fabs(plane[2]))));
+            }
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(
+                    _mm_add_ps(distance, radius), zero));
+        }
+
+        int mask = _mm_movemask_ps(inside);
+        __m128i indices = _mm_add_epi32(
+                _mm_set1_epi32(static_cast<int>(i)), laneIndices);
+        __m128i packed = _mm_shuffle_epi8(indices, _mm_loadu_si128(
+                reinterpret_cast<const __m128i *>(tables.bytes[mask])));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(visible + visibleCount),
+                         packed);
+        visibleCount += tables.counts[mask];
+    }
+    return visibleCount;
+}
+
+/* CullSse41 eight objects at a time, end a multiple of 8 */
+template<typename Bounds>
+CPU_CULLER_TARGET("avx2")
+uint32_t CullAvx2(const CullFrustum &frustum, const Bounds &bounds,
+                  size_t end, uint32_t *visible) {
+    const CompactTables &tables = GetCompactTables();
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256i laneIndices = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    uint32_t visibleCount = 0;
+    for (size_t i = 0; i < end; i += 8) {
+        __m256 x = _mm256_loadu_ps(bounds.centerX + i);
+        __m256 y = _mm256_loadu_ps(bounds.centerY + i);
+        __m256 z = _mm256_loadu_ps(bounds.centerZ + i);
+        __m256 extentX = zero, extentY = zero, extentZ = zero, radius = zero;
+        if constexpr (IS_BOX<Bounds>) {
+            extentX = _mm256_loadu_ps(bounds.extentX + i);
+            extentY = _mm256_loadu_ps(bounds.extentY + i);
+            extentZ = _mm256_loadu_ps(bounds.extentZ + i);
+        } else {
+            radius = _mm256_loadu_ps(bounds.radius + i);
+        }
+
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (const auto &plane : frustum.planes) {
+            __m256 distance = _mm256_add_ps(
+                    _mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(plane[0])),
+                                  _mm256_mul_ps(y, _mm256_set1_ps(plane[1]))),
+                    _mm256_add_ps(_mm256_mul_ps(z, _mm256_set1_ps(plane[2])),
+                                  _mm256_set1_ps(plane[3])));
+            if constexpr (IS_BOX<Bounds>) {
+                radius = _mm256_add_ps(
+                        _mm256_add_ps(
+                                _mm256_mul_ps(extentX, _mm256_set1_ps(
+                                        std::fabs(plane[0]))),
+                                _mm256_mul_ps(extentY, _mm256_set1_ps(
+                                        std::fabs(plane[1])))),
+                        _mm256_mul_ps(extentZ,
+                                      _mm256_set1_ps(std::fabs(plane[2]))));
+            }
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(
+                    _mm256_add_ps(distance, radius), zero, _CMP_GE_OQ));
+        }
+
+        int mask = _mm256_movemask_ps(inside);
+        __m256i indices = _mm256_add_epi32(
+                _mm256_set1_epi32(static_cast<int>(i)), laneIndices);
+        __m256i packed = _mm256_permutevar8x32_epi32(
+                indices, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(
+                        tables.lanes[mask])));
+        _mm256_storeu_si256(
+                reinterpret_cast<__m256i *>(visible + visibleCount), packed);
+        visibleCount += tables.counts[mask];
+    }
+    return visibleCount;
+}
+#endif
+
+CpuCullLevel DetectCpuCullLevel() {
+#if defined(CPU_CULLER_X86)
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+    __cpuid(info, 1);
+    bool sse41 = (info[2] & (1 << 19)) != 0;
+    // AVX state must also be saved by the OS
+    bool osSavesAvx = (info[2] & (1 << 27)) != 0 &&
+                      (info[2] & (1 << 28)) != 0 &&
+                      (_xgetbv(0) & 0x6) == 0x6;
+    bool avx2 = false;
+    if (maxLeaf >= 7 && osSavesAvx) {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+    }
+#else
+    __builtin_cpu_init();
+    bool sse41 = __builtin_cpu_supports("sse4.1");
+    bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+    if (avx2) {
+        return CpuCullLevel::AVX2;
+    }
+    if (sse41) {
+        return CpuCullLevel::SSE41;
+    }
+#endif
+    return CpuCullLevel::Scalar;
+}
+
+template<typename Bounds>
+uint32_t Cull(const CullFrustum &frustum, const Bounds &bounds,
+              uint32_t *visible, CpuCullLevel level) {
+    level = std::min(level, GetCpuCullLevel());
+    size_t first = 0;
+    uint32_t visibleCount = 0;
+#if defined(CPU_CULLER_X86)
+    if (level == CpuCullLevel::AVX2) {
+        first = bounds.count & ~size_t(7);
+        visibleCount = CullAvx2(frustum, bounds, first, visible);
+    } else if (level == CpuCullLevel::SSE41) {
+        first = bounds.count & ~size_t(3);
+        visibleCount = CullSse41(frustum, bounds, first, visible);
+    }
+#endif
+    return CullScalar(frustum, bounds, first, visible, visibleCount);
+}
+
+}
+
+CpuCullLevel GetCpuCullLevel() {
+    static const CpuCullLevel level = DetectCpuCullLevel();
+    return level;
+}
+
+uint32_t CullSpheres(const CullFrustum &frustum,
+                     const CullSphereBounds &bounds, uint32_t *visible,
+                     CpuCullLevel level) {
+    return Cull(frustum, bounds, visible, level);
+}
+
+uint32_t CullBoxes(const CullFrustum &frustum, const CullBoxBounds &bounds,
+                   uint32_t *visible, CpuCullLevel level) {
+    return Cull(frustum, bounds, visible, level);
+}
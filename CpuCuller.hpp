@@ -0,0 +1,64 @@
+//
+// Created by Krisu on 2020/4/16.
+//
+
+#ifndef VULKAN_TEST_CPUCULLER_HPP
+#define VULKAN_TEST_CPUCULLER_HPP
+
+#include "GpuCuller.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+
+/* Frustum culling on the CPU, for when GpuCuller is not available and for
+ * views the GPU path does not cull such as shadow cascades. Bounds come
+ * as a structure of arrays and the visible ones come back as a compacted
+ * list of their indices, 4 or 8 objects are tested at once with SSE4.1 or
+ * AVX2, picked at runtime. */
+
+/* count spheres, one float per object in each array */
+struct CullSphereBounds {
+    const float *centerX = nullptr;
+    const float *centerY = nullptr;
+    const float *centerZ = nullptr;
+    const float *radius = nullptr;
+    size_t       count = 0;
+};
+
+/* count axis aligned boxes as centers and half extents */
+struct CullBoxBounds {
+    const float *centerX = nullptr;
+    const float *centerY = nullptr;
+    const float *centerZ = nullptr;
+    const float *extentX = nullptr;
+    const float *extentY = nullptr;
+    const float *extentZ = nullptr;
+    size_t       count = 0;
+};
+
+/* Instruction sets of the kernels, from slowest to fastest. Scalar is
+ * the reference the others must agree with. */
+enum class CpuCullLevel {
+    Scalar,
+    SSE41,
+    AVX2
+};
+
+/* The fastest level this CPU runs, detected on the first call */
+CpuCullLevel GetCpuCullLevel();
+
+/* Write the indices of the spheres at least partly inside frustum to
+ * visible, in order, and return how many there are. visible needs room
+ * for bounds.count indices even when fewer are visible. Levels above
+ * GetCpuCullLevel are lowered to it. */
+uint32_t CullSpheres(const CullFrustum &frustum,
+                     const CullSphereBounds &bounds, uint32_t *visible,
+                     CpuCullLevel level = GetCpuCullLevel());
+
+/* CullSpheres for boxes */
+uint32_t CullBoxes(const CullFrustum &frustum, const CullBoxBounds &bounds,
+                   uint32_t *visible,
+                   CpuCullLevel level = GetCpuCullLevel());
+
+#endif //VULKAN_TEST_CPUCULLER_HPP
@@ -0,0 +1,322 @@
+//
+// Created by Krisu on 2020/4/16.
+//
+
+#include "DepthPyramid.hpp"
+#include "AllocationTracker.hpp"
+#include "VulkanUtils.hpp"
+
+#include <stdexcept>
+
+namespace {
+
+constexpr uint32_t HIZ_GROUP_SIZE = 8;
+
+// size of mip in one dimension, the depth buffer halved mip + 1 times
+// rounding up
+uint32_t GetLevelSize(uint32_t depthSize, uint32_t mip) {
+    return (depthSize + (2u << mip) - 1) >> (mip + 1);
+}
+
+// image levels are floor halved, a power of two base keeps every level
+// at least as large as GetLevelSize
+uint32_t GetImageSize(uint32_t depthSize) {
+    uint32_t size = 1;
+    while (size < GetLevelSize(depthSize, 0)) {
+        size *= 2;
+    }
+    return size;
+}
+
+}
+
+void DepthPyramid::Init(VkPhysicalDevice physicalDevice, VkDevice device,
+                        const VkAllocationCallbacks *pAllocator,
+                        DescriptorAllocator &descriptorAllocator,
+                        DescriptorUpdater &descriptorUpdater,
+                        const std::vector<char> &shaderCode) {
+    mPhysicalDevice = physicalDevice;
+    mDevice = device;
+    mAllocator = pAllocator;
+    mDescriptorAllocator = &descriptorAllocator;
+    mDescriptorUpdater = &descriptorUpdater;
+
+    // only ever read with texelFetch, the sampler just has to exist
+    VkSamplerCreateInfo samplerCreateInfo{};
+    samplerCreateInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerCreateInfo.magFilter = VK_FILTER_NEAREST;
+    samplerCreateInfo.minFilter = VK_FILTER_NEAREST;
+    samplerCreateInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerCreateInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerCreateInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerCreateInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerCreateInfo.maxLod = VK_LOD_CLAMP_NONE;
+    {
+        AllocationTracker::ScopedTag tag(VK_OBJECT_TYPE_SAMPLER);
+        if (vkCreateSampler(mDevice, &samplerCreateInfo, mAllocator,
+                            &mSampler) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create depth pyramid sampler");
+        }
+    }
+
+    std::vector<VkDescriptorSetLayoutBinding> bindings(2);
+    bindings[0].binding = 0;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bindings[0].descriptorCount = 1;
+    bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings[0].pImmutableSamplers = &mSampler;
+    bindings[1].binding = 1;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    bindings[1].descriptorCount = 1;
+    bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    VkDescriptorSetLayoutCreateInfo setLayoutCreateInfo{};
+    setLayoutCreateInfo.sType =
+            VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    setLayoutCreateInfo.bindingCount = bindings.size();
+    setLayoutCreateInfo.pBindings = bindings.data();
+    {
+        AllocationTracker::ScopedTag tag(
+                VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT);
+        if (vkCreateDescriptorSetLayout(mDevice, &setLayoutCreateInfo,
+                                        mAllocator, &mSetLayout) !=
+            VK_SUCCESS) {
+            throw std::runtime_error(
+                    "failed to create depth pyramid descriptor set layout");
+        }
+    }
+    mDescriptorAllocator->RegisterLayout(mSetLayout, bindings);
+    mDescriptorUpdater->RegisterLayout(mSetLayout, bindings);
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.size = sizeof(Constants);
+    VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo{};
+    pipelineLayoutCreateInfo.sType =
+            VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutCreateInfo.setLayoutCount = 1;
+    pipelineLayoutCreateInfo.pSetLayouts = &mSetLayout;
+    pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+    pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+    {
+        AllocationTracker::ScopedTag tag(VK_OBJECT_TYPE_PIPELINE_LAYOUT);
+        if (vkCreatePipelineLayout(mDevice, &pipelineLayoutCreateInfo,
+                                   mAllocator, &mPipelineLayout) !=
+            VK_SUCCESS) {
+            throw std::runtime_error(
+                    "failed to create depth pyramid pipeline layout");
+        }
+    }
+
+    VkShaderModuleCreateInfo shaderModuleCreateInfo{};
+    shaderModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    shaderModuleCreateInfo.codeSize = shaderCode.size();
+    shaderModuleCreateInfo.pCode =
+            reinterpret_cast<const uint32_t *>(shaderCode.data());
+    VkShaderModule shaderModule;
+    {
+        AllocationTracker::ScopedTag tag(VK_OBJECT_TYPE_SHADER_MODULE);
+        if (vkCreateShaderModule(mDevice, &shaderModuleCreateInfo, mAllocator,
+                                 &shaderModule) != VK_SUCCESS) {
+            throw std::runtime_error(
+                    "failed to create depth pyramid shader module");
+        }
+    }
+
+    VkComputePipelineCreateInfo pipelineCreateInfo{};
+    pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineCreateInfo.stage.sType =
+            VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineCreateInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineCreateInfo.stage.module = shaderModule;
+    pipelineCreateInfo.stage.pName = "main";
+    pipelineCreateInfo.layout = mPipelineLayout;
+    VkResult result;
+    {
+        AllocationTracker::ScopedTag tag(VK_OBJECT_TYPE_PIPELINE);
+        result = vkCreateComputePipelines(mDevice, VK_NULL_HANDLE, 1,
+                                          &pipelineCreateInfo, mAllocator,
+                                          &mPipeline);
+    }
+    vkDestroyShaderModule(mDevice, shaderModule, mAllocator);
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("failed to create depth pyramid pipeline");
+    }
+}
+
+void DepthPyramid::Destroy() {
+    if (mDevice == VK_NULL_HANDLE) {
+        return;
+    }
+    DestroyImage();
+    vkDestroyPipeline(mDevice, mPipeline, mAllocator);
+    vkDestroyPipelineLayout(mDevice, mPipelineLayout, mAllocator);
+    vkDestroyDescriptorSetLayout(mDevice, mSetLayout, mAllocator);
+    vkDestroySampler(mDevice, mSampler, mAllocator);
+    mDevice = VK_NULL_HANDLE;
+}
+
+void DepthPyramid::Resize(VkExtent2D depthExtent) {
+    if (depthExtent.width == mDepthExtent.width &&
+        depthExtent.height == mDepthExtent.height) {
+        return;
+    }
+    DestroyImage();
+    mDepthExtent = depthExtent;
+
+    // halve until a single texel covers the whole depth buffer
+    mMipCount = 1;
+    while (GetLevelSize(depthExtent.width, mMipCount - 1) > 1 ||
+           GetLevelSize(depthExtent.height, mMipCount - 1) > 1) {
+        mMipCount++;
+    }
+
+    VkImageCreateInfo imageCreateInfo{};
+    imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageCreateInfo.format = FORMAT;
+    imageCreateInfo.extent = {GetImageSize(depthExtent.width),
+                              GetImageSize(depthExtent.height), 1};
+    imageCreateInfo.mipLevels = mMipCount;
+    imageCreateInfo.arrayLayers = 1;
+    imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageCreateInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT |
+                            VK_IMAGE_USAGE_SAMPLED_BIT;
+    imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    CreateImage(mPhysicalDevice, mDevice, mAllocator, imageCreateInfo,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mImage, mImageMemory);
+
+    mView = CreateView(0, mMipCount);
+    for (uint32_t mip = 0; mip < mMipCount; mip++) {
+        mMipViews.push_back(CreateView(mip, 1));
+    }
+}
+
+RenderGraphHandle DepthPyramid::Import(RenderGraph &graph) const {
+    RenderGraphImageInfo info;
+    info.image = mImage;
+    info.view = mView;
+    info.format = FORMAT;
+    info.extent = {GetImageSize(mDepthExtent.width),
+                   GetImageSize(mDepthExtent.height)};
+    // the previous frame may still be culling against it
+    info.initialStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    return graph.ImportImage("depth pyramid", info);
+}
+
+void DepthPyramid::AddBuildPass(RenderGraph &graph, RenderGraphHandle depth,
+                                RenderGraphHandle pyramid) {
+    graph.AddPass(
+            "build depth pyramid",
+            [&](RenderGraph::PassBuilder &builder) {
+                builder.Read(depth, RenderGraphUsage::ComputeSampled);
+                builder.Write(pyramid, RenderGraphUsage::ComputeStorageWrite,
+                              RenderGraphWriteMode::Discard);
+            },
+            [this, depth](const RenderGraph::PassContext &context) {
+                VkCommandBuffer commandBuffer = context.GetCommandBuffer();
+                vkCmdBindPipeline(commandBuffer,
+                                  VK_PIPELINE_BIND_POINT_COMPUTE, mPipeline);
+
+                VkImageMemoryBarrier barrier{};
+                barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+                barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+                barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+                barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+                barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+                barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barrier.image = mImage;
+
+                Constants constants{};
+                constants.sourceSize[0] = mDepthExtent.width;
+                constants.sourceSize[1] = mDepthExtent.height;
+                for (uint32_t mip = 0; mip < mMipCount; mip++) {
+                    constants.destinationSize[0] =
+                            GetLevelSize(mDepthExtent.width, mip);
+                    constants.destinationSize[1] =
+                            GetLevelSize(mDepthExtent.height, mip);
+
+                    Descriptors descriptors{};
+                    if (mip == 0) {
+                        descriptors.source = {
+                                VK_NULL_HANDLE, context.GetImageView(depth),
+                                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+                    } else {
+                        descriptors.source = {VK_NULL_HANDLE,
+                                              mMipViews[mip - 1],
+                                              VK_IMAGE_LAYOUT_GENERAL};
+                    }
+                    descriptors.destination = {VK_NULL_HANDLE,
+                                               mMipViews[mip],
+                                               VK_IMAGE_LAYOUT_GENERAL};
+                    VkDescriptorSet set = mDescriptorAllocator->Allocate(
+                            mSetLayout);
+                    mDescriptorUpdater->Update(set, mSetLayout, descriptors);
+
+                    vkCmdBindDescriptorSets(commandBuffer,
+                                            VK_PIPELINE_BIND_POINT_COMPUTE,
+                                            mPipelineLayout, 0, 1, &set, 0,
+                                            nullptr);
+                    vkCmdPushConstants(commandBuffer, mPipelineLayout,
+                                       VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                                       sizeof(constants), &constants);
+                    vkCmdDispatch(commandBuffer,
+                                  (constants.destinationSize[0] +
+                                   HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE,
+                                  (constants.destinationSize[1] +
+                                   HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, 1);
+
+                    // the next level reads this one, the graph orders the
+                    // last one against the culling pass
+                    if (mip + 1 < mMipCount) {
+                        barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT,
+                                                    mip, 1, 0, 1};
+                        vkCmdPipelineBarrier(
+                                commandBuffer,
+                                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0,
+                                nullptr, 0, nullptr, 1, &barrier);
+                    }
+                    constants.sourceSize[0] = constants.destinationSize[0];
+                    constants.sourceSize[1] = constants.destinationSize[1];
+                }
+            });
+}
+
+VkDescriptorImageInfo DepthPyramid::GetDescriptor() const {
+    return {mSampler, mView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+}
+
+void DepthPyramid::DestroyImage() {
+    for (VkImageView view : mMipViews) {
+        vkDestroyImageView(mDevice, view, mAllocator);
+    }
+    mMipViews.clear();
+    vkDestroyImageView(mDevice, mView, mAllocator);
+    vkDestroyImage(mDevice, mImage, mAllocator);
+    vkFreeMemory(mDevice, mImageMemory, mAllocator);
+    mView = VK_NULL_HANDLE;
+    mImage = VK_NULL_HANDLE;
+    mImageMemory = VK_NULL_HANDLE;
+    mDepthExtent = {0, 0};
+    mMipCount = 0;
+}
+
+VkImageView DepthPyramid::CreateView(uint32_t mip, uint32_t mipCount) {
+    VkImageViewCreateInfo viewCreateInfo{};
+    viewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewCreateInfo.image = mImage;
+    viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewCreateInfo.format = FORMAT;
+    viewCreateInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, mip,
+                                       mipCount, 0, 1};
+    VkImageView view;
+    AllocationTracker::ScopedTag tag(VK_OBJECT_TYPE_IMAGE_VIEW);
+    if (vkCreateImageView(mDevice, &viewCreateInfo, mAllocator, &view) !=
+        VK_SUCCESS) {
+        throw std::runtime_error("failed to create depth pyramid view");
+    }
+    return view;
+}
@@ -0,0 +1,93 @@
+//
+// Created by Krisu on 2020/4/16.
+//
+
+#ifndef VULKAN_TEST_DEPTHPYRAMID_HPP
+#define VULKAN_TEST_DEPTHPYRAMID_HPP
+
+#include <vulkan/vulkan.h>
+
+#include "DescriptorAllocator.hpp"
+#include "DescriptorUpdater.hpp"
+#include "RenderGraph.hpp"
+
+#include <cstdint>
+#include <vector>
+
+
+/* Hierarchical Z buffer for occlusion culling: every texel holds the
+ * farthest depth of the texels below it. Texel p of mip m covers the
+ * depth pixels [p << (m + 1), (p + 1) << (m + 1)), so mip 0 is half the
+ * depth buffer rounded up. The image is padded to a power of two to keep
+ * every level in it. Built by shaders/hiz.comp with one dispatch per
+ * level.
+ *
+ * Depth is 0 at the near plane, a greater depth is farther away. */
+class DepthPyramid {
+public:
+    /* shaderCode is shaders/hiz.spv */
+    void Init(VkPhysicalDevice physicalDevice, VkDevice device,
+              const VkAllocationCallbacks *pAllocator,
+              DescriptorAllocator &descriptorAllocator,
+              DescriptorUpdater &descriptorUpdater,
+              const std::vector<char> &shaderCode);
+
+    void Destroy();
+
+    /* Fit the pyramid to a depth buffer of extent, the GPU must be done
+     * with the previous one */
+    void Resize(VkExtent2D depthExtent);
+
+    /* The pyramid of this frame, rebuilt from scratch by AddBuildPass */
+    RenderGraphHandle Import(RenderGraph &graph) const;
+
+    /* Reduce depth into pyramid, pyramid comes from Import */
+    void AddBuildPass(RenderGraph &graph, RenderGraphHandle depth,
+                      RenderGraphHandle pyramid);
+
+    /* View of every level with a nearest sampler, for texelFetch */
+    VkDescriptorImageInfo GetDescriptor() const;
+
+    VkExtent2D GetDepthExtent() const { return mDepthExtent; }
+
+    uint32_t GetMipCount() const { return mMipCount; }
+
+    constexpr static const VkFormat FORMAT = VK_FORMAT_R32_SFLOAT;
+
+private:
+    struct Constants {
+        uint32_t sourceSize[2];
+        uint32_t destinationSize[2];
+    };
+
+    struct Descriptors {
+        VkDescriptorImageInfo source;
+        VkDescriptorImageInfo destination;
+    };
+
+    void DestroyImage();
+
+    VkImageView CreateView(uint32_t mip, uint32_t mipCount);
+
+private:
+    VkPhysicalDevice             mPhysicalDevice = VK_NULL_HANDLE;
+    VkDevice                     mDevice = VK_NULL_HANDLE;
+    const VkAllocationCallbacks *mAllocator = nullptr;
+    DescriptorAllocator         *mDescriptorAllocator = nullptr;
+    DescriptorUpdater           *mDescriptorUpdater = nullptr;
+
+    VkSampler             mSampler = VK_NULL_HANDLE;
+    VkDescriptorSetLayout mSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout      mPipelineLayout = VK_NULL_HANDLE;
+    VkPipeline            mPipeline = VK_NULL_HANDLE;
+
+    VkExtent2D               mDepthExtent{0, 0};
+    uint32_t                 mMipCount = 0;
+    VkImage                  mImage = VK_NULL_HANDLE;
+    VkDeviceMemory           mImageMemory = VK_NULL_HANDLE;
+    VkImageView              mView = VK_NULL_HANDLE;
+    // one view per level, written as storage and read by the next level
+    std::vector<VkImageView> mMipViews;
+};
+
+#endif //VULKAN_TEST_DEPTHPYRAMID_HPP
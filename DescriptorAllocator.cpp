@@ -0,0 +1,234 @@
+//
+// Created by Krisu on 2020/4/11.
+//
+
+#include "DescriptorAllocator.hpp"
+#include "AllocationTracker.hpp"
+#include "Hash.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+bool DescriptorDesc::operator==(const DescriptorDesc &other) const {
+    return binding == other.binding && arrayElement == other.arrayElement &&
+           type == other.type && image.sampler == other.image.sampler &&
+           image.imageView == other.image.imageView &&
+           image.imageLayout == other.image.imageLayout &&
+           buffer.buffer == other.buffer.buffer &&
+           buffer.offset == other.buffer.offset &&
+           buffer.range == other.buffer.range;
+}
+
+uint64_t DescriptorSetDesc::Hash() const {
+    uint64_t hash = HashCombine(HASH_SEED, (uint64_t) layout);
+    hash = HashCombine(hash, descriptors.size());
+    for (const auto &descriptor : descriptors) {
+        hash = HashCombine(hash, descriptor.binding);
+        hash = HashCombine(hash, descriptor.arrayElement);
+        hash = HashCombine(hash, descriptor.type);
+        hash = HashCombine(hash, (uint64_t) descriptor.image.sampler);
+        hash = HashCombine(hash, (uint64_t) descriptor.image.imageView);
+        hash = HashCombine(hash, descriptor.image.imageLayout);
+        hash = HashCombine(hash, (uint64_t) descriptor.buffer.buffer);
+        hash = HashCombine(hash, descriptor.buffer.offset);
+        hash = HashCombine(hash, descriptor.buffer.range);
+    }
+    return hash;
+}
+
+bool DescriptorSetDesc::operator==(const DescriptorSetDesc &other) const {
+    return layout == other.layout && descriptors == other.descriptors;
+}
+
+void DescriptorAllocator::Init(VkDevice device,
+                               const VkAllocationCallbacks *pAllocator,
+                               uint32_t framesInFlight,
+                               uint32_t setsPerPool) {
+    mDevice = device;
+    mAllocator = pAllocator;
+    mFramesInFlight = framesInFlight;
+    mSetsPerPool = setsPerPool;
+    mFrame = 0;
+}
+
+void DescriptorAllocator::RegisterLayout(
+        VkDescriptorSetLayout layout,
+        const std::vector<VkDescriptorSetLayoutBinding> &bindings) {
+    // descriptors of each type a single set needs
+    std::vector<VkDescriptorPoolSize> ratios;
+    for (const auto &binding : bindings) {
+        auto it = std::find_if(ratios.begin(), ratios.end(),
+                               [&](const VkDescriptorPoolSize &size) {
+                                   return size.type == binding.descriptorType;
+                               });
+        if (it != ratios.end()) {
+            it->descriptorCount += binding.descriptorCount;
+        } else {
+            ratios.push_back({binding.descriptorType,
+                              binding.descriptorCount});
+        }
+    }
+    // pools created from now on use the new ratios
+    GetLayoutPools(layout).ratios = ratios;
+}
+
+VkDescriptorSet DescriptorAllocator::Allocate(VkDescriptorSetLayout layout) {
+    LayoutPools &layoutPools = GetLayoutPools(layout);
+    return Allocate(layout, layoutPools, layoutPools.chains[mFrame]);
+}
+
+VkDescriptorSet DescriptorAllocator::GetStatic(const DescriptorSetDesc &desc) {
+    auto it = mStaticSets.find(desc);
+    if (it != mStaticSets.end()) {
+        return it->second;
+    }
+    LayoutPools &layoutPools = GetLayoutPools(desc.layout);
+    VkDescriptorSet set = Allocate(desc.layout, layoutPools,
+                                   layoutPools.chains.back());
+    Write(set, desc);
+    mStaticSets.emplace(desc, set);
+    return set;
+}
+
+void DescriptorAllocator::NextFrame() {
+    mFrame = (mFrame + 1) % mFramesInFlight;
+    for (auto &entry : mLayouts) {
+        PoolChain &chain = entry.second.chains[mFrame];
+        for (VkDescriptorPool pool : chain.usedPools) {
+            vkResetDescriptorPool(mDevice, pool, 0);
+            chain.freePools.push_back(pool);
+        }
+        chain.usedPools.clear();
+    }
+}
+
+void DescriptorAllocator::Release() {
+    for (auto &entry : mLayouts) {
+        for (auto &chain : entry.second.chains) {
+            for (VkDescriptorPool pool : chain.usedPools) {
+                vkDestroyDescriptorPool(mDevice, pool, mAllocator);
+            }
+            for (VkDescriptorPool pool : chain.freePools) {
+                vkDestroyDescriptorPool(mDevice, pool, mAllocator);
+            }
+        }
+    }
+    mLayouts.clear();
+    mStaticSets.clear();
+    mPoolCount = 0;
+}
+
+DescriptorAllocator::LayoutPools &
+DescriptorAllocator::GetLayoutPools(VkDescriptorSetLayout layout) {
+    auto it = mLayouts.find(layout);
+    if (it != mLayouts.end()) {
+        return it->second;
+    }
+    LayoutPools layoutPools;
+    // a bit of everything for layouts nobody told us about
+    layoutPools.ratios = {
+            {VK_DESCRIPTOR_TYPE_SAMPLER,                1},
+            {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4},
+            {VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,          4},
+            {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,          1},
+            {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,         2},
+            {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,         2},
+            {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1},
+            {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1},
+            {VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT,       1}
+    };
+    layoutPools.chains.resize(mFramesInFlight + 1);
+    for (auto &chain : layoutPools.chains) {
+        chain.setsPerPool = mSetsPerPool;
+    }
+    return mLayouts.emplace(layout, std::move(layoutPools)).first->second;
+}
+
+VkDescriptorSet DescriptorAllocator::Allocate(VkDescriptorSetLayout layout,
+                                              LayoutPools &layoutPools,
+                                              PoolChain &chain) {
+    VkDescriptorSetAllocateInfo allocateInfo{};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocateInfo.descriptorSetCount = 1;
+    allocateInfo.pSetLayouts = &layout;
+
+    VkDescriptorSet set;
+    if (!chain.usedPools.empty()) {
+        allocateInfo.descriptorPool = chain.usedPools.back();
+        VkResult result = vkAllocateDescriptorSets(mDevice, &allocateInfo,
+                                                   &set);
+        if (result == VK_SUCCESS) {
+            return set;
+        }
+        if (result != VK_ERROR_OUT_OF_POOL_MEMORY &&
+            result != VK_ERROR_FRAGMENTED_POOL) {
+            throw std::runtime_error("failed to allocate descriptor set");
+        }
+    }
+
+    // the current pool is full, move on to the next one
+    if (!chain.freePools.empty()) {
+        chain.usedPools.push_back(chain.freePools.back());
+        chain.freePools.pop_back();
+    } else {
+        chain.usedPools.push_back(CreatePool(layoutPools, chain.setsPerPool));
+        chain.setsPerPool = std::min(chain.setsPerPool * 2,
+                                     MAX_SETS_PER_POOL);
+    }
+    allocateInfo.descriptorPool = chain.usedPools.back();
+    if (vkAllocateDescriptorSets(mDevice, &allocateInfo, &set) !=
+        VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate descriptor set");
+    }
+    return set;
+}
+
+VkDescriptorPool DescriptorAllocator::CreatePool(const LayoutPools &layoutPools,
+                                                 uint32_t maxSets) {
+    std::vector<VkDescriptorPoolSize> poolSizes;
+    for (const auto &ratio : layoutPools.ratios) {
+        if (ratio.descriptorCount > 0) {
+            poolSizes.push_back({ratio.type, ratio.descriptorCount * maxSets});
+        }
+    }
+
+    VkDescriptorPoolCreateInfo poolCreateInfo{};
+    poolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolCreateInfo.maxSets = maxSets;
+    poolCreateInfo.poolSizeCount = poolSizes.size();
+    poolCreateInfo.pPoolSizes = poolSizes.data();
+
+    VkDescriptorPool pool;
+    AllocationTracker::ScopedTag tag(VK_OBJECT_TYPE_DESCRIPTOR_POOL);
+    if (vkCreateDescriptorPool(mDevice, &poolCreateInfo, mAllocator,
+                               &pool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create descriptor pool");
+    }
+    mPoolCount++;
+    return pool;
+}
+
+void DescriptorAllocator::Write(VkDescriptorSet set,
+                                const DescriptorSetDesc &desc) {
+    std::vector<VkWriteDescriptorSet> writes(desc.descriptors.size());
+    for (size_t i = 0; i < writes.size(); i++) {
+        const auto &descriptor = desc.descriptors[i];
+        bool isBuffer =
+                descriptor.type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER ||
+                descriptor.type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER ||
+                descriptor.type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC ||
+                descriptor.type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = set;
+        writes[i].dstBinding = descriptor.binding;
+        writes[i].dstArrayElement = descriptor.arrayElement;
+        writes[i].descriptorCount = 1;
+        writes[i].descriptorType = descriptor.type;
+        if (isBuffer) {
+            writes[i].pBufferInfo = &descriptor.buffer;
+        } else {
+            writes[i].pImageInfo = &descriptor.image;
+        }
+    }
+    vkUpdateDescriptorSets(mDevice, writes.size(), writes.data(), 0, nullptr);
+}
@@ -0,0 +1,115 @@
+//
+// Created by Krisu on 2020/4/11.
+//
+
+#ifndef VULKAN_TEST_DESCRIPTORALLOCATOR_HPP
+#define VULKAN_TEST_DESCRIPTORALLOCATOR_HPP
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+
+/* One descriptor of a set, either an image or a buffer */
+struct DescriptorDesc {
+    uint32_t               binding = 0;
+    uint32_t               arrayElement = 0;
+    VkDescriptorType       type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    VkDescriptorImageInfo  image{VK_NULL_HANDLE, VK_NULL_HANDLE,
+                                 VK_IMAGE_LAYOUT_UNDEFINED};
+    VkDescriptorBufferInfo buffer{VK_NULL_HANDLE, 0, 0};
+
+    bool operator==(const DescriptorDesc &other) const;
+};
+
+/* The content of a set, equal contents share one cached set */
+struct DescriptorSetDesc {
+    VkDescriptorSetLayout       layout = VK_NULL_HANDLE;
+    std::vector<DescriptorDesc> descriptors;
+
+    uint64_t Hash() const;
+
+    bool operator==(const DescriptorSetDesc &other) const;
+};
+
+
+/* Hands out descriptor sets from chains of pools, one chain per layout
+ * and frame. A pool is used until it runs out, then the next one is
+ * taken. Sets are never freed one by one, the pools of a frame are reset
+ * as a whole when the frame comes around again. Sets for static materials
+ * live in their own chains and are cached by content. */
+class DescriptorAllocator {
+public:
+    /* framesInFlight: frames whose sets may still be in use
+     * setsPerPool: sets in the first pool of a chain, later ones grow */
+    void Init(VkDevice device, const VkAllocationCallbacks *pAllocator,
+              uint32_t framesInFlight, uint32_t setsPerPool = 64);
+
+    /* Size the pools for layout after its bindings. Layouts that are not
+     * registered get generic pools. */
+    void RegisterLayout(VkDescriptorSetLayout layout,
+                        const std::vector<VkDescriptorSetLayoutBinding> &bindings);
+
+    /* A set only valid for the current frame, the content is up to the
+     * caller */
+    VkDescriptorSet Allocate(VkDescriptorSetLayout layout);
+
+    /* A written set for desc, kept until Release */
+    VkDescriptorSet GetStatic(const DescriptorSetDesc &desc);
+
+    /* Call once per frame after the frame's fence was waited on, resets
+     * the pools of the frame that comes around again */
+    void NextFrame();
+
+    void Release();
+
+    size_t GetPoolCount() const { return mPoolCount; }
+
+private:
+    template<typename T>
+    struct Hasher {
+        size_t operator()(const T &desc) const {
+            return static_cast<size_t>(desc.Hash());
+        }
+    };
+
+    struct PoolChain {
+        std::vector<VkDescriptorPool> usedPools;
+        std::vector<VkDescriptorPool> freePools;
+        uint32_t                      setsPerPool = 0;
+    };
+
+    /* chains[0 .. framesInFlight) are per frame, the last one is static */
+    struct LayoutPools {
+        std::vector<VkDescriptorPoolSize> ratios;
+        std::vector<PoolChain>            chains;
+    };
+
+    LayoutPools &GetLayoutPools(VkDescriptorSetLayout layout);
+
+    VkDescriptorSet Allocate(VkDescriptorSetLayout layout,
+                             LayoutPools &layoutPools, PoolChain &chain);
+
+    VkDescriptorPool CreatePool(const LayoutPools &layoutPools,
+                                uint32_t maxSets);
+
+    void Write(VkDescriptorSet set, const DescriptorSetDesc &desc);
+
+private:
+    VkDevice                     mDevice = VK_NULL_HANDLE;
+    const VkAllocationCallbacks *mAllocator = nullptr;
+    uint32_t                     mFramesInFlight = 1;
+    uint32_t                     mSetsPerPool = 64;
+    uint32_t                     mFrame = 0;
+    size_t                       mPoolCount = 0;
+
+    std::unordered_map<VkDescriptorSetLayout, LayoutPools> mLayouts;
+    std::unordered_map<DescriptorSetDesc, VkDescriptorSet,
+            Hasher<DescriptorSetDesc>>                     mStaticSets;
+
+    constexpr static const uint32_t MAX_SETS_PER_POOL = 4096;
+};
+
+#endif //VULKAN_TEST_DESCRIPTORALLOCATOR_HPP
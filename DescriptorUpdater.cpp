@@ -0,0 +1,189 @@
+//
+// Created by Krisu on 2020/4/12.
+//
+
+#include "DescriptorUpdater.hpp"
+#include "AllocationTracker.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+void DescriptorUpdater::Init(VkDevice device,
+                             const VkAllocationCallbacks *pAllocator,
+                             bool templatesSupported, bool core) {
+    mDevice = device;
+    mAllocator = pAllocator;
+    if (!templatesSupported) {
+        return;
+    }
+    mCreateTemplate = (PFN_vkCreateDescriptorUpdateTemplate)
+            vkGetDeviceProcAddr(mDevice,
+                                core ? "vkCreateDescriptorUpdateTemplate"
+                                     : "vkCreateDescriptorUpdateTemplateKHR");
+    mDestroyTemplate = (PFN_vkDestroyDescriptorUpdateTemplate)
+            vkGetDeviceProcAddr(mDevice,
+                                core ? "vkDestroyDescriptorUpdateTemplate"
+                                     : "vkDestroyDescriptorUpdateTemplateKHR");
+    mUpdateWithTemplate = (PFN_vkUpdateDescriptorSetWithTemplate)
+            vkGetDeviceProcAddr(mDevice,
+                                core ? "vkUpdateDescriptorSetWithTemplate"
+                                     : "vkUpdateDescriptorSetWithTemplateKHR");
+    if (mCreateTemplate == nullptr || mDestroyTemplate == nullptr ||
+        mUpdateWithTemplate == nullptr) {
+        mCreateTemplate = nullptr;
+        mDestroyTemplate = nullptr;
+        mUpdateWithTemplate = nullptr;
+    }
+}
+
+void DescriptorUpdater::RegisterLayout(
+        VkDescriptorSetLayout layout,
+        const std::vector<VkDescriptorSetLayoutBinding> &bindings) {
+    if (mLayouts.count(layout) != 0) {
+        return;
+    }
+
+    std::vector<VkDescriptorSetLayoutBinding> sorted = bindings;
+    std::sort(sorted.begin(), sorted.end(),
+              [](const VkDescriptorSetLayoutBinding &a,
+                 const VkDescriptorSetLayoutBinding &b) {
+                  return a.binding < b.binding;
+              });
+
+    // every descriptor info is a multiple of 8 bytes, so this matches the
+    // member offsets of a plain struct without padding
+    Layout packed;
+    for (const auto &binding : sorted) {
+        if (binding.descriptorCount == 0) {
+            continue;
+        }
+        DescriptorUpdateEntry entry;
+        entry.binding = binding.binding;
+        entry.count = binding.descriptorCount;
+        entry.type = binding.descriptorType;
+        entry.offset = packed.size;
+        entry.stride = GetDescriptorSize(binding.descriptorType);
+        packed.entries.push_back(entry);
+        packed.size += entry.stride * entry.count;
+    }
+
+    if (mCreateTemplate != nullptr) {
+        std::vector<VkDescriptorUpdateTemplateEntry> templateEntries;
+        for (const auto &entry : packed.entries) {
+            templateEntries.push_back({entry.binding, 0, entry.count,
+                                       entry.type, entry.offset,
+                                       entry.stride});
+        }
+        VkDescriptorUpdateTemplateCreateInfo templateCreateInfo{};
+        templateCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+        templateCreateInfo.descriptorUpdateEntryCount = templateEntries.size();
+        templateCreateInfo.pDescriptorUpdateEntries = templateEntries.data();
+        templateCreateInfo.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+        templateCreateInfo.descriptorSetLayout = layout;
+
+        AllocationTracker::ScopedTag tag(
+                VK_OBJECT_TYPE_DESCRIPTOR_UPDATE_TEMPLATE);
+        if (mCreateTemplate(mDevice, &templateCreateInfo, mAllocator,
+                            &packed.updateTemplate) != VK_SUCCESS) {
+            throw std::runtime_error(
+                    "failed to create descriptor update template");
+        }
+    }
+
+    mLayouts.emplace(layout, std::move(packed));
+}
+
+size_t DescriptorUpdater::GetDataSize(VkDescriptorSetLayout layout) const {
+    return GetLayout(layout).size;
+}
+
+size_t DescriptorUpdater::GetOffset(VkDescriptorSetLayout layout,
+                                    uint32_t binding) const {
+    for (const auto &entry : GetLayout(layout).entries) {
+        if (entry.binding == binding) {
+            return entry.offset;
+        }
+    }
+    throw std::runtime_error("binding is not part of the descriptor layout");
+}
+
+void DescriptorUpdater::Update(VkDescriptorSet set,
+                               VkDescriptorSetLayout layout,
+                               const void *data) {
+    const Layout &packed = GetLayout(layout);
+    if (packed.updateTemplate != VK_NULL_HANDLE) {
+        mUpdateWithTemplate(mDevice, set, packed.updateTemplate, data);
+        return;
+    }
+
+    // same entries, one write per binding
+    auto *bytes = static_cast<const char *>(data);
+    mWrites.resize(packed.entries.size());
+    for (size_t i = 0; i < packed.entries.size(); i++) {
+        const auto &entry = packed.entries[i];
+        const char *descriptors = bytes + entry.offset;
+        VkWriteDescriptorSet &write = mWrites[i];
+        write = {};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = set;
+        write.dstBinding = entry.binding;
+        write.descriptorCount = entry.count;
+        write.descriptorType = entry.type;
+        switch (entry.type) {
+            case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+            case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+            case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC:
+            case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC:
+                write.pBufferInfo =
+                        reinterpret_cast<const VkDescriptorBufferInfo *>(
+                                descriptors);
+                break;
+            case VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER:
+            case VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER:
+                write.pTexelBufferView =
+                        reinterpret_cast<const VkBufferView *>(descriptors);
+                break;
+            default:
+                write.pImageInfo =
+                        reinterpret_cast<const VkDescriptorImageInfo *>(
+                                descriptors);
+                break;
+        }
+    }
+    vkUpdateDescriptorSets(mDevice, mWrites.size(), mWrites.data(), 0,
+                           nullptr);
+}
+
+void DescriptorUpdater::Clear() {
+    for (auto &entry : mLayouts) {
+        if (entry.second.updateTemplate != VK_NULL_HANDLE) {
+            mDestroyTemplate(mDevice, entry.second.updateTemplate,
+                             mAllocator);
+        }
+    }
+    mLayouts.clear();
+}
+
+const DescriptorUpdater::Layout &
+DescriptorUpdater::GetLayout(VkDescriptorSetLayout layout) const {
+    auto it = mLayouts.find(layout);
+    if (it == mLayouts.end()) {
+        throw std::runtime_error("descriptor layout was not registered");
+    }
+    return it->second;
+}
+
+size_t DescriptorUpdater::GetDescriptorSize(VkDescriptorType type) {
+    switch (type) {
+        case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+        case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+        case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC:
+        case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC:
+            return sizeof(VkDescriptorBufferInfo);
+        case VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER:
+        case VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER:
+            return sizeof(VkBufferView);
+        default:
+            return sizeof(VkDescriptorImageInfo);
+    }
+}
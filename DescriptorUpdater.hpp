@@ -0,0 +1,95 @@
+//
+// Created by Krisu on 2020/4/12.
+//
+
+#ifndef VULKAN_TEST_DESCRIPTORUPDATER_HPP
+#define VULKAN_TEST_DESCRIPTORUPDATER_HPP
+
+#include <vulkan/vulkan.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+
+/* Where the descriptors of one binding sit in the packed update struct */
+struct DescriptorUpdateEntry {
+    uint32_t         binding = 0;
+    uint32_t         count = 1;
+    VkDescriptorType type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    size_t           offset = 0;
+    size_t           stride = 0;
+};
+
+
+/* Writes whole descriptor sets from one packed struct with
+ * vkUpdateDescriptorSetWithTemplate, or with vkUpdateDescriptorSets when
+ * the device has no update templates.
+ *
+ * The packed struct follows the bindings of the layout in binding order:
+ * a VkDescriptorImageInfo per image or sampler descriptor, a
+ * VkDescriptorBufferInfo per buffer descriptor and a VkBufferView per
+ * texel buffer, e.g. for a uniform buffer at 0 and a texture at 1
+ *
+ *     struct MaterialDescriptors {
+ *         VkDescriptorBufferInfo constants;
+ *         VkDescriptorImageInfo  albedo;
+ *     };
+ */
+class DescriptorUpdater {
+public:
+    /* templatesSupported: Vulkan 1.1 or VK_KHR_descriptor_update_template
+     * is enabled on device, core tells which of the two */
+    void Init(VkDevice device, const VkAllocationCallbacks *pAllocator,
+              bool templatesSupported, bool core);
+
+    /* bindings are the ones layout was created with */
+    void RegisterLayout(VkDescriptorSetLayout layout,
+                        const std::vector<VkDescriptorSetLayoutBinding> &bindings);
+
+    /* Size of the packed struct of layout */
+    size_t GetDataSize(VkDescriptorSetLayout layout) const;
+
+    /* Offset of binding inside the packed struct of layout */
+    size_t GetOffset(VkDescriptorSetLayout layout, uint32_t binding) const;
+
+    /* Write every descriptor of set, data is the packed struct */
+    void Update(VkDescriptorSet set, VkDescriptorSetLayout layout,
+                const void *data);
+
+    template<typename T>
+    void Update(VkDescriptorSet set, VkDescriptorSetLayout layout,
+                const T &data) {
+        Update(set, layout, static_cast<const void *>(&data));
+    }
+
+    bool UsesTemplates() const { return mUpdateWithTemplate != nullptr; }
+
+    void Clear();
+
+private:
+    struct Layout {
+        std::vector<DescriptorUpdateEntry> entries;
+        size_t                             size = 0;
+        VkDescriptorUpdateTemplate         updateTemplate = VK_NULL_HANDLE;
+    };
+
+    const Layout &GetLayout(VkDescriptorSetLayout layout) const;
+
+    static size_t GetDescriptorSize(VkDescriptorType type);
+
+private:
+    VkDevice                     mDevice = VK_NULL_HANDLE;
+    const VkAllocationCallbacks *mAllocator = nullptr;
+
+    PFN_vkCreateDescriptorUpdateTemplate  mCreateTemplate = nullptr;
+    PFN_vkDestroyDescriptorUpdateTemplate mDestroyTemplate = nullptr;
+    PFN_vkUpdateDescriptorSetWithTemplate mUpdateWithTemplate = nullptr;
+
+    std::unordered_map<VkDescriptorSetLayout, Layout> mLayouts;
+    // reused by the fallback path so updates do not allocate
+    std::vector<VkWriteDescriptorSet>                 mWrites;
+};
+
+#endif //VULKAN_TEST_DESCRIPTORUPDATER_HPP
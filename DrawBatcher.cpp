@@ -0,0 +1,199 @@
+//
+// Created by Krisu on 2020/4/16.
+//
+
+#include "DrawBatcher.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+void DrawBatcher::Init(uint32_t instanceSize) {
+    Clear();
+    mInstanceSize = instanceSize;
+}
+
+uint32_t DrawBatcher::RegisterPipeline(VkPipeline pipeline,
+                                       VkPipelineLayout layout,
+                                       uint32_t drawDataSetIndex) {
+    if (mPipelines.size() >= MAX_PIPELINES) {
+        throw std::runtime_error("too many batched pipelines");
+    }
+    mPipelines.push_back({pipeline, layout, drawDataSetIndex});
+    return mPipelines.size() - 1;
+}
+
+uint32_t DrawBatcher::RegisterMaterial(VkDescriptorSet set,
+                                       uint32_t setIndex) {
+    if (mMaterials.size() >= MAX_MATERIALS) {
+        throw std::runtime_error("too many batched materials");
+    }
+    mMaterials.push_back({set, setIndex});
+    return mMaterials.size() - 1;
+}
+
+uint32_t DrawBatcher::RegisterMesh(const Mesh &mesh) {
+    if (mMeshes.size() >= MAX_MESHES) {
+        throw std::runtime_error("too many batched meshes");
+    }
+    mMeshes.push_back(mesh);
+    return mMeshes.size() - 1;
+}
+
+uint64_t DrawBatcher::MakeKey(uint32_t pipeline, uint32_t material,
+                              uint32_t mesh, float depth) {
+    auto quantized = static_cast<uint32_t>(
+            std::min(std::max(depth, 0.0f), 1.0f) * MAX_DEPTH + 0.5f);
+    return PackKey(pipeline, material, mesh, quantized);
+}
+
+void DrawBatcher::Add(uint32_t pipeline, uint32_t material, uint32_t mesh,
+                      float depth, const void *instanceData) {
+    auto index = static_cast<uint32_t>(mEntries.size());
+    mEntries.push_back({MakeKey(pipeline, material, mesh, depth), index});
+    auto *bytes = static_cast<const uint8_t *>(instanceData);
+    mInstanceData.insert(mInstanceData.end(), bytes, bytes + mInstanceSize);
+}
+
+DrawBatcherStats DrawBatcher::Submit(VkCommandBuffer commandBuffer,
+                                     const MeshBuffer &meshBuffer,
+                                     DrawDataStream &drawDataStream) {
+    RadixSort(mEntries, mScratch);
+    mStream.Clear();
+    BuildStream(mEntries.data(), mEntries.size(), mInstanceData.data(),
+                mInstanceSize, GetMaxInstances(drawDataStream), mStream);
+    DrawBatcherStats stats = Record(commandBuffer, meshBuffer,
+                                    drawDataStream, &mStream, 1);
+    mEntries.clear();
+    mInstanceData.clear();
+    return stats;
+}
+
+DrawBatcherStats DrawBatcher::Record(VkCommandBuffer commandBuffer,
+                                     const MeshBuffer &meshBuffer,
+                                     DrawDataStream &drawDataStream,
+                                     const RenderCommandStream *streams,
+                                     size_t streamCount) const {
+    DrawBatcherStats stats;
+    uint32_t boundPipeline = UINT32_MAX;
+    uint32_t boundMaterial = UINT32_MAX;
+    uint32_t boundBounds = UINT32_MAX;
+    const Mesh *boundMesh = nullptr;
+    for (size_t i = 0; i < streamCount; i++) {
+        const RenderCommandStream &stream = streams[i];
+        for (const auto &command : stream.commands) {
+            const Pipeline &pipeline = mPipelines[command.pipeline];
+            if (command.pipeline != boundPipeline) {
+                vkCmdBindPipeline(commandBuffer,
+                                  VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                  pipeline.pipeline);
+                boundPipeline = command.pipeline;
+                // another layout may have disturbed the material's set
+                // and the push constants
+                boundMaterial = UINT32_MAX;
+                boundBounds = UINT32_MAX;
+                stats.pipelineBinds++;
+            }
+            const Material &material = mMaterials[command.material];
+            if (command.material != boundMaterial) {
+                if (material.set != VK_NULL_HANDLE) {
+                    vkCmdBindDescriptorSets(commandBuffer,
+                                            VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                            pipeline.layout,
+                                            material.setIndex, 1,
+                                            &material.set, 0, nullptr);
+                }
+                boundMaterial = command.material;
+                stats.materialBinds++;
+            }
+            // meshes sharing layout and index type share their streams
+            const Mesh &mesh = mMeshes[command.mesh];
+            if (boundMesh == nullptr || boundMesh->layout != mesh.layout ||
+                boundMesh->indexType != mesh.indexType) {
+                meshBuffer.Bind(commandBuffer, mesh.layout, mesh.indexType);
+                boundMesh = &mesh;
+                stats.meshBinds++;
+            }
+            if (mesh.layout == VertexLayout::Quantized &&
+                command.mesh != boundBounds) {
+                QuantizedDrawData drawData{
+                        {mesh.boundsMin[0], mesh.boundsMin[1],
+                         mesh.boundsMin[2], 0.0f},
+                        {mesh.boundsExtent[0], mesh.boundsExtent[1],
+                         mesh.boundsExtent[2], 0.0f}};
+                drawDataStream.Push(commandBuffer, pipeline.layout,
+                                    pipeline.drawDataSetIndex, drawData);
+                boundBounds = command.mesh;
+            }
+
+            if (mInstanceSize > 0) {
+                drawDataStream.PushStorage(
+                        commandBuffer, pipeline.layout,
+                        pipeline.drawDataSetIndex,
+                        stream.instanceData.data() + command.instanceOffset,
+                        command.instanceCount * mInstanceSize);
+            }
+            MeshBuffer::Draw(commandBuffer, mesh, command.instanceCount);
+            stats.items += command.instanceCount;
+            stats.draws++;
+        }
+    }
+    return stats;
+}
+
+void DrawBatcher::BuildStream(const SortEntry *entries, size_t count,
+                              const uint8_t *instanceData,
+                              uint32_t instanceSize, size_t maxInstances,
+                              RenderCommandStream &stream) {
+    size_t begin = 0;
+    while (begin < count) {
+        uint64_t group = entries[begin].key >> DEPTH_BITS;
+        size_t end = begin + 1;
+        while (end < count && end - begin < maxInstances &&
+               entries[end].key >> DEPTH_BITS == group) {
+            end++;
+        }
+
+        RenderCommand command;
+        command.pipeline = static_cast<uint32_t>(group >> 32);
+        command.material = static_cast<uint32_t>(group >> 16) & 0xffff;
+        command.mesh = static_cast<uint32_t>(group) & 0xffff;
+        command.instanceCount = static_cast<uint32_t>(end - begin);
+        command.instanceOffset = stream.instanceData.size();
+        stream.commands.push_back(command);
+        if (instanceSize == 0) {
+            begin = end;
+            continue;
+        }
+
+        // gathered in sorted order, gl_InstanceIndex walks front to back
+        stream.instanceData.resize(command.instanceOffset +
+                                   command.instanceCount * instanceSize);
+        uint8_t *instances = stream.instanceData.data() +
+                             command.instanceOffset;
+        for (size_t i = begin; i < end; i++) {
+            std::memcpy(instances + (i - begin) * instanceSize,
+                        instanceData + entries[i].index * instanceSize,
+                        instanceSize);
+        }
+        begin = end;
+    }
+}
+
+size_t DrawBatcher::GetMaxInstances(
+        const DrawDataStream &drawDataStream) const {
+    // a draw's instances must fit one storage slice
+    if (mInstanceSize == 0) {
+        return SIZE_MAX;
+    }
+    return drawDataStream.GetStorageRange() / mInstanceSize;
+}
+
+void DrawBatcher::Clear() {
+    mPipelines.clear();
+    mMaterials.clear();
+    mMeshes.clear();
+    mEntries.clear();
+    mInstanceData.clear();
+    mStream.Clear();
+}
@@ -0,0 +1,161 @@
+//
+// Created by Krisu on 2020/4/16.
+//
+
+#ifndef VULKAN_TEST_DRAWBATCHER_HPP
+#define VULKAN_TEST_DRAWBATCHER_HPP
+
+#include <vulkan/vulkan.h>
+
+#include "DrawDataStream.hpp"
+#include "MeshBuffer.hpp"
+#include "RadixSort.hpp"
+
+#include <cstdint>
+#include <vector>
+
+
+/* One instanced draw, its instances are instanceCount * instanceSize
+ * bytes at instanceOffset of the stream's instance data */
+struct RenderCommand {
+    uint32_t pipeline;
+    uint32_t material;
+    uint32_t mesh;
+    uint32_t instanceCount;
+    size_t   instanceOffset;
+};
+
+/* Draws of a run of sorted items, ready to be recorded */
+struct RenderCommandStream {
+    std::vector<RenderCommand> commands;
+    std::vector<uint8_t>       instanceData;
+
+    void Clear() {
+        commands.clear();
+        instanceData.clear();
+    }
+};
+
+/* State changes and draws of one Submit */
+struct DrawBatcherStats {
+    uint32_t items = 0;
+    uint32_t draws = 0;
+    uint32_t pipelineBinds = 0;
+    uint32_t materialBinds = 0;
+    uint32_t meshBinds = 0;
+};
+
+/* Sorts the draws of a frame so state changes as rarely as possible and
+ * merges the ones sharing pipeline, material and mesh into instanced
+ * draws. Every draw item carries instanceSize bytes of instance data, the
+ * instances of a draw reach the shader as one DrawDataStream storage
+ * slice:
+ *
+ *     DRAW_DATA_STORAGE(1, Instances, Instance instances[];)
+ *     ... instances[gl_InstanceIndex] ...
+ *
+ * Pipelines, materials and meshes are registered once and referred to by
+ * their small ids, which the sort key packs as
+ *
+ *     pipeline:10 | material:16 | mesh:16 | depth:22
+ *
+ * from the top bit down, so items are grouped by pipeline first and the
+ * instances of a draw go front to back. Quantized meshes get their bounds
+ * as QuantizedDrawData push constants. */
+class DrawBatcher {
+public:
+    constexpr static const uint32_t MAX_PIPELINES = 1u << 10;
+    constexpr static const uint32_t MAX_MATERIALS = 1u << 16;
+    constexpr static const uint32_t MAX_MESHES = 1u << 16;
+
+    /* instanceSize: bytes of instance data per item, 0 for shaders
+     * without any */
+    void Init(uint32_t instanceSize);
+
+    /* drawDataSetIndex is where layout has the DrawDataStream set */
+    uint32_t RegisterPipeline(VkPipeline pipeline, VkPipelineLayout layout,
+                              uint32_t drawDataSetIndex);
+
+    /* set is bound at setIndex, a VK_NULL_HANDLE set binds nothing */
+    uint32_t RegisterMaterial(VkDescriptorSet set, uint32_t setIndex);
+
+    uint32_t RegisterMesh(const Mesh &mesh);
+
+    /* Queue a draw, depth is the view depth in 0..1 and instanceData
+     * holds instanceSize bytes */
+    void Add(uint32_t pipeline, uint32_t material, uint32_t mesh,
+             float depth, const void *instanceData);
+
+    /* Sort and record everything added since the last Submit, inside a
+     * render pass or dynamic rendering */
+    DrawBatcherStats Submit(VkCommandBuffer commandBuffer,
+                            const MeshBuffer &meshBuffer,
+                            DrawDataStream &drawDataStream);
+
+    /* Record streams one after another, the ids in them must be
+     * registered here. State carries over from stream to stream. */
+    DrawBatcherStats Record(VkCommandBuffer commandBuffer,
+                            const MeshBuffer &meshBuffer,
+                            DrawDataStream &drawDataStream,
+                            const RenderCommandStream *streams,
+                            size_t streamCount) const;
+
+    /* Merge sorted entries into the draws of stream. The instance data
+     * of entry i is instanceSize bytes at entries[i].index * instanceSize
+     * of instanceData, draws get at most maxInstances of them. */
+    static void BuildStream(const SortEntry *entries, size_t count,
+                            const uint8_t *instanceData,
+                            uint32_t instanceSize, size_t maxInstances,
+                            RenderCommandStream &stream);
+
+    /* Largest instance count of a draw recorded with drawDataStream */
+    size_t GetMaxInstances(const DrawDataStream &drawDataStream) const;
+
+    /* Forget the registered pipelines, materials and meshes */
+    void Clear();
+
+    uint32_t GetItemCount() const { return mEntries.size(); }
+
+    static uint64_t MakeKey(uint32_t pipeline, uint32_t material,
+                            uint32_t mesh, float depth);
+
+    /* The key with depth already quantized to DEPTH_BITS */
+    static uint64_t PackKey(uint32_t pipeline, uint32_t material,
+                            uint32_t mesh, uint32_t depth) {
+        return static_cast<uint64_t>(pipeline) << (DEPTH_BITS + 32) |
+               static_cast<uint64_t>(material) << (DEPTH_BITS + 16) |
+               static_cast<uint64_t>(mesh) << DEPTH_BITS |
+               depth;
+    }
+
+    // low bits of the key, items equal above them share a draw
+    constexpr static const uint32_t DEPTH_BITS = 22;
+    constexpr static const uint32_t MAX_DEPTH = (1u << DEPTH_BITS) - 1;
+
+private:
+    struct Pipeline {
+        VkPipeline       pipeline;
+        VkPipelineLayout layout;
+        uint32_t         drawDataSetIndex;
+    };
+
+    struct Material {
+        VkDescriptorSet set;
+        uint32_t        setIndex;
+    };
+
+private:
+    uint32_t mInstanceSize = 0;
+
+    std::vector<Pipeline> mPipelines;
+    std::vector<Material> mMaterials;
+    std::vector<Mesh>     mMeshes;
+
+    // one entry per item, index points at its instance data
+    std::vector<SortEntry> mEntries;
+    std::vector<SortEntry> mScratch;
+    std::vector<uint8_t>   mInstanceData;
+    RenderCommandStream    mStream;
+};
+
+#endif //VULKAN_TEST_DRAWBATCHER_HPP
@@ -0,0 +1,197 @@
+//
+// Created by Krisu on 2020/4/12.
+//
+
+#include "DrawDataStream.hpp"
+#include "AllocationTracker.hpp"
+#include "VulkanUtils.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+void DrawDataStream::Init(VkPhysicalDevice physicalDevice, VkDevice device,
+                          const VkAllocationCallbacks *pAllocator,
+                          uint32_t framesInFlight,
+                          VkDeviceSize bytesPerFrame) {
+    mDevice = device;
+    mAllocator = pAllocator;
+    mFramesInFlight = framesInFlight;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    const VkPhysicalDeviceLimits &limits = properties.limits;
+    mPushConstantSize = std::min(limits.maxPushConstantsSize,
+                                 MAX_PUSH_CONSTANT_SIZE);
+    mUniformRange = std::min<VkDeviceSize>(limits.maxUniformBufferRange,
+                                           MAX_UNIFORM_RANGE);
+    mStorageRange = std::min<VkDeviceSize>(
+            {limits.maxStorageBufferRange, MAX_STORAGE_RANGE,
+             bytesPerFrame});
+    mUniformAlignment = limits.minUniformBufferOffsetAlignment;
+    mStorageAlignment = limits.minStorageBufferOffsetAlignment;
+
+    // every frame starts aligned for both kinds of slices
+    VkDeviceSize frameAlignment = std::max(mUniformAlignment,
+                                           mStorageAlignment);
+    mBytesPerFrame = (bytesPerFrame + frameAlignment - 1) / frameAlignment *
+                     frameAlignment;
+    // the descriptor ranges reach past the last slice
+    VkDeviceSize bufferSize = mBytesPerFrame * mFramesInFlight +
+                              std::max(mUniformRange, mStorageRange);
+
+    CreateBuffer(physicalDevice, mDevice, mAllocator, bufferSize,
+                 VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT |
+                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, mBuffer, mMemory);
+    void *mapped;
+    vkMapMemory(mDevice, mMemory, 0, VK_WHOLE_SIZE, 0, &mapped);
+    mMapped = static_cast<char *>(mapped);
+
+    VkDescriptorSetLayoutBinding bindings[2]{};
+    bindings[0].binding = UNIFORM_BINDING;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    bindings[0].descriptorCount = 1;
+    bindings[0].stageFlags = VK_SHADER_STAGE_ALL;
+    bindings[1].binding = STORAGE_BINDING;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    bindings[1].descriptorCount = 1;
+    bindings[1].stageFlags = VK_SHADER_STAGE_ALL;
+
+    VkDescriptorSetLayoutCreateInfo layoutCreateInfo{};
+    layoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutCreateInfo.bindingCount = 2;
+    layoutCreateInfo.pBindings = bindings;
+    {
+        AllocationTracker::ScopedTag tag(VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT);
+        if (vkCreateDescriptorSetLayout(mDevice, &layoutCreateInfo,
+                                        mAllocator, &mLayout) != VK_SUCCESS) {
+            throw std::runtime_error(
+                    "failed to create draw data descriptor set layout");
+        }
+    }
+
+    VkDescriptorPoolSize poolSizes[2]{
+            {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1},
+            {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1}
+    };
+    VkDescriptorPoolCreateInfo poolCreateInfo{};
+    poolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolCreateInfo.maxSets = 1;
+    poolCreateInfo.poolSizeCount = 2;
+    poolCreateInfo.pPoolSizes = poolSizes;
+    {
+        AllocationTracker::ScopedTag tag(VK_OBJECT_TYPE_DESCRIPTOR_POOL);
+        if (vkCreateDescriptorPool(mDevice, &poolCreateInfo, mAllocator,
+                                   &mPool) != VK_SUCCESS) {
+            throw std::runtime_error(
+                    "failed to create draw data descriptor pool");
+        }
+    }
+
+    VkDescriptorSetAllocateInfo allocateInfo{};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocateInfo.descriptorPool = mPool;
+    allocateInfo.descriptorSetCount = 1;
+    allocateInfo.pSetLayouts = &mLayout;
+    if (vkAllocateDescriptorSets(mDevice, &allocateInfo, &mDescriptorSet) !=
+        VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate draw data descriptor set");
+    }
+
+    // the set never changes, only the dynamic offsets do
+    VkDescriptorBufferInfo bufferInfos[2]{
+            {mBuffer, 0, mUniformRange},
+            {mBuffer, 0, mStorageRange}
+    };
+    VkWriteDescriptorSet writes[2]{};
+    for (uint32_t i = 0; i < 2; i++) {
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = mDescriptorSet;
+        writes[i].dstBinding = bindings[i].binding;
+        writes[i].descriptorCount = 1;
+        writes[i].descriptorType = bindings[i].descriptorType;
+        writes[i].pBufferInfo = &bufferInfos[i];
+    }
+    vkUpdateDescriptorSets(mDevice, 2, writes, 0, nullptr);
+}
+
+void DrawDataStream::Destroy() {
+    if (mDevice == VK_NULL_HANDLE) {
+        return;
+    }
+    vkDestroyDescriptorPool(mDevice, mPool, mAllocator);
+    vkDestroyDescriptorSetLayout(mDevice, mLayout, mAllocator);
+    vkUnmapMemory(mDevice, mMemory);
+    vkDestroyBuffer(mDevice, mBuffer, mAllocator);
+    vkFreeMemory(mDevice, mMemory, mAllocator);
+    mDevice = VK_NULL_HANDLE;
+}
+
+DrawDataPath DrawDataStream::ChoosePath(uint32_t size) const {
+    if (size <= mPushConstantSize) {
+        return DrawDataPath::PushConstants;
+    }
+    if (size <= mUniformRange) {
+        return DrawDataPath::UniformSlice;
+    }
+    if (size <= mStorageRange) {
+        return DrawDataPath::StorageSlice;
+    }
+    throw std::runtime_error("draw data is larger than a storage slice");
+}
+
+DrawDataPath DrawDataStream::Push(VkCommandBuffer commandBuffer,
+                                  VkPipelineLayout pipelineLayout,
+                                  uint32_t setIndex, const void *data,
+                                  uint32_t size) {
+    DrawDataPath path = ChoosePath(size);
+    if (path == DrawDataPath::PushConstants) {
+        vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_ALL,
+                           0, size, data);
+        return path;
+    }
+    PushSlice(commandBuffer, pipelineLayout, setIndex, data, size, path);
+    return path;
+}
+
+void DrawDataStream::PushStorage(VkCommandBuffer commandBuffer,
+                                 VkPipelineLayout pipelineLayout,
+                                 uint32_t setIndex, const void *data,
+                                 uint32_t size) {
+    if (size > mStorageRange) {
+        throw std::runtime_error("draw data is larger than a storage slice");
+    }
+    PushSlice(commandBuffer, pipelineLayout, setIndex, data, size,
+              DrawDataPath::StorageSlice);
+}
+
+void DrawDataStream::PushSlice(VkCommandBuffer commandBuffer,
+                               VkPipelineLayout pipelineLayout,
+                               uint32_t setIndex, const void *data,
+                               uint32_t size, DrawDataPath path) {
+    VkDeviceSize alignment = path == DrawDataPath::UniformSlice
+                             ? mUniformAlignment : mStorageAlignment;
+    VkDeviceSize offset = (mHead + alignment - 1) / alignment * alignment;
+    if (offset + size > mBytesPerFrame) {
+        throw std::runtime_error("draw data ring is full");
+    }
+    mHead = offset + size;
+
+    VkDeviceSize frameOffset = mBytesPerFrame * mFrame + offset;
+    std::memcpy(mMapped + frameOffset, data, size);
+
+    // the other binding keeps offset 0, which is always in range
+    uint32_t dynamicOffsets[2]{0, 0};
+    dynamicOffsets[path == DrawDataPath::UniformSlice ? 0 : 1] =
+            static_cast<uint32_t>(frameOffset);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                            pipelineLayout, setIndex, 1, &mDescriptorSet, 2,
+                            dynamicOffsets);
+}
+
+void DrawDataStream::NextFrame() {
+    mFrame = (mFrame + 1) % mFramesInFlight;
+    mHead = 0;
+}
@@ -0,0 +1,109 @@
+//
+// Created by Krisu on 2020/4/12.
+//
+
+#ifndef VULKAN_TEST_DRAWDATASTREAM_HPP
+#define VULKAN_TEST_DRAWDATASTREAM_HPP
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+
+
+/* How a draw's data reaches the shader */
+enum class DrawDataPath {
+    PushConstants,  // push_constant block
+    UniformSlice,   // binding 0 of the draw data set, dynamic offset
+    StorageSlice    // binding 1 of the draw data set, dynamic offset
+};
+
+
+/* Per-draw data delivered the cheapest way its size allows. Small data
+ * goes into push constants, everything else is copied into a persistently
+ * mapped per-frame ring and bound with a dynamic offset, as a uniform
+ * buffer slice while it fits the uniform range and as a storage buffer
+ * slice for large per-instance arrays. A draw costs a memcpy, a pointer
+ * bump and one bind. */
+class DrawDataStream {
+public:
+    // layout of the set: binding 0 uniform, binding 1 storage
+    constexpr static const uint32_t UNIFORM_BINDING = 0;
+    constexpr static const uint32_t STORAGE_BINDING = 1;
+
+    /* bytesPerFrame: ring space for the slices of one frame */
+    void Init(VkPhysicalDevice physicalDevice, VkDevice device,
+              const VkAllocationCallbacks *pAllocator,
+              uint32_t framesInFlight,
+              VkDeviceSize bytesPerFrame = 4 * 1024 * 1024);
+
+    void Destroy();
+
+    /* Path data of size bytes would take */
+    DrawDataPath ChoosePath(uint32_t size) const;
+
+    /* Copy data and bind it for the next draws. pipelineLayout must have
+     * GetPushConstantRange and GetLayout at setIndex. */
+    DrawDataPath Push(VkCommandBuffer commandBuffer,
+                      VkPipelineLayout pipelineLayout, uint32_t setIndex,
+                      const void *data, uint32_t size);
+
+    template<typename T>
+    DrawDataPath Push(VkCommandBuffer commandBuffer,
+                      VkPipelineLayout pipelineLayout, uint32_t setIndex,
+                      const T &data) {
+        return Push(commandBuffer, pipelineLayout, setIndex, &data,
+                    static_cast<uint32_t>(sizeof(T)));
+    }
+
+    /* Copy data into a storage slice whatever its size, for instance
+     * arrays whose length changes between draws */
+    void PushStorage(VkCommandBuffer commandBuffer,
+                     VkPipelineLayout pipelineLayout, uint32_t setIndex,
+                     const void *data, uint32_t size);
+
+    /* Call once per frame after the frame's fence was waited on */
+    void NextFrame();
+
+    VkDescriptorSetLayout GetLayout() const { return mLayout; }
+
+    VkPushConstantRange GetPushConstantRange() const {
+        return {VK_SHADER_STAGE_ALL, 0, mPushConstantSize};
+    }
+
+    /* Largest storage slice */
+    VkDeviceSize GetStorageRange() const { return mStorageRange; }
+
+private:
+    void PushSlice(VkCommandBuffer commandBuffer,
+                   VkPipelineLayout pipelineLayout, uint32_t setIndex,
+                   const void *data, uint32_t size, DrawDataPath path);
+
+private:
+    VkDevice                     mDevice = VK_NULL_HANDLE;
+    const VkAllocationCallbacks *mAllocator = nullptr;
+    uint32_t                     mFramesInFlight = 1;
+
+    uint32_t     mPushConstantSize = 0;
+    VkDeviceSize mUniformRange = 0;
+    VkDeviceSize mStorageRange = 0;
+    VkDeviceSize mUniformAlignment = 1;
+    VkDeviceSize mStorageAlignment = 1;
+
+    VkBuffer       mBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory mMemory = VK_NULL_HANDLE;
+    char          *mMapped = nullptr;
+    VkDeviceSize   mBytesPerFrame = 0;
+    uint32_t       mFrame = 0;
+    VkDeviceSize   mHead = 0;
+
+    VkDescriptorSetLayout mLayout = VK_NULL_HANDLE;
+    VkDescriptorPool      mPool = VK_NULL_HANDLE;
+    VkDescriptorSet       mDescriptorSet = VK_NULL_HANDLE;
+
+    // upper bounds, the device limits may be lower
+    constexpr static const uint32_t     MAX_PUSH_CONSTANT_SIZE = 128;
+    constexpr static const VkDeviceSize MAX_UNIFORM_RANGE = 16 * 1024;
+    constexpr static const VkDeviceSize MAX_STORAGE_RANGE = 1024 * 1024;
+};
+
+#endif //VULKAN_TEST_DRAWDATASTREAM_HPP
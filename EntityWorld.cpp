@@ -0,0 +1,276 @@
+//
+// Created by Krisu on 2020/4/16.
+//
+
+#include "EntityWorld.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+std::mutex gComponentMutex;
+ComponentInfo gComponents[MAX_COMPONENTS];
+uint32_t gComponentCount = 0;
+
+uint32_t AlignUp(uint32_t value, uint32_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+}
+
+ComponentId RegisterComponent(uint32_t size, uint32_t alignment) {
+    std::lock_guard<std::mutex> lock(gComponentMutex);
+    if (gComponentCount == MAX_COMPONENTS) {
+        throw std::runtime_error("failed to register component, too many "
+                                 "component types!");
+    }
+    gComponents[gComponentCount] = {size, alignment};
+    return gComponentCount++;
+}
+
+const ComponentInfo &GetComponentInfo(ComponentId id) {
+    return gComponents[id];
+}
+
+Entity EntityWorld::CreateEntity(ComponentMask mask) {
+    Entity entity;
+    if (mFreeIndices.empty()) {
+        entity.index = mRecords.size();
+        mRecords.emplace_back();
+    } else {
+        entity.index = mFreeIndices.back();
+        mFreeIndices.pop_back();
+    }
+    entity.generation = mRecords[entity.index].generation;
+    PushRow(GetArchetype(mask), entity);
+    mEntityCount++;
+    return entity;
+}
+
+void EntityWorld::Destroy(Entity entity) {
+    if (!IsAlive(entity)) {
+        return;
+    }
+    EntityRecord &record = mRecords[entity.index];
+    RemoveRow(record);
+    record.archetype = nullptr;
+    record.generation++;
+    mFreeIndices.push_back(entity.index);
+    mEntityCount--;
+}
+
+bool EntityWorld::IsAlive(Entity entity) const {
+    return Find(entity) != nullptr;
+}
+
+void EntityWorld::AddComponent(Entity entity, ComponentId id,
+                               const void *data) {
+    ComponentMask mask = GetMask(entity);
+    if (!IsAlive(entity)) {
+        throw std::runtime_error("failed to add component, entity is not "
+                                 "alive!");
+    }
+    ComponentMask bit = ComponentMask{1} << id;
+    if ((mask & bit) == 0) {
+        Move(entity, mask | bit);
+    }
+    std::memcpy(GetComponent(entity, id), data, GetComponentInfo(id).size);
+}
+
+void EntityWorld::RemoveComponent(Entity entity, ComponentId id) {
+    ComponentMask mask = GetMask(entity);
+    ComponentMask bit = ComponentMask{1} << id;
+    if (mask & bit) {
+        Move(entity, mask & ~bit);
+    }
+}
+
+void *EntityWorld::GetComponent(Entity entity, ComponentId id) {
+    const EntityRecord *record = Find(entity);
+    if (record == nullptr ||
+        (record->archetype->mask & ComponentMask{1} << id) == 0) {
+        return nullptr;
+    }
+    Chunk &chunk = *record->archetype->chunks[record->chunk];
+    return chunk.data + record->archetype->offsets[id] +
+           static_cast<size_t>(record->row) * GetComponentInfo(id).size;
+}
+
+ComponentMask EntityWorld::GetMask(Entity entity) const {
+    const EntityRecord *record = Find(entity);
+    return record == nullptr ? 0 : record->archetype->mask;
+}
+
+EntityWorld::Archetype &EntityWorld::GetArchetype(ComponentMask mask) {
+    auto found = mArchetypes.find(mask);
+    if (found != mArchetypes.end()) {
+        return *found->second;
+    }
+
+    auto archetype = std::make_unique<Archetype>();
+    archetype->mask = mask;
+    uint32_t rowSize = sizeof(Entity);
+    for (ComponentId id = 0; id < MAX_COMPONENTS; id++) {
+        if (mask & ComponentMask{1} << id) {
+            archetype->components.push_back(id);
+            rowSize += GetComponentInfo(id).size;
+        }
+    }
+
+    // as many rows as fit, less the ones lost to aligning the arrays
+    uint32_t capacity = CHUNK_SIZE / rowSize;
+    for (; capacity > 0; capacity--) {
+        uint32_t offset = sizeof(Entity) * capacity;
+        for (ComponentId id : archetype->components) {
+            const ComponentInfo &info = GetComponentInfo(id);
+            offset = AlignUp(offset, info.alignment);
+            archetype->offsets[id] = offset;
+            offset += info.size * capacity;
+        }
+        if (offset <= CHUNK_SIZE) {
+            break;
+        }
+    }
+    if (capacity == 0) {
+        throw std::runtime_error("failed to create archetype, components "
+                                 "do not fit in a chunk!");
+    }
+    archetype->capacity = capacity;
+    return *mArchetypes.emplace(mask, std::move(archetype)).first->second;
+}
+
+std::vector<EntityWorld::ChunkRef>
+EntityWorld::GetChunks(ComponentMask mask) const {
+    std::vector<ChunkRef> chunks;
+    for (const auto &entry : mArchetypes) {
+        const Archetype &archetype = *entry.second;
+        if ((archetype.mask & mask) != mask) {
+            continue;
+        }
+        for (const auto &chunk : archetype.chunks) {
+            chunks.push_back({&archetype, chunk.get()});
+        }
+    }
+    return chunks;
+}
+
+void EntityWorld::PushRow(Archetype &archetype, Entity entity) {
+    if (archetype.chunks.empty() ||
+        archetype.chunks.back()->count == archetype.capacity) {
+        archetype.chunks.push_back(std::make_unique<Chunk>());
+    }
+    Chunk &chunk = *archetype.chunks.back();
+    uint32_t row = chunk.count++;
+    reinterpret_cast<Entity *>(chunk.data)[row] = entity;
+    for (ComponentId id : archetype.components) {
+        uint32_t size = GetComponentInfo(id).size;
+        std::memset(chunk.data + archetype.offsets[id] + row * size, 0, size);
+    }
+
+    EntityRecord &record = mRecords[entity.index];
+    record.archetype = &archetype;
+    record.chunk = archetype.chunks.size() - 1;
+    record.row = row;
+}
+
+void EntityWorld::RemoveRow(const EntityRecord &record) {
+    Archetype &archetype = *record.archetype;
+    Chunk &chunk = *archetype.chunks[record.chunk];
+    Chunk &last = *archetype.chunks.back();
+    uint32_t lastRow = last.count - 1;
+    if (&chunk != &last || record.row != lastRow) {
+        Entity moved = reinterpret_cast<Entity *>(last.data)[lastRow];
+        reinterpret_cast<Entity *>(chunk.data)[record.row] = moved;
+        for (ComponentId id : archetype.components) {
+            uint32_t size = GetComponentInfo(id).size;
+            uint32_t offset = archetype.offsets[id];
+            std::memcpy(chunk.data + offset + record.row * size,
+                        last.data + offset + lastRow * size, size);
+        }
+        mRecords[moved.index].chunk = record.chunk;
+        mRecords[moved.index].row = record.row;
+    }
+    if (--last.count == 0) {
+        archetype.chunks.pop_back();
+    }
+}
+
+void EntityWorld::Move(Entity entity, ComponentMask mask) {
+    EntityRecord from = mRecords[entity.index];
+    Archetype &target = GetArchetype(mask);
+    PushRow(target, entity);
+
+    const EntityRecord &to = mRecords[entity.index];
+    const Chunk &fromChunk = *from.archetype->chunks[from.chunk];
+    Chunk &toChunk = *target.chunks[to.chunk];
+    for (ComponentId id : target.components) {
+        if ((from.archetype->mask & ComponentMask{1} << id) == 0) {
+            continue;
+        }
+        uint32_t size = GetComponentInfo(id).size;
+        std::memcpy(toChunk.data + target.offsets[id] + to.row * size,
+                    fromChunk.data + from.archetype->offsets[id] +
+                    from.row * size, size);
+    }
+    RemoveRow(from);
+}
+
+const EntityWorld::EntityRecord *EntityWorld::Find(Entity entity) const {
+    if (entity.index >= mRecords.size()) {
+        return nullptr;
+    }
+    const EntityRecord &record = mRecords[entity.index];
+    if (record.archetype == nullptr ||
+        record.generation != entity.generation) {
+        return nullptr;
+    }
+    return &record;
+}
+
+void EntityCommandBuffer::Destroy(Entity entity) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    RecordCommand(CommandType::Destroy, entity, 0, 0, nullptr, 0);
+}
+
+void EntityCommandBuffer::Playback(EntityWorld &world) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    Entity created;
+    for (const Command &command : mCommands) {
+        const uint8_t *data = mData.data() + command.dataOffset;
+        switch (command.type) {
+            case CommandType::Create:
+                created = world.CreateEntity(command.mask);
+                break;
+            case CommandType::SetCreated:
+                std::memcpy(world.GetComponent(created, command.component),
+                            data, GetComponentInfo(command.component).size);
+                break;
+            case CommandType::Destroy:
+                world.Destroy(command.entity);
+                break;
+            case CommandType::Add:
+                if (world.IsAlive(command.entity)) {
+                    world.AddComponent(command.entity, command.component,
+                                       data);
+                }
+                break;
+            case CommandType::Remove:
+                world.RemoveComponent(command.entity, command.component);
+                break;
+        }
+    }
+    mCommands.clear();
+    mData.clear();
+}
+
+void EntityCommandBuffer::RecordCommand(CommandType type, Entity entity,
+                                        ComponentMask mask,
+                                        ComponentId component,
+                                        const void *data, size_t size) {
+    mCommands.push_back({type, entity, mask, component, mData.size()});
+    if (size > 0) {
+        auto bytes = static_cast<const uint8_t *>(data);
+        mData.insert(mData.end(), bytes, bytes + size);
+    }
+}
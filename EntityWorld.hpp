@@ -0,0 +1,278 @@
+//
+// Created by Krisu on 2020/4/16.
+//
+
+#ifndef VULKAN_TEST_ENTITYWORLD_HPP
+#define VULKAN_TEST_ENTITYWORLD_HPP
+
+#include "JobSystem.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+
+/* Index into the world's entities and the generation of that slot, an
+ * entity whose slot was reused since is no longer alive */
+struct Entity {
+    uint32_t index = UINT32_MAX;
+    uint32_t generation = 0;
+
+    bool operator==(const Entity &other) const {
+        return index == other.index && generation == other.generation;
+    }
+};
+
+using ComponentId = uint32_t;
+// bit id set for every component of an archetype
+using ComponentMask = uint64_t;
+
+constexpr uint32_t MAX_COMPONENTS = 64;
+
+struct ComponentInfo {
+    uint32_t size;
+    uint32_t alignment;
+};
+
+/* Ids are handed out once per process on first use of a type, so they
+ * are the same in every EntityWorld */
+ComponentId RegisterComponent(uint32_t size, uint32_t alignment);
+
+const ComponentInfo &GetComponentInfo(ComponentId id);
+
+/* Components are plain data, they are moved around with memcpy */
+template<typename T>
+ComponentId GetComponentId() {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "components must be trivially copyable");
+    static const ComponentId id = RegisterComponent(sizeof(T), alignof(T));
+    return id;
+}
+
+template<typename... Ts>
+ComponentMask GetComponentMask() {
+    return (ComponentMask{0} | ... |
+            (ComponentMask{1} << GetComponentId<Ts>()));
+}
+
+/* Entities with exactly the same components share an archetype, which
+ * stores them in 16 KB chunks. A chunk holds an array of entities and
+ * one array per component, so a query walks every component it reads
+ * front to back and nothing else.
+ *
+ * Queries visit the chunks of every archetype with at least the
+ * components asked for:
+ *
+ *     world.ParallelForEach<Position, Velocity>(jobSystem,
+ *             [](uint32_t count, const Entity *entities,
+ *                Position *positions, Velocity *velocities) { ... });
+ *
+ * Creating and destroying entities or adding and removing components
+ * moves entities between chunks, which must not happen during a query:
+ * record those in an EntityCommandBuffer and play it back after. Removing
+ * an entity moves the last one of its archetype into its place, so
+ * component pointers do not survive structural changes. */
+class EntityWorld {
+public:
+    constexpr static const size_t CHUNK_SIZE = 16 * 1024;
+
+    /* An entity with the given components, copied in */
+    template<typename... Ts>
+    Entity Create(const Ts &...components) {
+        Entity entity = CreateEntity(GetComponentMask<Ts...>());
+        (std::memcpy(GetComponent(entity, GetComponentId<Ts>()),
+                     &components, sizeof(Ts)), ...);
+        return entity;
+    }
+
+    /* An entity with the components of mask, zero initialized */
+    Entity CreateEntity(ComponentMask mask);
+
+    void Destroy(Entity entity);
+
+    bool IsAlive(Entity entity) const;
+
+    /* Add the component or overwrite it when the entity has it */
+    template<typename T>
+    void Add(Entity entity, const T &component) {
+        AddComponent(entity, GetComponentId<T>(), &component);
+    }
+
+    template<typename T>
+    void Remove(Entity entity) {
+        RemoveComponent(entity, GetComponentId<T>());
+    }
+
+    /* nullptr when the entity does not have the component */
+    template<typename T>
+    T *Get(Entity entity) {
+        return static_cast<T *>(GetComponent(entity, GetComponentId<T>()));
+    }
+
+    template<typename T>
+    bool Has(Entity entity) const {
+        return (GetMask(entity) & GetComponentMask<T>()) != 0;
+    }
+
+    /* data holds the component's size in bytes, see Add */
+    void AddComponent(Entity entity, ComponentId id, const void *data);
+
+    void RemoveComponent(Entity entity, ComponentId id);
+
+    void *GetComponent(Entity entity, ComponentId id);
+
+    ComponentMask GetMask(Entity entity) const;
+
+    /* fn(count, entities, components...) for every chunk of entities
+     * having all of Ts, each argument an array of count */
+    template<typename... Ts, typename Fn>
+    void ForEach(Fn &&fn) {
+        for (const ChunkRef &chunk : GetChunks(GetComponentMask<Ts...>())) {
+            InvokeOnChunk<Ts...>(chunk, fn);
+        }
+    }
+
+    /* ForEach with the chunks spread over jobSystem, fn must be safe to
+     * call from several threads at once */
+    template<typename... Ts, typename Fn>
+    void ParallelForEach(JobSystem &jobSystem, Fn &&fn) {
+        std::vector<ChunkRef> chunks = GetChunks(GetComponentMask<Ts...>());
+        jobSystem.ParallelFor(chunks.size(), 1,
+                              [&](size_t begin, size_t end) {
+                                  for (size_t i = begin; i < end; i++) {
+                                      InvokeOnChunk<Ts...>(chunks[i], fn);
+                                  }
+                              });
+    }
+
+    uint32_t GetEntityCount() const { return mEntityCount; }
+
+private:
+    struct Chunk {
+        alignas(64) uint8_t data[CHUNK_SIZE];
+        uint32_t count = 0;
+    };
+
+    struct Archetype {
+        ComponentMask            mask = 0;
+        std::vector<ComponentId> components;
+        // where each component's array starts in a chunk, by id, the
+        // entities come first
+        uint32_t                 offsets[MAX_COMPONENTS]{};
+        uint32_t                 capacity = 0;
+        // all full but the last
+        std::vector<std::unique_ptr<Chunk>> chunks;
+    };
+
+    struct ChunkRef {
+        const Archetype *archetype;
+        Chunk           *chunk;
+    };
+
+    struct EntityRecord {
+        Archetype *archetype = nullptr;
+        uint32_t   chunk = 0;
+        uint32_t   row = 0;
+        uint32_t   generation = 0;
+    };
+
+    Archetype &GetArchetype(ComponentMask mask);
+
+    /* Chunks of every archetype having all of mask, non-empty ones */
+    std::vector<ChunkRef> GetChunks(ComponentMask mask) const;
+
+    /* A new zeroed row at the end of archetype for entity */
+    void PushRow(Archetype &archetype, Entity entity);
+
+    /* Fill the row of record with the last one of its archetype */
+    void RemoveRow(const EntityRecord &record);
+
+    /* Move entity to the archetype of mask, keeping the components both
+     * have */
+    void Move(Entity entity, ComponentMask mask);
+
+    const EntityRecord *Find(Entity entity) const;
+
+    template<typename... Ts, typename Fn>
+    static void InvokeOnChunk(const ChunkRef &ref, Fn &fn) {
+        uint8_t *data = ref.chunk->data;
+        fn(ref.chunk->count, reinterpret_cast<const Entity *>(data),
+           reinterpret_cast<Ts *>(
+                   data + ref.archetype->offsets[GetComponentId<Ts>()])...);
+    }
+
+private:
+    std::unordered_map<ComponentMask, std::unique_ptr<Archetype>> mArchetypes;
+    std::vector<EntityRecord> mRecords;
+    std::vector<uint32_t>     mFreeIndices;
+    uint32_t                  mEntityCount = 0;
+};
+
+/* Structural changes recorded during a query, applied in order by
+ * Playback. Recording is thread safe, so one buffer can take the
+ * commands of a ParallelForEach. */
+class EntityCommandBuffer {
+public:
+    template<typename... Ts>
+    void Create(const Ts &...components) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        RecordCommand(CommandType::Create, Entity{},
+                      GetComponentMask<Ts...>(), 0, nullptr, 0);
+        (RecordCommand(CommandType::SetCreated, Entity{}, 0,
+                       GetComponentId<Ts>(), &components, sizeof(Ts)), ...);
+    }
+
+    void Destroy(Entity entity);
+
+    template<typename T>
+    void Add(Entity entity, const T &component) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        RecordCommand(CommandType::Add, entity, 0, GetComponentId<T>(),
+                      &component, sizeof(T));
+    }
+
+    template<typename T>
+    void Remove(Entity entity) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        RecordCommand(CommandType::Remove, entity, 0, GetComponentId<T>(),
+                      nullptr, 0);
+    }
+
+    /* Apply and clear the commands, entities destroyed by an earlier
+     * command are skipped */
+    void Playback(EntityWorld &world);
+
+private:
+    enum class CommandType {
+        Create,
+        // a component of the entity the last Create made
+        SetCreated,
+        Destroy,
+        Add,
+        Remove
+    };
+
+    struct Command {
+        CommandType   type;
+        Entity        entity;
+        ComponentMask mask;
+        ComponentId   component;
+        size_t        dataOffset;
+    };
+
+    /* Call with mMutex held */
+    void RecordCommand(CommandType type, Entity entity, ComponentMask mask,
+                       ComponentId component, const void *data, size_t size);
+
+private:
+    std::mutex           mMutex;
+    std::vector<Command> mCommands;
+    std::vector<uint8_t> mData;
+};
+
+#endif //VULKAN_TEST_ENTITYWORLD_HPP
@@ -0,0 +1,480 @@
+//
+// Created by Krisu on 2020/4/16.
+//
+
+#include "GpuCuller.hpp"
+#include "AllocationTracker.hpp"
+#include "VulkanUtils.hpp"
+
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+constexpr uint32_t CULL_GROUP_SIZE = 64;
+// the phase values of shaders/cull.comp
+constexpr uint32_t SHADER_PHASE_ALL = 0;
+constexpr uint32_t SHADER_PHASE_EARLY = 1;
+constexpr uint32_t SHADER_PHASE_LATE = 2;
+
+}
+
+CullFrustum CullFrustum::FromViewProjection(const float viewProjection[16]) {
+    // rows of the matrix, clip space is -w <= x, y <= w and 0 <= z <= w
+    float rows[4][4];
+    for (int row = 0; row < 4; row++) {
+        for (int column = 0; column < 4; column++) {
+            rows[row][column] = viewProjection[column * 4 + row];
+        }
+    }
+    CullFrustum frustum{};
+    for (int i = 0; i < 4; i++) {
+        frustum.planes[0][i] = rows[3][i] + rows[0][i];
+        frustum.planes[1][i] = rows[3][i] - rows[0][i];
+        frustum.planes[2][i] = rows[3][i] + rows[1][i];
+        frustum.planes[3][i] = rows[3][i] - rows[1][i];
+        frustum.planes[4][i] = rows[2][i];
+        frustum.planes[5][i] = rows[3][i] - rows[2][i];
+    }
+    for (auto &plane : frustum.planes) {
+        float length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] +
+                                 plane[2] * plane[2]);
+        for (float &value : plane) {
+            value /= length;
+        }
+    }
+    return frustum;
+}
+
+void GpuCuller::Init(VkPhysicalDevice physicalDevice, VkDevice device,
+                     const VkAllocationCallbacks *pAllocator,
+                     DescriptorAllocator &descriptorAllocator,
+                     DescriptorUpdater &descriptorUpdater,
+                     const std::vector<char> &shaderCode,
+                     const DepthPyramid *depthPyramid,
+                     PFN_vkCmdDrawIndexedIndirectCountKHR drawIndexedIndirectCount,
+                     bool multiDrawIndirect, uint32_t maxObjects,
+                     uint32_t framesInFlight) {
+    mPhysicalDevice = physicalDevice;
+    mDevice = device;
+    mAllocator = pAllocator;
+    mDescriptorAllocator = &descriptorAllocator;
+    mDescriptorUpdater = &descriptorUpdater;
+    // counts past 1 need multi draw, without it every command is drawn alone
+    mMultiDrawIndirect = multiDrawIndirect;
+    mDrawIndexedIndirectCount = multiDrawIndirect ? drawIndexedIndirectCount
+                                                  : nullptr;
+    mMaxObjects = maxObjects;
+    mDepthPyramid = depthPyramid;
+
+    // objects, draws, counts, then visibility and the depth pyramid when
+    // culling occlusion
+    std::vector<VkDescriptorSetLayoutBinding> bindings(CullsOcclusion() ? 5
+                                                                        : 3);
+    for (uint32_t i = 0; i < bindings.size(); i++) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+    if (CullsOcclusion()) {
+        bindings[4].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    }
+    VkDescriptorSetLayoutCreateInfo setLayoutCreateInfo{};
+    setLayoutCreateInfo.sType =
+            VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    setLayoutCreateInfo.bindingCount = bindings.size();
+    setLayoutCreateInfo.pBindings = bindings.data();
+    {
+        AllocationTracker::ScopedTag tag(
+                VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT);
+        if (vkCreateDescriptorSetLayout(mDevice, &setLayoutCreateInfo,
+                                        mAllocator, &mSetLayout) !=
+            VK_SUCCESS) {
+            throw std::runtime_error(
+                    "failed to create cull descriptor set layout");
+        }
+    }
+    mDescriptorAllocator->RegisterLayout(mSetLayout, bindings);
+    mDescriptorUpdater->RegisterLayout(mSetLayout, bindings);
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.size = sizeof(Constants);
+    VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo{};
+    pipelineLayoutCreateInfo.sType =
+            VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutCreateInfo.setLayoutCount = 1;
+    pipelineLayoutCreateInfo.pSetLayouts = &mSetLayout;
+    pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+    pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+    {
+        AllocationTracker::ScopedTag tag(VK_OBJECT_TYPE_PIPELINE_LAYOUT);
+        if (vkCreatePipelineLayout(mDevice, &pipelineLayoutCreateInfo,
+                                   mAllocator, &mPipelineLayout) !=
+            VK_SUCCESS) {
+            throw std::runtime_error("failed to create cull pipeline layout");
+        }
+    }
+
+    VkShaderModuleCreateInfo shaderModuleCreateInfo{};
+    shaderModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    shaderModuleCreateInfo.codeSize = shaderCode.size();
+    shaderModuleCreateInfo.pCode =
+            reinterpret_cast<const uint32_t *>(shaderCode.data());
+    VkShaderModule shaderModule;
+    {
+        AllocationTracker::ScopedTag tag(VK_OBJECT_TYPE_SHADER_MODULE);
+        if (vkCreateShaderModule(mDevice, &shaderModuleCreateInfo, mAllocator,
+                                 &shaderModule) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create cull shader module");
+        }
+    }
+
+    VkComputePipelineCreateInfo pipelineCreateInfo{};
+    pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineCreateInfo.stage.sType =
+            VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineCreateInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineCreateInfo.stage.module = shaderModule;
+    pipelineCreateInfo.stage.pName = "main";
+    pipelineCreateInfo.layout = mPipelineLayout;
+    VkResult result;
+    {
+        AllocationTracker::ScopedTag tag(VK_OBJECT_TYPE_PIPELINE);
+        result = vkCreateComputePipelines(mDevice, VK_NULL_HANDLE, 1,
+                                          &pipelineCreateInfo, mAllocator,
+                                          &mPipeline);
+    }
+    vkDestroyShaderModule(mDevice, shaderModule, mAllocator);
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("failed to create cull pipeline");
+    }
+
+    VkDeviceSize objectsSize = sizeof(Header) +
+                               mMaxObjects * sizeof(GpuObject);
+    VkDeviceSize drawsSize = mMaxObjects *
+                             sizeof(VkDrawIndexedIndirectCommand);
+    uint32_t phaseCount = CullsOcclusion() ? 2 : 1;
+    mFrames.resize(framesInFlight);
+    for (auto &frame : mFrames) {
+        CreateBuffer(mPhysicalDevice, mDevice, mAllocator, objectsSize,
+                     VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                     VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                     frame.objects, frame.objectsMemory);
+        void *mapped;
+        vkMapMemory(mDevice, frame.objectsMemory, 0, objectsSize, 0, &mapped);
+        frame.objectsData = static_cast<uint8_t *>(mapped);
+        for (uint32_t i = 0; i < phaseCount; i++) {
+            PhaseDraws &phase = frame.phases[i];
+            CreateBuffer(mPhysicalDevice, mDevice, mAllocator, drawsSize,
+                         VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                         VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, phase.draws,
+                         phase.drawsMemory);
+            CreateBuffer(mPhysicalDevice, mDevice, mAllocator,
+                         MAX_BATCHES * sizeof(uint32_t),
+                         VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                         VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                         VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, phase.counts,
+                         phase.countsMemory);
+        }
+    }
+    // shared by all frames, each late phase leaves it for the next frame
+    if (CullsOcclusion()) {
+        CreateBuffer(mPhysicalDevice, mDevice, mAllocator,
+                     mMaxObjects * sizeof(uint32_t),
+                     VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                     VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                     VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mVisibility,
+                     mVisibilityMemory);
+        mVisibilityCleared = false;
+    }
+}
+
+void GpuCuller::Destroy() {
+    if (mDevice == VK_NULL_HANDLE) {
+        return;
+    }
+    for (auto &frame : mFrames) {
+        vkDestroyBuffer(mDevice, frame.objects, mAllocator);
+        vkFreeMemory(mDevice, frame.objectsMemory, mAllocator);
+        for (auto &phase : frame.phases) {
+            vkDestroyBuffer(mDevice, phase.draws, mAllocator);
+            vkFreeMemory(mDevice, phase.drawsMemory, mAllocator);
+            vkDestroyBuffer(mDevice, phase.counts, mAllocator);
+            vkFreeMemory(mDevice, phase.countsMemory, mAllocator);
+        }
+    }
+    mFrames.clear();
+    vkDestroyBuffer(mDevice, mVisibility, mAllocator);
+    vkFreeMemory(mDevice, mVisibilityMemory, mAllocator);
+    mVisibility = VK_NULL_HANDLE;
+    mVisibilityMemory = VK_NULL_HANDLE;
+    mDepthPyramid = nullptr;
+    vkDestroyPipeline(mDevice, mPipeline, mAllocator);
+    vkDestroyPipelineLayout(mDevice, mPipelineLayout, mAllocator);
+    vkDestroyDescriptorSetLayout(mDevice, mSetLayout, mAllocator);
+    mObjects.clear();
+    mFreeHandles.clear();
+    mObjectCount = 0;
+    mDevice = VK_NULL_HANDLE;
+}
+
+CullObjectHandle GpuCuller::Add(const CullObject &object) {
+    CullObjectHandle handle;
+    if (!mFreeHandles.empty()) {
+        handle = mFreeHandles.back();
+        mFreeHandles.pop_back();
+    } else {
+        if (mObjects.size() >= mMaxObjects) {
+            throw std::runtime_error("too many cull objects");
+        }
+        handle = mObjects.size();
+        mObjects.emplace_back();
+    }
+    mObjectCount++;
+    Update(handle, object);
+    return handle;
+}
+
+void GpuCuller::Update(CullObjectHandle handle, const CullObject &object) {
+    if (object.batch >= MAX_BATCHES) {
+        throw std::runtime_error("cull object batch out of range");
+    }
+    if (object.indexCount == 0) {
+        throw std::runtime_error("cull object has no indices");
+    }
+    mObjects[handle] = object;
+    mVersion++;
+}
+
+void GpuCuller::Remove(CullObjectHandle handle) {
+    mObjects[handle] = CullObject{};
+    mFreeHandles.push_back(handle);
+    mObjectCount--;
+    mVersion++;
+}
+
+void GpuCuller::NextFrame() {
+    mFrame = (mFrame + 1) % mFrames.size();
+}
+
+void GpuCuller::AddCullPasses(RenderGraph &graph, const CullView &view,
+                              CullPhase phase, RenderGraphHandle pyramid) {
+    if ((phase == CullPhase::All) == CullsOcclusion()) {
+        throw std::runtime_error(
+                "cull phase does not match the occlusion culling setup");
+    }
+    Frame &frame = mFrames[mFrame];
+    PhaseDraws &draws = frame.phases[GetPhaseIndex(phase)];
+    if (phase != CullPhase::Late) {
+        Upload(frame);
+        std::memcpy(frame.objectsData + offsetof(Header, viewProjection),
+                    view.viewProjection, sizeof(view.viewProjection));
+        std::memcpy(frame.objectsData + offsetof(Header, cameraPosition),
+                    view.cameraPosition, sizeof(view.cameraPosition));
+    }
+
+    // every command the draws read is written again each frame
+    draws.drawsHandle = graph.ImportBuffer("cull draws", draws.draws, false);
+    if (Compacts()) {
+        draws.countsHandle = graph.ImportBuffer("cull counts", draws.counts,
+                                                false);
+        graph.AddPass(
+                "clear draw counts",
+                [&](RenderGraph::PassBuilder &builder) {
+                    builder.Write(draws.countsHandle,
+                                  RenderGraphUsage::TransferDst,
+                                  RenderGraphWriteMode::Discard);
+                },
+                [&draws](const RenderGraph::PassContext &context) {
+                    vkCmdFillBuffer(context.GetCommandBuffer(), draws.counts,
+                                    0, VK_WHOLE_SIZE, 0);
+                });
+    }
+    if (phase == CullPhase::Early) {
+        frame.visibilityHandle = graph.ImportBuffer("cull visibility",
+                                                    mVisibility);
+    }
+
+    CullFrustum frustum = CullFrustum::FromViewProjection(view.viewProjection);
+    Constants constants{};
+    std::memcpy(constants.planes, frustum.planes, sizeof(constants.planes));
+    constants.objectCount = frame.objectCount;
+    constants.compact = Compacts() ? 1 : 0;
+    if (phase == CullPhase::All) {
+        constants.phase = SHADER_PHASE_ALL;
+    } else {
+        constants.phase = phase == CullPhase::Early ? SHADER_PHASE_EARLY
+                                                    : SHADER_PHASE_LATE;
+        constants.pyramidMipCount = mDepthPyramid->GetMipCount();
+        constants.viewportSize[0] =
+                static_cast<float>(mDepthPyramid->GetDepthExtent().width);
+        constants.viewportSize[1] =
+                static_cast<float>(mDepthPyramid->GetDepthExtent().height);
+    }
+    graph.AddPass(
+            phase == CullPhase::Late ? "late cull" : "cull",
+            [&](RenderGraph::PassBuilder &builder) {
+                builder.Write(draws.drawsHandle,
+                              RenderGraphUsage::ComputeStorageWrite,
+                              RenderGraphWriteMode::Discard);
+                if (Compacts()) {
+                    builder.Write(draws.countsHandle,
+                                  RenderGraphUsage::ComputeStorageWrite);
+                }
+                if (phase == CullPhase::Early) {
+                    builder.Read(frame.visibilityHandle,
+                                 RenderGraphUsage::ComputeStorageRead);
+                } else if (phase == CullPhase::Late) {
+                    builder.Write(frame.visibilityHandle,
+                                  RenderGraphUsage::ComputeStorageWrite);
+                }
+                // early culling only binds the pyramid, it is not built yet
+                if (phase != CullPhase::All) {
+                    builder.Read(pyramid, RenderGraphUsage::ComputeSampled);
+                }
+            },
+            [this, &frame, &draws, constants](
+                    const RenderGraph::PassContext &context) {
+                VkCommandBuffer commandBuffer = context.GetCommandBuffer();
+                if (constants.phase == SHADER_PHASE_EARLY) {
+                    RecordVisibilityBarrier(commandBuffer);
+                }
+                if (constants.objectCount == 0) {
+                    return;
+                }
+                Descriptors descriptors{};
+                descriptors.objects = {frame.objects, 0, VK_WHOLE_SIZE};
+                descriptors.draws = {draws.draws, 0, VK_WHOLE_SIZE};
+                descriptors.counts = {draws.counts, 0, VK_WHOLE_SIZE};
+                if (CullsOcclusion()) {
+                    descriptors.visibility = {mVisibility, 0, VK_WHOLE_SIZE};
+                    descriptors.pyramid = mDepthPyramid->GetDescriptor();
+                }
+                VkDescriptorSet set = mDescriptorAllocator->Allocate(
+                        mSetLayout);
+                mDescriptorUpdater->Update(set, mSetLayout, descriptors);
+
+                vkCmdBindPipeline(commandBuffer,
+                                  VK_PIPELINE_BIND_POINT_COMPUTE, mPipeline);
+                vkCmdBindDescriptorSets(commandBuffer,
+                                        VK_PIPELINE_BIND_POINT_COMPUTE,
+                                        mPipelineLayout, 0, 1, &set, 0,
+                                        nullptr);
+                vkCmdPushConstants(commandBuffer, mPipelineLayout,
+                                   VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                                   sizeof(constants), &constants);
+                vkCmdDispatch(commandBuffer,
+                              (constants.objectCount + CULL_GROUP_SIZE - 1) /
+                              CULL_GROUP_SIZE, 1, 1);
+            });
+}
+
+void GpuCuller::ReadDraws(RenderGraph::PassBuilder &builder,
+                          CullPhase phase) const {
+    const PhaseDraws &draws = mFrames[mFrame].phases[GetPhaseIndex(phase)];
+    builder.Read(draws.drawsHandle, RenderGraphUsage::IndirectBuffer);
+    if (Compacts()) {
+        builder.Read(draws.countsHandle, RenderGraphUsage::IndirectBuffer);
+    }
+}
+
+void GpuCuller::RecordDraws(VkCommandBuffer commandBuffer, uint32_t batch,
+                            CullPhase phase) const {
+    const Frame &frame = mFrames[mFrame];
+    const PhaseDraws &draws = frame.phases[GetPhaseIndex(phase)];
+    uint32_t size = frame.batchSize[batch];
+    if (size == 0) {
+        return;
+    }
+    const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+    VkDeviceSize offset = frame.batchBase[batch] * stride;
+    if (Compacts()) {
+        mDrawIndexedIndirectCount(commandBuffer, draws.draws, offset,
+                                  draws.counts, batch * sizeof(uint32_t),
+                                  size, stride);
+    } else if (mMultiDrawIndirect) {
+        vkCmdDrawIndexedIndirect(commandBuffer, draws.draws, offset, size,
+                                 stride);
+    } else {
+        for (uint32_t i = 0; i < size; i++) {
+            vkCmdDrawIndexedIndirect(commandBuffer, draws.draws,
+                                     offset + i * stride, 1, stride);
+        }
+    }
+}
+
+void GpuCuller::RecordVisibilityBarrier(VkCommandBuffer commandBuffer) {
+    // the graph starts fresh every frame, it does not know the late phase
+    // of the previous frame wrote the flags
+    VkBufferMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT |
+                            VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = mVisibility;
+    barrier.size = VK_WHOLE_SIZE;
+    VkPipelineStageFlags srcStages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    // nothing was visible before the first frame
+    if (!mVisibilityCleared) {
+        vkCmdFillBuffer(commandBuffer, mVisibility, 0, VK_WHOLE_SIZE, 0);
+        barrier.srcAccessMask |= VK_ACCESS_TRANSFER_WRITE_BIT;
+        srcStages |= VK_PIPELINE_STAGE_TRANSFER_BIT;
+        mVisibilityCleared = true;
+    }
+    vkCmdPipelineBarrier(commandBuffer, srcStages,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr,
+                         1, &barrier, 0, nullptr);
+}
+
+void GpuCuller::Upload(Frame &frame) {
+    if (frame.version == mVersion) {
+        return;
+    }
+
+    // batches take consecutive command ranges in batch order
+    std::memset(frame.batchSize, 0, sizeof(frame.batchSize));
+    for (const auto &object : mObjects) {
+        if (object.indexCount > 0) {
+            frame.batchSize[object.batch]++;
+        }
+    }
+    uint32_t base = 0;
+    for (uint32_t batch = 0; batch < MAX_BATCHES; batch++) {
+        frame.batchBase[batch] = base;
+        base += frame.batchSize[batch];
+    }
+    std::memcpy(frame.objectsData + offsetof(Header, batchBase),
+                frame.batchBase, sizeof(frame.batchBase));
+
+    uint32_t next[MAX_BATCHES];
+    std::memcpy(next, frame.batchBase, sizeof(next));
+    auto *objects = reinterpret_cast<GpuObject *>(frame.objectsData +
+                                                  sizeof(Header));
+    for (size_t handle = 0; handle < mObjects.size(); handle++) {
+        const CullObject &object = mObjects[handle];
+        GpuObject gpuObject{};
+        std::memcpy(gpuObject.sphere, object.center, sizeof(object.center));
+        gpuObject.sphere[3] = object.radius;
+        std::memcpy(gpuObject.cone, object.coneAxis, sizeof(object.coneAxis));
+        gpuObject.cone[3] = object.coneCutoff;
+        gpuObject.indexCount = object.indexCount;
+        gpuObject.firstIndex = object.firstIndex;
+        gpuObject.vertexOffset = object.vertexOffset;
+        gpuObject.batch = object.batch;
+        if (object.indexCount > 0) {
+            gpuObject.drawSlot = next[object.batch]++;
+        }
+        objects[handle] = gpuObject;
+    }
+    frame.objectCount = mObjects.size();
+    frame.version = mVersion;
+}
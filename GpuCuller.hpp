@@ -0,0 +1,239 @@
+//
+// Created by Krisu on 2020/4/16.
+//
+
+#ifndef VULKAN_TEST_GPUCULLER_HPP
+#define VULKAN_TEST_GPUCULLER_HPP
+
+#include <vulkan/vulkan.h>
+
+#include "DescriptorAllocator.hpp"
+#include "DescriptorUpdater.hpp"
+#include "DepthPyramid.hpp"
+#include "RenderGraph.hpp"
+
+#include <cstdint>
+#include <vector>
+
+
+using CullObjectHandle = uint32_t;
+
+/* Six planes pointing inwards, xyz the normal and w the distance */
+struct CullFrustum {
+    float planes[6][4];
+
+    /* Planes of a column major view projection matrix with a 0..1 depth
+     * range, normalized */
+    static CullFrustum FromViewProjection(const float viewProjection[16]);
+};
+
+/* Where the objects are seen from */
+struct CullView {
+    // column major with a 0..1 depth range
+    float viewProjection[16];
+    // world space, for the normal cones
+    float cameraPosition[3];
+};
+
+/* One indexed draw with its bounds. Objects of a batch are drawn by one
+ * indirect draw, so they must share pipeline, vertex layout and index
+ * type. The normal cone is the one of MeshletBounds, objects whose
+ * triangles all face away from the camera are culled, the default never
+ * is. */
+struct CullObject {
+    float    center[3]{0.0f, 0.0f, 0.0f};
+    float    radius = 0.0f;
+    float    coneAxis[3]{0.0f, 0.0f, 0.0f};
+    float    coneCutoff = 1.0f;
+    uint32_t indexCount = 0;
+    uint32_t firstIndex = 0;
+    int32_t  vertexOffset = 0;
+    uint32_t batch = 0;
+};
+
+/* Which objects a cull pass draws */
+enum class CullPhase {
+    All,    // every object in the frustum, no occlusion culling
+    Early,  // objects visible last frame, drawn before the depth pyramid
+    Late    // objects the early draws missed that pass the depth pyramid
+};
+
+/* GPU driven drawing: object bounds live in a storage buffer, a compute
+ * pass (shaders/cull.comp) tests them against the frustum and writes the
+ * draw commands of the survivors, so the CPU records one indirect draw
+ * per batch however many objects there are.
+ *
+ * With vkCmdDrawIndexedIndirectCount survivors are compacted to the front
+ * of their batch and counted. Without it every object keeps its own
+ * command and culled ones get no instances.
+ *
+ * With a DepthPyramid culling runs in two phases. The early phase draws
+ * what was visible last frame, the pyramid is built from that depth and
+ * the late phase tests every object against it: the ones the early
+ * phase missed are drawn and the visibility for the next frame is kept.
+ * Occluders are whatever was visible last frame, so nothing new pops in
+ * late and nothing visible is ever lost.
+ *
+ * firstInstance of every command is the object handle, vertex shaders
+ * find per-object data with gl_InstanceIndex. This needs the
+ * drawIndirectFirstInstance feature. */
+class GpuCuller {
+public:
+    /* shaderCode is shaders/cull.spv, or shaders/cull_occlusion.spv with
+     * a depthPyramid and nullptr otherwise. drawIndexedIndirectCount is
+     * nullptr when the device has neither Vulkan 1.2 nor
+     * VK_KHR_draw_indirect_count, multiDrawIndirect tells whether the
+     * feature is enabled. */
+    void Init(VkPhysicalDevice physicalDevice, VkDevice device,
+              const VkAllocationCallbacks *pAllocator,
+              DescriptorAllocator &descriptorAllocator,
+              DescriptorUpdater &descriptorUpdater,
+              const std::vector<char> &shaderCode,
+              const DepthPyramid *depthPyramid,
+              PFN_vkCmdDrawIndexedIndirectCountKHR drawIndexedIndirectCount,
+              bool multiDrawIndirect, uint32_t maxObjects,
+              uint32_t framesInFlight);
+
+    void Destroy();
+
+    CullObjectHandle Add(const CullObject &object);
+
+    void Update(CullObjectHandle handle, const CullObject &object);
+
+    void Remove(CullObjectHandle handle);
+
+    /* Call once per frame after the frame's fence was waited on */
+    void NextFrame();
+
+    /* Add the passes culling the objects of this frame for phase seen
+     * from view, the view must not change between phases. pyramid is
+     * the handle from DepthPyramid::Import, the early phase only binds it
+     * and the late one must come after its build pass. CullPhase::All
+     * takes no pyramid and is the only phase without one. */
+    void AddCullPasses(RenderGraph &graph, const CullView &view,
+                       CullPhase phase, RenderGraphHandle pyramid = 0);
+
+    /* Declare the reads of the pass drawing phase with RecordDraws */
+    void ReadDraws(RenderGraph::PassBuilder &builder, CullPhase phase) const;
+
+    /* Draw the objects of batch culling left for phase, the pipeline and
+     * the buffers of the batch must be bound */
+    void RecordDraws(VkCommandBuffer commandBuffer, uint32_t batch,
+                     CullPhase phase) const;
+
+    bool CullsOcclusion() const { return mDepthPyramid != nullptr; }
+
+    uint32_t GetObjectCount() const { return mObjectCount; }
+
+    constexpr static const uint32_t MAX_BATCHES = 64;
+
+private:
+    // std430 layout of shaders/cull.comp
+    struct GpuObject {
+        float    sphere[4];
+        // axis and cutoff
+        float    cone[4];
+        uint32_t indexCount;
+        uint32_t firstIndex;
+        int32_t  vertexOffset;
+        uint32_t batch;
+        // command of the object when draws are not compacted
+        uint32_t drawSlot;
+        uint32_t padding[3];
+    };
+
+    // the header of the objects buffer in front of the objects
+    struct Header {
+        uint32_t batchBase[MAX_BATCHES];
+        float    viewProjection[16];
+        float    cameraPosition[4];
+    };
+
+    struct Constants {
+        float    planes[6][4];
+        uint32_t objectCount;
+        uint32_t compact;
+        uint32_t phase;
+        uint32_t pyramidMipCount;
+        float    viewportSize[2];
+    };
+
+    // the last two are only in the layout when culling occlusion
+    struct Descriptors {
+        VkDescriptorBufferInfo objects;
+        VkDescriptorBufferInfo draws;
+        VkDescriptorBufferInfo counts;
+        VkDescriptorBufferInfo visibility;
+        VkDescriptorImageInfo  pyramid;
+    };
+
+    // commands of one phase, the early one is used by CullPhase::All too
+    struct PhaseDraws {
+        VkBuffer          draws = VK_NULL_HANDLE;
+        VkDeviceMemory    drawsMemory = VK_NULL_HANDLE;
+        VkBuffer          counts = VK_NULL_HANDLE;
+        VkDeviceMemory    countsMemory = VK_NULL_HANDLE;
+        RenderGraphHandle drawsHandle = 0;
+        RenderGraphHandle countsHandle = 0;
+    };
+
+    struct Frame {
+        // header followed by the objects, written by the host
+        VkBuffer          objects = VK_NULL_HANDLE;
+        VkDeviceMemory    objectsMemory = VK_NULL_HANDLE;
+        uint8_t          *objectsData = nullptr;
+        uint64_t          version = UINT64_MAX;
+        uint32_t          objectCount = 0;
+        PhaseDraws        phases[2];
+        // first command and objects of every batch
+        uint32_t          batchBase[MAX_BATCHES]{};
+        uint32_t          batchSize[MAX_BATCHES]{};
+        RenderGraphHandle visibilityHandle = 0;
+    };
+
+    /* Bring the frame's objects up to date with mObjects */
+    void Upload(Frame &frame);
+
+    /* Order the visibility writes of the previous frame before this one,
+     * clears them on first use */
+    void RecordVisibilityBarrier(VkCommandBuffer commandBuffer);
+
+    static uint32_t GetPhaseIndex(CullPhase phase) {
+        return phase == CullPhase::Late ? 1 : 0;
+    }
+
+    bool Compacts() const { return mDrawIndexedIndirectCount != nullptr; }
+
+private:
+    VkPhysicalDevice             mPhysicalDevice = VK_NULL_HANDLE;
+    VkDevice                     mDevice = VK_NULL_HANDLE;
+    const VkAllocationCallbacks *mAllocator = nullptr;
+    DescriptorAllocator         *mDescriptorAllocator = nullptr;
+    DescriptorUpdater           *mDescriptorUpdater = nullptr;
+
+    PFN_vkCmdDrawIndexedIndirectCountKHR mDrawIndexedIndirectCount = nullptr;
+    bool                                 mMultiDrawIndirect = false;
+
+    const DepthPyramid   *mDepthPyramid = nullptr;
+    // 1 for every object that passed the last late phase
+    VkBuffer              mVisibility = VK_NULL_HANDLE;
+    VkDeviceMemory        mVisibilityMemory = VK_NULL_HANDLE;
+    bool                  mVisibilityCleared = false;
+
+    VkDescriptorSetLayout mSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout      mPipelineLayout = VK_NULL_HANDLE;
+    VkPipeline            mPipeline = VK_NULL_HANDLE;
+
+    uint32_t                      mMaxObjects = 0;
+    // indexed by handle, removed ones have no indices
+    std::vector<CullObject>       mObjects;
+    std::vector<CullObjectHandle> mFreeHandles;
+    uint32_t                      mObjectCount = 0;
+    // bumped on every change, frames upload when theirs is behind
+    uint64_t                      mVersion = 0;
+
+    std::vector<Frame> mFrames;
+    uint32_t           mFrame = 0;
+};
+
+#endif //VULKAN_TEST_GPUCULLER_HPP
@@ -0,0 +1,32 @@
+//
+// Created by Krisu on 2020/4/7.
+//
+
+#ifndef VULKAN_TEST_HASH_HPP
+#define VULKAN_TEST_HASH_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+// 64 bit FNV-1a, stable across runs and platforms
+constexpr uint64_t HASH_SEED = 0xcbf29ce484222325ull;
+
+inline uint64_t HashBytes(const void *data, size_t size,
+                          uint64_t hash = HASH_SEED) {
+    auto *bytes = static_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+/* Hash a single value by its numeric value. Only use it for integers,
+ * enums and handles, never for structs which may contain padding. */
+template<typename T>
+inline uint64_t HashCombine(uint64_t hash, T value) {
+    auto widened = (uint64_t) value;
+    return HashBytes(&widened, sizeof(widened), hash);
+}
+
+#endif //VULKAN_TEST_HASH_HPP
@@ -3,6 +3,9 @@
 //
 
 #include "HelloTriangle.hpp"
+#include "VulkanUtils.hpp"
+#include <algorithm>
+#include <cmath>
 #include <fstream>
 
 void HelloTriangleApplication::PickPhysicalDevice() {
@@ -27,25 +30,201 @@ void HelloTriangleApplication::PickPhysicalDevice() {
     if (mPhysicalDevice == VK_NULL_HANDLE) {
         throw std::runtime_error("failed to find a suitable GPU");
     }
+
+    // optional: render without VkRenderPass / VkFramebuffer objects
+    if (CheckInstanceExtensionSupport(
+            VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME) &&
+        CheckDeviceExtensionSupport(mPhysicalDevice,
+                                    mDynamicRenderingExtensions)) {
+        mDeviceExtensions.insert(mDeviceExtensions.end(),
+                                 mDynamicRenderingExtensions.begin(),
+                                 mDynamicRenderingExtensions.end());
+        mDynamicRenderingSupported = true;
+    }
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(mPhysicalDevice, &properties);
+    mDeviceApiVersion = std::min(properties.apiVersion, mApiVersion);
+
+    // optional: write whole descriptor sets from one packed struct
+    if (mDeviceApiVersion >= VK_API_VERSION_1_1) {
+        mDescriptorUpdateTemplateSupported = true;
+    } else if (CheckDeviceExtensionSupport(
+            mPhysicalDevice,
+            {VK_KHR_DESCRIPTOR_UPDATE_TEMPLATE_EXTENSION_NAME})) {
+        mDeviceExtensions.push_back(
+                VK_KHR_DESCRIPTOR_UPDATE_TEMPLATE_EXTENSION_NAME);
+        mDescriptorUpdateTemplateSupported = true;
+    }
+
+    CheckDescriptorIndexingSupport();
+    CheckMeshShaderSupport();
+
+    // optional: compact GPU culled draws and draw them with a count
+    if (CheckDeviceExtensionSupport(
+            mPhysicalDevice, {VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME})) {
+        mDeviceExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+        mDrawIndirectCountSupported = true;
+    }
+}
+
+void HelloTriangleApplication::CheckDescriptorIndexingSupport() {
+    bool core = mDeviceApiVersion >= VK_API_VERSION_1_2;
+    if (!core && !(CheckInstanceExtensionSupport(
+            VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME) &&
+                   CheckDeviceExtensionSupport(
+                           mPhysicalDevice, mDescriptorIndexingExtensions))) {
+        return;
+    }
+
+    // the KHR entry points are the only ones on a 1.0 instance
+    bool instance11 = mApiVersion >= VK_API_VERSION_1_1;
+    auto getFeatures2 = (PFN_vkGetPhysicalDeviceFeatures2) vkGetInstanceProcAddr(
+            mInstance, instance11 ? "vkGetPhysicalDeviceFeatures2"
+                                  : "vkGetPhysicalDeviceFeatures2KHR");
+    auto getProperties2 = (PFN_vkGetPhysicalDeviceProperties2) vkGetInstanceProcAddr(
+            mInstance, instance11 ? "vkGetPhysicalDeviceProperties2"
+                                  : "vkGetPhysicalDeviceProperties2KHR");
+    if (getFeatures2 == nullptr || getProperties2 == nullptr) {
+        return;
+    }
+
+    VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures{};
+    indexingFeatures.sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+    VkPhysicalDeviceFeatures2 features2{};
+    features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features2.pNext = &indexingFeatures;
+    getFeatures2(mPhysicalDevice, &features2);
+    if (!indexingFeatures.runtimeDescriptorArray ||
+        !indexingFeatures.descriptorBindingPartiallyBound ||
+        !indexingFeatures.descriptorBindingUpdateUnusedWhilePending ||
+        !indexingFeatures.descriptorBindingSampledImageUpdateAfterBind ||
+        !indexingFeatures.descriptorBindingStorageBufferUpdateAfterBind ||
+        !indexingFeatures.shaderSampledImageArrayNonUniformIndexing) {
+        return;
+    }
+
+    // the heap is a single set, visible to every stage
+    VkPhysicalDeviceDescriptorIndexingPropertiesEXT indexingProperties{};
+    indexingProperties.sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT;
+    VkPhysicalDeviceProperties2 properties2{};
+    properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties2.pNext = &indexingProperties;
+    getProperties2(mPhysicalDevice, &properties2);
+    mBindlessCapacity.sampledImages = std::min({
+            mBindlessCapacity.sampledImages,
+            indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+            indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages});
+    mBindlessCapacity.storageBuffers = std::min({
+            mBindlessCapacity.storageBuffers,
+            indexingProperties.maxPerStageDescriptorUpdateAfterBindStorageBuffers,
+            indexingProperties.maxDescriptorSetUpdateAfterBindStorageBuffers});
+    mBindlessCapacity.samplers = std::min({
+            mBindlessCapacity.samplers,
+            indexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers,
+            indexingProperties.maxDescriptorSetUpdateAfterBindSamplers});
+
+    if (!core) {
+        mDeviceExtensions.insert(mDeviceExtensions.end(),
+                                 mDescriptorIndexingExtensions.begin(),
+                                 mDescriptorIndexingExtensions.end());
+    }
+    mDescriptorIndexingSupported = true;
+    // optional on top: fragment shaders writing texture feedback through a
+    // non-uniform storage buffer handle
+    mTextureFeedbackSupported =
+            indexingFeatures.shaderStorageBufferArrayNonUniformIndexing &&
+            features2.features.fragmentStoresAndAtomics;
+}
+
+void HelloTriangleApplication::CheckMeshShaderSupport() {
+    // VK_KHR_spirv_1_4 needs 1.1, which brings the features2 query too
+    if (mDeviceApiVersion < VK_API_VERSION_1_1 ||
+        !std::ifstream(MESHLET_TASK_SHADER_PATH).good() ||
+        !std::ifstream(MESHLET_MESH_SHADER_PATH).good()) {
+        return;
+    }
+    bool core = mDeviceApiVersion >= VK_API_VERSION_1_2;
+    std::vector<const char *> extensions(
+            mMeshShaderExtensions.begin(),
+            core ? mMeshShaderExtensions.begin() + 1
+                 : mMeshShaderExtensions.end());
+    if (!CheckDeviceExtensionSupport(mPhysicalDevice, extensions)) {
+        return;
+    }
+
+    auto getFeatures2 = (PFN_vkGetPhysicalDeviceFeatures2) vkGetInstanceProcAddr(
+            mInstance, "vkGetPhysicalDeviceFeatures2");
+    if (getFeatures2 == nullptr) {
+        return;
+    }
+    VkPhysicalDeviceMeshShaderFeaturesEXT meshShaderFeatures{};
+    meshShaderFeatures.sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+    VkPhysicalDeviceFeatures2 features2{};
+    features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features2.pNext = &meshShaderFeatures;
+    getFeatures2(mPhysicalDevice, &features2);
+    if (!meshShaderFeatures.taskShader || !meshShaderFeatures.meshShader) {
+        return;
+    }
+
+    mDeviceExtensions.insert(mDeviceExtensions.end(), extensions.begin(),
+                             extensions.end());
+    mMeshShadingSupported = true;
 }
 
 void HelloTriangleApplication::CleanUp() {
     if (ENABLE_VALIDATION_LAYERS) {
         proxyDestroyDebugUtilsMessengerEXT(mInstance, mDebugUtilsMessenger,
-                                           nullptr);
+                                           mAllocator);
     }
-    for (auto &imageView : mSwapChainImageViews) {
-        vkDestroyImageView(mDevice, imageView, nullptr);
+    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        vkDestroySemaphore(mDevice, mImageAvailableSemaphores[i], mAllocator);
+        vkDestroySemaphore(mDevice, mRenderFinishedSemaphores[i], mAllocator);
+        vkDestroyFence(mDevice, mInFlightFences[i], mAllocator);
     }
-    vkDestroySwapchainKHR(mDevice, mSwapChain, nullptr);
-    vkDestroyDevice(mDevice, nullptr);
+    vkDestroyCommandPool(mDevice, mCommandPool, mAllocator);
 
-    vkDestroySurfaceKHR(mInstance, mSurface, nullptr);
-    vkDestroyInstance(mInstance, nullptr);
+    if (ENABLE_ALLOCATION_TRACKING) {
+        mTransientAllocator.PrintReport(std::cout);
+    }
+    mTransientAllocator.Release();
+    CleanUpSwapChain();
+    vkDestroyPipeline(mDevice, mGraphicsPipeline, mAllocator);
+    vkDestroyPipeline(mDevice, mQuantizedPipeline, mAllocator);
+    vkDestroyPipelineLayout(mDevice, mPipelineLayout, mAllocator);
+    mDescriptorAllocator.Release();
+    mDescriptorUpdater.Clear();
+    mDrawDataStream.Destroy();
+    mSceneLoader.Destroy();
+    mMeshBuffer.Destroy();
+    mTextureStreamer.Destroy();
+    vkDestroySampler(mDevice, mQuadSampler, mAllocator);
+    mMipGenerator.Destroy();
+    mGpuCuller.Destroy();
+    mMeshletRenderer.Destroy();
+    mDepthPyramid.Destroy();
+    mBindlessHeap.Destroy();
+    mRenderPassCache.Clear();
+    vkDestroyDevice(mDevice, mAllocator);
+
+    vkDestroySurfaceKHR(mInstance, mSurface, mAllocator);
+    vkDestroyInstance(mInstance, mAllocator);
+
+    if (ENABLE_VALIDATION_LAYERS) {
+        mValidationLogger.Stop();
+    }
 
     glfwDestroyWindow(mWindow);
 
     glfwTerminate();
+
+    if (ENABLE_ALLOCATION_TRACKING) {
+        mAllocationTracker.PrintReport(std::cout);
+    }
 }
 
 void HelloTriangleApplication::CreateInstance() {
@@ -61,7 +240,9 @@ void HelloTriangleApplication::CreateInstance() {
     appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
     appInfo.pEngineName = "No Engine";
     appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-    appInfo.apiVersion = VK_API_VERSION_1_0;
+    // requesting more than the loader knows fails on 1.0 loaders
+    mApiVersion = GetInstanceApiVersion();
+    appInfo.apiVersion = mApiVersion;
 
     VkInstanceCreateInfo instanceCreateInfo{};
     instanceCreateInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -84,7 +265,8 @@ void HelloTriangleApplication::CreateInstance() {
         instanceCreateInfo.pNext = nullptr;
     }
 
-    if (vkCreateInstance(&instanceCreateInfo, nullptr, &mInstance) !=
+    AllocationTracker::ScopedTag tag(VK_OBJECT_TYPE_INSTANCE);
+    if (vkCreateInstance(&instanceCreateInfo, mAllocator, &mInstance) !=
         VK_SUCCESS) {
         throw std::runtime_error("failed to create instance");
     }
@@ -98,7 +280,8 @@ void HelloTriangleApplication::SetupDebugMessenger() {
     VkDebugUtilsMessengerCreateInfoEXT createInfo;
     PopulateDebugUtilsMessengerCreateInfo(createInfo);
 
-    if (proxyCreateDebugUtilsMessengerEXT(mInstance, &createInfo, nullptr,
+    AllocationTracker::ScopedTag tag(VK_OBJECT_TYPE_DEBUG_UTILS_MESSENGER_EXT);
+    if (proxyCreateDebugUtilsMessengerEXT(mInstance, &createInfo, mAllocator,
                                           &mDebugUtilsMessenger) !=
         VK_SUCCESS) {
         throw std::runtime_error("failed to set up debug messenger");
@@ -106,7 +289,8 @@ void HelloTriangleApplication::SetupDebugMessenger() {
 }
 
 void HelloTriangleApplication::CreateSurface() {
-    if (glfwCreateWindowSurface(mInstance, mWindow, nullptr, &mSurface) !=
+    AllocationTracker::ScopedTag tag(VK_OBJECT_TYPE_SURFACE_KHR);
+    if (glfwCreateWindowSurface(mInstance, mWindow, mAllocator, &mSurface) !=
         VK_SUCCESS) {
         throw std::runtime_error("failed to create window surface");
     }
@@ -130,7 +314,19 @@ void HelloTriangleApplication::CreateLogicalDevice() {
     }
 
     // setting needed device features
+    VkPhysicalDeviceFeatures supportedFeatures;
+    vkGetPhysicalDeviceFeatures(mPhysicalDevice, &supportedFeatures);
     VkPhysicalDeviceFeatures deviceFeatures{};
+    // optional: the compute mip generator stores without a format
+    deviceFeatures.shaderStorageImageWriteWithoutFormat =
+            supportedFeatures.shaderStorageImageWriteWithoutFormat;
+    // optional: GPU culling passes object handles in firstInstance
+    deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+    deviceFeatures.drawIndirectFirstInstance =
+            supportedFeatures.drawIndirectFirstInstance;
+    // optional: texture feedback atomics in fragment shaders
+    deviceFeatures.fragmentStoresAndAtomics =
+            mTextureFeedbackSupported ? VK_TRUE : VK_FALSE;
 
     // creating device
     VkDeviceCreateInfo deviceCreateInfo{};
@@ -147,6 +343,45 @@ void HelloTriangleApplication::CreateLogicalDevice() {
     // features
     deviceCreateInfo.pEnabledFeatures = &deviceFeatures;
 
+    // optional features are chained in front of each other
+    void *featureChain = nullptr;
+
+    VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamicRenderingFeatures{};
+    dynamicRenderingFeatures.sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR;
+    dynamicRenderingFeatures.dynamicRendering = VK_TRUE;
+    if (mDynamicRenderingSupported) {
+        dynamicRenderingFeatures.pNext = featureChain;
+        featureChain = &dynamicRenderingFeatures;
+    }
+
+    VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures{};
+    indexingFeatures.sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+    indexingFeatures.runtimeDescriptorArray = VK_TRUE;
+    indexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+    indexingFeatures.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+    indexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+    indexingFeatures.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+    indexingFeatures.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+    indexingFeatures.shaderStorageBufferArrayNonUniformIndexing =
+            mTextureFeedbackSupported ? VK_TRUE : VK_FALSE;
+    if (mDescriptorIndexingSupported) {
+        indexingFeatures.pNext = featureChain;
+        featureChain = &indexingFeatures;
+    }
+
+    VkPhysicalDeviceMeshShaderFeaturesEXT meshShaderFeatures{};
+    meshShaderFeatures.sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+    meshShaderFeatures.taskShader = VK_TRUE;
+    meshShaderFeatures.meshShader = VK_TRUE;
+    if (mMeshShadingSupported) {
+        meshShaderFeatures.pNext = featureChain;
+        featureChain = &meshShaderFeatures;
+    }
+    deviceCreateInfo.pNext = featureChain;
+
     // validation layer
     if (ENABLE_VALIDATION_LAYERS) {
         deviceCreateInfo.enabledLayerCount = mValidationLayers.size();
@@ -155,7 +390,8 @@ void HelloTriangleApplication::CreateLogicalDevice() {
         deviceCreateInfo.enabledLayerCount = 0;
     }
 
-    if (vkCreateDevice(mPhysicalDevice, &deviceCreateInfo, nullptr,
+    AllocationTracker::ScopedTag tag(VK_OBJECT_TYPE_DEVICE);
+    if (vkCreateDevice(mPhysicalDevice, &deviceCreateInfo, mAllocator,
                        &mDevice) != VK_SUCCESS) {
         throw std::runtime_error("failed to create logical device");
     }
@@ -164,6 +400,70 @@ void HelloTriangleApplication::CreateLogicalDevice() {
                      &mGraphicsQueue);
     vkGetDeviceQueue(mDevice, indices.presentFamily.value(), 0,
                      &mPresentQueue);
+
+    mRenderPassCache.Init(mDevice, mAllocator);
+    mTransientAllocator.Init(mPhysicalDevice, mDevice, mAllocator,
+                             MAX_FRAMES_IN_FLIGHT);
+    mDescriptorAllocator.Init(mDevice, mAllocator, MAX_FRAMES_IN_FLIGHT);
+    mDescriptorUpdater.Init(mDevice, mAllocator,
+                            mDescriptorUpdateTemplateSupported,
+                            mDeviceApiVersion >= VK_API_VERSION_1_1);
+    mDrawDataStream.Init(mPhysicalDevice, mDevice, mAllocator,
+                         MAX_FRAMES_IN_FLIGHT);
+    // mips are blitted when the compute shader was not built
+    std::vector<char> downsampleCode;
+    if (deviceFeatures.shaderStorageImageWriteWithoutFormat &&
+        std::ifstream(DOWNSAMPLE_SHADER_PATH).good()) {
+        downsampleCode = ReadFile(DOWNSAMPLE_SHADER_PATH);
+    }
+    mMipGenerator.Init(mPhysicalDevice, mDevice, mAllocator,
+                       mDescriptorAllocator, mDescriptorUpdater,
+                       downsampleCode, MAX_FRAMES_IN_FLIGHT);
+    // the task shaders cull meshlets themselves
+    if (!mMeshShadingSupported &&
+        deviceFeatures.drawIndirectFirstInstance &&
+        std::ifstream(CULL_SHADER_PATH).good()) {
+        auto drawIndexedIndirectCount =
+                mDrawIndirectCountSupported
+                ? (PFN_vkCmdDrawIndexedIndirectCountKHR) vkGetDeviceProcAddr(
+                        mDevice, "vkCmdDrawIndexedIndirectCountKHR")
+                : nullptr;
+        // occlusion culling needs both of its shaders, frustum culling
+        // alone works without
+        mOcclusionCullingSupported =
+                std::ifstream(CULL_OCCLUSION_SHADER_PATH).good() &&
+                std::ifstream(HIZ_SHADER_PATH).good();
+        if (mOcclusionCullingSupported) {
+            mDepthPyramid.Init(mPhysicalDevice, mDevice, mAllocator,
+                               mDescriptorAllocator, mDescriptorUpdater,
+                               ReadFile(HIZ_SHADER_PATH));
+        }
+        mGpuCuller.Init(mPhysicalDevice, mDevice, mAllocator,
+                        mDescriptorAllocator, mDescriptorUpdater,
+                        ReadFile(mOcclusionCullingSupported
+                                 ? CULL_OCCLUSION_SHADER_PATH
+                                 : CULL_SHADER_PATH),
+                        mOcclusionCullingSupported ? &mDepthPyramid : nullptr,
+                        drawIndexedIndirectCount,
+                        deviceFeatures.multiDrawIndirect, MAX_CULL_OBJECTS,
+                        MAX_FRAMES_IN_FLIGHT);
+        mGpuCullingSupported = true;
+    }
+    if (mDescriptorIndexingSupported) {
+        mBindlessHeap.Init(mDevice, mAllocator, mBindlessCapacity,
+                           MAX_FRAMES_IN_FLIGHT);
+        mTextureStreamer.Init(mPhysicalDevice, mDevice, mAllocator,
+                              mGraphicsQueue, indices.graphicsFamily.value(),
+                              mJobSystem, mBindlessHeap, mMipGenerator, {},
+                              MAX_FRAMES_IN_FLIGHT);
+    }
+
+    if (mDynamicRenderingSupported) {
+        mCmdBeginRendering = (PFN_vkCmdBeginRenderingKHR) vkGetDeviceProcAddr(
+                mDevice, "vkCmdBeginRenderingKHR");
+        mCmdEndRendering = (PFN_vkCmdEndRenderingKHR) vkGetDeviceProcAddr(
+                mDevice, "vkCmdEndRenderingKHR");
+    }
 }
 
 QueueFamilyIndices
@@ -233,17 +533,50 @@ std::vector<const char *> HelloTriangleApplication::GetRequiredExtensions() {
     if (ENABLE_VALIDATION_LAYERS) {
         extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
     }
+    // needed by VK_KHR_dynamic_rendering on a 1.0 instance (optional)
+    if (CheckInstanceExtensionSupport(
+            VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME)) {
+        extensions.push_back(
+                VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+    }
     return extensions;
 }
 
+uint32_t HelloTriangleApplication::GetInstanceApiVersion() {
+    // vkEnumerateInstanceVersion is missing from 1.0 loaders
+    auto enumerateInstanceVersion = (PFN_vkEnumerateInstanceVersion)
+            vkGetInstanceProcAddr(nullptr, "vkEnumerateInstanceVersion");
+    uint32_t version = VK_API_VERSION_1_0;
+    if (enumerateInstanceVersion != nullptr) {
+        enumerateInstanceVersion(&version);
+    }
+    return std::min(version, static_cast<uint32_t>(VK_API_VERSION_1_2));
+}
+
+bool HelloTriangleApplication::CheckInstanceExtensionSupport(
+        const char *extension) {
+    uint32_t extensionCount = 0;
+    vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount,
+                                           availableExtensions.data());
+
+    for (const auto &availableExtension : availableExtensions) {
+        if (std::string(extension) == availableExtension.extensionName) {
+            return true;
+        }
+    }
+    return false;
+}
+
 VkBool32 HelloTriangleApplication::DebugCallback(
         VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
         VkDebugUtilsMessageTypeFlagsEXT messageType,
         const VkDebugUtilsMessengerCallbackDataEXT *pCallbackData,
         void *pUserData) {
 
-    std::cerr << "Validation layer: " << pCallbackData->pMessage
-              << std::endl;
+    auto *logger = static_cast<ValidationLogger *>(pUserData);
+    logger->Submit(messageSeverity, messageType, pCallbackData);
 
     return VK_FALSE;
 }
@@ -292,8 +625,10 @@ void HelloTriangleApplication::PopulateDebugUtilsMessengerCreateInfo(
         VkDebugUtilsMessengerCreateInfoEXT &createInfo) {
     createInfo = {};
     createInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
+    // everything is reported, mValidationLogger filters at runtime
     createInfo.messageSeverity =
             VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT |
+            VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT |
             VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT |
             VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
     createInfo.messageType =
@@ -301,6 +636,7 @@ void HelloTriangleApplication::PopulateDebugUtilsMessengerCreateInfo(
             VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
             VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
     createInfo.pfnUserCallback = DebugCallback;
+    createInfo.pUserData = &mValidationLogger;
 }
 
 void HelloTriangleApplication::InitWindow() {
@@ -337,6 +673,12 @@ HelloTriangleApplication::IsDeviceSuitable(VkPhysicalDevice physicalDevice) {
 
 bool HelloTriangleApplication::CheckDeviceExtensionSupport(
         VkPhysicalDevice physicalDevice) {
+    return CheckDeviceExtensionSupport(physicalDevice, mDeviceExtensions);
+}
+
+bool HelloTriangleApplication::CheckDeviceExtensionSupport(
+        VkPhysicalDevice physicalDevice,
+        const std::vector<const char *> &extensions) {
 
     uint32_t extensionCount;
     vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr,
@@ -345,8 +687,8 @@ bool HelloTriangleApplication::CheckDeviceExtensionSupport(
     vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr,
                                          &extensionCount,
                                          availableExtensions.data());
-    std::set<std::string> requiredExtensions{mDeviceExtensions.begin(),
-                                             mDeviceExtensions.end()};
+    std::set<std::string> requiredExtensions{extensions.begin(),
+                                             extensions.end()};
 
     for (const auto &extension : availableExtensions) {
         requiredExtensions.erase(extension.extensionName);
@@ -477,7 +819,8 @@ void HelloTriangleApplication::CreateSwapChain() {
     swapchainCreateInfo.presentMode = presentMode;
     swapchainCreateInfo.clipped = VK_TRUE;
     swapchainCreateInfo.oldSwapchain = VK_NULL_HANDLE;
-    if (vkCreateSwapchainKHR(mDevice, &swapchainCreateInfo, nullptr,
+    AllocationTracker::ScopedTag tag(VK_OBJECT_TYPE_SWAPCHAIN_KHR);
+    if (vkCreateSwapchainKHR(mDevice, &swapchainCreateInfo, mAllocator,
                              &mSwapChain) != VK_SUCCESS) {
         throw std::runtime_error("failed to create swap chain!");
     }
@@ -495,6 +838,8 @@ void HelloTriangleApplication::CreateSwapChain() {
 void HelloTriangleApplication::CreateImageViews() {
     mSwapChainImageViews.resize(mSwapChainImages.size());
 
+    AllocationTracker::ScopedTag tag(VK_OBJECT_TYPE_IMAGE_VIEW);
+
     for (size_t i = 0; i < mSwapChainImages.size(); i++) {
         VkImageViewCreateInfo imageViewCreateInfo{};
         imageViewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -513,13 +858,111 @@ void HelloTriangleApplication::CreateImageViews() {
         imageViewCreateInfo.subresourceRange.baseArrayLayer = 0;
         imageViewCreateInfo.subresourceRange.layerCount = 1;
 
-        if (vkCreateImageView(mDevice, &imageViewCreateInfo, nullptr,
+        if (vkCreateImageView(mDevice, &imageViewCreateInfo, mAllocator,
                               &mSwapChainImageViews[i]) != VK_SUCCESS) {
             throw std::runtime_error("failed to create image views");
         }
     }
 }
 
+VkFormat HelloTriangleApplication::FindDepthFormat() {
+    // the depth pyramid samples it, one of these two is guaranteed to be
+    // a sampled depth attachment
+    const VkFormat candidates[] {
+        VK_FORMAT_D32_SFLOAT, VK_FORMAT_X8_D24_UNORM_PACK32
+    };
+    const VkFormatFeatureFlags features =
+            VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT |
+            VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+    for (VkFormat format : candidates) {
+        VkFormatProperties properties;
+        vkGetPhysicalDeviceFormatProperties(mPhysicalDevice, format,
+                                            &properties);
+        if ((properties.optimalTilingFeatures & features) == features) {
+            return format;
+        }
+    }
+    throw std::runtime_error("failed to find a depth format");
+}
+
+void HelloTriangleApplication::CreateDepthResources() {
+    if (mDepthFormat == VK_FORMAT_UNDEFINED) {
+        mDepthFormat = FindDepthFormat();
+    }
+
+    if (mOcclusionCullingSupported) {
+        mDepthPyramid.Resize(mSwapChainExtent);
+    }
+}
+
+void HelloTriangleApplication::CreateRenderPass() {
+    // load/store ops do not affect compatibility, any variant works for
+    // the pipeline and the framebuffers
+    RenderGraphAttachmentOps ops;
+    ops.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    ops.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    mRenderPass = GetSwapChainRenderPass(ops, ops);
+}
+
+VkRenderPass HelloTriangleApplication::GetSwapChainRenderPass(
+        const RenderGraphAttachmentOps &colorOps,
+        const RenderGraphAttachmentOps &depthOps) {
+    AttachmentDesc colorAttachment;
+    colorAttachment.format = mSwapChainImageFormat;
+    colorAttachment.loadOp = colorOps.loadOp;
+    colorAttachment.storeOp = colorOps.storeOp;
+    colorAttachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    AttachmentDesc depthAttachment;
+    depthAttachment.format = mDepthFormat;
+    depthAttachment.loadOp = depthOps.loadOp;
+    depthAttachment.storeOp = depthOps.storeOp;
+    depthAttachment.initialLayout =
+            VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    depthAttachment.finalLayout =
+            VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    SubpassDesc subpass;
+    subpass.colorAttachments.push_back(0);
+    subpass.depthAttachment = 1;
+
+    RenderPassDesc renderPassDesc;
+    renderPassDesc.attachments.push_back(colorAttachment);
+    renderPassDesc.attachments.push_back(depthAttachment);
+    renderPassDesc.subpasses.push_back(subpass);
+
+    return mRenderPassCache.GetRenderPass(renderPassDesc);
+}
+
+void HelloTriangleApplication::CleanUpSwapChain() {
+    // framebuffers hold on to the views, they go first. Every one of them
+    // has a swap chain view, so this also drops the ones with a depth
+    // view the transient allocator is about to replace
+    mRenderPassCache.EvictFramebuffers(mSwapChainImageViews);
+
+    for (auto &imageView : mSwapChainImageViews) {
+        vkDestroyImageView(mDevice, imageView, mAllocator);
+    }
+    mSwapChainImageViews.clear();
+    vkDestroySwapchainKHR(mDevice, mSwapChain, mAllocator);
+}
+
+void HelloTriangleApplication::RecreateSwapChain() {
+    vkDeviceWaitIdle(mDevice);
+
+    CleanUpSwapChain();
+
+    CreateSwapChain();
+    CreateImageViews();
+    CreateDepthResources();
+    // the render pass only depends on the format and stays cached,
+    // viewport and scissor are dynamic so the pipeline survives as well
+    if (!mDynamicRenderingSupported) {
+        CreateRenderPass();
+    }
+}
+
 void HelloTriangleApplication::CreateGraphicsPipeline() {
     auto vertShaderCode = ReadFile("shaders/vert.spv");
     auto fragShaderCode = ReadFile("shaders/frag.spv");
@@ -545,10 +988,200 @@ void HelloTriangleApplication::CreateGraphicsPipeline() {
         vertShaderStageCreateInfo, fragShaderStageCreateInfo
     };
 
+    // vertices come from the mesh buffer, positions and colors in separate
+    // streams
+    auto bindingDescriptions = MeshBuffer::GetBindingDescriptions(
+            VertexLayout::Deinterleaved);
+    auto attributeDescriptions = MeshBuffer::GetAttributeDescriptions(
+            VertexLayout::Deinterleaved);
+    VkPipelineVertexInputStateCreateInfo vertexInputStateCreateInfo{};
+    vertexInputStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertexInputStateCreateInfo.vertexBindingDescriptionCount = bindingDescriptions.size();
+    vertexInputStateCreateInfo.pVertexBindingDescriptions = bindingDescriptions.data();
+    vertexInputStateCreateInfo.vertexAttributeDescriptionCount = attributeDescriptions.size();
+    vertexInputStateCreateInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+
+    VkPipelineInputAssemblyStateCreateInfo inputAssemblyStateCreateInfo{};
+    inputAssemblyStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    inputAssemblyStateCreateInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    inputAssemblyStateCreateInfo.primitiveRestartEnable = VK_FALSE;
+
+    // viewport and scissor are set when recording, so the pipeline does
+    // not depend on the swap chain extent
+    VkPipelineViewportStateCreateInfo viewportStateCreateInfo{};
+    viewportStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportStateCreateInfo.viewportCount = 1;
+    viewportStateCreateInfo.scissorCount = 1;
+
+    VkDynamicState dynamicStates[] {
+        VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR
+    };
+    VkPipelineDynamicStateCreateInfo dynamicStateCreateInfo{};
+    dynamicStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicStateCreateInfo.dynamicStateCount = 2;
+    dynamicStateCreateInfo.pDynamicStates = dynamicStates;
+
+    VkPipelineRasterizationStateCreateInfo rasterizationStateCreateInfo{};
+    rasterizationStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizationStateCreateInfo.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterizationStateCreateInfo.lineWidth = 1.0f;
+    rasterizationStateCreateInfo.cullMode = VK_CULL_MODE_BACK_BIT;
+    rasterizationStateCreateInfo.frontFace = VK_FRONT_FACE_CLOCKWISE;
+
+    VkPipelineMultisampleStateCreateInfo multisampleStateCreateInfo{};
+    multisampleStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampleStateCreateInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+    VkPipelineColorBlendAttachmentState colorBlendAttachmentState{};
+    colorBlendAttachmentState.colorWriteMask =
+            VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+            VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    colorBlendAttachmentState.blendEnable = VK_FALSE;
+
+    VkPipelineColorBlendStateCreateInfo colorBlendStateCreateInfo{};
+    colorBlendStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    colorBlendStateCreateInfo.attachmentCount = 1;
+    colorBlendStateCreateInfo.pAttachments = &colorBlendAttachmentState;
+
+    VkPipelineDepthStencilStateCreateInfo depthStencilStateCreateInfo{};
+    depthStencilStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depthStencilStateCreateInfo.depthTestEnable = VK_TRUE;
+    depthStencilStateCreateInfo.depthWriteEnable = VK_TRUE;
+    depthStencilStateCreateInfo.depthCompareOp = VK_COMPARE_OP_LESS;
+
+    // set 0 is the bindless heap when there is one, the draw data set
+    // follows
+    std::vector<VkDescriptorSetLayout> setLayouts;
+    if (mDescriptorIndexingSupported) {
+        setLayouts.push_back(mBindlessHeap.GetLayout());
+    }
+    mDrawDataSetIndex = setLayouts.size();
+    setLayouts.push_back(mDrawDataStream.GetLayout());
+    VkPushConstantRange pushConstantRange =
+            mDrawDataStream.GetPushConstantRange();
+
+    VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo{};
+    pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutCreateInfo.setLayoutCount = setLayouts.size();
+    pipelineLayoutCreateInfo.pSetLayouts = setLayouts.data();
+    pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+    pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+
+    {
+        AllocationTracker::ScopedTag tag(VK_OBJECT_TYPE_PIPELINE_LAYOUT);
+        if (vkCreatePipelineLayout(mDevice, &pipelineLayoutCreateInfo,
+                                   mAllocator, &mPipelineLayout) !=
+            VK_SUCCESS) {
+            throw std::runtime_error("failed to create pipeline layout");
+        }
+    }
+
+    VkGraphicsPipelineCreateInfo pipelineCreateInfo{};
+    pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineCreateInfo.stageCount = 2;
+    pipelineCreateInfo.pStages = shaderStageCreateInfos;
+    pipelineCreateInfo.pVertexInputState = &vertexInputStateCreateInfo;
+    pipelineCreateInfo.pInputAssemblyState = &inputAssemblyStateCreateInfo;
+    pipelineCreateInfo.pViewportState = &viewportStateCreateInfo;
+    pipelineCreateInfo.pRasterizationState = &rasterizationStateCreateInfo;
+    pipelineCreateInfo.pMultisampleState = &multisampleStateCreateInfo;
+    pipelineCreateInfo.pDepthStencilState = &depthStencilStateCreateInfo;
+    pipelineCreateInfo.pColorBlendState = &colorBlendStateCreateInfo;
+    pipelineCreateInfo.pDynamicState = &dynamicStateCreateInfo;
+    pipelineCreateInfo.layout = mPipelineLayout;
+
+    // with dynamic rendering only the attachment formats are needed
+    VkPipelineRenderingCreateInfoKHR renderingCreateInfo{};
+    renderingCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR;
+    renderingCreateInfo.colorAttachmentCount = 1;
+    renderingCreateInfo.pColorAttachmentFormats = &mSwapChainImageFormat;
+    renderingCreateInfo.depthAttachmentFormat = mDepthFormat;
+    if (mDynamicRenderingSupported) {
+        pipelineCreateInfo.pNext = &renderingCreateInfo;
+        pipelineCreateInfo.renderPass = VK_NULL_HANDLE;
+    } else {
+        pipelineCreateInfo.renderPass = mRenderPass;
+        pipelineCreateInfo.subpass = 0;
+    }
+
+    {
+        AllocationTracker::ScopedTag tag(VK_OBJECT_TYPE_PIPELINE);
+        if (vkCreateGraphicsPipelines(mDevice, VK_NULL_HANDLE, 1,
+                                      &pipelineCreateInfo, mAllocator,
+                                      &mGraphicsPipeline) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create graphics pipeline");
+        }
+    }
+
+    // quantized meshes differ in the vertex shader and its input only,
+    // the bounds come in the push constants
+    if (std::ifstream(QUANTIZED_SHADER_PATH).good()) {
+        VkShaderModule quantizedShaderModule = CreateShaderModule(
+                ReadFile(QUANTIZED_SHADER_PATH));
+        shaderStageCreateInfos[0].module = quantizedShaderModule;
+        // the quad samples a streamed texture from the bindless heap, with
+        // feedback when the device can write it
+        const char *texturedShaderPath = mTextureFeedbackSupported
+                                         ? TEXTURED_FEEDBACK_SHADER_PATH
+                                         : TEXTURED_SHADER_PATH;
+        VkShaderModule texturedShaderModule = VK_NULL_HANDLE;
+        if (mDescriptorIndexingSupported &&
+            std::ifstream(texturedShaderPath).good()) {
+            texturedShaderModule = CreateShaderModule(
+                    ReadFile(texturedShaderPath));
+            shaderStageCreateInfos[1].module = texturedShaderModule;
+            mQuadTextured = true;
+        }
+        // the vertex input depends on the attributes only, not their values
+        PackedMesh quadFormat = PackMesh(GetQuadAttributes());
+        vertexInputStateCreateInfo.vertexBindingDescriptionCount = 1;
+        vertexInputStateCreateInfo.pVertexBindingDescriptions =
+                &quadFormat.binding;
+        vertexInputStateCreateInfo.vertexAttributeDescriptionCount =
+                quadFormat.attributes.size();
+        vertexInputStateCreateInfo.pVertexAttributeDescriptions =
+                quadFormat.attributes.data();
+        {
+            AllocationTracker::ScopedTag tag(VK_OBJECT_TYPE_PIPELINE);
+            if (vkCreateGraphicsPipelines(mDevice, VK_NULL_HANDLE, 1,
+                                          &pipelineCreateInfo, mAllocator,
+                                          &mQuantizedPipeline) !=
+                VK_SUCCESS) {
+                throw std::runtime_error(
+                        "failed to create quantized graphics pipeline");
+            }
+        }
+        vkDestroyShaderModule(mDevice, quantizedShaderModule, mAllocator);
+        vkDestroyShaderModule(mDevice, texturedShaderModule, mAllocator);
+        shaderStageCreateInfos[1].module = fragShaderModule;
+    }
+
+    // the triangle shaders read no instance data and need no material
+    mDrawBatcher.Init(0);
+    mBatchPipeline = mDrawBatcher.RegisterPipeline(
+            mGraphicsPipeline, mPipelineLayout, mDrawDataSetIndex);
+    mBatchMaterial = mDrawBatcher.RegisterMaterial(VK_NULL_HANDLE, 0);
+    if (mQuantizedPipeline != VK_NULL_HANDLE) {
+        mBatchQuantizedPipeline = mDrawBatcher.RegisterPipeline(
+                mQuantizedPipeline, mPipelineLayout, mDrawDataSetIndex);
+    }
+
     // after graphics pipeline is created, spir-v bytecode is compiled to
     // machine code
-    vkDestroyShaderModule(mDevice, vertShaderModule, nullptr);
-    vkDestroyShaderModule(mDevice, fragShaderModule, nullptr);
+    vkDestroyShaderModule(mDevice, vertShaderModule, mAllocator);
+    vkDestroyShaderModule(mDevice, fragShaderModule, mAllocator);
+
+    // same fragment shader and attachments, vertices come from meshlets
+    if (mMeshShadingSupported) {
+        mMeshletRenderer.Init(
+                mPhysicalDevice, mDevice, mAllocator, mDescriptorAllocator,
+                ReadFile(MESHLET_TASK_SHADER_PATH),
+                ReadFile(MESHLET_MESH_SHADER_PATH), fragShaderCode,
+                mSwapChainImageFormat, mDepthFormat,
+                mDynamicRenderingSupported ? VK_NULL_HANDLE : mRenderPass,
+                (PFN_vkCmdDrawMeshTasksEXT) vkGetDeviceProcAddr(
+                        mDevice, "vkCmdDrawMeshTasksEXT"));
+    }
 }
 
 VkShaderModule
@@ -559,16 +1192,628 @@ HelloTriangleApplication::CreateShaderModule(const std::vector<char> &code) {
     shaderModuleCreateInfo.pCode = reinterpret_cast<const uint32_t *>(code.data());
 
     VkShaderModule shaderModule;
-    if (vkCreateShaderModule(mDevice, &shaderModuleCreateInfo, nullptr,
+    AllocationTracker::ScopedTag tag(VK_OBJECT_TYPE_SHADER_MODULE);
+    if (vkCreateShaderModule(mDevice, &shaderModuleCreateInfo, mAllocator,
                              &shaderModule) != VK_SUCCESS) {
         throw std::runtime_error("failed to create shader module!");
     }
     return shaderModule;
 }
 
+void HelloTriangleApplication::CreateCommandPool() {
+    QueueFamilyIndices indices = FindQueueFamilies(mPhysicalDevice);
+
+    VkCommandPoolCreateInfo commandPoolCreateInfo{};
+    commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    // command buffers are re-recorded every frame
+    commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    commandPoolCreateInfo.queueFamilyIndex = indices.graphicsFamily.value();
+
+    AllocationTracker::ScopedTag tag(VK_OBJECT_TYPE_COMMAND_POOL);
+    if (vkCreateCommandPool(mDevice, &commandPoolCreateInfo, mAllocator,
+                            &mCommandPool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create command pool");
+    }
+}
+
+void HelloTriangleApplication::CreateMeshes() {
+    mSceneLoader.Init(mPhysicalDevice, mDevice, mAllocator, mCommandPool,
+                      mGraphicsQueue, mJobSystem);
+    if (std::ifstream(SCENE_FILE_PATH).good()) {
+        // the pipeline takes deinterleaved vertices
+        auto meshes = mSceneLoader.Load(SCENE_FILE_PATH, mMeshBuffer);
+        if (!meshes.empty() &&
+            meshes[0].layout == VertexLayout::Deinterleaved) {
+            mTriangle = meshes[0];
+            mBatchTriangle = mDrawBatcher.RegisterMesh(mTriangle);
+            return;
+        }
+    }
+
+    std::vector<Vertex> vertices{
+            {{0.0f,  -0.5f, 0.0f}, {1.0f, 0.0f, 0.0f}},
+            {{0.5f,  0.5f,  0.0f}, {0.0f, 1.0f, 0.0f}},
+            {{-0.5f, 0.5f,  0.0f}, {0.0f, 0.0f, 1.0f}}
+    };
+    std::vector<uint32_t> indices{0, 1, 2};
+    OptimizeMesh(vertices, indices);
+    // indices go in meshlet order, so every meshlet is a range of them
+    mTriangleMeshlets = BuildMeshlets(indices, vertices[0].position,
+                                      vertices.size(), sizeof(Vertex));
+    mTriangle = mMeshBuffer.Add(vertices,
+                                GetMeshletIndices(mTriangleMeshlets),
+                                VertexLayout::Deinterleaved);
+    mBatchTriangle = mDrawBatcher.RegisterMesh(mTriangle);
+    if (mQuantizedPipeline != VK_NULL_HANDLE) {
+        PackedMesh quad = PackMesh(GetQuadAttributes());
+        // size and precision lost next to the float attributes
+        if (ENABLE_ALLOCATION_TRACKING) {
+            PrintPackReport(std::cout, "quad", quad.report);
+        }
+        mQuad = mMeshBuffer.Add(quad, {0, 1, 2, 2, 1, 3});
+        mBatchQuad = mDrawBatcher.RegisterMesh(mQuad);
+    }
+    mMeshBuffer.Upload(mPhysicalDevice, mDevice, mAllocator, mCommandPool,
+                       mGraphicsQueue);
+    if (mMeshShadingSupported) {
+        mMeshletRenderer.Add(mTriangleMeshlets, mTriangle);
+        mMeshletRenderer.Upload(mCommandPool, mGraphicsQueue);
+    }
+}
+
+MeshAttributes HelloTriangleApplication::GetQuadAttributes() {
+    // clip space like the triangle, in the lower right corner and behind
+    // it, facing the viewer
+    MeshAttributes quad;
+    quad.name = "quad";
+    quad.positions = {0.55f, 0.55f, 0.5f,   0.85f, 0.55f, 0.5f,
+                      0.55f, 0.85f, 0.5f,   0.85f, 0.85f, 0.5f};
+    quad.normals = {0.0f, 0.0f, -1.0f,   0.0f, 0.0f, -1.0f,
+                    0.0f, 0.0f, -1.0f,   0.0f, 0.0f, -1.0f};
+    quad.uvs = {0.0f, 0.0f,   1.0f, 0.0f,   0.0f, 1.0f,   1.0f, 1.0f};
+    return quad;
+}
+
+void HelloTriangleApplication::CreateTextures() {
+    if (!mQuadTextured || mQuad.indexCount == 0) {
+        return;
+    }
+
+    VkSamplerCreateInfo samplerCreateInfo{};
+    samplerCreateInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerCreateInfo.magFilter = VK_FILTER_LINEAR;
+    samplerCreateInfo.minFilter = VK_FILTER_LINEAR;
+    samplerCreateInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    samplerCreateInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerCreateInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerCreateInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerCreateInfo.maxLod = VK_LOD_CLAMP_NONE;
+    {
+        AllocationTracker::ScopedTag tag(VK_OBJECT_TYPE_SAMPLER);
+        if (vkCreateSampler(mDevice, &samplerCreateInfo, mAllocator,
+                            &mQuadSampler) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create texture sampler");
+        }
+    }
+    mQuadSamplerHandle = mBindlessHeap.AddSampler(mQuadSampler);
+
+    TextureSource source;
+    if (std::ifstream(QUAD_TEXTURE_PATH).good()) {
+        source = MakeKtx2Source(
+                std::make_shared<const Ktx2Texture>(QUAD_TEXTURE_PATH),
+                mPhysicalDevice);
+        mQuadTextureExtent = {source.width, source.height};
+        mQuadTexture = mTextureStreamer.Add(std::move(source));
+        return;
+    }
+
+    // a checkerboard tinted per mip, so streaming shows on screen
+    source.format = VK_FORMAT_R8G8B8A8_UNORM;
+    source.width = QUAD_TEXTURE_SIZE;
+    source.height = QUAD_TEXTURE_SIZE;
+    source.mipCount = UINT32_MAX;
+    source.readMip = [](uint32_t mip, uint8_t *dst) {
+        const uint8_t tints[][3] = {{255, 255, 255}, {255, 96, 96},
+                                    {96, 255, 96}, {96, 96, 255},
+                                    {255, 255, 96}, {96, 255, 255}};
+        const uint8_t *tint = tints[mip % 6];
+        uint32_t size = std::max(QUAD_TEXTURE_SIZE >> mip, 1u);
+        uint32_t square = std::max(64u >> mip, 1u);
+        for (uint32_t y = 0; y < size; y++) {
+            for (uint32_t x = 0; x < size; x++) {
+                bool dark = ((x / square) + (y / square)) % 2 == 1;
+                for (int c = 0; c < 3; c++) {
+                    *dst++ = dark ? tint[c] / 4 : tint[c];
+                }
+                *dst++ = 255;
+            }
+        }
+    };
+    mQuadTextureExtent = {source.width, source.height};
+    mQuadTexture = mTextureStreamer.Add(std::move(source));
+}
+
+void HelloTriangleApplication::CreateCullObjects() {
+    if (!mGpuCullingSupported) {
+        return;
+    }
+    if (mTriangleMeshlets.meshlets.empty()) {
+        // the triangle is in clip space, inside the unit cube around 0
+        CullObject triangle;
+        triangle.radius = std::sqrt(3.0f);
+        triangle.indexCount = mTriangle.indexCount;
+        triangle.firstIndex = mTriangle.firstIndex;
+        triangle.vertexOffset = mTriangle.vertexOffset;
+        triangle.batch = 0;
+        mGpuCuller.Add(triangle);
+        return;
+    }
+    for (size_t i = 0; i < mTriangleMeshlets.meshlets.size(); i++) {
+        const Meshlet &meshlet = mTriangleMeshlets.meshlets[i];
+        const MeshletBounds &bounds = mTriangleMeshlets.bounds[i];
+        CullObject object;
+        std::copy(bounds.center, bounds.center + 3, object.center);
+        object.radius = bounds.radius;
+        std::copy(bounds.coneAxis, bounds.coneAxis + 3, object.coneAxis);
+        object.coneCutoff = bounds.coneCutoff;
+        object.indexCount = meshlet.triangleCount * 3;
+        object.firstIndex = mTriangle.firstIndex + meshlet.triangleOffset * 3;
+        object.vertexOffset = mTriangle.vertexOffset;
+        object.batch = 0;
+        mGpuCuller.Add(object);
+    }
+}
+
+void HelloTriangleApplication::CreateScene() {
+    // the triangle is in clip space, inside the unit cube around 0
+    bool triangleOnGpu = mGpuCullingSupported ||
+                         (mMeshShadingSupported &&
+                          mMeshletRenderer.GetMeshletCount() > 0);
+    mTransforms.Init(mJobSystem);
+    mSceneRoot = mTransforms.AddNode();
+    if (!triangleOnGpu) {
+        SceneNode node{mTransforms.AddNode(mSceneRoot), {0.0f, 0.0f, 0.0f},
+                       std::sqrt(3.0f)};
+        SceneDrawable drawable{mBatchPipeline, mBatchMaterial,
+                               mBatchTriangle};
+        mScene.Create(SceneCenterX{}, SceneCenterY{}, SceneCenterZ{},
+                      SceneRadius{}, node, drawable);
+    }
+    if (mQuad.indexCount > 0) {
+        // the node sits in the middle of the quad's vertices
+        SceneNode node{mTransforms.AddNode(mSceneRoot), {0.0f, 0.0f, 0.0f},
+                       0.22f};
+        const float translation[3]{0.7f, 0.7f, 0.5f};
+        mTransforms.SetTranslation(node.node, translation);
+        SceneDrawable drawable{mBatchQuantizedPipeline, mBatchMaterial,
+                               mBatchQuad};
+        mScene.Create(SceneCenterX{}, SceneCenterY{}, SceneCenterZ{},
+                      SceneRadius{}, node, drawable);
+    }
+}
+
+void HelloTriangleApplication::CreateCommandBuffers() {
+    mCommandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+
+    VkCommandBufferAllocateInfo commandBufferAllocateInfo{};
+    commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    commandBufferAllocateInfo.commandPool = mCommandPool;
+    commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    commandBufferAllocateInfo.commandBufferCount = mCommandBuffers.size();
+
+    // allocated through the pool's callbacks
+    AllocationTracker::ScopedTag tag(VK_OBJECT_TYPE_COMMAND_BUFFER);
+    if (vkAllocateCommandBuffers(mDevice, &commandBufferAllocateInfo,
+                                 mCommandBuffers.data()) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate command buffers");
+    }
+}
+
+void HelloTriangleApplication::CreateSyncObjects() {
+    mImageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
+    mRenderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
+    mInFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
+
+    VkSemaphoreCreateInfo semaphoreCreateInfo{};
+    semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    // signaled so the first frame does not wait forever
+    VkFenceCreateInfo fenceCreateInfo{};
+    fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        AllocationTracker::ScopedTag semaphoreTag(VK_OBJECT_TYPE_SEMAPHORE);
+        if (vkCreateSemaphore(mDevice, &semaphoreCreateInfo, mAllocator,
+                              &mImageAvailableSemaphores[i]) != VK_SUCCESS ||
+            vkCreateSemaphore(mDevice, &semaphoreCreateInfo, mAllocator,
+                              &mRenderFinishedSemaphores[i]) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create sync objects");
+        }
+        AllocationTracker::ScopedTag fenceTag(VK_OBJECT_TYPE_FENCE);
+        if (vkCreateFence(mDevice, &fenceCreateInfo, mAllocator,
+                          &mInFlightFences[i]) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create sync objects");
+        }
+    }
+}
+
+void HelloTriangleApplication::DrawFrame() {
+    vkWaitForFences(mDevice, 1, &mInFlightFences[mCurrentFrame], VK_TRUE,
+                    UINT64_MAX);
+
+    uint32_t imageIndex;
+    VkResult result = vkAcquireNextImageKHR(
+            mDevice, mSwapChain, UINT64_MAX,
+            mImageAvailableSemaphores[mCurrentFrame], VK_NULL_HANDLE,
+            &imageIndex);
+    if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+        RecreateSwapChain();
+        return;
+    } else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+        throw std::runtime_error("failed to acquire swap chain image");
+    }
+
+    // only reset once we know work will be submitted
+    vkResetFences(mDevice, 1, &mInFlightFences[mCurrentFrame]);
+    mTransientAllocator.NextFrame();
+    mDescriptorAllocator.NextFrame();
+    mDrawDataStream.NextFrame();
+    mMipGenerator.NextFrame();
+    if (mGpuCullingSupported) {
+        mGpuCuller.NextFrame();
+    }
+    if (mDescriptorIndexingSupported) {
+        mBindlessHeap.NextFrame();
+        mTextureStreamer.NextFrame();
+    }
+
+    VkCommandBuffer commandBuffer = mCommandBuffers[mCurrentFrame];
+    vkResetCommandBuffer(commandBuffer, 0);
+    RecordCommandBuffer(commandBuffer, imageIndex);
+
+    VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.waitSemaphoreCount = 1;
+    submitInfo.pWaitSemaphores = &mImageAvailableSemaphores[mCurrentFrame];
+    submitInfo.pWaitDstStageMask = &waitStage;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &mRenderFinishedSemaphores[mCurrentFrame];
+
+    if (vkQueueSubmit(mGraphicsQueue, 1, &submitInfo,
+                      mInFlightFences[mCurrentFrame]) != VK_SUCCESS) {
+        throw std::runtime_error("failed to submit draw command buffer");
+    }
+
+    VkPresentInfoKHR presentInfo{};
+    presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+    presentInfo.waitSemaphoreCount = 1;
+    presentInfo.pWaitSemaphores = &mRenderFinishedSemaphores[mCurrentFrame];
+    presentInfo.swapchainCount = 1;
+    presentInfo.pSwapchains = &mSwapChain;
+    presentInfo.pImageIndices = &imageIndex;
+
+    result = vkQueuePresentKHR(mPresentQueue, &presentInfo);
+    if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
+        RecreateSwapChain();
+    } else if (result != VK_SUCCESS) {
+        throw std::runtime_error("failed to present swap chain image");
+    }
+
+    mCurrentFrame = (mCurrentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+}
+
+void HelloTriangleApplication::RecordCommandBuffer(
+        VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
+    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+        throw std::runtime_error("failed to begin recording command buffer");
+    }
 
+    mRenderGraph.Reset();
+
+    // swap chain images come from the acquire semaphore wait, contents of
+    // the previous frame are not needed
+    RenderGraphImageInfo backBufferInfo;
+    backBufferInfo.image = mSwapChainImages[imageIndex];
+    backBufferInfo.view = mSwapChainImageViews[imageIndex];
+    backBufferInfo.format = mSwapChainImageFormat;
+    backBufferInfo.extent = mSwapChainExtent;
+    backBufferInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    backBufferInfo.initialStage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    RenderGraphHandle backBuffer = mRenderGraph.ImportImage("back buffer",
+                                                            backBufferInfo);
+    mRenderGraph.MarkOutput(backBuffer, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+                            VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0);
+
+    // placed by the transient allocator, lazily allocated when nothing
+    // samples it after the pass writing it
+    RenderGraphImageInfo depthInfo;
+    depthInfo.format = mDepthFormat;
+    depthInfo.extent = mSwapChainExtent;
+    depthInfo.aspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+    RenderGraphHandle depth = mRenderGraph.CreateImage("depth", depthInfo);
+
+    CullView view = GetCullView();
+    CullPhase firstPhase = mOcclusionCullingSupported ? CullPhase::Early
+                                                      : CullPhase::All;
+    RenderGraphHandle pyramid = 0;
+    if (mOcclusionCullingSupported) {
+        pyramid = mDepthPyramid.Import(mRenderGraph);
+    }
+    if (mGpuCullingSupported) {
+        mGpuCuller.AddCullPasses(mRenderGraph, view, firstPhase, pyramid);
+    }
 
+    mRenderGraph.AddPass(
+            "triangle",
+            [&](RenderGraph::PassBuilder &builder) {
+                VkClearValue clearColor{};
+                clearColor.color = {{0.0f, 0.0f, 0.0f, 1.0f}};
+                builder.Clear(backBuffer, RenderGraphUsage::ColorAttachment,
+                              clearColor);
+                VkClearValue clearDepth{};
+                clearDepth.depthStencil = {1.0f, 0};
+                builder.Clear(depth, RenderGraphUsage::DepthAttachment,
+                              clearDepth);
+                if (mGpuCullingSupported) {
+                    mGpuCuller.ReadDraws(builder, firstPhase);
+                }
+            },
+            [&, firstPhase](const RenderGraph::PassContext &context) {
+                BeginRendering(commandBuffer, imageIndex,
+                               context.GetImageView(depth),
+                               context.GetAttachmentOps(backBuffer),
+                               context.GetAttachmentOps(depth));
+                DrawScene(commandBuffer, firstPhase);
+                EndRendering(commandBuffer);
+            });
+
+    // objects that came into view since the last frame and were not
+    // hidden by what the early draws left in the depth buffer
+    if (mOcclusionCullingSupported) {
+        mDepthPyramid.AddBuildPass(mRenderGraph, depth, pyramid);
+        mGpuCuller.AddCullPasses(mRenderGraph, view, CullPhase::Late,
+                                 pyramid);
+        mRenderGraph.AddPass(
+                "late triangle",
+                [&](RenderGraph::PassBuilder &builder) {
+                    builder.Write(backBuffer,
+                                  RenderGraphUsage::ColorAttachment);
+                    builder.Write(depth, RenderGraphUsage::DepthAttachment);
+                    mGpuCuller.ReadDraws(builder, CullPhase::Late);
+                },
+                [&](const RenderGraph::PassContext &context) {
+                    BeginRendering(commandBuffer, imageIndex,
+                                   context.GetImageView(depth),
+                                   context.GetAttachmentOps(backBuffer),
+                                   context.GetAttachmentOps(depth));
+                    DrawScene(commandBuffer, CullPhase::Late);
+                    EndRendering(commandBuffer);
+                });
+    }
 
+    mRenderGraph.Compile(&mTransientAllocator);
+    mRenderGraph.Execute(commandBuffer);
+    if (mDescriptorIndexingSupported) {
+        mTextureStreamer.RecordFeedbackBarrier(commandBuffer);
+    }
 
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to record command buffer");
+    }
+}
 
+void HelloTriangleApplication::BeginRendering(
+        VkCommandBuffer commandBuffer, uint32_t imageIndex,
+        VkImageView depthView, const RenderGraphAttachmentOps &colorOps,
+        const RenderGraphAttachmentOps &depthOps) {
+    if (!mDynamicRenderingSupported) {
+        // the depth view stays the same while the graph's transient images
+        // do, so after the first frame this is a cache hit
+        FramebufferDesc framebufferDesc;
+        framebufferDesc.renderPass = mRenderPass;
+        framebufferDesc.attachments.push_back(mSwapChainImageViews[imageIndex]);
+        framebufferDesc.attachments.push_back(depthView);
+        framebufferDesc.extent = mSwapChainExtent;
+
+        VkClearValue clearValues[] {colorOps.clearValue, depthOps.clearValue};
+        VkRenderPassBeginInfo renderPassBeginInfo{};
+        renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        renderPassBeginInfo.renderPass = GetSwapChainRenderPass(colorOps,
+                                                                depthOps);
+        renderPassBeginInfo.framebuffer = mRenderPassCache.GetFramebuffer(
+                framebufferDesc);
+        renderPassBeginInfo.renderArea = {{0, 0}, mSwapChainExtent};
+        renderPassBeginInfo.clearValueCount = 2;
+        renderPassBeginInfo.pClearValues = clearValues;
+        vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo,
+                             VK_SUBPASS_CONTENTS_INLINE);
+        return;
+    }
+
+    VkRenderingAttachmentInfoKHR colorAttachmentInfo{};
+    colorAttachmentInfo.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
+    colorAttachmentInfo.imageView = mSwapChainImageViews[imageIndex];
+    colorAttachmentInfo.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    colorAttachmentInfo.loadOp = colorOps.loadOp;
+    colorAttachmentInfo.storeOp = colorOps.storeOp;
+    colorAttachmentInfo.clearValue = colorOps.clearValue;
+
+    VkRenderingAttachmentInfoKHR depthAttachmentInfo{};
+    depthAttachmentInfo.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
+    depthAttachmentInfo.imageView = depthView;
+    depthAttachmentInfo.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    depthAttachmentInfo.loadOp = depthOps.loadOp;
+    depthAttachmentInfo.storeOp = depthOps.storeOp;
+    depthAttachmentInfo.clearValue = depthOps.clearValue;
+
+    VkRenderingInfoKHR renderingInfo{};
+    renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR;
+    renderingInfo.renderArea = {{0, 0}, mSwapChainExtent};
+    renderingInfo.layerCount = 1;
+    renderingInfo.colorAttachmentCount = 1;
+    renderingInfo.pColorAttachments = &colorAttachmentInfo;
+    renderingInfo.pDepthAttachment = &depthAttachmentInfo;
+    mCmdBeginRendering(commandBuffer, &renderingInfo);
+}
+
+void HelloTriangleApplication::EndRendering(VkCommandBuffer commandBuffer) {
+    if (mDynamicRenderingSupported) {
+        mCmdEndRendering(commandBuffer);
+    } else {
+        vkCmdEndRenderPass(commandBuffer);
+    }
+}
+
+void HelloTriangleApplication::DrawScene(VkCommandBuffer commandBuffer,
+                                         CullPhase phase) {
+    VkViewport viewport{};
+    viewport.width = static_cast<float>(mSwapChainExtent.width);
+    viewport.height = static_cast<float>(mSwapChainExtent.height);
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+    VkRect2D scissor{{0, 0}, mSwapChainExtent};
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+    // meshes without meshlets still take the vertex pipeline
+    bool meshlets = mMeshShadingSupported &&
+                    mMeshletRenderer.GetMeshletCount() > 0;
+    if (meshlets) {
+        mMeshletRenderer.Draw(commandBuffer, mMeshBuffer, GetCullView());
+    }
+
+    if (mDescriptorIndexingSupported) {
+        mBindlessHeap.Bind(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                           mPipelineLayout);
+    }
+    if (!meshlets && mGpuCullingSupported) {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                          mGraphicsPipeline);
+        mMeshBuffer.Bind(commandBuffer, mTriangle.layout,
+                         mTriangle.indexType);
+        mGpuCuller.RecordDraws(commandBuffer, 0, phase);
+    }
+
+    // the rest of the scene is culled on the CPU once per frame, the late
+    // phase only draws what the GPU culler held back
+    if (phase == CullPhase::Late) {
+        return;
+    }
+    ExtractDraws();
+    if (mQuadTexture != INVALID_TEXTURE_HANDLE) {
+        // the quad covers 0.3 of the clip space's 2 along each side
+        if (!mTextureFeedbackSupported) {
+            mTextureStreamer.RequestScreenSize(
+                    mQuadTexture, 0.15f * std::max(mSwapChainExtent.width,
+                                                   mSwapChainExtent.height));
+        }
+        StreamedTextureDrawData textureData{
+                mTextureStreamer.GetDescriptor(mQuadTexture),
+                mQuadSamplerHandle, mTextureStreamer.GetFeedbackBuffer(),
+                mQuadTexture,
+                {static_cast<float>(mQuadTextureExtent.width),
+                 static_cast<float>(mQuadTextureExtent.height)}};
+        // DrawBatcher pushes only the QuantizedDrawData in front
+        vkCmdPushConstants(commandBuffer, mPipelineLayout,
+                           VK_SHADER_STAGE_ALL, sizeof(QuantizedDrawData),
+                           sizeof(textureData), &textureData);
+    }
+    mDrawBatcher.Submit(commandBuffer, mMeshBuffer, mDrawDataStream);
+}
+
+void HelloTriangleApplication::UpdateSceneBounds() {
+    mTransforms.Update();
+    mScene.ForEach<SceneNode, SceneCenterX, SceneCenterY, SceneCenterZ,
+                   SceneRadius>(
+            [&](uint32_t count, const Entity *, const SceneNode *nodes,
+                SceneCenterX *centerX, SceneCenterY *centerY,
+                SceneCenterZ *centerZ, SceneRadius *radius) {
+                for (uint32_t i = 0; i < count; i++) {
+                    const float *world =
+                            mTransforms.GetWorldMatrix(nodes[i].node);
+                    const float *center = nodes[i].center;
+                    float *worldCenter[3]{&centerX[i].value,
+                                          &centerY[i].value,
+                                          &centerZ[i].value};
+                    for (int row = 0; row < 3; row++) {
+                        const float *r = world + 4 * row;
+                        *worldCenter[row] = r[0] * center[0] +
+                                            r[1] * center[1] +
+                                            r[2] * center[2] + r[3];
+                    }
+                    // the radius grows with the longest scaled axis
+                    float scale = 0.0f;
+                    for (int column = 0; column < 3; column++) {
+                        float x = world[column];
+                        float y = world[4 + column];
+                        float z = world[8 + column];
+                        scale = std::max(scale, x * x + y * y + z * z);
+                    }
+                    radius[i].value = nodes[i].radius * std::sqrt(scale);
+                }
+            });
+}
+
+void HelloTriangleApplication::ExtractDraws() {
+    UpdateSceneBounds();
+    // the CPU culls instead of the GPU, a chunk of bounds at a time read
+    // where the chunk keeps them
+    static_assert(sizeof(SceneCenterX) == sizeof(float) &&
+                  sizeof(SceneRadius) == sizeof(float),
+                  "bounds components must be float arrays");
+    CullView view = GetCullView();
+    const float *matrix = view.viewProjection;
+    CullFrustum frustum = CullFrustum::FromViewProjection(matrix);
+    std::vector<uint32_t> visible;
+    mScene.ForEach<SceneCenterX, SceneCenterY, SceneCenterZ, SceneRadius,
+                   SceneDrawable>(
+            [&](uint32_t count, const Entity *, const SceneCenterX *centerX,
+                const SceneCenterY *centerY, const SceneCenterZ *centerZ,
+                const SceneRadius *radius, const SceneDrawable *drawables) {
+                visible.resize(count);
+                CullSphereBounds spheres{&centerX->value, &centerY->value,
+                                         &centerZ->value, &radius->value,
+                                         count};
+                uint32_t visibleCount = CullSpheres(frustum, spheres,
+                                                    visible.data());
+                for (uint32_t v = 0; v < visibleCount; v++) {
+                    uint32_t i = visible[v];
+                    // clip depth of the center
+                    float x = centerX[i].value;
+                    float y = centerY[i].value;
+                    float z = centerZ[i].value;
+                    float clipZ = matrix[2] * x + matrix[6] * y +
+                                  matrix[10] * z + matrix[14];
+                    float w = matrix[3] * x + matrix[7] * y +
+                              matrix[11] * z + matrix[15];
+                    // a center on or behind the eye plane sorts first,
+                    // z / w would be infinite or flip sign there, and so
+                    // does a NaN w
+                    float depth = 0.0f;
+                    if (w > 0.0f) {
+                        depth = std::min(std::max(clipZ / w, 0.0f), 1.0f);
+                    }
+                    mDrawBatcher.Add(drawables[i].pipeline,
+                                     drawables[i].material, drawables[i].mesh,
+                                     depth, nullptr);
+                }
+            });
+}
+
+CullView HelloTriangleApplication::GetCullView() const {
+    // no camera yet, clip space is world space and the triangle is seen
+    // from in front of it
+    return {{1.0f, 0.0f, 0.0f, 0.0f,
+             0.0f, 1.0f, 0.0f, 0.0f,
+             0.0f, 0.0f, 1.0f, 0.0f,
+             0.0f, 0.0f, 0.0f, 1.0f},
+            {0.0f, 0.0f, -1.0f}};
+}
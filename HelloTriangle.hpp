@@ -19,10 +19,35 @@
 #include <optional>
 #include <set>
 
+#include "AllocationTracker.hpp"
+#include "BindlessHeap.hpp"
+#include "CpuCuller.hpp"
+#include "DescriptorAllocator.hpp"
+#include "DepthPyramid.hpp"
+#include "DescriptorUpdater.hpp"
+#include "DrawBatcher.hpp"
+#include "DrawDataStream.hpp"
+#include "EntityWorld.hpp"
+#include "GpuCuller.hpp"
+#include "JobSystem.hpp"
+#include "Ktx2Texture.hpp"
+#include "MeshBuffer.hpp"
+#include "MeshOptimizer.hpp"
+#include "MeshletRenderer.hpp"
+#include "MipGenerator.hpp"
+#include "RenderGraph.hpp"
+#include "RenderPassCache.hpp"
+#include "SceneLoader.hpp"
+#include "TextureStreamer.hpp"
+#include "TransformHierarchy.hpp"
+#include "ValidationLogger.hpp"
+
 #ifdef NDEBUG
 #define ENABLE_VALIDATION_LAYERS false
+#define ENABLE_ALLOCATION_TRACKING false
 #else
 #define ENABLE_VALIDATION_LAYERS true
+#define ENABLE_ALLOCATION_TRACKING true
 #endif
 
 
@@ -39,6 +64,49 @@ void proxyDestroyDebugUtilsMessengerEXT(VkInstance instance,
 
 std::vector<char> ReadFile(const std::string& filename);
 
+/* World space bounding sphere of an entity, one component per value so
+ * that every chunk holds a float array of each, which is the layout
+ * CullSpheres reads */
+struct SceneCenterX {
+    float value;
+};
+
+struct SceneCenterY {
+    float value;
+};
+
+struct SceneCenterZ {
+    float value;
+};
+
+struct SceneRadius {
+    float value;
+};
+
+/* The TransformHierarchy node an entity sits at, its bounding sphere is
+ * this one moved by the node's world matrix */
+struct SceneNode {
+    uint32_t node;
+    float    center[3];
+    float    radius;
+};
+
+/* What an entity is drawn with, ids registered with the DrawBatcher */
+struct SceneDrawable {
+    uint32_t pipeline;
+    uint32_t material;
+    uint32_t mesh;
+};
+
+/* Push constants of the textured quad, they follow QuantizedDrawData */
+struct StreamedTextureDrawData {
+    BindlessHandle texture;
+    BindlessHandle sampler;
+    BindlessHandle feedback;
+    TextureHandle  streamedTexture;
+    float          size[2];
+};
+
 struct QueueFamilyIndices {
     std::optional<uint32_t> graphicsFamily;
     std::optional<uint32_t> presentFamily;
@@ -69,6 +137,9 @@ private:
     void InitWindow();
 
     void InitVulkan() {
+        if (ENABLE_VALIDATION_LAYERS) {
+            mValidationLogger.Start();
+        }
         CreateInstance();
         SetupDebugMessenger();
         CreateSurface();
@@ -76,13 +147,26 @@ private:
         CreateLogicalDevice();
         CreateSwapChain();
         CreateImageViews();
+        CreateDepthResources();
+        if (!mDynamicRenderingSupported) {
+            CreateRenderPass();
+        }
         CreateGraphicsPipeline();
+        CreateCommandPool();
+        CreateMeshes();
+        CreateTextures();
+        CreateCullObjects();
+        CreateScene();
+        CreateCommandBuffers();
+        CreateSyncObjects();
     }
 
     void MainLoop() {
         while (!glfwWindowShouldClose(mWindow)) {
             glfwPollEvents();
+            DrawFrame();
         }
+        vkDeviceWaitIdle(mDevice);
     }
 
     void CleanUp();
@@ -95,20 +179,114 @@ private:
 
     void PickPhysicalDevice();
 
+    /* Enables the bindless heap when the device can index partially bound,
+     * update-after-bind descriptor arrays */
+    void CheckDescriptorIndexingSupport();
+
+    /* Draws meshlets with task and mesh shaders when the device has
+     * VK_EXT_mesh_shader and the shaders were built */
+    void CheckMeshShaderSupport();
+
     void CreateLogicalDevice();
 
     void CreateSwapChain();
 
     void CreateImageViews();
 
+    /* Depth format of the swap chain passes, the depth buffer itself is
+     * a transient image of the render graph. The depth pyramid follows the
+     * swap chain size. */
+    void CreateDepthResources();
+
+    VkFormat FindDepthFormat();
+
+    void CreateRenderPass();
+
+    /* Swap chain render pass with depth for the load/store ops the graph
+     * picked, the graph does the layout transitions around it */
+    VkRenderPass GetSwapChainRenderPass(
+            const RenderGraphAttachmentOps &colorOps,
+            const RenderGraphAttachmentOps &depthOps);
+
     void CreateGraphicsPipeline();
 
+    void CreateCommandPool();
+
+    /* Fill the mesh buffer, needs the command pool for the upload. Loads
+     * SCENE_FILE_PATH instead when it exists, see SceneFile. */
+    void CreateMeshes();
+
+    /* A quad beside the triangle, packed with PackMesh for the quantized
+     * pipeline */
+    static MeshAttributes GetQuadAttributes();
+
+    /* Streams a texture into the quad when the textured shader was built,
+     * QUAD_TEXTURE_PATH when it exists, otherwise a checkerboard whose
+     * mips are generated on the fly */
+    void CreateTextures();
+
+    /* Hand the meshes to the GPU culler when it is enabled, one object
+     * per meshlet when they have meshlets */
+    void CreateCullObjects();
+
+    /* The entities the CPU draw path extracts its draws from, all but
+     * the ones the GPU culler or the meshlet renderer draw */
+    void CreateScene();
+
+    void CreateCommandBuffers();
+
+    void CreateSyncObjects();
+
+    void DrawFrame();
+
+    void RecordCommandBuffer(VkCommandBuffer commandBuffer,
+                             uint32_t imageIndex);
+
+    /* Start rendering into the swap chain image and the depth buffer,
+     * with dynamic rendering when the device has it and with a render
+     * pass otherwise */
+    void BeginRendering(VkCommandBuffer commandBuffer, uint32_t imageIndex,
+                        VkImageView depthView,
+                        const RenderGraphAttachmentOps &colorOps,
+                        const RenderGraphAttachmentOps &depthOps);
+
+    void EndRendering(VkCommandBuffer commandBuffer);
+
+    /* Record the draws of the scene culling left for phase, inside
+     * BeginRendering */
+    void DrawScene(VkCommandBuffer commandBuffer, CullPhase phase);
+
+    /* Update the world matrices and move the bounding spheres of the
+     * entities with a SceneNode along */
+    void UpdateSceneBounds();
+
+    /* Cull the scene's entities and queue the visible ones with the
+     * DrawBatcher */
+    void ExtractDraws();
+
+    /* Where the scene is seen from this frame */
+    CullView GetCullView() const;
+
+    /* Destroy everything depending on the swap chain images */
+    void CleanUpSwapChain();
+
+    void RecreateSwapChain();
+
     VkShaderModule CreateShaderModule(const std::vector<char> &code);
 
     bool IsDeviceSuitable(VkPhysicalDevice physicalDevice);
 
     bool CheckDeviceExtensionSupport(VkPhysicalDevice physicalDevice);
 
+    bool CheckDeviceExtensionSupport(
+            VkPhysicalDevice physicalDevice,
+            const std::vector<const char *> &extensions);
+
+    static bool CheckInstanceExtensionSupport(const char *extension);
+
+    /* Highest instance version supported by the loader, up to 1.2 */
+    static uint32_t GetInstanceApiVersion();
+
 
     QueueFamilyIndices FindQueueFamilies(VkPhysicalDevice physicalDevice);
 
@@ -133,8 +311,9 @@ private:
             const VkDebugUtilsMessengerCallbackDataEXT *pCallbackData,
             void *pUserData);
 
-    /* Generate a DebugUtilsMessengerCreateInfo and filled with data */
-    static void PopulateDebugUtilsMessengerCreateInfo(
+    /* Generate a DebugUtilsMessengerCreateInfo and filled with data,
+     * messages are forwarded to mValidationLogger */
+    void PopulateDebugUtilsMessengerCreateInfo(
             VkDebugUtilsMessengerCreateInfoEXT &createInfo);
 
 private:
@@ -153,15 +332,167 @@ private:
     VkExtent2D               mSwapChainExtent;
     std::vector<VkImageView> mSwapChainImageViews;
 
+    VkFormat mDepthFormat = VK_FORMAT_UNDEFINED;
+
+    // render passes and framebuffers are owned by the cache
+    RenderPassCache            mRenderPassCache;
+    VkRenderPass               mRenderPass = VK_NULL_HANDLE;
+
+    // rebuilt every frame, places all barriers and layout transitions
+    RenderGraph        mRenderGraph;
+    TransientAllocator mTransientAllocator;
+
+    VkPipelineLayout mPipelineLayout;
+    VkPipeline       mGraphicsPipeline;
+    // same layout, quantized vertices, VK_NULL_HANDLE without the shader
+    VkPipeline       mQuantizedPipeline = VK_NULL_HANDLE;
+
+    VkCommandPool                mCommandPool;
+    std::vector<VkCommandBuffer> mCommandBuffers;
+    std::vector<VkSemaphore>     mImageAvailableSemaphores;
+    std::vector<VkSemaphore>     mRenderFinishedSemaphores;
+    std::vector<VkFence>         mInFlightFences;
+    uint32_t                     mCurrentFrame = 0;
+
+    // VK_KHR_dynamic_rendering, render pass objects are used without it
+    bool                       mDynamicRenderingSupported = false;
+    PFN_vkCmdBeginRenderingKHR mCmdBeginRendering = nullptr;
+    PFN_vkCmdEndRenderingKHR   mCmdEndRendering = nullptr;
+
+    // core in 1.2, VK_EXT_descriptor_indexing before that
+    uint32_t               mApiVersion = VK_API_VERSION_1_0;
+    // lower of the instance and the picked device version
+    uint32_t               mDeviceApiVersion = VK_API_VERSION_1_0;
+    bool                   mDescriptorIndexingSupported = false;
+    BindlessHeap::Capacity mBindlessCapacity;
+    BindlessHeap           mBindlessHeap;
+
+    // per-frame and static sets for everything that is not bindless
+    DescriptorAllocator mDescriptorAllocator;
+    // core in 1.1, VK_KHR_descriptor_update_template before that
+    bool                mDescriptorUpdateTemplateSupported = false;
+    DescriptorUpdater   mDescriptorUpdater;
+
+    // per-draw data, push constants or slices of a per-frame ring
+    DrawDataStream mDrawDataStream;
+    uint32_t       mDrawDataSetIndex = 0;
+
+    // sorts and instances the draws the CPU records itself
+    DrawBatcher mDrawBatcher;
+    uint32_t    mBatchPipeline = 0;
+    uint32_t    mBatchMaterial = 0;
+    uint32_t    mBatchTriangle = 0;
+    uint32_t    mBatchQuantizedPipeline = 0;
+    uint32_t    mBatchQuad = 0;
+
+    // what the CPU draw path draws, entities with a bounding sphere and
+    // a SceneDrawable
+    EntityWorld mScene;
+    // where the scene's entities are, see SceneNode
+    TransformHierarchy mTransforms;
+    uint32_t           mSceneRoot = TransformHierarchy::NO_PARENT;
+
+    // every mesh lives in one buffer, see MeshBuffer
+    MeshBuffer  mMeshBuffer;
+    Mesh        mTriangle;
+    // empty for meshes from a scene file
+    MeshletData mTriangleMeshlets;
+    // no indices without the quantized pipeline or with a scene file
+    Mesh        mQuad;
+
+    // workers for asset loading, scene files stream through them
+    JobSystem   mJobSystem;
+    SceneLoader mSceneLoader;
+
+    // draws come from a culling compute pass when the device allows it
+    bool      mDrawIndirectCountSupported = false;
+    bool      mGpuCullingSupported = false;
+    GpuCuller mGpuCuller;
+
+    // two phase culling against a pyramid of the early draws' depth
+    bool         mOcclusionCullingSupported = false;
+    DepthPyramid mDepthPyramid;
+
+    // meshlets are culled and drawn by task and mesh shaders instead of
+    // the culling compute pass when the device has them
+    bool            mMeshShadingSupported = false;
+    MeshletRenderer mMeshletRenderer;
+
+    // fills mip chains on the GPU, with a compute pass where it can
+    MipGenerator mMipGenerator;
+
+    // textures live in the bindless heap, so streaming needs it too
+    TextureStreamer mTextureStreamer;
+    // fragmentStoresAndAtomics and non-uniform storage buffer indexing for
+    // texture_feedback.glsl, the CPU asks for the quad's mips without
+    bool            mTextureFeedbackSupported = false;
+    // the quantized pipeline samples the quad's texture
+    bool            mQuadTextured = false;
+    TextureHandle   mQuadTexture = INVALID_TEXTURE_HANDLE;
+    VkExtent2D      mQuadTextureExtent{};
+    VkSampler       mQuadSampler = VK_NULL_HANDLE;
+    BindlessHandle  mQuadSamplerHandle = INVALID_BINDLESS_HANDLE;
+
+    // validation messages are printed off the driver thread
+    ValidationLogger mValidationLogger{std::cerr};
+
+    // host allocations of the driver, nullptr when tracking is disabled
+    AllocationTracker            mAllocationTracker;
+    const VkAllocationCallbacks *mAllocator =
+            ENABLE_ALLOCATION_TRACKING ? mAllocationTracker.GetCallbacks()
+                                       : nullptr;
+
     const std::vector<const char *> mValidationLayers{
             "VK_LAYER_KHRONOS_validation"
     };
-    const std::vector<const char *> mDeviceExtensions{
+    // optional extensions are appended once the device is picked
+    std::vector<const char *> mDeviceExtensions{
             VK_KHR_SWAPCHAIN_EXTENSION_NAME
     };
+    const std::vector<const char *> mDynamicRenderingExtensions{
+            VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME,
+            VK_KHR_DEPTH_STENCIL_RESOLVE_EXTENSION_NAME,
+            VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME,
+            VK_KHR_MULTIVIEW_EXTENSION_NAME,
+            VK_KHR_MAINTENANCE2_EXTENSION_NAME
+    };
+    const std::vector<const char *> mDescriptorIndexingExtensions{
+            VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME,
+            VK_KHR_MAINTENANCE3_EXTENSION_NAME
+    };
+    // the last two are core in 1.2
+    const std::vector<const char *> mMeshShaderExtensions{
+            VK_EXT_MESH_SHADER_EXTENSION_NAME,
+            VK_KHR_SPIRV_1_4_EXTENSION_NAME,
+            VK_KHR_SHADER_FLOAT_CONTROLS_EXTENSION_NAME
+    };
 
     constexpr static const int WIDTH = 1280;
     constexpr static const int HEIGHT = 720;
+    constexpr static const int MAX_FRAMES_IN_FLIGHT = 2;
+    // baked with WriteSceneFile, relative to the working directory
+    constexpr static const char *SCENE_FILE_PATH = "scene.vksc";
+    // only there when glslc was found, see CMakeLists.txt
+    constexpr static const char *DOWNSAMPLE_SHADER_PATH =
+            "shaders/downsample.spv";
+    constexpr static const char *CULL_SHADER_PATH = "shaders/cull.spv";
+    constexpr static const char *CULL_OCCLUSION_SHADER_PATH =
+            "shaders/cull_occlusion.spv";
+    constexpr static const char *HIZ_SHADER_PATH = "shaders/hiz.spv";
+    constexpr static const char *QUANTIZED_SHADER_PATH =
+            "shaders/quantized.spv";
+    // any KTX2 file the Ktx2Texture loader takes
+    constexpr static const char *QUAD_TEXTURE_PATH = "textures/quad.ktx2";
+    constexpr static const char *TEXTURED_SHADER_PATH =
+            "shaders/textured.spv";
+    constexpr static const char *TEXTURED_FEEDBACK_SHADER_PATH =
+            "shaders/textured_feedback.spv";
+    constexpr static const char *MESHLET_TASK_SHADER_PATH =
+            "shaders/meshlet_task.spv";
+    constexpr static const char *MESHLET_MESH_SHADER_PATH =
+            "shaders/meshlet_mesh.spv";
+    constexpr static const uint32_t MAX_CULL_OBJECTS = 65536;
+    constexpr static const uint32_t QUAD_TEXTURE_SIZE = 1024;
 };
 
 #endif //VULKAN_TEST_HELLOTRIANGLE_HPP
@@ -0,0 +1,143 @@
+//
+// Created by Krisu on 2020/4/14.
+//
+
+#include "JobSystem.hpp"
+
+#include <algorithm>
+
+JobSystem::JobSystem(uint32_t threadCount) {
+    if (threadCount == 0) {
+        uint32_t hardwareThreads = std::thread::hardware_concurrency();
+        threadCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+    }
+    for (uint32_t i = 0; i < threadCount; i++) {
+        mThreads.emplace_back(&JobSystem::WorkerLoop, this);
+    }
+}
+
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStopping = true;
+    }
+    mWorkAvailable.notify_all();
+    for (auto &thread : mThreads) {
+        thread.join();
+    }
+}
+
+void JobSystem::Submit(std::function<void()> job) {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mQueue.push_back(std::move(job));
+        mPending++;
+    }
+    mWorkAvailable.notify_one();
+}
+
+void JobSystem::Wait() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (mPending > 0) {
+        if (!RunOne(lock)) {
+            // the rest is running on the workers
+            mWorkDone.wait(lock, [this] {
+                return mPending == 0 || !mQueue.empty();
+            });
+        }
+    }
+    if (mException) {
+        std::exception_ptr exception = mException;
+        mException = nullptr;
+        std::rethrow_exception(exception);
+    }
+}
+
+void JobSystem::ParallelFor(size_t count, size_t batchSize,
+                            const std::function<void(size_t, size_t)> &fn) {
+    batchSize = std::max<size_t>(batchSize, 1);
+    size_t batchCount = (count + batchSize - 1) / batchSize;
+    if (batchCount == 0) {
+        return;
+    }
+
+    // counts the batches of this call only, guarded by mMutex
+    struct Latch {
+        size_t             remaining;
+        std::exception_ptr exception;
+    };
+    Latch latch{batchCount, nullptr};
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    for (size_t begin = 0; begin < count; begin += batchSize) {
+        size_t end = std::min(begin + batchSize, count);
+        mQueue.push_back([this, &fn, &latch, begin, end] {
+            std::exception_ptr exception;
+            try {
+                fn(begin, end);
+            } catch (...) {
+                exception = std::current_exception();
+            }
+            std::lock_guard<std::mutex> latchLock(mMutex);
+            if (exception && !latch.exception) {
+                latch.exception = exception;
+            }
+            if (--latch.remaining == 0) {
+                mWorkDone.notify_all();
+            }
+        });
+    }
+    mPending += batchCount;
+    mWorkAvailable.notify_all();
+
+    // whatever is queued gets run meanwhile, so a job calling this
+    // cannot starve the pool
+    while (latch.remaining > 0) {
+        if (!RunOne(lock)) {
+            mWorkDone.wait(lock, [&latch, this] {
+                return latch.remaining == 0 || !mQueue.empty();
+            });
+        }
+    }
+    if (latch.exception) {
+        std::rethrow_exception(latch.exception);
+    }
+}
+
+void JobSystem::WorkerLoop() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (true) {
+        mWorkAvailable.wait(lock, [this] {
+            return mStopping || !mQueue.empty();
+        });
+        if (mStopping && mQueue.empty()) {
+            return;
+        }
+        RunOne(lock);
+    }
+}
+
+bool JobSystem::RunOne(std::unique_lock<std::mutex> &lock) {
+    if (mQueue.empty()) {
+        return false;
+    }
+    std::function<void()> job = std::move(mQueue.front());
+    mQueue.pop_front();
+
+    lock.unlock();
+    std::exception_ptr exception;
+    try {
+        job();
+    } catch (...) {
+        exception = std::current_exception();
+    }
+    lock.lock();
+
+    if (exception && !mException) {
+        mException = exception;
+    }
+    if (--mPending == 0) {
+        mWorkDone.notify_all();
+    }
+    return true;
+}
@@ -0,0 +1,64 @@
+//
+// Created by Krisu on 2020/4/14.
+//
+
+#ifndef VULKAN_TEST_JOBSYSTEM_HPP
+#define VULKAN_TEST_JOBSYSTEM_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+/* A fixed pool of worker threads running submitted jobs. Threads calling
+ * Wait or ParallelFor help with the queue instead of sleeping. The first
+ * exception thrown by a submitted job is rethrown from Wait. */
+class JobSystem {
+public:
+    /* threadCount 0 uses one worker less than there are hardware threads */
+    explicit JobSystem(uint32_t threadCount = 0);
+
+    ~JobSystem();
+
+    JobSystem(const JobSystem &) = delete;
+
+    JobSystem &operator=(const JobSystem &) = delete;
+
+    void Submit(std::function<void()> job);
+
+    /* Returns once every job submitted so far has finished */
+    void Wait();
+
+    /* fn(begin, end) over [0, count) in batches of batchSize, waits for
+     * these batches only and rethrows the first exception one of them
+     * threw. Safe to call from inside a job. */
+    void ParallelFor(size_t count, size_t batchSize,
+                     const std::function<void(size_t, size_t)> &fn);
+
+    /* Workers plus the waiting thread */
+    uint32_t GetConcurrency() const { return mThreads.size() + 1; }
+
+private:
+    void WorkerLoop();
+
+    /* Run one queued job, false when the queue was empty */
+    bool RunOne(std::unique_lock<std::mutex> &lock);
+
+private:
+    std::vector<std::thread>          mThreads;
+    std::mutex                        mMutex;
+    std::condition_variable           mWorkAvailable;
+    std::condition_variable           mWorkDone;
+    std::deque<std::function<void()>> mQueue;
+    size_t                            mPending = 0;
+    bool                              mStopping = false;
+    std::exception_ptr                mException;
+};
+
+#endif //VULKAN_TEST_JOBSYSTEM_HPP
@@ -0,0 +1,157 @@
+//
+// Created by Krisu on 2020/4/16.
+//
+
+#include "Ktx2Texture.hpp"
+#include "BlockDecoder.hpp"
+#include "VulkanUtils.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+constexpr uint8_t KTX2_IDENTIFIER[12]{
+        0xab, 0x4b, 0x54, 0x58, 0x20, 0x32, 0x30, 0xbb, 0x0d, 0x0a, 0x1a, 0x0a
+};
+
+struct Ktx2Header {
+    uint8_t  identifier[12];
+    uint32_t vkFormat;
+    uint32_t typeSize;
+    uint32_t pixelWidth;
+    uint32_t pixelHeight;
+    uint32_t pixelDepth;
+    uint32_t layerCount;
+    uint32_t faceCount;
+    uint32_t levelCount;
+    uint32_t supercompressionScheme;
+    uint32_t dfdByteOffset;
+    uint32_t dfdByteLength;
+    uint32_t kvdByteOffset;
+    uint32_t kvdByteLength;
+    uint64_t sgdByteOffset;
+    uint64_t sgdByteLength;
+};
+
+struct Ktx2Level {
+    uint64_t byteOffset;
+    uint64_t byteLength;
+    uint64_t uncompressedByteLength;
+};
+
+static_assert(sizeof(Ktx2Header) == 80, "ktx2 header must not contain padding");
+static_assert(sizeof(Ktx2Level) == 24, "ktx2 level must not contain padding");
+
+}
+
+Ktx2Texture::Ktx2Texture(const std::string &path) : mFile(path) {
+    const uint8_t *data = mFile.GetData();
+    size_t size = mFile.GetSize();
+
+    Ktx2Header header;
+    if (size < sizeof(header)) {
+        throw std::runtime_error("failed to read ktx2 header");
+    }
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.identifier, KTX2_IDENTIFIER,
+                    sizeof(KTX2_IDENTIFIER)) != 0) {
+        throw std::runtime_error("file is not a ktx2 texture");
+    }
+    if (header.supercompressionScheme != 0) {
+        throw std::runtime_error("supercompressed ktx2 is not supported");
+    }
+    if (header.pixelDepth > 1 || header.layerCount > 1 ||
+        header.faceCount != 1) {
+        throw std::runtime_error("ktx2 texture must be a single 2D image");
+    }
+    mFormat = static_cast<VkFormat>(header.vkFormat);
+    mWidth = header.pixelWidth;
+    mHeight = std::max(header.pixelHeight, 1u);
+    if (GetFormatBlock(mFormat).bytes == 0 || mWidth == 0) {
+        throw std::runtime_error("ktx2 texture format is not supported");
+    }
+
+    // zero levels asks the loader to generate them, there is only the base
+    mNeedsMipGeneration = header.levelCount == 0;
+    uint32_t levelCount = std::max(header.levelCount, 1u);
+    uint32_t largest = std::max(mWidth, mHeight);
+    if (levelCount > 32 || (largest >> (levelCount - 1)) == 0) {
+        throw std::runtime_error("ktx2 texture has too many levels");
+    }
+    if (size < sizeof(header) + levelCount * sizeof(Ktx2Level)) {
+        throw std::runtime_error("failed to read ktx2 level index");
+    }
+    for (uint32_t mip = 0; mip < levelCount; mip++) {
+        Ktx2Level level;
+        std::memcpy(&level, data + sizeof(header) + mip * sizeof(level),
+                    sizeof(level));
+        if (level.byteLength != ::GetMipSize(mFormat, mWidth, mHeight, mip)) {
+            throw std::runtime_error("ktx2 level has the wrong size");
+        }
+        if (level.byteOffset > size ||
+            level.byteLength > size - level.byteOffset) {
+            throw std::runtime_error("ktx2 level is out of bounds");
+        }
+        mMips.push_back({level.byteOffset, level.byteLength});
+    }
+}
+
+const uint8_t *Ktx2Texture::GetMipData(uint32_t mip) const {
+    return mFile.GetData() + mMips.at(mip).offset;
+}
+
+VkDeviceSize Ktx2Texture::GetMipSize(uint32_t mip) const {
+    return mMips.at(mip).size;
+}
+
+VkFormat ChooseTextureFormat(VkPhysicalDevice physicalDevice, VkFormat format) {
+    const VkFormatFeatureFlags required =
+            VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT |
+            VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    for (VkFormat candidate : {format, GetDecodedFormat(format)}) {
+        if (candidate == VK_FORMAT_UNDEFINED) {
+            continue;
+        }
+        VkFormatProperties properties;
+        vkGetPhysicalDeviceFormatProperties(physicalDevice, candidate,
+                                            &properties);
+        if ((properties.optimalTilingFeatures & required) == required) {
+            return candidate;
+        }
+    }
+    return VK_FORMAT_UNDEFINED;
+}
+
+TextureSource MakeKtx2Source(std::shared_ptr<const Ktx2Texture> texture,
+                             VkPhysicalDevice physicalDevice) {
+    VkFormat format = ChooseTextureFormat(physicalDevice,
+                                          texture->GetFormat());
+    if (format == VK_FORMAT_UNDEFINED) {
+        throw std::runtime_error("failed to find a format to sample texture");
+    }
+
+    TextureSource source;
+    source.format = format;
+    source.width = texture->GetWidth();
+    source.height = texture->GetHeight();
+    source.mipCount = texture->GetMipCount();
+    // the streamer clamps the count to the full chain
+    if (texture->NeedsMipGeneration()) {
+        source.mipCount = UINT32_MAX;
+        source.generateMips = true;
+    }
+    bool decode = format != texture->GetFormat();
+    source.readMip = [texture, decode](uint32_t mip, uint8_t *dst) {
+        if (decode) {
+            DecodeBlocks(texture->GetFormat(), texture->GetMipData(mip),
+                         std::max(texture->GetWidth() >> mip, 1u),
+                         std::max(texture->GetHeight() >> mip, 1u), dst);
+        } else {
+            std::memcpy(dst, texture->GetMipData(mip),
+                        texture->GetMipSize(mip));
+        }
+    };
+    return source;
+}
@@ -0,0 +1,69 @@
+//
+// Created by Krisu on 2020/4/16.
+//
+
+#ifndef VULKAN_TEST_KTX2TEXTURE_HPP
+#define VULKAN_TEST_KTX2TEXTURE_HPP
+
+#include <vulkan/vulkan.h>
+
+#include "MappedFile.hpp"
+#include "TextureStreamer.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+/* A mapped KTX2 file holding one 2D image and its mips. The mips point
+ * into the mapping, nothing is copied until a mip is read. A level count
+ * of zero in the header means only the base level is stored and the
+ * other mips are to be generated.
+ *
+ * Only files without supercompression, layers, faces or depth load;
+ * anything else throws. */
+class Ktx2Texture {
+public:
+    explicit Ktx2Texture(const std::string &path);
+
+    VkFormat GetFormat() const { return mFormat; }
+
+    uint32_t GetWidth() const { return mWidth; }
+
+    uint32_t GetHeight() const { return mHeight; }
+
+    uint32_t GetMipCount() const { return mMips.size(); }
+
+    /* The file asks for the mips below the base level to be generated */
+    bool NeedsMipGeneration() const { return mNeedsMipGeneration; }
+
+    const uint8_t *GetMipData(uint32_t mip) const;
+
+    VkDeviceSize GetMipSize(uint32_t mip) const;
+
+private:
+    struct Mip {
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    MappedFile       mFile;
+    VkFormat         mFormat = VK_FORMAT_UNDEFINED;
+    uint32_t         mWidth = 0;
+    uint32_t         mHeight = 0;
+    bool             mNeedsMipGeneration = false;
+    std::vector<Mip> mMips;
+};
+
+/* format when the device can sample and filter it, otherwise the format
+ * it decodes to on the CPU, VK_FORMAT_UNDEFINED when neither works */
+VkFormat ChooseTextureFormat(VkPhysicalDevice physicalDevice, VkFormat format);
+
+/* A source for TextureStreamer::Add streaming the mips of texture, block
+ * compressed data the device can not sample is decoded on the workers.
+ * Textures without stored mips get theirs from the MipGenerator. */
+TextureSource MakeKtx2Source(std::shared_ptr<const Ktx2Texture> texture,
+                             VkPhysicalDevice physicalDevice);
+
+#endif //VULKAN_TEST_KTX2TEXTURE_HPP
@@ -0,0 +1,163 @@
+//
+// Created by Krisu on 2020/4/14.
+//
+
+#include "Lz4.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+constexpr size_t MIN_MATCH = 4;
+// the format wants the last 5 bytes as literals and no match starting in
+// the last 12 bytes
+constexpr size_t LAST_LITERALS = 5;
+constexpr size_t MATCH_LIMIT = 12;
+constexpr size_t MAX_OFFSET = 65535;
+constexpr int    HASH_BITS = 16;
+
+uint32_t Read32(const uint8_t *p) {
+    uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+uint32_t Hash(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - HASH_BITS);
+}
+
+void WriteLength(std::vector<uint8_t> &dst, size_t length) {
+    while (length >= 255) {
+        dst.push_back(255);
+        length -= 255;
+    }
+    dst.push_back(static_cast<uint8_t>(length));
+}
+
+void WriteSequence(std::vector<uint8_t> &dst, const uint8_t *literals,
+                   size_t literalLength, size_t offset, size_t matchLength) {
+    size_t token = std::min<size_t>(literalLength, 15) << 4;
+    if (matchLength >= MIN_MATCH) {
+        token |= std::min<size_t>(matchLength - MIN_MATCH, 15);
+    }
+    dst.push_back(static_cast<uint8_t>(token));
+    if (literalLength >= 15) {
+        WriteLength(dst, literalLength - 15);
+    }
+    dst.insert(dst.end(), literals, literals + literalLength);
+    if (matchLength >= MIN_MATCH) {
+        dst.push_back(static_cast<uint8_t>(offset & 0xff));
+        dst.push_back(static_cast<uint8_t>(offset >> 8));
+        if (matchLength - MIN_MATCH >= 15) {
+            WriteLength(dst, matchLength - MIN_MATCH - 15);
+        }
+    }
+}
+
+bool ReadLength(const uint8_t *&src, const uint8_t *srcEnd, size_t &length) {
+    uint8_t byte;
+    do {
+        if (src == srcEnd) {
+            return false;
+        }
+        byte = *src++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+}
+
+std::vector<uint8_t> Lz4Compress(const uint8_t *src, size_t size) {
+    std::vector<uint8_t> dst;
+    dst.reserve(size);
+    std::vector<uint32_t> table(size_t(1) << HASH_BITS, UINT32_MAX);
+
+    size_t anchor = 0;
+    size_t pos = 0;
+    if (size >= MATCH_LIMIT + 1) {
+        size_t matchEnd = size - LAST_LITERALS;
+        while (pos + MATCH_LIMIT <= size) {
+            uint32_t sequence = Read32(src + pos);
+            uint32_t h = Hash(sequence);
+            uint32_t candidate = table[h];
+            table[h] = static_cast<uint32_t>(pos);
+            if (candidate == UINT32_MAX || pos - candidate > MAX_OFFSET ||
+                Read32(src + candidate) != sequence) {
+                pos++;
+                continue;
+            }
+
+            size_t length = MIN_MATCH;
+            while (pos + length < matchEnd &&
+                   src[candidate + length] == src[pos + length]) {
+                length++;
+            }
+            WriteSequence(dst, src + anchor, pos - anchor, pos - candidate,
+                          length);
+            pos += length;
+            anchor = pos;
+            if (dst.size() >= size) {
+                return {};
+            }
+        }
+    }
+    WriteSequence(dst, src + anchor, size - anchor, 0, 0);
+    if (dst.size() >= size) {
+        return {};
+    }
+    return dst;
+}
+
+bool Lz4Decompress(const uint8_t *src, size_t srcSize, uint8_t *dst,
+                   size_t dstSize) {
+    const uint8_t *srcEnd = src + srcSize;
+    uint8_t *out = dst;
+    uint8_t *outEnd = dst + dstSize;
+
+    while (src < srcEnd) {
+        uint8_t token = *src++;
+
+        size_t literalLength = token >> 4;
+        if (literalLength == 15 && !ReadLength(src, srcEnd, literalLength)) {
+            return false;
+        }
+        if (literalLength > static_cast<size_t>(srcEnd - src) ||
+            literalLength > static_cast<size_t>(outEnd - out)) {
+            return false;
+        }
+        std::memcpy(out, src, literalLength);
+        src += literalLength;
+        out += literalLength;
+
+        // the last sequence has no match
+        if (src == srcEnd) {
+            break;
+        }
+
+        if (srcEnd - src < 2) {
+            return false;
+        }
+        size_t offset = src[0] | (src[1] << 8);
+        src += 2;
+        if (offset == 0 || offset > static_cast<size_t>(out - dst)) {
+            return false;
+        }
+        size_t matchLength = token & 0xf;
+        if (matchLength == 15 && !ReadLength(src, srcEnd, matchLength)) {
+            return false;
+        }
+        matchLength += MIN_MATCH;
+        if (matchLength > static_cast<size_t>(outEnd - out)) {
+            return false;
+        }
+        // byte by byte, the match may overlap what it is writing
+        const uint8_t *match = out - offset;
+        for (size_t i = 0; i < matchLength; i++) {
+            out[i] = match[i];
+        }
+        out += matchLength;
+    }
+    return out == outEnd;
+}
@@ -0,0 +1,25 @@
+//
+// Created by Krisu on 2020/4/14.
+//
+
+#ifndef VULKAN_TEST_LZ4_HPP
+#define VULKAN_TEST_LZ4_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+/* LZ4 block format, compatible with LZ4_decompress_safe. The compressor
+ * is a plain greedy one with a single hash table, fast enough for asset
+ * baking, the decompressor is what matters at load time. */
+
+/* Empty when the data does not get smaller */
+std::vector<uint8_t> Lz4Compress(const uint8_t *src, size_t size);
+
+/* False when src is malformed or does not decode to exactly dstSize
+ * bytes */
+bool Lz4Decompress(const uint8_t *src, size_t srcSize, uint8_t *dst,
+                   size_t dstSize);
+
+#endif //VULKAN_TEST_LZ4_HPP
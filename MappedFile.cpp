@@ -0,0 +1,95 @@
+//
+// Created by Krisu on 2020/4/15.
+//
+
+#include "MappedFile.hpp"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string &path) {
+    mFile = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                        OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (mFile == INVALID_HANDLE_VALUE) {
+        mFile = nullptr;
+        throw std::runtime_error("failed to open " + path);
+    }
+    LARGE_INTEGER size;
+    GetFileSizeEx(mFile, &size);
+    mSize = static_cast<size_t>(size.QuadPart);
+    if (mSize == 0) {
+        return;
+    }
+    mMapping = CreateFileMappingA(mFile, nullptr, PAGE_READONLY, 0, 0,
+                                  nullptr);
+    if (mMapping != nullptr) {
+        mData = static_cast<const uint8_t *>(
+                MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+    }
+    if (mData == nullptr) {
+        if (mMapping != nullptr) {
+            CloseHandle(mMapping);
+        }
+        CloseHandle(mFile);
+        throw std::runtime_error("failed to map " + path);
+    }
+}
+
+MappedFile::~MappedFile() {
+    if (mData != nullptr) {
+        UnmapViewOfFile(mData);
+    }
+    if (mMapping != nullptr) {
+        CloseHandle(mMapping);
+    }
+    if (mFile != nullptr) {
+        CloseHandle(mFile);
+    }
+}
+
+#else
+
+MappedFile::MappedFile(const std::string &path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("failed to open " + path);
+    }
+    struct stat status{};
+    if (fstat(fd, &status) != 0) {
+        close(fd);
+        throw std::runtime_error("failed to stat " + path);
+    }
+    mSize = status.st_size;
+    if (mSize == 0) {
+        close(fd);
+        return;
+    }
+    void *data = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping keeps the file alive
+    close(fd);
+    if (data == MAP_FAILED) {
+        throw std::runtime_error("failed to map " + path);
+    }
+    // chunks are read front to back
+    madvise(data, mSize, MADV_SEQUENTIAL);
+    mData = static_cast<const uint8_t *>(data);
+}
+
+MappedFile::~MappedFile() {
+    if (mData != nullptr) {
+        munmap(const_cast<uint8_t *>(mData), mSize);
+    }
+}
+
+#endif
@@ -0,0 +1,37 @@
+//
+// Created by Krisu on 2020/4/15.
+//
+
+#ifndef VULKAN_TEST_MAPPEDFILE_HPP
+#define VULKAN_TEST_MAPPEDFILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+
+/* A read only mapping of a whole file */
+class MappedFile {
+public:
+    explicit MappedFile(const std::string &path);
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const uint8_t *GetData() const { return mData; }
+
+    size_t GetSize() const { return mSize; }
+
+private:
+    const uint8_t *mData = nullptr;
+    size_t         mSize = 0;
+#ifdef _WIN32
+    void          *mFile = nullptr;
+    void          *mMapping = nullptr;
+#endif
+};
+
+#endif //VULKAN_TEST_MAPPEDFILE_HPP
@@ -0,0 +1,206 @@
+//
+// Created by Krisu on 2020/4/13.
+//
+
+#include "MeshBuffer.hpp"
+#include "VulkanUtils.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+
+Mesh MeshBuffer::Add(const std::vector<Vertex> &vertices,
+                     const std::vector<uint32_t> &indices,
+                     VertexLayout layout, bool force32BitIndices) {
+    Mesh mesh;
+    mesh.layout = layout;
+    mesh.indexCount = indices.size();
+
+    if (layout == VertexLayout::Interleaved) {
+        auto &section = mSections[INTERLEAVED];
+        mesh.vertexOffset = section.size() / sizeof(Vertex);
+        Append(section, vertices.data(), vertices.size() * sizeof(Vertex));
+    } else {
+        auto &positions = mSections[POSITIONS];
+        auto &attributes = mSections[ATTRIBUTES];
+        mesh.vertexOffset = positions.size() / sizeof(Vertex::position);
+        for (const auto &vertex : vertices) {
+            Append(positions, vertex.position, sizeof(vertex.position));
+            Append(attributes, vertex.color, sizeof(vertex.color));
+        }
+    }
+
+    AddIndices(mesh, vertices.size(), indices, force32BitIndices);
+    return mesh;
+}
+
+Mesh MeshBuffer::Add(const PackedMesh &packed,
+                     const std::vector<uint32_t> &indices,
+                     bool force32BitIndices) {
+    if (mQuantizedStride != 0 && mQuantizedStride != packed.stride) {
+        throw std::runtime_error("quantized meshes differ in vertex format");
+    }
+    mQuantizedStride = packed.stride;
+
+    Mesh mesh;
+    mesh.layout = VertexLayout::Quantized;
+    mesh.indexCount = indices.size();
+    auto &section = mSections[QUANTIZED];
+    mesh.vertexOffset = section.size() / packed.stride;
+    std::copy(packed.boundsMin, packed.boundsMin + 3, mesh.boundsMin);
+    std::copy(packed.boundsExtent, packed.boundsExtent + 3,
+              mesh.boundsExtent);
+    Append(section, packed.vertices.data(), packed.vertices.size());
+    AddIndices(mesh, packed.vertexCount, indices, force32BitIndices);
+    return mesh;
+}
+
+void MeshBuffer::Upload(VkPhysicalDevice physicalDevice, VkDevice device,
+                        const VkAllocationCallbacks *pAllocator,
+                        VkCommandPool commandPool, VkQueue queue) {
+    VkDeviceSize sectionSizes[SECTION_COUNT];
+    for (int i = 0; i < SECTION_COUNT; i++) {
+        sectionSizes[i] = mSections[i].size();
+    }
+    Allocate(physicalDevice, device, pAllocator, sectionSizes);
+    if (mBuffer == VK_NULL_HANDLE) {
+        return;
+    }
+
+    std::vector<uint8_t> data;
+    for (int i = 0; i < SECTION_COUNT; i++) {
+        data.resize(mSectionOffsets[i]);
+        data.insert(data.end(), mSections[i].begin(), mSections[i].end());
+    }
+    UploadBuffer(physicalDevice, mDevice, mAllocator, commandPool, queue,
+                 data.data(), data.size(), mBuffer);
+}
+
+void MeshBuffer::Allocate(VkPhysicalDevice physicalDevice, VkDevice device,
+                          const VkAllocationCallbacks *pAllocator,
+                          const VkDeviceSize sectionSizes[SECTION_COUNT]) {
+    Destroy();
+    mDevice = device;
+    mAllocator = pAllocator;
+
+    // 16 bytes keeps every section aligned for its element type
+    VkDeviceSize size = 0;
+    for (int i = 0; i < SECTION_COUNT; i++) {
+        size = (size + 15) / 16 * 16;
+        mSectionOffsets[i] = size;
+        size += sectionSizes[i];
+    }
+    if (size == 0) {
+        return;
+    }
+
+    // mesh shaders fetch the vertices as a storage buffer
+    CreateBuffer(physicalDevice, mDevice, mAllocator, size,
+                 VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+                 VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                 VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mBuffer, mMemory);
+}
+
+void MeshBuffer::Destroy() {
+    if (mBuffer == VK_NULL_HANDLE) {
+        return;
+    }
+    vkDestroyBuffer(mDevice, mBuffer, mAllocator);
+    vkFreeMemory(mDevice, mMemory, mAllocator);
+    mBuffer = VK_NULL_HANDLE;
+    mMemory = VK_NULL_HANDLE;
+}
+
+void MeshBuffer::Bind(VkCommandBuffer commandBuffer, VertexLayout layout,
+                      VkIndexType indexType, bool positionOnly) const {
+    VkBuffer buffers[2]{mBuffer, mBuffer};
+    if (layout == VertexLayout::Interleaved) {
+        vkCmdBindVertexBuffers(commandBuffer, 0, 1, buffers,
+                               &mSectionOffsets[INTERLEAVED]);
+    } else if (layout == VertexLayout::Quantized) {
+        // positions come first in a packed vertex
+        vkCmdBindVertexBuffers(commandBuffer, 0, 1, buffers,
+                               &mSectionOffsets[QUANTIZED]);
+    } else {
+        // positions and attributes are adjacent sections
+        vkCmdBindVertexBuffers(commandBuffer, 0, positionOnly ? 1 : 2,
+                               buffers, &mSectionOffsets[POSITIONS]);
+    }
+    vkCmdBindIndexBuffer(commandBuffer, mBuffer,
+                         mSectionOffsets[indexType == VK_INDEX_TYPE_UINT16
+                                         ? INDICES_16 : INDICES_32],
+                         indexType);
+}
+
+void MeshBuffer::Draw(VkCommandBuffer commandBuffer, const Mesh &mesh,
+                      uint32_t instanceCount) {
+    vkCmdDrawIndexed(commandBuffer, mesh.indexCount, instanceCount,
+                     mesh.firstIndex, mesh.vertexOffset, 0);
+}
+
+std::vector<VkVertexInputBindingDescription>
+MeshBuffer::GetBindingDescriptions(VertexLayout layout, bool positionOnly) {
+    if (layout == VertexLayout::Quantized) {
+        throw std::runtime_error("quantized meshes carry their vertex input");
+    }
+    if (layout == VertexLayout::Interleaved) {
+        return {{0, sizeof(Vertex), VK_VERTEX_INPUT_RATE_VERTEX}};
+    }
+    std::vector<VkVertexInputBindingDescription> bindings{
+            {0, sizeof(Vertex::position), VK_VERTEX_INPUT_RATE_VERTEX}
+    };
+    if (!positionOnly) {
+        bindings.push_back({1, sizeof(Vertex::color),
+                            VK_VERTEX_INPUT_RATE_VERTEX});
+    }
+    return bindings;
+}
+
+std::vector<VkVertexInputAttributeDescription>
+MeshBuffer::GetAttributeDescriptions(VertexLayout layout, bool positionOnly) {
+    if (layout == VertexLayout::Quantized) {
+        throw std::runtime_error("quantized meshes carry their vertex input");
+    }
+    bool interleaved = layout == VertexLayout::Interleaved;
+    std::vector<VkVertexInputAttributeDescription> attributes{
+            {0, 0, VK_FORMAT_R32G32B32_SFLOAT,
+             interleaved ? static_cast<uint32_t>(offsetof(Vertex, position))
+                         : 0}
+    };
+    if (!positionOnly) {
+        attributes.push_back(
+                {1, interleaved ? 0u : 1u, VK_FORMAT_R32G32B32_SFLOAT,
+                 interleaved ? static_cast<uint32_t>(offsetof(Vertex, color))
+                             : 0});
+    }
+    return attributes;
+}
+
+void MeshBuffer::AddIndices(Mesh &mesh, size_t vertexCount,
+                            const std::vector<uint32_t> &indices,
+                            bool force32BitIndices) {
+    // indices are relative to the mesh, vertexOffset does the rest
+    if (!force32BitIndices && vertexCount <= UINT16_MAX + 1) {
+        auto &section = mSections[INDICES_16];
+        mesh.indexType = VK_INDEX_TYPE_UINT16;
+        mesh.firstIndex = section.size() / sizeof(uint16_t);
+        for (uint32_t index : indices) {
+            auto narrowed = static_cast<uint16_t>(index);
+            Append(section, &narrowed, sizeof(narrowed));
+        }
+    } else {
+        auto &section = mSections[INDICES_32];
+        mesh.indexType = VK_INDEX_TYPE_UINT32;
+        mesh.firstIndex = section.size() / sizeof(uint32_t);
+        Append(section, indices.data(), indices.size() * sizeof(uint32_t));
+    }
+}
+
+void MeshBuffer::Append(std::vector<uint8_t> &section, const void *data,
+                        size_t size) {
+    auto *bytes = static_cast<const uint8_t *>(data);
+    section.insert(section.end(), bytes, bytes + size);
+}
@@ -0,0 +1,137 @@
+//
+// Created by Krisu on 2020/4/13.
+//
+
+#ifndef VULKAN_TEST_MESHBUFFER_HPP
+#define VULKAN_TEST_MESHBUFFER_HPP
+
+#include <vulkan/vulkan.h>
+
+#include "MeshPacker.hpp"
+
+#include <cstdint>
+#include <vector>
+
+
+struct Vertex {
+    float position[3];
+    float color[3];
+};
+
+/* How the vertices of a mesh are stored */
+enum class VertexLayout {
+    // one stream of whole vertices
+    Interleaved,
+    // a position stream and a stream with the other attributes, depth only
+    // passes fetch the positions alone
+    Deinterleaved,
+    // interleaved PackedMesh vertices, the vertex input comes with them
+    Quantized
+};
+
+/* Where a mesh lives inside the MeshBuffer */
+struct Mesh {
+    VertexLayout layout = VertexLayout::Interleaved;
+    VkIndexType  indexType = VK_INDEX_TYPE_UINT32;
+    uint32_t     indexCount = 0;
+    uint32_t     firstIndex = 0;
+    int32_t      vertexOffset = 0;
+    // quantized meshes only, position = boundsMin + unorm * boundsExtent
+    float        boundsMin[3]{};
+    float        boundsExtent[3]{};
+};
+
+/* Push constants of a pipeline drawing quantized meshes, DrawBatcher
+ * pushes them whenever the mesh changes, see shaders/quantized.vert */
+struct QuantizedDrawData {
+    float boundsMin[4];
+    float boundsExtent[4];
+};
+
+
+/* All meshes in one device local buffer. Meshes sharing a vertex layout
+ * and an index type share their streams, so switching meshes is only a
+ * different firstIndex / vertexOffset and needs no rebinding. */
+class MeshBuffer {
+public:
+    // sections of the buffer, in this order
+    enum Section {
+        INTERLEAVED, POSITIONS, ATTRIBUTES, QUANTIZED, INDICES_16,
+        INDICES_32, SECTION_COUNT
+    };
+
+    /* Queue a mesh for the next Upload. 16 bit indices are used when the
+     * vertices allow it and force32BitIndices is not set. */
+    Mesh Add(const std::vector<Vertex> &vertices,
+             const std::vector<uint32_t> &indices, VertexLayout layout,
+             bool force32BitIndices = false);
+
+    /* Queue a quantized mesh, all of them must share one vertex format */
+    Mesh Add(const PackedMesh &packed, const std::vector<uint32_t> &indices,
+             bool force32BitIndices = false);
+
+    /* Copy everything added so far to the device */
+    void Upload(VkPhysicalDevice physicalDevice, VkDevice device,
+                const VkAllocationCallbacks *pAllocator,
+                VkCommandPool commandPool, VkQueue queue);
+
+    /* Create the device buffer for sections of the given sizes without
+     * filling it, for loaders that copy the sections in themselves */
+    void Allocate(VkPhysicalDevice physicalDevice, VkDevice device,
+                  const VkAllocationCallbacks *pAllocator,
+                  const VkDeviceSize sectionSizes[SECTION_COUNT]);
+
+    void Destroy();
+
+    /* What Add queued for a section, kept after Upload */
+    const std::vector<uint8_t> &GetSectionData(Section section) const {
+        return mSections[section];
+    }
+
+    /* Bytes per vertex of the quantized section, 0 before a quantized
+     * mesh was added */
+    uint32_t GetQuantizedStride() const { return mQuantizedStride; }
+
+    VkBuffer GetBuffer() const { return mBuffer; }
+
+    VkDeviceSize GetSectionOffset(Section section) const {
+        return mSectionOffsets[section];
+    }
+
+    /* Bind the streams of layout and the indices of indexType. With
+     * positionOnly only the position stream is bound at binding 0. */
+    void Bind(VkCommandBuffer commandBuffer, VertexLayout layout,
+              VkIndexType indexType, bool positionOnly = false) const;
+
+    /* mesh's layout and index type must be bound */
+    static void Draw(VkCommandBuffer commandBuffer, const Mesh &mesh,
+                     uint32_t instanceCount = 1);
+
+    /* Vertex input of a pipeline drawing meshes of layout, quantized
+     * meshes have theirs in PackedMesh */
+    static std::vector<VkVertexInputBindingDescription>
+    GetBindingDescriptions(VertexLayout layout, bool positionOnly = false);
+
+    static std::vector<VkVertexInputAttributeDescription>
+    GetAttributeDescriptions(VertexLayout layout, bool positionOnly = false);
+
+private:
+    void AddIndices(Mesh &mesh, size_t vertexCount,
+                    const std::vector<uint32_t> &indices,
+                    bool force32BitIndices);
+
+    static void Append(std::vector<uint8_t> &section, const void *data,
+                       size_t size);
+
+private:
+    std::vector<uint8_t> mSections[SECTION_COUNT];
+    VkDeviceSize         mSectionOffsets[SECTION_COUNT]{};
+    uint32_t             mQuantizedStride = 0;
+
+    VkDevice                     mDevice = VK_NULL_HANDLE;
+    const VkAllocationCallbacks *mAllocator = nullptr;
+    VkBuffer                     mBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory               mMemory = VK_NULL_HANDLE;
+};
+
+#endif //VULKAN_TEST_MESHBUFFER_HPP
@@ -0,0 +1,323 @@
+//
+// Created by Krisu on 2020/4/14.
+//
+
+#include "MeshOptimizer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+
+namespace {
+
+// scoring of Forsyth's algorithm, from the original write-up
+constexpr int   CACHE_SIZE = 32;
+constexpr float CACHE_DECAY_POWER = 1.5f;
+constexpr float LAST_TRIANGLE_SCORE = 0.75f;
+constexpr float VALENCE_BOOST_SCALE = 2.0f;
+constexpr float VALENCE_BOOST_POWER = 0.5f;
+
+float VertexScore(int cachePosition, uint32_t remainingTriangles) {
+    if (remainingTriangles == 0) {
+        return -1.0f;
+    }
+    float score = 0.0f;
+    if (cachePosition >= 0) {
+        if (cachePosition < 3) {
+            // the last triangle's vertices, using them again is no better
+            // than any other cached vertex
+            score = LAST_TRIANGLE_SCORE;
+        } else {
+            float scaler = 1.0f / (CACHE_SIZE - 3);
+            score = std::pow(1.0f - (cachePosition - 3) * scaler,
+                             CACHE_DECAY_POWER);
+        }
+    }
+    // finish off vertices with few triangles left
+    score += VALENCE_BOOST_SCALE *
+             std::pow(static_cast<float>(remainingTriangles),
+                      -VALENCE_BOOST_POWER);
+    return score;
+}
+
+}
+
+VertexCacheStats AnalyzeVertexCache(const std::vector<uint32_t> &indices,
+                                    size_t vertexCount, uint32_t cacheSize) {
+    if (indices.size() % 3 != 0) {
+        throw std::runtime_error("cache indices are not a triangle list");
+    }
+    VertexCacheStats stats;
+    if (indices.empty()) {
+        return stats;
+    }
+
+    // a vertex is cached while fewer than cacheSize misses came after it
+    std::vector<uint64_t> missStamp(vertexCount, 0);
+    std::vector<bool> referenced(vertexCount, false);
+    uint64_t misses = 0;
+    for (uint32_t index : indices) {
+        referenced[index] = true;
+        if (missStamp[index] == 0 || misses - missStamp[index] >= cacheSize) {
+            misses++;
+            missStamp[index] = misses;
+        }
+    }
+
+    size_t referencedCount = std::count(referenced.begin(), referenced.end(),
+                                        true);
+    stats.acmr = static_cast<float>(misses) / (indices.size() / 3);
+    stats.atvr = static_cast<float>(misses) / referencedCount;
+    return stats;
+}
+
+void OptimizeVertexCache(std::vector<uint32_t> &indices, size_t vertexCount) {
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0) {
+        return;
+    }
+
+    // triangles of every vertex, as offsets into one array
+    std::vector<uint32_t> remaining(vertexCount, 0);
+    for (uint32_t index : indices) {
+        remaining[index]++;
+    }
+    std::vector<uint32_t> adjacencyOffset(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++) {
+        adjacencyOffset[v + 1] = adjacencyOffset[v] + remaining[v];
+    }
+    std::vector<uint32_t> adjacency(indices.size());
+    std::vector<uint32_t> fill(adjacencyOffset.begin(),
+                               adjacencyOffset.end() - 1);
+    for (size_t t = 0; t < triangleCount; t++) {
+        for (int k = 0; k < 3; k++) {
+            adjacency[fill[indices[t * 3 + k]]++] = t;
+        }
+    }
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> vertexScore(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++) {
+        vertexScore[v] = VertexScore(-1, remaining[v]);
+    }
+    std::vector<float> triangleScore(triangleCount);
+    for (size_t t = 0; t < triangleCount; t++) {
+        triangleScore[t] = vertexScore[indices[t * 3]] +
+                           vertexScore[indices[t * 3 + 1]] +
+                           vertexScore[indices[t * 3 + 2]];
+    }
+
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+    std::vector<uint32_t> cache;
+    std::vector<uint32_t> newCache;
+    cache.reserve(CACHE_SIZE + 3);
+    newCache.reserve(CACHE_SIZE + 3);
+
+    int64_t best = -1;
+    size_t scanCursor = 0;
+    for (size_t emittedCount = 0; emittedCount < triangleCount;
+         emittedCount++) {
+        if (best < 0) {
+            // nothing in the cache helps, take the best triangle left
+            float bestScore = -1.0f;
+            while (emitted[scanCursor]) {
+                scanCursor++;
+            }
+            for (size_t t = scanCursor; t < triangleCount; t++) {
+                if (!emitted[t] && triangleScore[t] > bestScore) {
+                    bestScore = triangleScore[t];
+                    best = t;
+                }
+            }
+        }
+
+        uint32_t triangle[3]{indices[best * 3], indices[best * 3 + 1],
+                             indices[best * 3 + 2]};
+        emitted[best] = true;
+        result.insert(result.end(), triangle, triangle + 3);
+
+        for (uint32_t v : triangle) {
+            // drop the triangle from the vertex's list
+            uint32_t begin = adjacencyOffset[v];
+            uint32_t end = begin + remaining[v];
+            auto it = std::find(adjacency.begin() + begin,
+                                adjacency.begin() + end,
+                                static_cast<uint32_t>(best));
+            std::iter_swap(it, adjacency.begin() + end - 1);
+            remaining[v]--;
+        }
+
+        // the triangle's vertices move to the front of the cache
+        newCache.assign(triangle, triangle + 3);
+        for (uint32_t v : cache) {
+            if (v != triangle[0] && v != triangle[1] && v != triangle[2]) {
+                newCache.push_back(v);
+            }
+        }
+        for (size_t i = 0; i < newCache.size(); i++) {
+            uint32_t v = newCache[i];
+            cachePosition[v] = i < CACHE_SIZE ? static_cast<int>(i) : -1;
+            vertexScore[v] = VertexScore(cachePosition[v], remaining[v]);
+        }
+
+        // rescore the triangles touching the cache, the best one goes next
+        best = -1;
+        float bestScore = -1.0f;
+        for (uint32_t v : newCache) {
+            uint32_t begin = adjacencyOffset[v];
+            for (uint32_t i = begin; i < begin + remaining[v]; i++) {
+                uint32_t t = adjacency[i];
+                triangleScore[t] = vertexScore[indices[t * 3]] +
+                                   vertexScore[indices[t * 3 + 1]] +
+                                   vertexScore[indices[t * 3 + 2]];
+                if (triangleScore[t] > bestScore) {
+                    bestScore = triangleScore[t];
+                    best = t;
+                }
+            }
+        }
+        if (newCache.size() > CACHE_SIZE) {
+            newCache.resize(CACHE_SIZE);
+        }
+        cache.swap(newCache);
+    }
+    indices.swap(result);
+}
+
+void OptimizeOverdraw(std::vector<uint32_t> &indices, const float *positions,
+                      size_t vertexCount, size_t positionStride,
+                      float threshold) {
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0) {
+        return;
+    }
+    auto position = [&](uint32_t index) {
+        return reinterpret_cast<const float *>(
+                reinterpret_cast<const char *>(positions) +
+                index * positionStride);
+    };
+
+    // clusters end where the cache order jumps, i.e. where a triangle
+    // misses with every vertex
+    std::vector<size_t> clusterStart{0};
+    {
+        constexpr uint32_t cacheSize = 16;
+        std::vector<uint64_t> missStamp(vertexCount, 0);
+        uint64_t misses = 0;
+        for (size_t t = 0; t < triangleCount; t++) {
+            int triangleMisses = 0;
+            for (int k = 0; k < 3; k++) {
+                uint32_t index = indices[t * 3 + k];
+                if (missStamp[index] == 0 ||
+                    misses - missStamp[index] >= cacheSize) {
+                    misses++;
+                    missStamp[index] = misses;
+                    triangleMisses++;
+                }
+            }
+            if (t > 0 && triangleMisses == 3) {
+                clusterStart.push_back(t);
+            }
+        }
+    }
+    size_t clusterCount = clusterStart.size();
+    clusterStart.push_back(triangleCount);
+
+    float meshCentroid[3]{0.0f, 0.0f, 0.0f};
+    for (uint32_t index : indices) {
+        for (int axis = 0; axis < 3; axis++) {
+            meshCentroid[axis] += position(index)[axis];
+        }
+    }
+    for (float &value : meshCentroid) {
+        value /= indices.size();
+    }
+
+    // clusters facing away from the mesh center occlude the others, the
+    // area weighted normal tells where a cluster faces
+    std::vector<float> sortKey(clusterCount);
+    for (size_t c = 0; c < clusterCount; c++) {
+        float centroid[3]{0.0f, 0.0f, 0.0f};
+        float normal[3]{0.0f, 0.0f, 0.0f};
+        float area = 0.0f;
+        for (size_t t = clusterStart[c]; t < clusterStart[c + 1]; t++) {
+            const float *p0 = position(indices[t * 3]);
+            const float *p1 = position(indices[t * 3 + 1]);
+            const float *p2 = position(indices[t * 3 + 2]);
+            float e1[3]{p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+            float e2[3]{p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+            float n[3]{e1[1] * e2[2] - e1[2] * e2[1],
+                       e1[2] * e2[0] - e1[0] * e2[2],
+                       e1[0] * e2[1] - e1[1] * e2[0]};
+            float triangleArea = std::sqrt(n[0] * n[0] + n[1] * n[1] +
+                                           n[2] * n[2]);
+            for (int axis = 0; axis < 3; axis++) {
+                centroid[axis] += (p0[axis] + p1[axis] + p2[axis]) / 3.0f *
+                                  triangleArea;
+                normal[axis] += n[axis];
+            }
+            area += triangleArea;
+        }
+        float key = 0.0f;
+        if (area > 0.0f) {
+            for (int axis = 0; axis < 3; axis++) {
+                key += (centroid[axis] / area - meshCentroid[axis]) *
+                       normal[axis];
+            }
+            key /= area;
+        }
+        sortKey[c] = key;
+    }
+
+    std::vector<size_t> order(clusterCount);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return sortKey[a] > sortKey[b];
+    });
+
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+    for (size_t c : order) {
+        result.insert(result.end(), indices.begin() + clusterStart[c] * 3,
+                      indices.begin() + clusterStart[c + 1] * 3);
+    }
+
+    // cutting clusters apart costs some cache hits at their borders
+    float before = AnalyzeVertexCache(indices, vertexCount).acmr;
+    float after = AnalyzeVertexCache(result, vertexCount).acmr;
+    if (after <= before * threshold) {
+        indices.swap(result);
+    }
+}
+
+std::vector<uint32_t> OptimizeVertexFetch(std::vector<uint32_t> &indices,
+                                          size_t vertexCount) {
+    std::vector<uint32_t> remap(vertexCount, UINT32_MAX);
+    uint32_t next = 0;
+    for (uint32_t &index : indices) {
+        if (remap[index] == UINT32_MAX) {
+            remap[index] = next++;
+        }
+        index = remap[index];
+    }
+    for (uint32_t &newIndex : remap) {
+        if (newIndex == UINT32_MAX) {
+            newIndex = next++;
+        }
+    }
+    return remap;
+}
+
+void OptimizeMesh(std::vector<Vertex> &vertices,
+                  std::vector<uint32_t> &indices) {
+    if (vertices.empty()) {
+        return;
+    }
+    OptimizeVertexCache(indices, vertices.size());
+    OptimizeOverdraw(indices, vertices.data()->position, vertices.size(),
+                     sizeof(Vertex));
+    RemapVertices(vertices, OptimizeVertexFetch(indices, vertices.size()));
+}
@@ -0,0 +1,63 @@
+//
+// Created by Krisu on 2020/4/14.
+//
+
+#ifndef VULKAN_TEST_MESHOPTIMIZER_HPP
+#define VULKAN_TEST_MESHOPTIMIZER_HPP
+
+#include "MeshBuffer.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+/* Post-transform cache statistics of an index buffer, simulated with a
+ * FIFO cache. The indices must be a triangle list, an empty one has all
+ * zero stats. */
+struct VertexCacheStats {
+    // transformed vertices per triangle, 0.5 is ideal, 3 is worst
+    float acmr = 0.0f;
+    // transformed vertices per referenced vertex, 1 is ideal
+    float atvr = 0.0f;
+};
+
+VertexCacheStats AnalyzeVertexCache(const std::vector<uint32_t> &indices,
+                                    size_t vertexCount,
+                                    uint32_t cacheSize = 16);
+
+/* Reorder triangles for the post-transform vertex cache (Forsyth's linear
+ * speed vertex cache optimisation) */
+void OptimizeVertexCache(std::vector<uint32_t> &indices, size_t vertexCount);
+
+/* Reorder triangles so outward facing clusters are drawn first, keeping
+ * the vertex cache order inside clusters. Run it after
+ * OptimizeVertexCache. The new order is only kept while the ACMR stays
+ * below threshold times the ACMR before. positions are 3 floats at
+ * positionStride bytes apart. */
+void OptimizeOverdraw(std::vector<uint32_t> &indices, const float *positions,
+                      size_t vertexCount, size_t positionStride,
+                      float threshold = 1.05f);
+
+/* Renumber vertices in the order the index buffer first uses them, so
+ * vertex fetch walks memory forwards. Rewrites indices and returns the
+ * new index of every old vertex, unused ones go to the end. */
+std::vector<uint32_t> OptimizeVertexFetch(std::vector<uint32_t> &indices,
+                                          size_t vertexCount);
+
+/* Move vertices to the places OptimizeVertexFetch picked */
+template<typename T>
+void RemapVertices(std::vector<T> &vertices,
+                   const std::vector<uint32_t> &remap) {
+    std::vector<T> remapped(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++) {
+        remapped[remap[i]] = vertices[i];
+    }
+    vertices.swap(remapped);
+}
+
+/* All of the above, in order, for meshes going into the MeshBuffer */
+void OptimizeMesh(std::vector<Vertex> &vertices,
+                  std::vector<uint32_t> &indices);
+
+#endif //VULKAN_TEST_MESHOPTIMIZER_HPP
@@ -0,0 +1,283 @@
+//
+// Created by Krisu on 2020/4/13.
+//
+
+#include "MeshPacker.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+constexpr float PI = 3.14159265358979f;
+
+float Clamp(float value, float low, float high) {
+    return std::max(low, std::min(value, high));
+}
+
+uint16_t QuantizeUnorm16(float value) {
+    return static_cast<uint16_t>(std::lround(Clamp(value, 0.0f, 1.0f) *
+                                             65535.0f));
+}
+
+int32_t QuantizeSnorm(float value, int32_t max) {
+    return static_cast<int32_t>(std::lround(Clamp(value, -1.0f, 1.0f) *
+                                            max));
+}
+
+float DequantizeSnorm(int32_t value, int32_t max) {
+    return std::max(static_cast<float>(value) / max, -1.0f);
+}
+
+// float32 to IEEE half, round to nearest even, no NaN payloads
+uint16_t FloatToHalf(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000;
+    int32_t exponent = static_cast<int32_t>((bits >> 23) & 0xff) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffff;
+
+    if (((bits >> 23) & 0xff) == 0xff) {
+        return static_cast<uint16_t>(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+    }
+    if (exponent >= 31) {
+        return static_cast<uint16_t>(sign | 0x7c00);
+    }
+    if (exponent <= 0) {
+        if (exponent < -10) {
+            return static_cast<uint16_t>(sign);
+        }
+        // subnormal half
+        mantissa |= 0x800000;
+        uint32_t shift = static_cast<uint32_t>(14 - exponent);
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1))) {
+            half++;
+        }
+        return static_cast<uint16_t>(sign | half);
+    }
+    uint32_t half = (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+    uint32_t rest = mantissa & 0x1fff;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) {
+        // may carry into the exponent, which is still the right result
+        half++;
+    }
+    return static_cast<uint16_t>(sign | half);
+}
+
+float HalfToFloat(uint16_t half) {
+    uint32_t sign = (half & 0x8000u) << 16;
+    uint32_t exponent = (half >> 10) & 0x1f;
+    uint32_t mantissa = half & 0x3ff;
+    uint32_t bits;
+    if (exponent == 0) {
+        float value = std::ldexp(static_cast<float>(mantissa), -24);
+        return sign ? -value : value;
+    } else if (exponent == 31) {
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    } else {
+        bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+    }
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+void Normalize(float v[3]) {
+    float length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    if (length > 0.0f) {
+        v[0] /= length;
+        v[1] /= length;
+        v[2] /= length;
+    } else {
+        v[0] = 0.0f;
+        v[1] = 0.0f;
+        v[2] = 1.0f;
+    }
+}
+
+float SignNotZero(float value) {
+    return value >= 0.0f ? 1.0f : -1.0f;
+}
+
+// unit vector onto the octahedron, then unfolded onto [-1, 1]^2
+void OctEncode(const float n[3], float out[2]) {
+    float l1 = std::fabs(n[0]) + std::fabs(n[1]) + std::fabs(n[2]);
+    float x = n[0] / l1;
+    float y = n[1] / l1;
+    if (n[2] < 0.0f) {
+        float foldedX = (1.0f - std::fabs(y)) * SignNotZero(x);
+        float foldedY = (1.0f - std::fabs(x)) * SignNotZero(y);
+        x = foldedX;
+        y = foldedY;
+    }
+    out[0] = x;
+    out[1] = y;
+}
+
+void OctDecode(const float e[2], float out[3]) {
+    out[0] = e[0];
+    out[1] = e[1];
+    out[2] = 1.0f - std::fabs(e[0]) - std::fabs(e[1]);
+    if (out[2] < 0.0f) {
+        float x = out[0];
+        out[0] = (1.0f - std::fabs(out[1])) * SignNotZero(x);
+        out[1] = (1.0f - std::fabs(x)) * SignNotZero(out[1]);
+    }
+    Normalize(out);
+}
+
+float AngleDegrees(const float a[3], const float b[3]) {
+    float cosine = Clamp(a[0] * b[0] + a[1] * b[1] + a[2] * b[2],
+                         -1.0f, 1.0f);
+    return std::acos(cosine) * 180.0f / PI;
+}
+
+/* Encode a direction at the given precision, write it to dst and return
+ * the angle error of the round trip */
+float PackDirection(const float *input, OctEncoding encoding, uint8_t *dst) {
+    float n[3]{input[0], input[1], input[2]};
+    Normalize(n);
+    float e[2];
+    OctEncode(n, e);
+
+    int32_t max = encoding == OctEncoding::Oct8 ? 127 : 32767;
+    float decoded[2];
+    for (int i = 0; i < 2; i++) {
+        int32_t q = QuantizeSnorm(e[i], max);
+        decoded[i] = DequantizeSnorm(q, max);
+        if (encoding == OctEncoding::Oct8) {
+            auto value = static_cast<int8_t>(q);
+            std::memcpy(dst + i, &value, sizeof(value));
+        } else {
+            auto value = static_cast<int16_t>(q);
+            std::memcpy(dst + i * 2, &value, sizeof(value));
+        }
+    }
+    float roundTrip[3];
+    OctDecode(decoded, roundTrip);
+    return AngleDegrees(n, roundTrip);
+}
+
+}
+
+PackedMesh PackMesh(const MeshAttributes &mesh, OctEncoding encoding) {
+    if (mesh.positions.empty() || mesh.positions.size() % 3 != 0) {
+        throw std::runtime_error("mesh " + mesh.name + " has no positions");
+    }
+    PackedMesh packed;
+    packed.vertexCount = mesh.positions.size() / 3;
+    size_t count = packed.vertexCount;
+
+    bool hasNormals = mesh.normals.size() == count * 3;
+    bool hasTangents = mesh.tangents.size() == count * 4;
+    bool hasUvs = mesh.uvs.size() == count * 2;
+
+    // 8 bit normal and tangent share 4 bytes, everything else is 4 byte
+    // aligned
+    uint32_t directionSize = encoding == OctEncoding::Oct8 ? 2 : 4;
+    VkFormat directionFormat = encoding == OctEncoding::Oct8
+                               ? VK_FORMAT_R8G8_SNORM
+                               : VK_FORMAT_R16G16_SNORM;
+    uint32_t offset = 0;
+    packed.attributes.push_back({0, 0, VK_FORMAT_R16G16B16A16_UNORM, offset});
+    offset += 8;
+    uint32_t normalOffset = offset;
+    if (hasNormals) {
+        packed.attributes.push_back({1, 0, directionFormat, offset});
+        offset += directionSize;
+    }
+    uint32_t tangentOffset = offset;
+    if (hasTangents) {
+        packed.attributes.push_back({2, 0, directionFormat, offset});
+        offset += directionSize;
+    }
+    offset = (offset + 3) / 4 * 4;
+    uint32_t uvOffset = offset;
+    if (hasUvs) {
+        packed.attributes.push_back({3, 0, VK_FORMAT_R16G16_SFLOAT, offset});
+        offset += 4;
+    }
+    packed.stride = offset;
+    packed.binding = {0, packed.stride, VK_VERTEX_INPUT_RATE_VERTEX};
+
+    // bounds, flat axes keep a non-zero extent so decoding stays finite
+    for (int axis = 0; axis < 3; axis++) {
+        float low = mesh.positions[axis];
+        float high = low;
+        for (size_t i = 0; i < count; i++) {
+            low = std::min(low, mesh.positions[i * 3 + axis]);
+            high = std::max(high, mesh.positions[i * 3 + axis]);
+        }
+        packed.boundsMin[axis] = low;
+        packed.boundsExtent[axis] = high > low ? high - low : 1.0f;
+    }
+
+    PackedMesh::Report &report = packed.report;
+    packed.vertices.assign(count * packed.stride, 0);
+    for (size_t i = 0; i < count; i++) {
+        uint8_t *vertex = packed.vertices.data() + i * packed.stride;
+
+        uint16_t position[4];
+        float error = 0.0f;
+        for (int axis = 0; axis < 3; axis++) {
+            float value = mesh.positions[i * 3 + axis];
+            float normalized = (value - packed.boundsMin[axis]) /
+                               packed.boundsExtent[axis];
+            position[axis] = QuantizeUnorm16(normalized);
+            float decoded = packed.boundsMin[axis] +
+                            position[axis] / 65535.0f *
+                            packed.boundsExtent[axis];
+            error = std::max(error, std::fabs(decoded - value));
+        }
+        position[3] = hasTangents && mesh.tangents[i * 4 + 3] < 0.0f ? 0
+                                                                     : 65535;
+        std::memcpy(vertex, position, sizeof(position));
+        report.maxPositionError = std::max(report.maxPositionError, error);
+
+        if (hasNormals) {
+            report.maxNormalError = std::max(
+                    report.maxNormalError,
+                    PackDirection(&mesh.normals[i * 3], encoding,
+                                  vertex + normalOffset));
+        }
+        if (hasTangents) {
+            report.maxTangentError = std::max(
+                    report.maxTangentError,
+                    PackDirection(&mesh.tangents[i * 4], encoding,
+                                  vertex + tangentOffset));
+        }
+        if (hasUvs) {
+            uint16_t uv[2];
+            for (int c = 0; c < 2; c++) {
+                float value = mesh.uvs[i * 2 + c];
+                uv[c] = FloatToHalf(value);
+                report.maxUvError = std::max(
+                        report.maxUvError,
+                        std::fabs(HalfToFloat(uv[c]) - value));
+            }
+            std::memcpy(vertex + uvOffset, uv, sizeof(uv));
+        }
+    }
+
+    report.floatBytes = count * sizeof(float) *
+                        (3 + (hasNormals ? 3 : 0) + (hasTangents ? 4 : 0) +
+                         (hasUvs ? 2 : 0));
+    report.packedBytes = packed.vertices.size();
+    return packed;
+}
+
+void PrintPackReport(std::ostream &os, const std::string &name,
+                     const PackedMesh::Report &report) {
+    os << "Packed " << name << ": " << report.floatBytes << " B -> "
+       << report.packedBytes << " B ("
+       << (report.floatBytes
+           ? 100.0 * report.packedBytes / report.floatBytes : 0.0)
+       << "%), max error position " << report.maxPositionError
+       << ", normal " << report.maxNormalError << " deg, tangent "
+       << report.maxTangentError << " deg, uv " << report.maxUvError << "\n";
+}
@@ -0,0 +1,70 @@
+//
+// Created by Krisu on 2020/4/13.
+//
+
+#ifndef VULKAN_TEST_MESHPACKER_HPP
+#define VULKAN_TEST_MESHPACKER_HPP
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+
+/* float32 attributes of a mesh as imported, one entry per vertex. Only
+ * positions are required, empty attributes are left out when packing. */
+struct MeshAttributes {
+    std::string        name;
+    std::vector<float> positions;   // xyz
+    std::vector<float> normals;     // xyz
+    std::vector<float> tangents;    // xyz, w is the bitangent sign
+    std::vector<float> uvs;         // uv
+};
+
+/* Precision of octahedral normals and tangents */
+enum class OctEncoding {
+    Oct8,   // VK_FORMAT_R8G8_SNORM, normal and tangent share 4 bytes
+    Oct16   // VK_FORMAT_R16G16_SNORM
+};
+
+/* An interleaved, quantized vertex stream:
+ *  location 0: position, R16G16B16A16_UNORM relative to the mesh bounds,
+ *              w holds the tangent sign (0 is -1, 1 is +1)
+ *  location 1: octahedral normal
+ *  location 2: octahedral tangent
+ *  location 3: uv, R16G16_SFLOAT
+ * see shaders/quantized.glsl for the decoding side */
+struct PackedMesh {
+    struct Report {
+        size_t floatBytes = 0;
+        size_t packedBytes = 0;
+        // largest error against the float input, in object space units
+        float  maxPositionError = 0.0f;
+        // largest angle between input and decoded direction, in degrees
+        float  maxNormalError = 0.0f;
+        float  maxTangentError = 0.0f;
+        float  maxUvError = 0.0f;
+    };
+
+    uint32_t             vertexCount = 0;
+    uint32_t             stride = 0;
+    std::vector<uint8_t> vertices;
+    // position = boundsMin + unorm * boundsExtent
+    float                boundsMin[3]{};
+    float                boundsExtent[3]{};
+
+    VkVertexInputBindingDescription                binding{};
+    std::vector<VkVertexInputAttributeDescription> attributes;
+
+    Report report;
+};
+
+PackedMesh PackMesh(const MeshAttributes &mesh,
+                    OctEncoding encoding = OctEncoding::Oct16);
+
+void PrintPackReport(std::ostream &os, const std::string &name,
+                     const PackedMesh::Report &report);
+
+#endif //VULKAN_TEST_MESHPACKER_HPP
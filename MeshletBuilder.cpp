@@ -0,0 +1,192 @@
+//
+// Created by Krisu on 2020/4/16.
+//
+
+#include "MeshletBuilder.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+
+struct Vec3 {
+    float x, y, z;
+};
+
+Vec3 operator-(const Vec3 &a, const Vec3 &b) {
+    return {a.x - b.x, a.y - b.y, a.z - b.z};
+}
+
+float Dot(const Vec3 &a, const Vec3 &b) {
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+Vec3 Cross(const Vec3 &a, const Vec3 &b) {
+    return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z,
+            a.x * b.y - a.y * b.x};
+}
+
+Vec3 GetPosition(const float *positions, size_t positionStride,
+                 uint32_t vertex) {
+    const float *position = reinterpret_cast<const float *>(
+            reinterpret_cast<const uint8_t *>(positions) +
+            vertex * positionStride);
+    return {position[0], position[1], position[2]};
+}
+
+MeshletBounds ComputeBounds(const MeshletData &data, const Meshlet &meshlet,
+                            const float *positions, size_t positionStride) {
+    MeshletBounds bounds;
+
+    // sphere around the center of the box, not the smallest one but close
+    // for compact meshlets
+    Vec3 lower = GetPosition(positions, positionStride,
+                             data.vertices[meshlet.vertexOffset]);
+    Vec3 upper = lower;
+    for (uint32_t i = 1; i < meshlet.vertexCount; i++) {
+        Vec3 position = GetPosition(positions, positionStride,
+                                    data.vertices[meshlet.vertexOffset + i]);
+        lower = {std::min(lower.x, position.x), std::min(lower.y, position.y),
+                 std::min(lower.z, position.z)};
+        upper = {std::max(upper.x, position.x), std::max(upper.y, position.y),
+                 std::max(upper.z, position.z)};
+    }
+    Vec3 center{(lower.x + upper.x) * 0.5f, (lower.y + upper.y) * 0.5f,
+                (lower.z + upper.z) * 0.5f};
+    float radiusSquared = 0.0f;
+    for (uint32_t i = 0; i < meshlet.vertexCount; i++) {
+        Vec3 offset = GetPosition(positions, positionStride,
+                                  data.vertices[meshlet.vertexOffset + i]) -
+                      center;
+        radiusSquared = std::max(radiusSquared, Dot(offset, offset));
+    }
+    bounds.center[0] = center.x;
+    bounds.center[1] = center.y;
+    bounds.center[2] = center.z;
+    bounds.radius = std::sqrt(radiusSquared);
+
+    // cone around the average face normal, clockwise front faces
+    std::vector<Vec3> normals;
+    normals.reserve(meshlet.triangleCount);
+    Vec3 axis{0.0f, 0.0f, 0.0f};
+    for (uint32_t i = 0; i < meshlet.triangleCount; i++) {
+        const uint8_t *triangle =
+                &data.triangles[(meshlet.triangleOffset + i) * 3];
+        Vec3 corners[3];
+        for (int j = 0; j < 3; j++) {
+            corners[j] = GetPosition(
+                    positions, positionStride,
+                    data.vertices[meshlet.vertexOffset + triangle[j]]);
+        }
+        Vec3 normal = Cross(corners[2] - corners[0], corners[1] - corners[0]);
+        float length = std::sqrt(Dot(normal, normal));
+        // degenerate triangles face nowhere
+        if (length == 0.0f) {
+            continue;
+        }
+        normal = {normal.x / length, normal.y / length, normal.z / length};
+        normals.push_back(normal);
+        axis = {axis.x + normal.x, axis.y + normal.y, axis.z + normal.z};
+    }
+    float axisLength = std::sqrt(Dot(axis, axis));
+    if (axisLength == 0.0f) {
+        return bounds;
+    }
+    axis = {axis.x / axisLength, axis.y / axisLength, axis.z / axisLength};
+    float minDot = 1.0f;
+    for (const auto &normal : normals) {
+        minDot = std::min(minDot, Dot(normal, axis));
+    }
+    // nearly a half space or wider, nothing would ever be culled
+    if (minDot <= 0.1f) {
+        return bounds;
+    }
+    bounds.coneAxis[0] = axis.x;
+    bounds.coneAxis[1] = axis.y;
+    bounds.coneAxis[2] = axis.z;
+    // sine of the cone angle, the test works on the center instead of
+    // the apex
+    bounds.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+    return bounds;
+}
+
+}
+
+MeshletData BuildMeshlets(const std::vector<uint32_t> &indices,
+                          const float *positions, size_t vertexCount,
+                          size_t positionStride, uint32_t maxVertices,
+                          uint32_t maxTriangles) {
+    if (indices.size() % 3 != 0) {
+        throw std::runtime_error("meshlet indices are not a triangle list");
+    }
+    // local vertices are stored in a byte
+    if (maxVertices < 3 || maxVertices > 256 || maxTriangles < 1) {
+        throw std::runtime_error("invalid meshlet limits");
+    }
+
+    MeshletData data;
+    // local index of every mesh vertex in the current meshlet, -1 if absent
+    std::vector<int> localIndex(vertexCount, -1);
+    Meshlet meshlet;
+
+    auto finish = [&]() {
+        if (meshlet.triangleCount == 0) {
+            return;
+        }
+        for (uint32_t i = 0; i < meshlet.vertexCount; i++) {
+            localIndex[data.vertices[meshlet.vertexOffset + i]] = -1;
+        }
+        data.meshlets.push_back(meshlet);
+        data.bounds.push_back(ComputeBounds(data, meshlet, positions,
+                                            positionStride));
+        meshlet.vertexOffset = data.vertices.size();
+        meshlet.triangleOffset = data.triangles.size() / 3;
+        meshlet.vertexCount = 0;
+        meshlet.triangleCount = 0;
+    };
+
+    for (size_t i = 0; i < indices.size(); i += 3) {
+        const uint32_t *triangle = &indices[i];
+        uint32_t newVertices = 0;
+        for (int j = 0; j < 3; j++) {
+            if (triangle[j] >= vertexCount) {
+                throw std::runtime_error("meshlet index out of range");
+            }
+            // repeated corners of a degenerate triangle count once
+            bool repeated = (j > 0 && triangle[j] == triangle[0]) ||
+                            (j > 1 && triangle[j] == triangle[1]);
+            if (localIndex[triangle[j]] < 0 && !repeated) {
+                newVertices++;
+            }
+        }
+        if (meshlet.vertexCount + newVertices > maxVertices ||
+            meshlet.triangleCount + 1 > maxTriangles) {
+            finish();
+        }
+
+        for (int j = 0; j < 3; j++) {
+            int &local = localIndex[triangle[j]];
+            if (local < 0) {
+                local = meshlet.vertexCount++;
+                data.vertices.push_back(triangle[j]);
+            }
+            data.triangles.push_back(static_cast<uint8_t>(local));
+        }
+        meshlet.triangleCount++;
+    }
+    finish();
+    return data;
+}
+
+std::vector<uint32_t> GetMeshletIndices(const MeshletData &data) {
+    std::vector<uint32_t> indices;
+    indices.reserve(data.triangles.size());
+    for (const auto &meshlet : data.meshlets) {
+        for (uint32_t i = 0; i < meshlet.triangleCount * 3; i++) {
+            uint8_t local = data.triangles[meshlet.triangleOffset * 3 + i];
+            indices.push_back(data.vertices[meshlet.vertexOffset + local]);
+        }
+    }
+    return indices;
+}
@@ -0,0 +1,59 @@
+//
+// Created by Krisu on 2020/4/16.
+//
+
+#ifndef VULKAN_TEST_MESHLETBUILDER_HPP
+#define VULKAN_TEST_MESHLETBUILDER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+// limits of one meshlet, a mesh shader workgroup writes one
+constexpr uint32_t MAX_MESHLET_VERTICES = 64;
+constexpr uint32_t MAX_MESHLET_TRIANGLES = 124;
+
+/* A cluster of triangles, ranges index into the MeshletData arrays */
+struct Meshlet {
+    uint32_t vertexOffset = 0;
+    uint32_t triangleOffset = 0;
+    uint32_t vertexCount = 0;
+    uint32_t triangleCount = 0;
+};
+
+/* Culling bounds of a meshlet. Every triangle faces away from a camera at
+ * p when dot(center - p, coneAxis) >= coneCutoff * |center - p| + radius,
+ * a cutoff of 1 never culls. */
+struct MeshletBounds {
+    float center[3]{0.0f, 0.0f, 0.0f};
+    float radius = 0.0f;
+    float coneAxis[3]{0.0f, 0.0f, 0.0f};
+    float coneCutoff = 1.0f;
+};
+
+struct MeshletData {
+    std::vector<Meshlet>       meshlets;
+    std::vector<MeshletBounds> bounds;
+    // mesh vertex of every meshlet vertex
+    std::vector<uint32_t>      vertices;
+    // three meshlet vertices per triangle
+    std::vector<uint8_t>       triangles;
+};
+
+/* Split a triangle list into meshlets, walking the triangles in order and
+ * starting a new meshlet when one is full. Run OptimizeVertexCache first,
+ * its locality is what keeps the meshlets tight. positions are 3 floats
+ * at positionStride bytes apart, front faces are clockwise like in the
+ * pipeline. */
+MeshletData BuildMeshlets(const std::vector<uint32_t> &indices,
+                          const float *positions, size_t vertexCount,
+                          size_t positionStride,
+                          uint32_t maxVertices = MAX_MESHLET_VERTICES,
+                          uint32_t maxTriangles = MAX_MESHLET_TRIANGLES);
+
+/* The triangles of every meshlet as mesh indices, meshlet after meshlet,
+ * for drawing meshlets with indexed draws */
+std::vector<uint32_t> GetMeshletIndices(const MeshletData &data);
+
+#endif //VULKAN_TEST_MESHLETBUILDER_HPP
@@ -0,0 +1,327 @@
+//
+// Created by Krisu on 2020/4/16.
+//
+
+#include "MeshletRenderer.hpp"
+#include "AllocationTracker.hpp"
+#include "VulkanUtils.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+// above any minStorageBufferOffsetAlignment
+constexpr VkDeviceSize SECTION_ALIGNMENT = 256;
+
+VkDeviceSize AlignSection(VkDeviceSize offset) {
+    return (offset + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT *
+           SECTION_ALIGNMENT;
+}
+
+}
+
+void MeshletRenderer::Init(VkPhysicalDevice physicalDevice, VkDevice device,
+                           const VkAllocationCallbacks *pAllocator,
+                           DescriptorAllocator &descriptorAllocator,
+                           const std::vector<char> &taskCode,
+                           const std::vector<char> &meshCode,
+                           const std::vector<char> &fragCode,
+                           VkFormat colorFormat, VkFormat depthFormat,
+                           VkRenderPass renderPass,
+                           PFN_vkCmdDrawMeshTasksEXT drawMeshTasks) {
+    mPhysicalDevice = physicalDevice;
+    mDevice = device;
+    mAllocator = pAllocator;
+    mDescriptorAllocator = &descriptorAllocator;
+    mDrawMeshTasks = drawMeshTasks;
+
+    // meshlets, meshlet vertices, meshlet triangles and the mesh buffer
+    std::vector<VkDescriptorSetLayoutBinding> bindings(4);
+    for (uint32_t i = 0; i < bindings.size(); i++) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_MESH_BIT_EXT;
+    }
+    bindings[0].stageFlags |= VK_SHADER_STAGE_TASK_BIT_EXT;
+    VkDescriptorSetLayoutCreateInfo setLayoutCreateInfo{};
+    setLayoutCreateInfo.sType =
+            VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    setLayoutCreateInfo.bindingCount = bindings.size();
+    setLayoutCreateInfo.pBindings = bindings.data();
+    {
+        AllocationTracker::ScopedTag tag(
+                VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT);
+        if (vkCreateDescriptorSetLayout(mDevice, &setLayoutCreateInfo,
+                                        mAllocator, &mSetLayout) !=
+            VK_SUCCESS) {
+            throw std::runtime_error(
+                    "failed to create meshlet descriptor set layout");
+        }
+    }
+    mDescriptorAllocator->RegisterLayout(mSetLayout, bindings);
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_TASK_BIT_EXT |
+                                   VK_SHADER_STAGE_MESH_BIT_EXT;
+    pushConstantRange.size = sizeof(Constants);
+    VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo{};
+    pipelineLayoutCreateInfo.sType =
+            VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutCreateInfo.setLayoutCount = 1;
+    pipelineLayoutCreateInfo.pSetLayouts = &mSetLayout;
+    pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+    pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+    {
+        AllocationTracker::ScopedTag tag(VK_OBJECT_TYPE_PIPELINE_LAYOUT);
+        if (vkCreatePipelineLayout(mDevice, &pipelineLayoutCreateInfo,
+                                   mAllocator, &mPipelineLayout) !=
+            VK_SUCCESS) {
+            throw std::runtime_error(
+                    "failed to create meshlet pipeline layout");
+        }
+    }
+
+    const std::vector<char> *codes[3]{&taskCode, &meshCode, &fragCode};
+    const VkShaderStageFlagBits stages[3]{VK_SHADER_STAGE_TASK_BIT_EXT,
+                                          VK_SHADER_STAGE_MESH_BIT_EXT,
+                                          VK_SHADER_STAGE_FRAGMENT_BIT};
+    VkShaderModule shaderModules[3]{};
+    VkPipelineShaderStageCreateInfo shaderStageCreateInfos[3]{};
+    for (int i = 0; i < 3; i++) {
+        VkShaderModuleCreateInfo shaderModuleCreateInfo{};
+        shaderModuleCreateInfo.sType =
+                VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        shaderModuleCreateInfo.codeSize = codes[i]->size();
+        shaderModuleCreateInfo.pCode =
+                reinterpret_cast<const uint32_t *>(codes[i]->data());
+        AllocationTracker::ScopedTag tag(VK_OBJECT_TYPE_SHADER_MODULE);
+        if (vkCreateShaderModule(mDevice, &shaderModuleCreateInfo,
+                                 mAllocator, &shaderModules[i]) !=
+            VK_SUCCESS) {
+            throw std::runtime_error(
+                    "failed to create meshlet shader module");
+        }
+        shaderStageCreateInfos[i].sType =
+                VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        shaderStageCreateInfos[i].stage = stages[i];
+        shaderStageCreateInfos[i].module = shaderModules[i];
+        shaderStageCreateInfos[i].pName = "main";
+    }
+
+    // the state of the main pipeline, minus the vertex input
+    VkPipelineViewportStateCreateInfo viewportStateCreateInfo{};
+    viewportStateCreateInfo.sType =
+            VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportStateCreateInfo.viewportCount = 1;
+    viewportStateCreateInfo.scissorCount = 1;
+
+    VkDynamicState dynamicStates[]{
+            VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR
+    };
+    VkPipelineDynamicStateCreateInfo dynamicStateCreateInfo{};
+    dynamicStateCreateInfo.sType =
+            VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicStateCreateInfo.dynamicStateCount = 2;
+    dynamicStateCreateInfo.pDynamicStates = dynamicStates;
+
+    VkPipelineRasterizationStateCreateInfo rasterizationStateCreateInfo{};
+    rasterizationStateCreateInfo.sType =
+            VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizationStateCreateInfo.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterizationStateCreateInfo.lineWidth = 1.0f;
+    rasterizationStateCreateInfo.cullMode = VK_CULL_MODE_BACK_BIT;
+    rasterizationStateCreateInfo.frontFace = VK_FRONT_FACE_CLOCKWISE;
+
+    VkPipelineMultisampleStateCreateInfo multisampleStateCreateInfo{};
+    multisampleStateCreateInfo.sType =
+            VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampleStateCreateInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+    VkPipelineColorBlendAttachmentState colorBlendAttachmentState{};
+    colorBlendAttachmentState.colorWriteMask =
+            VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+            VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    VkPipelineColorBlendStateCreateInfo colorBlendStateCreateInfo{};
+    colorBlendStateCreateInfo.sType =
+            VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    colorBlendStateCreateInfo.attachmentCount = 1;
+    colorBlendStateCreateInfo.pAttachments = &colorBlendAttachmentState;
+
+    VkPipelineDepthStencilStateCreateInfo depthStencilStateCreateInfo{};
+    depthStencilStateCreateInfo.sType =
+            VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depthStencilStateCreateInfo.depthTestEnable = VK_TRUE;
+    depthStencilStateCreateInfo.depthWriteEnable = VK_TRUE;
+    depthStencilStateCreateInfo.depthCompareOp = VK_COMPARE_OP_LESS;
+
+    VkGraphicsPipelineCreateInfo pipelineCreateInfo{};
+    pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineCreateInfo.stageCount = 3;
+    pipelineCreateInfo.pStages = shaderStageCreateInfos;
+    pipelineCreateInfo.pViewportState = &viewportStateCreateInfo;
+    pipelineCreateInfo.pRasterizationState = &rasterizationStateCreateInfo;
+    pipelineCreateInfo.pMultisampleState = &multisampleStateCreateInfo;
+    pipelineCreateInfo.pDepthStencilState = &depthStencilStateCreateInfo;
+    pipelineCreateInfo.pColorBlendState = &colorBlendStateCreateInfo;
+    pipelineCreateInfo.pDynamicState = &dynamicStateCreateInfo;
+    pipelineCreateInfo.layout = mPipelineLayout;
+
+    VkPipelineRenderingCreateInfoKHR renderingCreateInfo{};
+    renderingCreateInfo.sType =
+            VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR;
+    renderingCreateInfo.colorAttachmentCount = 1;
+    renderingCreateInfo.pColorAttachmentFormats = &colorFormat;
+    renderingCreateInfo.depthAttachmentFormat = depthFormat;
+    if (renderPass == VK_NULL_HANDLE) {
+        pipelineCreateInfo.pNext = &renderingCreateInfo;
+    } else {
+        pipelineCreateInfo.renderPass = renderPass;
+        pipelineCreateInfo.subpass = 0;
+    }
+
+    VkResult result;
+    {
+        AllocationTracker::ScopedTag tag(VK_OBJECT_TYPE_PIPELINE);
+        result = vkCreateGraphicsPipelines(mDevice, VK_NULL_HANDLE, 1,
+                                           &pipelineCreateInfo, mAllocator,
+                                           &mPipeline);
+    }
+    for (VkShaderModule shaderModule : shaderModules) {
+        vkDestroyShaderModule(mDevice, shaderModule, mAllocator);
+    }
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("failed to create meshlet pipeline");
+    }
+}
+
+void MeshletRenderer::Destroy() {
+    if (mDevice == VK_NULL_HANDLE) {
+        return;
+    }
+    vkDestroyBuffer(mDevice, mBuffer, mAllocator);
+    vkFreeMemory(mDevice, mMemory, mAllocator);
+    mBuffer = VK_NULL_HANDLE;
+    mMemory = VK_NULL_HANDLE;
+    vkDestroyPipeline(mDevice, mPipeline, mAllocator);
+    vkDestroyPipelineLayout(mDevice, mPipelineLayout, mAllocator);
+    vkDestroyDescriptorSetLayout(mDevice, mSetLayout, mAllocator);
+    mMeshlets.clear();
+    mVertices.clear();
+    mTriangles.clear();
+    mMeshletCount = 0;
+    mDevice = VK_NULL_HANDLE;
+}
+
+void MeshletRenderer::Add(const MeshletData &meshlets, const Mesh &mesh) {
+    if (mesh.layout != VertexLayout::Deinterleaved) {
+        throw std::runtime_error("meshlets need deinterleaved vertices");
+    }
+    auto vertexBase = static_cast<uint32_t>(mVertices.size());
+    auto triangleBase = static_cast<uint32_t>(mTriangles.size());
+    for (size_t i = 0; i < meshlets.meshlets.size(); i++) {
+        const Meshlet &meshlet = meshlets.meshlets[i];
+        const MeshletBounds &bounds = meshlets.bounds[i];
+        GpuMeshlet gpuMeshlet{};
+        std::memcpy(gpuMeshlet.sphere, bounds.center, sizeof(bounds.center));
+        gpuMeshlet.sphere[3] = bounds.radius;
+        std::memcpy(gpuMeshlet.cone, bounds.coneAxis,
+                    sizeof(bounds.coneAxis));
+        gpuMeshlet.cone[3] = bounds.coneCutoff;
+        gpuMeshlet.vertexOffset = vertexBase + meshlet.vertexOffset;
+        gpuMeshlet.triangleOffset = triangleBase + meshlet.triangleOffset;
+        gpuMeshlet.vertexCount = meshlet.vertexCount;
+        gpuMeshlet.triangleCount = meshlet.triangleCount;
+        mMeshlets.push_back(gpuMeshlet);
+    }
+    for (uint32_t vertex : meshlets.vertices) {
+        mVertices.push_back(mesh.vertexOffset + vertex);
+    }
+    for (size_t i = 0; i < meshlets.triangles.size(); i += 3) {
+        mTriangles.push_back(meshlets.triangles[i] |
+                             meshlets.triangles[i + 1] << 8u |
+                             meshlets.triangles[i + 2] << 16u);
+    }
+}
+
+void MeshletRenderer::Upload(VkCommandPool commandPool, VkQueue queue) {
+    vkDestroyBuffer(mDevice, mBuffer, mAllocator);
+    vkFreeMemory(mDevice, mMemory, mAllocator);
+    mBuffer = VK_NULL_HANDLE;
+    mMemory = VK_NULL_HANDLE;
+    mMeshletCount = mMeshlets.size();
+    if (mMeshlets.empty()) {
+        return;
+    }
+
+    VkDeviceSize meshletsSize = mMeshlets.size() * sizeof(GpuMeshlet);
+    mVerticesOffset = AlignSection(meshletsSize);
+    mTrianglesOffset = AlignSection(mVerticesOffset +
+                                    mVertices.size() * sizeof(uint32_t));
+    VkDeviceSize size = mTrianglesOffset +
+                        mTriangles.size() * sizeof(uint32_t);
+    std::vector<uint8_t> data(size);
+    std::memcpy(data.data(), mMeshlets.data(), meshletsSize);
+    std::memcpy(data.data() + mVerticesOffset, mVertices.data(),
+                mVertices.size() * sizeof(uint32_t));
+    std::memcpy(data.data() + mTrianglesOffset, mTriangles.data(),
+                mTriangles.size() * sizeof(uint32_t));
+
+    CreateBuffer(mPhysicalDevice, mDevice, mAllocator, size,
+                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                 VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mBuffer, mMemory);
+    UploadBuffer(mPhysicalDevice, mDevice, mAllocator, commandPool, queue,
+                 data.data(), size, mBuffer);
+}
+
+void MeshletRenderer::Draw(VkCommandBuffer commandBuffer,
+                           const MeshBuffer &meshBuffer,
+                           const CullView &view) {
+    if (mMeshletCount == 0) {
+        return;
+    }
+
+    // the buffers never change, the set is cached after the first frame
+    DescriptorSetDesc setDesc;
+    setDesc.layout = mSetLayout;
+    const VkDescriptorBufferInfo buffers[4]{
+            {mBuffer, 0, mVerticesOffset},
+            {mBuffer, mVerticesOffset, mTrianglesOffset - mVerticesOffset},
+            {mBuffer, mTrianglesOffset, VK_WHOLE_SIZE},
+            {meshBuffer.GetBuffer(), 0, VK_WHOLE_SIZE}
+    };
+    for (uint32_t i = 0; i < 4; i++) {
+        DescriptorDesc descriptor;
+        descriptor.binding = i;
+        descriptor.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptor.buffer = buffers[i];
+        setDesc.descriptors.push_back(descriptor);
+    }
+    VkDescriptorSet set = mDescriptorAllocator->GetStatic(setDesc);
+
+    CullFrustum frustum = CullFrustum::FromViewProjection(
+            view.viewProjection);
+    Constants constants{};
+    std::memcpy(constants.planes, frustum.planes, sizeof(constants.planes));
+    std::memcpy(constants.cameraPosition, view.cameraPosition,
+                sizeof(constants.cameraPosition));
+    constants.meshletCount = mMeshletCount;
+    constants.positionsBase = meshBuffer.GetSectionOffset(
+            MeshBuffer::POSITIONS) / sizeof(float);
+    constants.attributesBase = meshBuffer.GetSectionOffset(
+            MeshBuffer::ATTRIBUTES) / sizeof(float);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                      mPipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                            mPipelineLayout, 0, 1, &set, 0, nullptr);
+    vkCmdPushConstants(commandBuffer, mPipelineLayout,
+                       VK_SHADER_STAGE_TASK_BIT_EXT |
+                       VK_SHADER_STAGE_MESH_BIT_EXT, 0, sizeof(constants),
+                       &constants);
+    mDrawMeshTasks(commandBuffer,
+                   (mMeshletCount + TASK_GROUP_SIZE - 1) / TASK_GROUP_SIZE,
+                   1, 1);
+}
@@ -0,0 +1,106 @@
+//
+// Created by Krisu on 2020/4/16.
+//
+
+#ifndef VULKAN_TEST_MESHLETRENDERER_HPP
+#define VULKAN_TEST_MESHLETRENDERER_HPP
+
+#include <vulkan/vulkan.h>
+
+#include "DescriptorAllocator.hpp"
+#include "GpuCuller.hpp"
+#include "MeshBuffer.hpp"
+#include "MeshletBuilder.hpp"
+
+#include <cstdint>
+#include <vector>
+
+
+/* Draws meshlets with task and mesh shaders (VK_EXT_mesh_shader): a task
+ * workgroup tests 32 meshlets against the frustum and their normal cones
+ * (shaders/meshlet.task) and launches one mesh workgroup per survivor,
+ * which reads the meshlet's vertices straight from the MeshBuffer
+ * (shaders/meshlet.mesh). Nothing goes through the input assembler, so
+ * the culling needs no compute pass and no indirect draws.
+ *
+ * Only deinterleaved meshes are supported, the meshlet data is static
+ * once uploaded. */
+class MeshletRenderer {
+public:
+    /* The pipeline renders to colorFormat and depthFormat, with dynamic
+     * rendering when renderPass is VK_NULL_HANDLE */
+    void Init(VkPhysicalDevice physicalDevice, VkDevice device,
+              const VkAllocationCallbacks *pAllocator,
+              DescriptorAllocator &descriptorAllocator,
+              const std::vector<char> &taskCode,
+              const std::vector<char> &meshCode,
+              const std::vector<char> &fragCode, VkFormat colorFormat,
+              VkFormat depthFormat, VkRenderPass renderPass,
+              PFN_vkCmdDrawMeshTasksEXT drawMeshTasks);
+
+    void Destroy();
+
+    /* Queue the meshlets of mesh for the next Upload, built from the
+     * indices mesh was added with */
+    void Add(const MeshletData &meshlets, const Mesh &mesh);
+
+    /* Copy everything added so far to the device */
+    void Upload(VkCommandPool commandPool, VkQueue queue);
+
+    /* Draw every meshlet visible from view, inside a render pass or
+     * dynamic rendering. meshBuffer holds the meshes. */
+    void Draw(VkCommandBuffer commandBuffer, const MeshBuffer &meshBuffer,
+              const CullView &view);
+
+    uint32_t GetMeshletCount() const { return mMeshletCount; }
+
+    // meshlets tested by one task workgroup, see shaders/meshlet.task
+    constexpr static const uint32_t TASK_GROUP_SIZE = 32;
+
+private:
+    // std430 layout of shaders/meshlet.task
+    struct GpuMeshlet {
+        float    sphere[4];
+        // axis and cutoff
+        float    cone[4];
+        uint32_t vertexOffset;
+        uint32_t triangleOffset;
+        uint32_t vertexCount;
+        uint32_t triangleCount;
+    };
+
+    struct Constants {
+        float    planes[6][4];
+        float    cameraPosition[3];
+        uint32_t meshletCount;
+        // float offsets of the streams in the mesh buffer
+        uint32_t positionsBase;
+        uint32_t attributesBase;
+    };
+
+private:
+    VkPhysicalDevice             mPhysicalDevice = VK_NULL_HANDLE;
+    VkDevice                     mDevice = VK_NULL_HANDLE;
+    const VkAllocationCallbacks *mAllocator = nullptr;
+    DescriptorAllocator         *mDescriptorAllocator = nullptr;
+    PFN_vkCmdDrawMeshTasksEXT    mDrawMeshTasks = nullptr;
+
+    VkDescriptorSetLayout mSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout      mPipelineLayout = VK_NULL_HANDLE;
+    VkPipeline            mPipeline = VK_NULL_HANDLE;
+
+    // what Add queued, vertices are absolute mesh buffer vertices and
+    // triangles three bytes packed in a uint
+    std::vector<GpuMeshlet> mMeshlets;
+    std::vector<uint32_t>   mVertices;
+    std::vector<uint32_t>   mTriangles;
+
+    // meshlets, vertices and triangles one after another
+    VkBuffer       mBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory mMemory = VK_NULL_HANDLE;
+    VkDeviceSize   mVerticesOffset = 0;
+    VkDeviceSize   mTrianglesOffset = 0;
+    uint32_t       mMeshletCount = 0;
+};
+
+#endif //VULKAN_TEST_MESHLETRENDERER_HPP
@@ -0,0 +1,375 @@
+//
+// Created by Krisu on 2020/4/16.
+//
+
+#include "MipGenerator.hpp"
+#include "AllocationTracker.hpp"
+#include "VulkanUtils.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+// one workgroup per 64x64 tile of mip 0
+constexpr uint32_t TILE_SIZE = 64;
+constexpr uint32_t MAX_COMPUTE_GROUPS =
+        (MipGenerator::MAX_COMPUTE_SIZE / TILE_SIZE) *
+        (MipGenerator::MAX_COMPUTE_SIZE / TILE_SIZE);
+// the counter is padded to the alignment of the vec4 texels after it
+constexpr VkDeviceSize SCRATCH_SIZE = 16 + MAX_COMPUTE_GROUPS * 16;
+
+}
+
+void MipGenerator::Init(VkPhysicalDevice physicalDevice, VkDevice device,
+                        const VkAllocationCallbacks *pAllocator,
+                        DescriptorAllocator &descriptorAllocator,
+                        DescriptorUpdater &descriptorUpdater,
+                        const std::vector<char> &shaderCode,
+                        uint32_t framesInFlight) {
+    mPhysicalDevice = physicalDevice;
+    mDevice = device;
+    mAllocator = pAllocator;
+    mDescriptorAllocator = &descriptorAllocator;
+    mDescriptorUpdater = &descriptorUpdater;
+    mViews.resize(framesInFlight);
+    if (shaderCode.empty()) {
+        return;
+    }
+
+    VkSamplerCreateInfo samplerCreateInfo{};
+    samplerCreateInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerCreateInfo.magFilter = VK_FILTER_LINEAR;
+    samplerCreateInfo.minFilter = VK_FILTER_LINEAR;
+    samplerCreateInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerCreateInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerCreateInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerCreateInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    {
+        AllocationTracker::ScopedTag tag(VK_OBJECT_TYPE_SAMPLER);
+        if (vkCreateSampler(mDevice, &samplerCreateInfo, mAllocator,
+                            &mSampler) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create downsample sampler");
+        }
+    }
+
+    std::vector<VkDescriptorSetLayoutBinding> bindings(3);
+    bindings[0].binding = 0;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bindings[0].descriptorCount = 1;
+    bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings[0].pImmutableSamplers = &mSampler;
+    bindings[1].binding = 1;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    bindings[1].descriptorCount = COMPUTE_MIPS;
+    bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings[2].binding = 2;
+    bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[2].descriptorCount = 1;
+    bindings[2].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    VkDescriptorSetLayoutCreateInfo setLayoutCreateInfo{};
+    setLayoutCreateInfo.sType =
+            VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    setLayoutCreateInfo.bindingCount = bindings.size();
+    setLayoutCreateInfo.pBindings = bindings.data();
+    {
+        AllocationTracker::ScopedTag tag(
+                VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT);
+        if (vkCreateDescriptorSetLayout(mDevice, &setLayoutCreateInfo,
+                                        mAllocator, &mSetLayout) !=
+            VK_SUCCESS) {
+            throw std::runtime_error(
+                    "failed to create downsample descriptor set layout");
+        }
+    }
+    mDescriptorAllocator->RegisterLayout(mSetLayout, bindings);
+    mDescriptorUpdater->RegisterLayout(mSetLayout, bindings);
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.size = sizeof(Constants);
+    VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo{};
+    pipelineLayoutCreateInfo.sType =
+            VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutCreateInfo.setLayoutCount = 1;
+    pipelineLayoutCreateInfo.pSetLayouts = &mSetLayout;
+    pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+    pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+    {
+        AllocationTracker::ScopedTag tag(VK_OBJECT_TYPE_PIPELINE_LAYOUT);
+        if (vkCreatePipelineLayout(mDevice, &pipelineLayoutCreateInfo,
+                                   mAllocator, &mPipelineLayout) !=
+            VK_SUCCESS) {
+            throw std::runtime_error(
+                    "failed to create downsample pipeline layout");
+        }
+    }
+
+    VkShaderModuleCreateInfo shaderModuleCreateInfo{};
+    shaderModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    shaderModuleCreateInfo.codeSize = shaderCode.size();
+    shaderModuleCreateInfo.pCode =
+            reinterpret_cast<const uint32_t *>(shaderCode.data());
+    VkShaderModule shaderModule;
+    {
+        AllocationTracker::ScopedTag tag(VK_OBJECT_TYPE_SHADER_MODULE);
+        if (vkCreateShaderModule(mDevice, &shaderModuleCreateInfo, mAllocator,
+                                 &shaderModule) != VK_SUCCESS) {
+            throw std::runtime_error(
+                    "failed to create downsample shader module");
+        }
+    }
+
+    VkComputePipelineCreateInfo pipelineCreateInfo{};
+    pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineCreateInfo.stage.sType =
+            VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineCreateInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineCreateInfo.stage.module = shaderModule;
+    pipelineCreateInfo.stage.pName = "main";
+    pipelineCreateInfo.layout = mPipelineLayout;
+    VkResult result;
+    {
+        AllocationTracker::ScopedTag tag(VK_OBJECT_TYPE_PIPELINE);
+        result = vkCreateComputePipelines(mDevice, VK_NULL_HANDLE, 1,
+                                          &pipelineCreateInfo, mAllocator,
+                                          &mPipeline);
+    }
+    vkDestroyShaderModule(mDevice, shaderModule, mAllocator);
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("failed to create downsample pipeline");
+    }
+
+    CreateBuffer(mPhysicalDevice, mDevice, mAllocator, SCRATCH_SIZE,
+                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                 VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mScratch,
+                 mScratchMemory);
+    mScratchCleared = false;
+}
+
+void MipGenerator::Destroy() {
+    if (mDevice == VK_NULL_HANDLE) {
+        return;
+    }
+    for (auto &views : mViews) {
+        for (VkImageView view : views) {
+            vkDestroyImageView(mDevice, view, mAllocator);
+        }
+    }
+    mViews.clear();
+    if (mPipeline != VK_NULL_HANDLE) {
+        vkDestroyBuffer(mDevice, mScratch, mAllocator);
+        vkFreeMemory(mDevice, mScratchMemory, mAllocator);
+        vkDestroyPipeline(mDevice, mPipeline, mAllocator);
+        vkDestroyPipelineLayout(mDevice, mPipelineLayout, mAllocator);
+        vkDestroyDescriptorSetLayout(mDevice, mSetLayout, mAllocator);
+        vkDestroySampler(mDevice, mSampler, mAllocator);
+        mPipeline = VK_NULL_HANDLE;
+    }
+    mDevice = VK_NULL_HANDLE;
+}
+
+VkImageUsageFlags MipGenerator::GetRequiredUsage(VkFormat format,
+                                                 uint32_t width,
+                                                 uint32_t height) const {
+    if (UsesCompute(format, width, height)) {
+        return VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT;
+    }
+    VkFormatProperties properties;
+    vkGetPhysicalDeviceFormatProperties(mPhysicalDevice, format, &properties);
+    const VkFormatFeatureFlags blit =
+            VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT |
+            VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    if ((properties.optimalTilingFeatures & blit) == blit) {
+        return VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+               VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    }
+    return 0;
+}
+
+void MipGenerator::Record(VkCommandBuffer commandBuffer, VkImage image,
+                          VkFormat format, uint32_t width, uint32_t height,
+                          uint32_t mipCount) {
+    if (mipCount <= 1) {
+        return;
+    }
+    if (UsesCompute(format, width, height)) {
+        RecordCompute(commandBuffer, image, format, width, height, mipCount);
+    } else {
+        RecordBlits(commandBuffer, image, width, height, mipCount);
+    }
+}
+
+void MipGenerator::NextFrame() {
+    mFrame = (mFrame + 1) % mViews.size();
+    for (VkImageView view : mViews[mFrame]) {
+        vkDestroyImageView(mDevice, view, mAllocator);
+    }
+    mViews[mFrame].clear();
+}
+
+bool MipGenerator::UsesCompute(VkFormat format, uint32_t width,
+                               uint32_t height) const {
+    if (mPipeline == VK_NULL_HANDLE ||
+        std::max(width, height) > MAX_COMPUTE_SIZE) {
+        return false;
+    }
+    VkFormatProperties properties;
+    vkGetPhysicalDeviceFormatProperties(mPhysicalDevice, format, &properties);
+    const VkFormatFeatureFlags compute =
+            VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT |
+            VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    return (properties.optimalTilingFeatures & compute) == compute;
+}
+
+void MipGenerator::RecordCompute(VkCommandBuffer commandBuffer, VkImage image,
+                                 VkFormat format, uint32_t width,
+                                 uint32_t height, uint32_t mipCount) {
+    // the counter starts at 0 and every dispatch leaves it there
+    if (!mScratchCleared) {
+        vkCmdFillBuffer(commandBuffer, mScratch, 0, 16, 0);
+        mScratchCleared = true;
+    }
+
+    Descriptors descriptors{};
+    descriptors.source = {mSampler, CreateView(image, format, 0),
+                          VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+    for (uint32_t i = 0; i < COMPUTE_MIPS; i++) {
+        // unused elements repeat the last mip, the shader skips them
+        uint32_t mip = std::min(i + 1, mipCount - 1);
+        VkImageView view = mip == i + 1 ? CreateView(image, format, mip)
+                                        : descriptors.mips[i - 1].imageView;
+        descriptors.mips[i] = {VK_NULL_HANDLE, view,
+                               VK_IMAGE_LAYOUT_GENERAL};
+    }
+    descriptors.scratch = {mScratch, 0, SCRATCH_SIZE};
+    VkDescriptorSet set = mDescriptorAllocator->Allocate(mSetLayout);
+    mDescriptorUpdater->Update(set, mSetLayout, descriptors);
+
+    // an earlier dispatch may still use the scratch buffer
+    VkMemoryBarrier memoryBarrier{};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT |
+                                  VK_ACCESS_TRANSFER_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT |
+                                  VK_ACCESS_SHADER_WRITE_BIT;
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 1, mipCount - 1,
+                                0, 1};
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    // mip 0 was written by a transfer, earlier frames may sample the rest
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+                         &memoryBarrier, 0, nullptr, 1, &barrier);
+
+    Constants constants{};
+    constants.width = width;
+    constants.height = height;
+    constants.mipCount = mipCount;
+    constants.groupCountX = (width + TILE_SIZE - 1) / TILE_SIZE;
+    uint32_t groupCountY = (height + TILE_SIZE - 1) / TILE_SIZE;
+    constants.groupCount = constants.groupCountX * groupCountY;
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                      mPipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                            mPipelineLayout, 0, 1, &set, 0, nullptr);
+    vkCmdPushConstants(commandBuffer, mPipelineLayout,
+                       VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants),
+                       &constants);
+    vkCmdDispatch(commandBuffer, constants.groupCountX, groupCountY, 1);
+
+    barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0,
+                         nullptr, 1, &barrier);
+}
+
+void MipGenerator::RecordBlits(VkCommandBuffer commandBuffer, VkImage image,
+                               uint32_t width, uint32_t height,
+                               uint32_t mipCount) {
+    VkImageMemoryBarrier barriers[2]{};
+    for (auto &barrier : barriers) {
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image;
+    }
+    barriers[0].subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    barriers[0].oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barriers[0].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    barriers[1].subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 1,
+                                    mipCount - 1, 0, 1};
+    barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barriers[1].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                         nullptr, 2, barriers);
+
+    // each level reads the one before, so every blit waits for the last
+    barriers[0].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barriers[0].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barriers[0].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    auto extent = [&](uint32_t mip) {
+        return VkOffset3D{static_cast<int32_t>(std::max(width >> mip, 1u)),
+                          static_cast<int32_t>(std::max(height >> mip, 1u)),
+                          1};
+    };
+    for (uint32_t mip = 1; mip < mipCount; mip++) {
+        VkImageBlit blit{};
+        blit.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, mip - 1, 0, 1};
+        blit.srcOffsets[1] = extent(mip - 1);
+        blit.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, mip, 0, 1};
+        blit.dstOffsets[1] = extent(mip);
+        vkCmdBlitImage(commandBuffer, image,
+                       VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image,
+                       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit,
+                       VK_FILTER_LINEAR);
+        barriers[0].subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, mip, 1, 0,
+                                        1};
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                             nullptr, 1, barriers);
+    }
+
+    barriers[0].subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, mipCount, 0,
+                                    1};
+    barriers[0].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barriers[0].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barriers[0].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0,
+                         nullptr, 1, barriers);
+}
+
+VkImageView MipGenerator::CreateView(VkImage image, VkFormat format,
+                                     uint32_t mip) {
+    VkImageViewCreateInfo viewCreateInfo{};
+    viewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewCreateInfo.image = image;
+    viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewCreateInfo.format = format;
+    viewCreateInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, mip, 1, 0,
+                                       1};
+    VkImageView view;
+    AllocationTracker::ScopedTag tag(VK_OBJECT_TYPE_IMAGE_VIEW);
+    if (vkCreateImageView(mDevice, &viewCreateInfo, mAllocator, &view) !=
+        VK_SUCCESS) {
+        throw std::runtime_error("failed to create mip image view");
+    }
+    mViews[mFrame].push_back(view);
+    return view;
+}
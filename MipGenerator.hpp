@@ -0,0 +1,105 @@
+//
+// Created by Krisu on 2020/4/16.
+//
+
+#ifndef VULKAN_TEST_MIPGENERATOR_HPP
+#define VULKAN_TEST_MIPGENERATOR_HPP
+
+#include <vulkan/vulkan.h>
+
+#include "DescriptorAllocator.hpp"
+#include "DescriptorUpdater.hpp"
+
+#include <cstdint>
+#include <vector>
+
+
+/* Fills the mip chain of an image from its mip 0 on the GPU.
+ *
+ * Images up to MAX_COMPUTE_SIZE whose format can be a storage image get
+ * the whole chain from one compute dispatch (shaders/downsample.comp):
+ * each workgroup reduces a 64x64 tile down to mip 6 in shared memory and
+ * the last one to finish reduces the rest, so there is no barrier between
+ * levels. Everything else falls back to a vkCmdBlitImage per level. */
+class MipGenerator {
+public:
+    /* shaderCode is shaders/downsample.spv, empty to always blit. The
+     * compute path writes storage images without a format, the device
+     * needs shaderStorageImageWriteWithoutFormat enabled. */
+    void Init(VkPhysicalDevice physicalDevice, VkDevice device,
+              const VkAllocationCallbacks *pAllocator,
+              DescriptorAllocator &descriptorAllocator,
+              DescriptorUpdater &descriptorUpdater,
+              const std::vector<char> &shaderCode, uint32_t framesInFlight);
+
+    void Destroy();
+
+    /* Usage an image of format needs for Record on top of its own, 0 when
+     * its mips can not be generated at all */
+    VkImageUsageFlags GetRequiredUsage(VkFormat format, uint32_t width,
+                                       uint32_t height) const;
+
+    /* Every level of image is in SHADER_READ_ONLY_OPTIMAL before and
+     * after, mip 0 holds the data. The views and sets used live until
+     * the frame comes around again. */
+    void Record(VkCommandBuffer commandBuffer, VkImage image, VkFormat format,
+                uint32_t width, uint32_t height, uint32_t mipCount);
+
+    /* Call once per frame after the frame's fence was waited on */
+    void NextFrame();
+
+    constexpr static const uint32_t MAX_COMPUTE_SIZE = 4096;
+
+private:
+    // levels below mip 0 the shader writes, log2(MAX_COMPUTE_SIZE)
+    constexpr static const uint32_t COMPUTE_MIPS = 12;
+
+    struct Constants {
+        uint32_t width;
+        uint32_t height;
+        uint32_t mipCount;
+        uint32_t groupCountX;
+        uint32_t groupCount;
+    };
+
+    // packed for DescriptorUpdater, mips[i] is mip i + 1
+    struct Descriptors {
+        VkDescriptorImageInfo  source;
+        VkDescriptorImageInfo  mips[COMPUTE_MIPS];
+        VkDescriptorBufferInfo scratch;
+    };
+
+    bool UsesCompute(VkFormat format, uint32_t width, uint32_t height) const;
+
+    void RecordCompute(VkCommandBuffer commandBuffer, VkImage image,
+                       VkFormat format, uint32_t width, uint32_t height,
+                       uint32_t mipCount);
+
+    void RecordBlits(VkCommandBuffer commandBuffer, VkImage image,
+                     uint32_t width, uint32_t height, uint32_t mipCount);
+
+    VkImageView CreateView(VkImage image, VkFormat format, uint32_t mip);
+
+private:
+    VkPhysicalDevice             mPhysicalDevice = VK_NULL_HANDLE;
+    VkDevice                     mDevice = VK_NULL_HANDLE;
+    const VkAllocationCallbacks *mAllocator = nullptr;
+    DescriptorAllocator         *mDescriptorAllocator = nullptr;
+    DescriptorUpdater           *mDescriptorUpdater = nullptr;
+
+    VkSampler             mSampler = VK_NULL_HANDLE;
+    VkDescriptorSetLayout mSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout      mPipelineLayout = VK_NULL_HANDLE;
+    VkPipeline            mPipeline = VK_NULL_HANDLE;
+
+    // atomic counter and the mip 6 texels of every workgroup
+    VkBuffer       mScratch = VK_NULL_HANDLE;
+    VkDeviceMemory mScratchMemory = VK_NULL_HANDLE;
+    bool           mScratchCleared = false;
+
+    // views recorded per frame, destroyed when the frame comes around
+    std::vector<std::vector<VkImageView>> mViews;
+    uint32_t                              mFrame = 0;
+};
+
+#endif //VULKAN_TEST_MIPGENERATOR_HPP
@@ -0,0 +1,133 @@
+//
+// Created by Krisu on 2020/4/16.
+//
+
+#include "RadixSort.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+
+namespace {
+
+constexpr uint32_t RADIX_BITS = 8;
+constexpr uint32_t RADIX_SIZE = 1u << RADIX_BITS;
+constexpr uint32_t PASS_COUNT = 64 / RADIX_BITS;
+// below this the jobs cost more than they save
+constexpr size_t PARALLEL_THRESHOLD = 16 * 1024;
+
+uint32_t GetDigit(uint64_t key, uint32_t pass) {
+    return (key >> (pass * RADIX_BITS)) & (RADIX_SIZE - 1);
+}
+
+}
+
+void RadixSort(std::vector<SortEntry> &entries,
+               std::vector<SortEntry> &scratch) {
+    size_t count = entries.size();
+    if (count < 2) {
+        return;
+    }
+    scratch.resize(count);
+
+    static_assert(PASS_COUNT * RADIX_BITS == 64, "digits must cover the key");
+    std::vector<uint32_t> histograms(PASS_COUNT * RADIX_SIZE, 0);
+    for (const auto &entry : entries) {
+        for (uint32_t pass = 0; pass < PASS_COUNT; pass++) {
+            histograms[pass * RADIX_SIZE + GetDigit(entry.key, pass)]++;
+        }
+    }
+
+    for (uint32_t pass = 0; pass < PASS_COUNT; pass++) {
+        uint32_t *histogram = &histograms[pass * RADIX_SIZE];
+        // the pass would not move anything
+        if (histogram[GetDigit(entries[0].key, pass)] == count) {
+            continue;
+        }
+
+        // histogram becomes the first slot of every digit
+        uint32_t offset = 0;
+        for (uint32_t digit = 0; digit < RADIX_SIZE; digit++) {
+            uint32_t size = histogram[digit];
+            histogram[digit] = offset;
+            offset += size;
+        }
+        for (const auto &entry : entries) {
+            scratch[histogram[GetDigit(entry.key, pass)]++] = entry;
+        }
+        std::swap(entries, scratch);
+    }
+}
+
+void ParallelRadixSort(std::vector<SortEntry> &entries,
+                       std::vector<SortEntry> &scratch,
+                       JobSystem &jobSystem) {
+    size_t count = entries.size();
+    size_t blockCount = std::min<size_t>(jobSystem.GetConcurrency(),
+                                         count / PARALLEL_THRESHOLD);
+    if (blockCount < 2) {
+        RadixSort(entries, scratch);
+        return;
+    }
+    scratch.resize(count);
+    size_t blockSize = (count + blockCount - 1) / blockCount;
+
+    // which passes move anything, from the digits of every pass at once
+    std::vector<uint32_t> blockHistograms(blockCount * PASS_COUNT *
+                                          RADIX_SIZE, 0);
+    jobSystem.ParallelFor(blockCount, 1, [&](size_t block, size_t) {
+        uint32_t *histograms = &blockHistograms[block * PASS_COUNT *
+                                                RADIX_SIZE];
+        size_t end = std::min(count, (block + 1) * blockSize);
+        for (size_t i = block * blockSize; i < end; i++) {
+            for (uint32_t pass = 0; pass < PASS_COUNT; pass++) {
+                histograms[pass * RADIX_SIZE +
+                           GetDigit(entries[i].key, pass)]++;
+            }
+        }
+    });
+    bool passNeeded[PASS_COUNT];
+    for (uint32_t pass = 0; pass < PASS_COUNT; pass++) {
+        uint32_t firstDigit = GetDigit(entries[0].key, pass);
+        size_t sameDigit = 0;
+        for (size_t block = 0; block < blockCount; block++) {
+            sameDigit += blockHistograms[(block * PASS_COUNT + pass) *
+                                         RADIX_SIZE + firstDigit];
+        }
+        passNeeded[pass] = sameDigit != count;
+    }
+
+    // per block and digit, first the counts and then the output slots
+    std::vector<uint32_t> offsets(blockCount * RADIX_SIZE);
+    for (uint32_t pass = 0; pass < PASS_COUNT; pass++) {
+        if (!passNeeded[pass]) {
+            continue;
+        }
+        // blocks hold other entries after a pass, count them again
+        std::fill(offsets.begin(), offsets.end(), 0);
+        jobSystem.ParallelFor(blockCount, 1, [&](size_t block, size_t) {
+            uint32_t *histogram = &offsets[block * RADIX_SIZE];
+            size_t end = std::min(count, (block + 1) * blockSize);
+            for (size_t i = block * blockSize; i < end; i++) {
+                histogram[GetDigit(entries[i].key, pass)]++;
+            }
+        });
+        uint32_t offset = 0;
+        for (uint32_t digit = 0; digit < RADIX_SIZE; digit++) {
+            for (size_t block = 0; block < blockCount; block++) {
+                uint32_t &slot = offsets[block * RADIX_SIZE + digit];
+                uint32_t size = slot;
+                slot = offset;
+                offset += size;
+            }
+        }
+        jobSystem.ParallelFor(blockCount, 1, [&](size_t block, size_t) {
+            uint32_t *slots = &offsets[block * RADIX_SIZE];
+            size_t end = std::min(count, (block + 1) * blockSize);
+            for (size_t i = block * blockSize; i < end; i++) {
+                scratch[slots[GetDigit(entries[i].key, pass)]++] = entries[i];
+            }
+        });
+        std::swap(entries, scratch);
+    }
+}
@@ -0,0 +1,37 @@
+//
+// Created by Krisu on 2020/4/16.
+//
+
+#ifndef VULKAN_TEST_RADIXSORT_HPP
+#define VULKAN_TEST_RADIXSORT_HPP
+
+#include "JobSystem.hpp"
+
+#include <cstdint>
+#include <vector>
+
+
+/* A sort key with the index of what it sorts */
+struct SortEntry {
+    uint64_t key;
+    uint32_t index;
+};
+
+/* Stable LSD radix sort by key, 8 bits per pass. One pass over the keys
+ * builds the histograms of every digit, passes where all keys share the
+ * digit are skipped, so keys using few bits sort in few passes. scratch
+ * holds garbage afterwards, keeping it around saves the allocation. */
+void RadixSort(std::vector<SortEntry> &entries,
+               std::vector<SortEntry> &scratch);
+
+/* RadixSort spread over the workers of jobSystem, same result. Every
+ * pass splits the entries into one block per thread: the blocks count
+ * their digits in parallel, a prefix sum over the counts in block order
+ * gives every block its own output slots, then the blocks scatter in
+ * parallel, which keeps the sort stable. Small inputs are sorted on the
+ * calling thread. */
+void ParallelRadixSort(std::vector<SortEntry> &entries,
+                       std::vector<SortEntry> &scratch,
+                       JobSystem &jobSystem);
+
+#endif //VULKAN_TEST_RADIXSORT_HPP
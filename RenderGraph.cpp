@@ -0,0 +1,577 @@
+//
+// Created by Krisu on 2020/4/9.
+//
+
+#include "RenderGraph.hpp"
+
+#include <stdexcept>
+
+void RenderGraph::PassBuilder::Read(RenderGraphHandle handle,
+                                    RenderGraphUsage usage) {
+    mGraph.mPasses[mPass].accesses.push_back(
+            {handle, usage, false, RenderGraphWriteMode::Preserve, {}, false});
+}
+
+void RenderGraph::PassBuilder::Write(RenderGraphHandle handle,
+                                     RenderGraphUsage usage,
+                                     RenderGraphWriteMode mode) {
+    mGraph.mPasses[mPass].accesses.push_back(
+            {handle, usage, true, mode, {}, false});
+}
+
+void RenderGraph::PassBuilder::Clear(RenderGraphHandle handle,
+                                     RenderGraphUsage usage,
+                                     VkClearValue clearValue) {
+    Access access{handle, usage, true, RenderGraphWriteMode::Clear, {}, true};
+    access.ops.clearValue = clearValue;
+    mGraph.mPasses[mPass].accesses.push_back(access);
+}
+
+void RenderGraph::PassBuilder::SetSideEffect() {
+    mGraph.mPasses[mPass].sideEffect = true;
+}
+
+RenderGraphAttachmentOps RenderGraph::PassContext::GetAttachmentOps(
+        RenderGraphHandle handle) const {
+    const Access *access = mGraph.FindAccess(mPass, handle);
+    if (access == nullptr || !access->write) {
+        throw std::runtime_error("attachment is not written by pass " +
+                                 mGraph.mPasses[mPass].name);
+    }
+    return access->ops;
+}
+
+VkImage RenderGraph::PassContext::GetImage(RenderGraphHandle handle) const {
+    return mGraph.mResources[handle].image.image;
+}
+
+VkImageView
+RenderGraph::PassContext::GetImageView(RenderGraphHandle handle) const {
+    return mGraph.mResources[handle].image.view;
+}
+
+VkBuffer RenderGraph::PassContext::GetBuffer(RenderGraphHandle handle) const {
+    return mGraph.mResources[handle].buffer;
+}
+
+void RenderGraph::BarrierBatch::Record(VkCommandBuffer commandBuffer) const {
+    if (Empty()) {
+        return;
+    }
+    vkCmdPipelineBarrier(
+            commandBuffer,
+            srcStages != 0 ? srcStages : static_cast<VkPipelineStageFlags>(
+                    VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT),
+            dstStages != 0 ? dstStages : static_cast<VkPipelineStageFlags>(
+                    VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT),
+            0, 0, nullptr,
+            bufferBarriers.size(), bufferBarriers.data(),
+            imageBarriers.size(), imageBarriers.data());
+}
+
+RenderGraphHandle RenderGraph::ImportImage(const std::string &name,
+                                           const RenderGraphImageInfo &info) {
+    Resource resource{};
+    resource.name = name;
+    resource.isImage = true;
+    resource.image = info;
+    resource.preserveContents = info.preserveContents;
+    mResources.push_back(resource);
+    return static_cast<RenderGraphHandle>(mResources.size() - 1);
+}
+
+RenderGraphHandle RenderGraph::ImportBuffer(const std::string &name,
+                                            VkBuffer buffer,
+                                            bool preserveContents) {
+    Resource resource{};
+    resource.name = name;
+    resource.isImage = false;
+    resource.buffer = buffer;
+    resource.preserveContents = preserveContents;
+    mResources.push_back(resource);
+    return static_cast<RenderGraphHandle>(mResources.size() - 1);
+}
+
+RenderGraphHandle RenderGraph::CreateImage(const std::string &name,
+                                           const RenderGraphImageInfo &info) {
+    Resource resource{};
+    resource.name = name;
+    resource.isImage = true;
+    resource.transient = true;
+    resource.image = info;
+    // memory may still be in use by an image aliasing it earlier on
+    resource.image.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    resource.image.initialStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    resource.image.initialAccess = VK_ACCESS_MEMORY_WRITE_BIT;
+    resource.image.preserveContents = false;
+    resource.preserveContents = false;
+    mResources.push_back(resource);
+    return static_cast<RenderGraphHandle>(mResources.size() - 1);
+}
+
+void RenderGraph::MarkOutput(RenderGraphHandle handle,
+                             VkImageLayout finalLayout,
+                             VkPipelineStageFlags finalStage,
+                             VkAccessFlags finalAccess) {
+    Resource &resource = mResources[handle];
+    resource.output = true;
+    resource.finalLayout = finalLayout;
+    resource.finalStage = finalStage;
+    resource.finalAccess = finalAccess;
+}
+
+void RenderGraph::AddPass(const std::string &name, const SetupFunction &setup,
+                          ExecuteFunction execute) {
+    Pass pass;
+    pass.name = name;
+    pass.execute = std::move(execute);
+    mPasses.push_back(std::move(pass));
+
+    PassBuilder builder(*this, static_cast<uint32_t>(mPasses.size() - 1));
+    setup(builder);
+}
+
+void RenderGraph::Compile(TransientAllocator *transientAllocator) {
+    CullPasses();
+    ChooseAttachmentOps();
+    RealizeTransientImages(transientAllocator);
+
+    for (auto &resource : mResources) {
+        resource.layout = resource.isImage ? resource.image.initialLayout
+                                           : VK_IMAGE_LAYOUT_UNDEFINED;
+        resource.writeStages = resource.isImage ? resource.image.initialStage
+                                                : 0;
+        resource.writeAccess = resource.isImage ? resource.image.initialAccess
+                                                : 0;
+        resource.readStages = 0;
+        // whatever happened before the graph is synchronised outside of it
+        resource.visibleStages = ~0u;
+        resource.visibleAccess = ~0u;
+    }
+
+    mBarrierBatchCount = 0;
+    for (auto &pass : mPasses) {
+        pass.barriers = {};
+        if (!pass.alive) {
+            continue;
+        }
+
+        // all accesses of one pass to a resource become a single state,
+        // a barrier inside a batch could not order them anyway
+        std::vector<bool> merged(pass.accesses.size(), false);
+        for (size_t i = 0; i < pass.accesses.size(); i++) {
+            if (merged[i]) {
+                continue;
+            }
+            const Access &access = pass.accesses[i];
+            UsageState state = GetUsageState(access.usage);
+            if (access.usage == RenderGraphUsage::ColorAttachment &&
+                access.ops.loadOp == VK_ATTACHMENT_LOAD_OP_LOAD) {
+                state.access |= VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
+            }
+            bool discard = access.discard;
+            for (size_t j = i + 1; j < pass.accesses.size(); j++) {
+                const Access &other = pass.accesses[j];
+                if (other.handle != access.handle) {
+                    continue;
+                }
+                UsageState otherState = GetUsageState(other.usage);
+                state.stages |= otherState.stages;
+                state.access |= otherState.access;
+                state.write |= otherState.write;
+                if (otherState.layout != state.layout) {
+                    state.layout = VK_IMAGE_LAYOUT_GENERAL;
+                }
+                discard = discard && other.discard;
+                merged[j] = true;
+            }
+            AddBarrier(pass.barriers, mResources[access.handle], state,
+                       discard);
+        }
+        if (!pass.barriers.Empty()) {
+            mBarrierBatchCount++;
+        }
+    }
+
+    mFinalBarriers = {};
+    for (auto &resource : mResources) {
+        if (!resource.output) {
+            continue;
+        }
+        UsageState state{resource.finalStage, resource.finalAccess,
+                         resource.isImage ? resource.finalLayout
+                                          : VK_IMAGE_LAYOUT_UNDEFINED,
+                         false};
+        AddBarrier(mFinalBarriers, resource, state, false);
+    }
+    if (!mFinalBarriers.Empty()) {
+        mBarrierBatchCount++;
+    }
+}
+
+void RenderGraph::Execute(VkCommandBuffer commandBuffer) {
+    for (uint32_t i = 0; i < mPasses.size(); i++) {
+        const Pass &pass = mPasses[i];
+        if (!pass.alive) {
+            continue;
+        }
+        pass.barriers.Record(commandBuffer);
+        if (pass.execute) {
+            pass.execute(PassContext(*this, i, commandBuffer));
+        }
+    }
+    mFinalBarriers.Record(commandBuffer);
+}
+
+void RenderGraph::Reset() {
+    mResources.clear();
+    mPasses.clear();
+    mFinalBarriers = {};
+    mCulledPassCount = 0;
+    mBarrierBatchCount = 0;
+}
+
+std::vector<RenderGraph::Lifetime> RenderGraph::GetResourceLifetimes() const {
+    std::vector<Lifetime> lifetimes(mResources.size());
+    for (int i = 0; i < static_cast<int>(mPasses.size()); i++) {
+        if (!mPasses[i].alive) {
+            continue;
+        }
+        for (const auto &access : mPasses[i].accesses) {
+            Lifetime &lifetime = lifetimes[access.handle];
+            if (lifetime.firstPass < 0) {
+                lifetime.firstPass = i;
+            }
+            lifetime.lastPass = i;
+        }
+    }
+    return lifetimes;
+}
+
+void RenderGraph::RealizeTransientImages(
+        TransientAllocator *transientAllocator) {
+    std::vector<Lifetime> lifetimes = GetResourceLifetimes();
+
+    std::vector<RenderGraphHandle> handles;
+    std::vector<TransientImageDesc> descs;
+    for (RenderGraphHandle i = 0; i < mResources.size(); i++) {
+        const Resource &resource = mResources[i];
+        if (!resource.transient || lifetimes[i].firstPass < 0) {
+            continue;
+        }
+        TransientImageDesc desc;
+        desc.name = resource.name;
+        desc.format = resource.image.format;
+        desc.extent = resource.image.extent;
+        desc.aspect = resource.image.aspect;
+        desc.samples = resource.image.samples;
+        desc.firstPass = lifetimes[i].firstPass;
+        desc.lastPass = lifetimes[i].lastPass;
+        desc.attachmentOnly = desc.firstPass == desc.lastPass;
+        handles.push_back(i);
+        descs.push_back(desc);
+    }
+    if (descs.empty()) {
+        return;
+    }
+    if (transientAllocator == nullptr) {
+        throw std::runtime_error("render graph has transient images but no "
+                                 "transient allocator");
+    }
+
+    for (size_t i = 0; i < handles.size(); i++) {
+        for (const auto &pass : mPasses) {
+            if (!pass.alive) {
+                continue;
+            }
+            for (const auto &access : pass.accesses) {
+                if (access.handle != handles[i]) {
+                    continue;
+                }
+                descs[i].usage |= GetImageUsage(access.usage);
+                if (access.usage != RenderGraphUsage::ColorAttachment &&
+                    access.usage != RenderGraphUsage::DepthAttachment &&
+                    access.usage != RenderGraphUsage::DepthAttachmentReadOnly) {
+                    descs[i].attachmentOnly = false;
+                }
+            }
+        }
+    }
+
+    std::vector<TransientImage> images = transientAllocator->Realize(descs);
+    for (size_t i = 0; i < handles.size(); i++) {
+        mResources[handles[i]].image.image = images[i].image;
+        mResources[handles[i]].image.view = images[i].view;
+    }
+}
+
+VkImageUsageFlags RenderGraph::GetImageUsage(RenderGraphUsage usage) {
+    switch (usage) {
+        case RenderGraphUsage::ColorAttachment:
+            return VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+        case RenderGraphUsage::DepthAttachment:
+        case RenderGraphUsage::DepthAttachmentReadOnly:
+            return VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+        case RenderGraphUsage::FragmentSampled:
+        case RenderGraphUsage::ComputeSampled:
+            return VK_IMAGE_USAGE_SAMPLED_BIT;
+        case RenderGraphUsage::ComputeStorageRead:
+        case RenderGraphUsage::ComputeStorageWrite:
+        case RenderGraphUsage::VertexStorageRead:
+            return VK_IMAGE_USAGE_STORAGE_BIT;
+        case RenderGraphUsage::TransferSrc:
+            return VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        case RenderGraphUsage::TransferDst:
+            return VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+        default:
+            return 0;
+    }
+}
+
+RenderGraph::UsageState RenderGraph::GetUsageState(RenderGraphUsage usage) {
+    switch (usage) {
+        case RenderGraphUsage::ColorAttachment:
+            return {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                    VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                    VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, true};
+        case RenderGraphUsage::DepthAttachment:
+            return {VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                    VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                    VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, true};
+        case RenderGraphUsage::DepthAttachmentReadOnly:
+            return {VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                    VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT,
+                    VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, false};
+        case RenderGraphUsage::FragmentSampled:
+            return {VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                    VK_ACCESS_SHADER_READ_BIT,
+                    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false};
+        case RenderGraphUsage::ComputeSampled:
+            return {VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                    VK_ACCESS_SHADER_READ_BIT,
+                    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false};
+        case RenderGraphUsage::ComputeStorageRead:
+            return {VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                    VK_ACCESS_SHADER_READ_BIT,
+                    VK_IMAGE_LAYOUT_GENERAL, false};
+        case RenderGraphUsage::ComputeStorageWrite:
+            return {VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                    VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                    VK_IMAGE_LAYOUT_GENERAL, true};
+        case RenderGraphUsage::VertexStorageRead:
+            return {VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+                    VK_ACCESS_SHADER_READ_BIT,
+                    VK_IMAGE_LAYOUT_GENERAL, false};
+        case RenderGraphUsage::TransferSrc:
+            return {VK_PIPELINE_STAGE_TRANSFER_BIT,
+                    VK_ACCESS_TRANSFER_READ_BIT,
+                    VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, false};
+        case RenderGraphUsage::TransferDst:
+            return {VK_PIPELINE_STAGE_TRANSFER_BIT,
+                    VK_ACCESS_TRANSFER_WRITE_BIT,
+                    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, true};
+        case RenderGraphUsage::VertexBuffer:
+            return {VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                    VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+                    VK_IMAGE_LAYOUT_UNDEFINED, false};
+        case RenderGraphUsage::IndexBuffer:
+            return {VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                    VK_ACCESS_INDEX_READ_BIT,
+                    VK_IMAGE_LAYOUT_UNDEFINED, false};
+        case RenderGraphUsage::IndirectBuffer:
+            return {VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+                    VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+                    VK_IMAGE_LAYOUT_UNDEFINED, false};
+        case RenderGraphUsage::UniformBuffer:
+            return {VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+                    VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+                    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                    VK_ACCESS_UNIFORM_READ_BIT,
+                    VK_IMAGE_LAYOUT_UNDEFINED, false};
+    }
+    throw std::runtime_error("unknown render graph usage");
+}
+
+void RenderGraph::CullPasses() {
+    // walk backwards from the outputs, a pass lives when somebody later
+    // needs what it writes
+    std::vector<bool> needed(mResources.size());
+    for (size_t i = 0; i < mResources.size(); i++) {
+        needed[i] = mResources[i].output;
+    }
+
+    mCulledPassCount = 0;
+    for (auto pass = mPasses.rbegin(); pass != mPasses.rend(); ++pass) {
+        pass->alive = pass->sideEffect;
+        for (const auto &access : pass->accesses) {
+            if (access.write && needed[access.handle]) {
+                pass->alive = true;
+            }
+        }
+        if (!pass->alive) {
+            mCulledPassCount++;
+            continue;
+        }
+        // a full overwrite makes earlier writers of the resource useless
+        for (const auto &access : pass->accesses) {
+            if (access.write && access.mode != RenderGraphWriteMode::Preserve) {
+                needed[access.handle] = false;
+            }
+        }
+        for (const auto &access : pass->accesses) {
+            if (!access.write || access.mode == RenderGraphWriteMode::Preserve) {
+                needed[access.handle] = true;
+            }
+        }
+    }
+}
+
+void RenderGraph::ChooseAttachmentOps() {
+    // load: only when something valid is there and the pass keeps it
+    std::vector<bool> hasContents(mResources.size());
+    for (size_t i = 0; i < mResources.size(); i++) {
+        hasContents[i] = mResources[i].preserveContents;
+    }
+    for (auto &pass : mPasses) {
+        if (!pass.alive) {
+            continue;
+        }
+        for (auto &access : pass.accesses) {
+            if (!access.write) {
+                continue;
+            }
+            bool keep = access.mode == RenderGraphWriteMode::Preserve &&
+                        hasContents[access.handle];
+            access.discard = !keep;
+            if (access.mode == RenderGraphWriteMode::Clear) {
+                access.ops.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+            } else {
+                access.ops.loadOp = keep ? VK_ATTACHMENT_LOAD_OP_LOAD
+                                         : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+            }
+        }
+        for (const auto &access : pass.accesses) {
+            if (access.write) {
+                hasContents[access.handle] = true;
+            }
+        }
+    }
+
+    // store: only when a later pass or the outside world looks at it
+    std::vector<bool> needed(mResources.size());
+    for (size_t i = 0; i < mResources.size(); i++) {
+        needed[i] = mResources[i].output;
+    }
+    for (auto pass = mPasses.rbegin(); pass != mPasses.rend(); ++pass) {
+        if (!pass->alive) {
+            continue;
+        }
+        for (auto &access : pass->accesses) {
+            if (access.write) {
+                access.ops.storeOp = needed[access.handle]
+                                     ? VK_ATTACHMENT_STORE_OP_STORE
+                                     : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+            }
+        }
+        for (const auto &access : pass->accesses) {
+            if (access.write && access.discard) {
+                needed[access.handle] = false;
+            }
+        }
+        for (const auto &access : pass->accesses) {
+            if (!access.write || !access.discard) {
+                needed[access.handle] = true;
+            }
+        }
+    }
+}
+
+void RenderGraph::AddBarrier(BarrierBatch &batch, Resource &resource,
+                             const UsageState &state, bool discardContents) {
+    bool layoutChange = resource.isImage && resource.layout != state.layout;
+
+    if (!state.write && !layoutChange) {
+        // read after read needs nothing, read after write only once per
+        // stage/access the write has not been made visible to yet
+        if (resource.writeStages == 0 ||
+            ((state.stages & ~resource.visibleStages) == 0 &&
+             (state.access & ~resource.visibleAccess) == 0)) {
+            resource.readStages |= state.stages;
+            return;
+        }
+    } else if (!resource.isImage && resource.writeStages == 0 &&
+               resource.readStages == 0) {
+        // first touch of a buffer, synchronised outside the graph
+        resource.writeStages = state.write ? state.stages : 0;
+        resource.writeAccess = state.write ? state.access : 0;
+        resource.readStages = state.write ? 0 : state.stages;
+        resource.visibleStages = state.stages;
+        resource.visibleAccess = state.access;
+        return;
+    }
+
+    VkPipelineStageFlags srcStages = resource.writeStages;
+    if (state.write || layoutChange) {
+        // write after read only needs the readers to have finished
+        srcStages |= resource.readStages;
+    }
+    batch.srcStages |= srcStages;
+    batch.dstStages |= state.stages;
+
+    if (resource.isImage) {
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = resource.writeAccess;
+        barrier.dstAccessMask = state.access;
+        barrier.oldLayout = discardContents ? VK_IMAGE_LAYOUT_UNDEFINED
+                                            : resource.layout;
+        barrier.newLayout = state.layout;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = resource.image.image;
+        barrier.subresourceRange = {resource.image.aspect,
+                                    0, VK_REMAINING_MIP_LEVELS,
+                                    0, VK_REMAINING_ARRAY_LAYERS};
+        batch.imageBarriers.push_back(barrier);
+    } else {
+        VkBufferMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcAccessMask = resource.writeAccess;
+        barrier.dstAccessMask = state.access;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.buffer = resource.buffer;
+        barrier.offset = 0;
+        barrier.size = VK_WHOLE_SIZE;
+        batch.bufferBarriers.push_back(barrier);
+    }
+
+    if (resource.isImage) {
+        resource.layout = state.layout;
+    }
+    if (state.write || layoutChange) {
+        // a layout transition counts as a write later readers wait for
+        resource.writeStages = state.stages;
+        resource.writeAccess = state.write ? state.access : 0;
+        resource.readStages = state.write ? 0 : state.stages;
+        resource.visibleStages = state.stages;
+        resource.visibleAccess = state.access;
+    } else {
+        resource.readStages |= state.stages;
+        resource.visibleStages |= state.stages;
+        resource.visibleAccess |= state.access;
+    }
+}
+
+const RenderGraph::Access *
+RenderGraph::FindAccess(uint32_t pass, RenderGraphHandle handle) const {
+    for (const auto &access : mPasses[pass].accesses) {
+        if (access.handle == handle && access.write) {
+            return &access;
+        }
+    }
+    return nullptr;
+}
@@ -0,0 +1,248 @@
+//
+// Created by Krisu on 2020/4/9.
+//
+
+#ifndef VULKAN_TEST_RENDERGRAPH_HPP
+#define VULKAN_TEST_RENDERGRAPH_HPP
+
+#include <vulkan/vulkan.h>
+
+#include "TransientAllocator.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+
+using RenderGraphHandle = uint32_t;
+
+/* How a pass touches a resource, decides stage, access and layout */
+enum class RenderGraphUsage {
+    ColorAttachment,
+    DepthAttachment,
+    DepthAttachmentReadOnly,
+    FragmentSampled,
+    ComputeSampled,
+    ComputeStorageRead,
+    ComputeStorageWrite,
+    VertexStorageRead,
+    TransferSrc,
+    TransferDst,
+    VertexBuffer,
+    IndexBuffer,
+    IndirectBuffer,
+    UniformBuffer
+};
+
+/* What a writing pass does with the previous contents */
+enum class RenderGraphWriteMode {
+    Preserve,   // partial write, previous contents are kept
+    Clear,      // attachment is cleared on load
+    Discard     // every texel is overwritten
+};
+
+struct RenderGraphImageInfo {
+    VkImage               image = VK_NULL_HANDLE;
+    VkImageView           view = VK_NULL_HANDLE;
+    VkFormat              format = VK_FORMAT_UNDEFINED;
+    VkExtent2D            extent{0, 0};
+    VkImageAspectFlags    aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+    VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+    // state when the graph starts, and whether that content is worth keeping
+    VkImageLayout         initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkPipelineStageFlags  initialStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    VkAccessFlags         initialAccess = 0;
+    bool                  preserveContents = false;
+};
+
+struct RenderGraphAttachmentOps {
+    VkAttachmentLoadOp  loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    VkAttachmentStoreOp storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    VkClearValue        clearValue{};
+};
+
+
+/* Frame graph: passes declare what they read and write, the graph culls
+ * passes nobody consumes, places batched barriers / layout transitions
+ * between the rest and picks attachment load/store ops. Rebuilt every
+ * frame after Reset(). */
+class RenderGraph {
+public:
+    class PassBuilder {
+    public:
+        void Read(RenderGraphHandle handle, RenderGraphUsage usage);
+
+        void Write(RenderGraphHandle handle, RenderGraphUsage usage,
+                   RenderGraphWriteMode mode = RenderGraphWriteMode::Preserve);
+
+        void Clear(RenderGraphHandle handle, RenderGraphUsage usage,
+                   VkClearValue clearValue);
+
+        /* Never cull this pass, e.g. it writes to a readback buffer */
+        void SetSideEffect();
+
+    private:
+        friend class RenderGraph;
+
+        PassBuilder(RenderGraph &graph, uint32_t pass)
+                : mGraph(graph), mPass(pass) {}
+
+        RenderGraph &mGraph;
+        uint32_t     mPass;
+    };
+
+    class PassContext {
+    public:
+        VkCommandBuffer GetCommandBuffer() const { return mCommandBuffer; }
+
+        /* Load/store ops chosen for an attachment written by this pass */
+        RenderGraphAttachmentOps GetAttachmentOps(
+                RenderGraphHandle handle) const;
+
+        VkImage GetImage(RenderGraphHandle handle) const;
+
+        VkImageView GetImageView(RenderGraphHandle handle) const;
+
+        VkBuffer GetBuffer(RenderGraphHandle handle) const;
+
+    private:
+        friend class RenderGraph;
+
+        PassContext(const RenderGraph &graph, uint32_t pass,
+                    VkCommandBuffer commandBuffer)
+                : mGraph(graph), mPass(pass), mCommandBuffer(commandBuffer) {}
+
+        const RenderGraph &mGraph;
+        uint32_t           mPass;
+        VkCommandBuffer    mCommandBuffer;
+    };
+
+    using SetupFunction = std::function<void(PassBuilder &)>;
+    using ExecuteFunction = std::function<void(const PassContext &)>;
+
+    RenderGraphHandle ImportImage(const std::string &name,
+                                  const RenderGraphImageInfo &info);
+
+    RenderGraphHandle ImportBuffer(const std::string &name, VkBuffer buffer,
+                                   bool preserveContents = true);
+
+    /* Image owned by the graph for this frame only. Format, extent, aspect
+     * and samples of info are used, the image is placed by the
+     * TransientAllocator given to Compile(). */
+    RenderGraphHandle CreateImage(const std::string &name,
+                                  const RenderGraphImageInfo &info);
+
+    /* The resource leaves the graph in this state, its writers are kept */
+    void MarkOutput(RenderGraphHandle handle, VkImageLayout finalLayout,
+                    VkPipelineStageFlags finalStage,
+                    VkAccessFlags finalAccess);
+
+    void AddPass(const std::string &name, const SetupFunction &setup,
+                 ExecuteFunction execute);
+
+    void Compile(TransientAllocator *transientAllocator = nullptr);
+
+    void Execute(VkCommandBuffer commandBuffer);
+
+    void Reset();
+
+    size_t GetCulledPassCount() const { return mCulledPassCount; }
+
+    size_t GetBarrierBatchCount() const { return mBarrierBatchCount; }
+
+    /* First and last alive pass touching each resource, -1 if unused.
+     * Valid after Compile(). */
+    struct Lifetime {
+        int firstPass = -1;
+        int lastPass = -1;
+    };
+
+    std::vector<Lifetime> GetResourceLifetimes() const;
+
+private:
+    struct UsageState {
+        VkPipelineStageFlags stages;
+        VkAccessFlags        access;
+        VkImageLayout        layout;
+        bool                 write;
+    };
+
+    struct Access {
+        RenderGraphHandle        handle;
+        RenderGraphUsage         usage;
+        bool                     write;
+        RenderGraphWriteMode     mode;
+        RenderGraphAttachmentOps ops;
+        // previous contents are not needed, transition from UNDEFINED
+        bool                     discard;
+    };
+
+    struct BarrierBatch {
+        VkPipelineStageFlags               srcStages = 0;
+        VkPipelineStageFlags               dstStages = 0;
+        std::vector<VkImageMemoryBarrier>  imageBarriers;
+        std::vector<VkBufferMemoryBarrier> bufferBarriers;
+
+        bool Empty() const {
+            return imageBarriers.empty() && bufferBarriers.empty();
+        }
+
+        void Record(VkCommandBuffer commandBuffer) const;
+    };
+
+    struct Pass {
+        std::string         name;
+        std::vector<Access> accesses;
+        ExecuteFunction     execute;
+        bool                sideEffect = false;
+        bool                alive = false;
+        BarrierBatch        barriers;
+    };
+
+    struct Resource {
+        std::string          name;
+        bool                 isImage;
+        RenderGraphImageInfo image;
+        VkBuffer             buffer = VK_NULL_HANDLE;
+        bool                 preserveContents;
+        bool                 transient = false;
+
+        bool                 output = false;
+        VkImageLayout        finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkPipelineStageFlags finalStage = 0;
+        VkAccessFlags        finalAccess = 0;
+
+        // tracked while compiling
+        VkImageLayout        layout;
+        VkPipelineStageFlags writeStages;
+        VkAccessFlags        writeAccess;
+        VkPipelineStageFlags readStages;
+        VkPipelineStageFlags visibleStages;
+        VkAccessFlags        visibleAccess;
+    };
+
+    static UsageState GetUsageState(RenderGraphUsage usage);
+
+    static VkImageUsageFlags GetImageUsage(RenderGraphUsage usage);
+
+    void RealizeTransientImages(TransientAllocator *transientAllocator);
+
+    void CullPasses();
+
+    void ChooseAttachmentOps();
+
+    void AddBarrier(BarrierBatch &batch, Resource &resource,
+                    const UsageState &state, bool discardContents);
+
+    const Access *FindAccess(uint32_t pass, RenderGraphHandle handle) const;
+
+private:
+    std::vector<Resource> mResources;
+    std::vector<Pass>     mPasses;
+    BarrierBatch          mFinalBarriers;
+    size_t                mCulledPassCount = 0;
+    size_t                mBarrierBatchCount = 0;
+};
+
+#endif //VULKAN_TEST_RENDERGRAPH_HPP
@@ -0,0 +1,216 @@
+//
+// Created by Krisu on 2020/4/7.
+//
+
+#include "RenderPassCache.hpp"
+#include "AllocationTracker.hpp"
+#include "Hash.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+bool AttachmentDesc::operator==(const AttachmentDesc &other) const {
+    return format == other.format && samples == other.samples &&
+           loadOp == other.loadOp && storeOp == other.storeOp &&
+           stencilLoadOp == other.stencilLoadOp &&
+           stencilStoreOp == other.stencilStoreOp &&
+           initialLayout == other.initialLayout &&
+           finalLayout == other.finalLayout;
+}
+
+bool SubpassDesc::operator==(const SubpassDesc &other) const {
+    return colorAttachments == other.colorAttachments &&
+           depthAttachment == other.depthAttachment;
+}
+
+uint64_t RenderPassDesc::Hash() const {
+    uint64_t hash = HashCombine(HASH_SEED, attachments.size());
+    for (const auto &attachment : attachments) {
+        hash = HashCombine(hash, attachment.format);
+        hash = HashCombine(hash, attachment.samples);
+        hash = HashCombine(hash, attachment.loadOp);
+        hash = HashCombine(hash, attachment.storeOp);
+        hash = HashCombine(hash, attachment.stencilLoadOp);
+        hash = HashCombine(hash, attachment.stencilStoreOp);
+        hash = HashCombine(hash, attachment.initialLayout);
+        hash = HashCombine(hash, attachment.finalLayout);
+    }
+    hash = HashCombine(hash, subpasses.size());
+    for (const auto &subpass : subpasses) {
+        hash = HashCombine(hash, subpass.colorAttachments.size());
+        for (uint32_t index : subpass.colorAttachments) {
+            hash = HashCombine(hash, index);
+        }
+        hash = HashCombine(hash, subpass.depthAttachment);
+    }
+    return hash;
+}
+
+bool RenderPassDesc::operator==(const RenderPassDesc &other) const {
+    return attachments == other.attachments && subpasses == other.subpasses;
+}
+
+uint64_t FramebufferDesc::Hash() const {
+    uint64_t hash = HashCombine(HASH_SEED, (uint64_t) renderPass);
+    for (VkImageView imageView : attachments) {
+        hash = HashCombine(hash, (uint64_t) imageView);
+    }
+    hash = HashCombine(hash, extent.width);
+    hash = HashCombine(hash, extent.height);
+    return HashCombine(hash, layers);
+}
+
+bool FramebufferDesc::operator==(const FramebufferDesc &other) const {
+    return renderPass == other.renderPass &&
+           attachments == other.attachments &&
+           extent.width == other.extent.width &&
+           extent.height == other.extent.height && layers == other.layers;
+}
+
+void RenderPassCache::Init(VkDevice device,
+                           const VkAllocationCallbacks *pAllocator) {
+    mDevice = device;
+    mAllocator = pAllocator;
+}
+
+VkRenderPass RenderPassCache::GetRenderPass(const RenderPassDesc &desc) {
+    auto it = mRenderPasses.find(desc);
+    if (it != mRenderPasses.end()) {
+        return it->second;
+    }
+    VkRenderPass renderPass = CreateRenderPass(desc);
+    mRenderPasses.emplace(desc, renderPass);
+    return renderPass;
+}
+
+VkFramebuffer RenderPassCache::GetFramebuffer(const FramebufferDesc &desc) {
+    auto it = mFramebuffers.find(desc);
+    if (it != mFramebuffers.end()) {
+        return it->second;
+    }
+    VkFramebuffer framebuffer = CreateFramebuffer(desc);
+    mFramebuffers.emplace(desc, framebuffer);
+    return framebuffer;
+}
+
+void RenderPassCache::EvictFramebuffers(
+        const std::vector<VkImageView> &imageViews) {
+    for (auto it = mFramebuffers.begin(); it != mFramebuffers.end();) {
+        const auto &attachments = it->first.attachments;
+        bool referenced = std::any_of(
+                attachments.begin(), attachments.end(),
+                [&](VkImageView view) {
+                    return std::find(imageViews.begin(), imageViews.end(),
+                                     view) != imageViews.end();
+                });
+        if (referenced) {
+            vkDestroyFramebuffer(mDevice, it->second, mAllocator);
+            it = mFramebuffers.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void RenderPassCache::Clear() {
+    for (auto &[desc, framebuffer] : mFramebuffers) {
+        vkDestroyFramebuffer(mDevice, framebuffer, mAllocator);
+    }
+    mFramebuffers.clear();
+    for (auto &[desc, renderPass] : mRenderPasses) {
+        vkDestroyRenderPass(mDevice, renderPass, mAllocator);
+    }
+    mRenderPasses.clear();
+}
+
+VkRenderPass RenderPassCache::CreateRenderPass(const RenderPassDesc &desc) {
+    std::vector<VkAttachmentDescription> attachments;
+    attachments.reserve(desc.attachments.size());
+    for (const auto &attachment : desc.attachments) {
+        VkAttachmentDescription attachmentDescription{};
+        attachmentDescription.format = attachment.format;
+        attachmentDescription.samples = attachment.samples;
+        attachmentDescription.loadOp = attachment.loadOp;
+        attachmentDescription.storeOp = attachment.storeOp;
+        attachmentDescription.stencilLoadOp = attachment.stencilLoadOp;
+        attachmentDescription.stencilStoreOp = attachment.stencilStoreOp;
+        attachmentDescription.initialLayout = attachment.initialLayout;
+        attachmentDescription.finalLayout = attachment.finalLayout;
+        attachments.push_back(attachmentDescription);
+    }
+
+    // references have to outlive vkCreateRenderPass
+    std::vector<std::vector<VkAttachmentReference>> colorReferences;
+    std::vector<VkAttachmentReference> depthReferences(desc.subpasses.size());
+    std::vector<VkSubpassDescription> subpasses;
+    colorReferences.reserve(desc.subpasses.size());
+    for (size_t i = 0; i < desc.subpasses.size(); i++) {
+        const auto &subpass = desc.subpasses[i];
+        auto &references = colorReferences.emplace_back();
+        for (uint32_t index : subpass.colorAttachments) {
+            references.push_back(
+                    {index, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL});
+        }
+
+        VkSubpassDescription subpassDescription{};
+        subpassDescription.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        subpassDescription.colorAttachmentCount = references.size();
+        subpassDescription.pColorAttachments = references.data();
+        if (subpass.depthAttachment != VK_ATTACHMENT_UNUSED) {
+            depthReferences[i] = {
+                    subpass.depthAttachment,
+                    VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+            subpassDescription.pDepthStencilAttachment = &depthReferences[i];
+        }
+        subpasses.push_back(subpassDescription);
+    }
+
+    // wait for the previous frame's attachment writes before ours
+    VkSubpassDependency dependency{};
+    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependency.dstSubpass = 0;
+    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                              VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                               VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                              VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                               VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+    VkRenderPassCreateInfo renderPassCreateInfo{};
+    renderPassCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    renderPassCreateInfo.attachmentCount = attachments.size();
+    renderPassCreateInfo.pAttachments = attachments.data();
+    renderPassCreateInfo.subpassCount = subpasses.size();
+    renderPassCreateInfo.pSubpasses = subpasses.data();
+    renderPassCreateInfo.dependencyCount = 1;
+    renderPassCreateInfo.pDependencies = &dependency;
+
+    VkRenderPass renderPass;
+    AllocationTracker::ScopedTag tag(VK_OBJECT_TYPE_RENDER_PASS);
+    if (vkCreateRenderPass(mDevice, &renderPassCreateInfo, mAllocator,
+                           &renderPass) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create render pass");
+    }
+    return renderPass;
+}
+
+VkFramebuffer RenderPassCache::CreateFramebuffer(const FramebufferDesc &desc) {
+    VkFramebufferCreateInfo framebufferCreateInfo{};
+    framebufferCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebufferCreateInfo.renderPass = desc.renderPass;
+    framebufferCreateInfo.attachmentCount = desc.attachments.size();
+    framebufferCreateInfo.pAttachments = desc.attachments.data();
+    framebufferCreateInfo.width = desc.extent.width;
+    framebufferCreateInfo.height = desc.extent.height;
+    framebufferCreateInfo.layers = desc.layers;
+
+    VkFramebuffer framebuffer;
+    AllocationTracker::ScopedTag tag(VK_OBJECT_TYPE_FRAMEBUFFER);
+    if (vkCreateFramebuffer(mDevice, &framebufferCreateInfo, mAllocator,
+                            &framebuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create framebuffer");
+    }
+    return framebuffer;
+}
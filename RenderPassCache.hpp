@@ -0,0 +1,97 @@
+//
+// Created by Krisu on 2020/4/7.
+//
+
+#ifndef VULKAN_TEST_RENDERPASSCACHE_HPP
+#define VULKAN_TEST_RENDERPASSCACHE_HPP
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+
+struct AttachmentDesc {
+    VkFormat              format = VK_FORMAT_UNDEFINED;
+    VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+    VkAttachmentLoadOp    loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    VkAttachmentStoreOp   storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    VkAttachmentLoadOp    stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    VkAttachmentStoreOp   stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    VkImageLayout         initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkImageLayout         finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    bool operator==(const AttachmentDesc &other) const;
+};
+
+struct SubpassDesc {
+    std::vector<uint32_t> colorAttachments;
+    uint32_t              depthAttachment = VK_ATTACHMENT_UNUSED;
+
+    bool operator==(const SubpassDesc &other) const;
+};
+
+/* Everything a VkRenderPass is built from. The hash only looks at field
+ * values, so equal descriptions get equal keys on every run. */
+struct RenderPassDesc {
+    std::vector<AttachmentDesc> attachments;
+    std::vector<SubpassDesc>    subpasses;
+
+    uint64_t Hash() const;
+
+    bool operator==(const RenderPassDesc &other) const;
+};
+
+struct FramebufferDesc {
+    VkRenderPass             renderPass = VK_NULL_HANDLE;
+    std::vector<VkImageView> attachments;
+    VkExtent2D               extent{0, 0};
+    uint32_t                 layers = 1;
+
+    uint64_t Hash() const;
+
+    bool operator==(const FramebufferDesc &other) const;
+};
+
+
+/* Builds render passes and framebuffers once and hands out the cached
+ * handle afterwards, so nothing is rebuilt per frame. */
+class RenderPassCache {
+public:
+    void Init(VkDevice device, const VkAllocationCallbacks *pAllocator);
+
+    VkRenderPass GetRenderPass(const RenderPassDesc &desc);
+
+    VkFramebuffer GetFramebuffer(const FramebufferDesc &desc);
+
+    /* Destroy every framebuffer referencing one of the views, call it
+     * before the swap chain image views are destroyed */
+    void EvictFramebuffers(const std::vector<VkImageView> &imageViews);
+
+    /* Destroy everything */
+    void Clear();
+
+private:
+    template<typename T>
+    struct Hasher {
+        size_t operator()(const T &desc) const {
+            return static_cast<size_t>(desc.Hash());
+        }
+    };
+
+    VkRenderPass CreateRenderPass(const RenderPassDesc &desc);
+
+    VkFramebuffer CreateFramebuffer(const FramebufferDesc &desc);
+
+private:
+    VkDevice                     mDevice = VK_NULL_HANDLE;
+    const VkAllocationCallbacks *mAllocator = nullptr;
+
+    std::unordered_map<RenderPassDesc, VkRenderPass,
+            Hasher<RenderPassDesc>>                   mRenderPasses;
+    std::unordered_map<FramebufferDesc, VkFramebuffer,
+            Hasher<FramebufferDesc>>                  mFramebuffers;
+};
+
+#endif //VULKAN_TEST_RENDERPASSCACHE_HPP
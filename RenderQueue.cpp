@@ -0,0 +1,196 @@
+//
+// Created by Krisu on 2020/4/16.
+//
+
+#include "RenderQueue.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define RENDER_QUEUE_SSE2
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define RENDER_QUEUE_NEON
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+// objects per job, smaller batches cost more in scheduling than they save
+constexpr size_t KEY_BATCH_SIZE = 16 * 1024;
+
+constexpr uint32_t MESH_LOW_BITS = 32 - DrawBatcher::DEPTH_BITS;
+
+}
+
+void RenderQueue::Init(JobSystem &jobSystem, uint32_t instanceSize) {
+    mJobSystem = &jobSystem;
+    mInstanceSize = instanceSize;
+}
+
+void RenderQueue::GenerateKeys(const RenderQueueObjects &objects,
+                               size_t begin, size_t end,
+                               const float depthPlane[4], float depthScale,
+                               SortEntry *keys) {
+    const auto maxDepth = static_cast<float>(DrawBatcher::MAX_DEPTH);
+    size_t i = begin;
+    // the halves of four keys are built in 32 bit lanes:
+    //   high = pipeline << 22 | material << 6 | mesh >> 10
+    //   low  = mesh << 22 | depth
+#if defined(RENDER_QUEUE_SSE2)
+    const __m128 planeX = _mm_set1_ps(depthPlane[0] * depthScale);
+    const __m128 planeY = _mm_set1_ps(depthPlane[1] * depthScale);
+    const __m128 planeZ = _mm_set1_ps(depthPlane[2] * depthScale);
+    const __m128 planeW = _mm_set1_ps(depthPlane[3] * depthScale);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 depthLimit = _mm_set1_ps(maxDepth);
+    for (; i + 4 <= end; i += 4) {
+        __m128 depth = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(objects.positionX + i),
+                                      planeX),
+                           _mm_mul_ps(_mm_loadu_ps(objects.positionY + i),
+                                      planeY)),
+                _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(objects.positionZ + i),
+                                      planeZ),
+                           planeW));
+        depth = _mm_min_ps(_mm_max_ps(depth, zero), depthLimit);
+        __m128i quantized = _mm_cvtps_epi32(depth);
+
+        __m128i pipelines = _mm_loadu_si128(
+                reinterpret_cast<const __m128i *>(objects.pipelines + i));
+        __m128i materials = _mm_loadu_si128(
+                reinterpret_cast<const __m128i *>(objects.materials + i));
+        __m128i meshes = _mm_loadu_si128(
+                reinterpret_cast<const __m128i *>(objects.meshes + i));
+        __m128i high = _mm_or_si128(
+                _mm_or_si128(_mm_slli_epi32(pipelines, DrawBatcher::DEPTH_BITS),
+                             _mm_slli_epi32(materials, DrawBatcher::DEPTH_BITS -
+                                                       16)),
+                _mm_srli_epi32(meshes, MESH_LOW_BITS));
+        __m128i low = _mm_or_si128(
+                _mm_slli_epi32(meshes, DrawBatcher::DEPTH_BITS), quantized);
+
+        // 64 bit keys in little endian order
+        __m128i keys01 = _mm_unpacklo_epi32(low, high);
+        __m128i keys23 = _mm_unpackhi_epi32(low, high);
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(&keys[i].key), keys01);
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(&keys[i + 1].key),
+                         _mm_unpackhi_epi64(keys01, keys01));
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(&keys[i + 2].key),
+                         keys23);
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(&keys[i + 3].key),
+                         _mm_unpackhi_epi64(keys23, keys23));
+        for (size_t j = i; j < i + 4; j++) {
+            keys[j].index = static_cast<uint32_t>(j);
+        }
+    }
+#elif defined(RENDER_QUEUE_NEON)
+    const float32x4_t planeX = vdupq_n_f32(depthPlane[0] * depthScale);
+    const float32x4_t planeY = vdupq_n_f32(depthPlane[1] * depthScale);
+    const float32x4_t planeZ = vdupq_n_f32(depthPlane[2] * depthScale);
+    const float32x4_t planeW = vdupq_n_f32(depthPlane[3] * depthScale);
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+    const float32x4_t depthLimit = vdupq_n_f32(maxDepth);
+    for (; i + 4 <= end; i += 4) {
+        float32x4_t depth = vfmaq_f32(planeW, vld1q_f32(objects.positionX + i),
+                                      planeX);
+        depth = vfmaq_f32(depth, vld1q_f32(objects.positionY + i), planeY);
+        depth = vfmaq_f32(depth, vld1q_f32(objects.positionZ + i), planeZ);
+        depth = vminq_f32(vmaxq_f32(depth, zero), depthLimit);
+        uint32x4_t quantized = vcvtnq_u32_f32(depth);
+
+        uint32x4_t pipelines = vld1q_u32(objects.pipelines + i);
+        uint32x4_t materials = vld1q_u32(objects.materials + i);
+        uint32x4_t meshes = vld1q_u32(objects.meshes + i);
+        uint32x4_t high = vorrq_u32(
+                vorrq_u32(vshlq_n_u32(pipelines, DrawBatcher::DEPTH_BITS),
+                          vshlq_n_u32(materials, DrawBatcher::DEPTH_BITS - 16)),
+                vshrq_n_u32(meshes, MESH_LOW_BITS));
+        uint32x4_t low = vorrq_u32(
+                vshlq_n_u32(meshes, DrawBatcher::DEPTH_BITS), quantized);
+
+        // 64 bit keys in little endian order
+        uint32x4x2_t zipped = vzipq_u32(low, high);
+        uint64x2_t keys01 = vreinterpretq_u64_u32(zipped.val[0]);
+        uint64x2_t keys23 = vreinterpretq_u64_u32(zipped.val[1]);
+        keys[i].key = vgetq_lane_u64(keys01, 0);
+        keys[i + 1].key = vgetq_lane_u64(keys01, 1);
+        keys[i + 2].key = vgetq_lane_u64(keys23, 0);
+        keys[i + 3].key = vgetq_lane_u64(keys23, 1);
+        for (size_t j = i; j < i + 4; j++) {
+            keys[j].index = static_cast<uint32_t>(j);
+        }
+    }
+#endif
+    // the tail, and everything without SIMD, rounds to nearest as well
+    for (; i < end; i++) {
+        float depth = (objects.positionX[i] * (depthPlane[0] * depthScale) +
+                       objects.positionY[i] * (depthPlane[1] * depthScale)) +
+                      (objects.positionZ[i] * (depthPlane[2] * depthScale) +
+                       depthPlane[3] * depthScale);
+        depth = std::min(std::max(depth, 0.0f), maxDepth);
+        auto quantized = static_cast<uint32_t>(std::nearbyint(depth));
+        keys[i].key = DrawBatcher::PackKey(objects.pipelines[i],
+                                           objects.materials[i],
+                                           objects.meshes[i], quantized);
+        keys[i].index = static_cast<uint32_t>(i);
+    }
+}
+
+void RenderQueue::Build(const RenderQueueObjects &objects,
+                        const CullView &view, float maxDepth,
+                        size_t maxInstances) {
+    size_t count = objects.count;
+    mEntries.resize(count);
+
+    // view distance is the clip w, the last row of the matrix
+    const float *matrix = view.viewProjection;
+    const float depthPlane[4]{matrix[3], matrix[7], matrix[11], matrix[15]};
+    float depthScale = DrawBatcher::MAX_DEPTH / maxDepth;
+    if (count <= KEY_BATCH_SIZE) {
+        GenerateKeys(objects, 0, count, depthPlane, depthScale,
+                     mEntries.data());
+    } else {
+        mJobSystem->ParallelFor(count, KEY_BATCH_SIZE,
+                                [&](size_t begin, size_t end) {
+                                    GenerateKeys(objects, begin, end,
+                                                 depthPlane, depthScale,
+                                                 mEntries.data());
+                                });
+    }
+
+    ParallelRadixSort(mEntries, mScratch, *mJobSystem);
+
+    // a run per thread, pushed forward to the end of the draw it cuts
+    size_t streamCount = std::min<size_t>(
+            mJobSystem->GetConcurrency(),
+            std::max<size_t>(1, count / KEY_BATCH_SIZE));
+    mStreams.resize(streamCount);
+    std::vector<size_t> bounds(streamCount + 1, count);
+    bounds[0] = 0;
+    for (size_t stream = 1; stream < streamCount; stream++) {
+        size_t bound = std::max(bounds[stream - 1],
+                                count * stream / streamCount);
+        while (bound > 0 && bound < count &&
+               mEntries[bound].key >> DrawBatcher::DEPTH_BITS ==
+               mEntries[bound - 1].key >> DrawBatcher::DEPTH_BITS) {
+            bound++;
+        }
+        bounds[stream] = bound;
+    }
+    auto buildStreams = [&](size_t begin, size_t end) {
+        for (size_t stream = begin; stream < end; stream++) {
+            mStreams[stream].Clear();
+            DrawBatcher::BuildStream(
+                    mEntries.data() + bounds[stream],
+                    bounds[stream + 1] - bounds[stream], objects.instances,
+                    mInstanceSize, maxInstances, mStreams[stream]);
+        }
+    };
+    if (streamCount == 1) {
+        buildStreams(0, 1);
+    } else {
+        mJobSystem->ParallelFor(streamCount, 1, buildStreams);
+    }
+}
@@ -0,0 +1,73 @@
+//
+// Created by Krisu on 2020/4/16.
+//
+
+#ifndef VULKAN_TEST_RENDERQUEUE_HPP
+#define VULKAN_TEST_RENDERQUEUE_HPP
+
+#include "DrawBatcher.hpp"
+#include "GpuCuller.hpp"
+#include "JobSystem.hpp"
+#include "RadixSort.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+/* What RenderQueue sorts, as a structure of arrays so keys are made four
+ * objects at a time. Ids are the ones registered with the DrawBatcher
+ * recording the streams, instances holds instanceSize bytes per object. */
+struct RenderQueueObjects {
+    const float    *positionX = nullptr;
+    const float    *positionY = nullptr;
+    const float    *positionZ = nullptr;
+    const uint32_t *pipelines = nullptr;
+    const uint32_t *materials = nullptr;
+    const uint32_t *meshes = nullptr;
+    const uint8_t  *instances = nullptr;
+    size_t          count = 0;
+};
+
+/* The DrawBatcher path for scenes too big to sort on one thread. Build
+ * runs every step on the JobSystem:
+ *
+ *  - keys in the DrawBatcher layout, with SSE2 or NEON where available,
+ *    depth is the view distance of the object's position
+ *  - ParallelRadixSort over the keys
+ *  - one RenderCommandStream per thread over a run of the sorted
+ *    objects, runs end where a draw ends so no draw is split
+ *
+ * DrawBatcher::Record replays the streams in order. */
+class RenderQueue {
+public:
+    /* instanceSize as for DrawBatcher::Init */
+    void Init(JobSystem &jobSystem, uint32_t instanceSize);
+
+    /* Sort objects seen from view into the streams. View distances from
+     * 0 to maxDepth spread over the depth bits, farther ones share the
+     * last value. maxInstances comes from DrawBatcher::GetMaxInstances. */
+    void Build(const RenderQueueObjects &objects, const CullView &view,
+               float maxDepth, size_t maxInstances);
+
+    /* The streams of the last Build, some may be empty */
+    const std::vector<RenderCommandStream> &GetStreams() const {
+        return mStreams;
+    }
+
+    /* Keys of objects [begin, end). depthPlane gives the view distance
+     * of a position, depthScale maps it to the depth bits. */
+    static void GenerateKeys(const RenderQueueObjects &objects, size_t begin,
+                             size_t end, const float depthPlane[4],
+                             float depthScale, SortEntry *keys);
+
+private:
+    JobSystem *mJobSystem = nullptr;
+    uint32_t   mInstanceSize = 0;
+
+    std::vector<SortEntry>           mEntries;
+    std::vector<SortEntry>           mScratch;
+    std::vector<RenderCommandStream> mStreams;
+};
+
+#endif //VULKAN_TEST_RENDERQUEUE_HPP
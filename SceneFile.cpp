@@ -0,0 +1,115 @@
+//
+// Created by Krisu on 2020/4/15.
+//
+
+#include "SceneFile.hpp"
+#include "Hash.hpp"
+#include "Lz4.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+
+namespace {
+
+void Write(std::ofstream &file, const void *data, size_t size) {
+    file.write(static_cast<const char *>(data), size);
+}
+
+void Pad(std::ofstream &file, uint64_t &offset, uint64_t alignment) {
+    static const char zeros[SCENE_CHUNK_ALIGNMENT]{};
+    uint64_t aligned = (offset + alignment - 1) / alignment * alignment;
+    Write(file, zeros, aligned - offset);
+    offset = aligned;
+}
+
+}
+
+void WriteSceneFile(const std::string &path, const MeshBuffer &meshBuffer,
+                    const std::vector<Mesh> &meshes, bool compress) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        throw std::runtime_error("failed to open scene file for writing");
+    }
+
+    SceneFileHeader header{};
+    header.magic = SCENE_FILE_MAGIC;
+    header.version = SCENE_FILE_VERSION;
+    Write(file, &header, sizeof(header));
+    uint64_t offset = sizeof(header);
+
+    std::vector<SceneChunk> chunks;
+    for (int section = 0; section < MeshBuffer::SECTION_COUNT; section++) {
+        const auto &data = meshBuffer.GetSectionData(
+                static_cast<MeshBuffer::Section>(section));
+        header.sectionSizes[section] = data.size();
+        for (size_t begin = 0; begin < data.size();
+             begin += SCENE_CHUNK_SIZE) {
+            SceneChunk chunk{};
+            chunk.section = section;
+            chunk.sectionOffset = begin;
+            chunk.size = std::min<uint64_t>(SCENE_CHUNK_SIZE,
+                                            data.size() - begin);
+            chunk.hash = HashBytes(data.data() + begin, chunk.size);
+
+            std::vector<uint8_t> compressed;
+            if (compress) {
+                compressed = Lz4Compress(data.data() + begin, chunk.size);
+            }
+            Pad(file, offset, SCENE_CHUNK_ALIGNMENT);
+            chunk.fileOffset = offset;
+            if (!compressed.empty()) {
+                chunk.flags |= SCENE_CHUNK_COMPRESSED_LZ4;
+                chunk.storedSize = compressed.size();
+                Write(file, compressed.data(), compressed.size());
+            } else {
+                chunk.storedSize = chunk.size;
+                Write(file, data.data() + begin, chunk.size);
+            }
+            offset += chunk.storedSize;
+            chunks.push_back(chunk);
+        }
+    }
+
+    std::vector<SceneMeshRecord> records;
+    for (const auto &mesh : meshes) {
+        SceneMeshRecord record{};
+        record.layout = static_cast<uint32_t>(mesh.layout);
+        record.indexType = mesh.indexType;
+        record.indexCount = mesh.indexCount;
+        record.firstIndex = mesh.firstIndex;
+        record.vertexOffset = mesh.vertexOffset;
+        switch (mesh.layout) {
+            case VertexLayout::Interleaved:
+                record.vertexStride = sizeof(Vertex);
+                break;
+            case VertexLayout::Deinterleaved:
+                record.vertexStride = sizeof(Vertex::position);
+                break;
+            case VertexLayout::Quantized:
+                record.vertexStride = meshBuffer.GetQuantizedStride();
+                break;
+        }
+        std::copy(mesh.boundsMin, mesh.boundsMin + 3, record.boundsMin);
+        std::copy(mesh.boundsExtent, mesh.boundsExtent + 3,
+                  record.boundsExtent);
+        records.push_back(record);
+    }
+
+    Pad(file, offset, alignof(SceneChunk));
+    header.chunkCount = chunks.size();
+    header.meshCount = records.size();
+    header.tocOffset = offset;
+    size_t chunksSize = chunks.size() * sizeof(SceneChunk);
+    size_t recordsSize = records.size() * sizeof(SceneMeshRecord);
+    header.tocHash = HashBytes(records.data(), recordsSize,
+                               HashBytes(chunks.data(), chunksSize));
+    Write(file, chunks.data(), chunksSize);
+    Write(file, records.data(), recordsSize);
+
+    file.seekp(0);
+    Write(file, &header, sizeof(header));
+    if (!file) {
+        throw std::runtime_error("failed to write scene file");
+    }
+}
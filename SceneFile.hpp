@@ -0,0 +1,87 @@
+//
+// Created by Krisu on 2020/4/15.
+//
+
+#ifndef VULKAN_TEST_SCENEFILE_HPP
+#define VULKAN_TEST_SCENEFILE_HPP
+
+#include <vulkan/vulkan.h>
+
+#include "MeshBuffer.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+/* Binary scene file, all little endian:
+ *
+ *   SceneFileHeader
+ *   chunk payloads, each at a SCENE_CHUNK_ALIGNMENT boundary
+ *   SceneChunk[chunkCount]      table of contents
+ *   SceneMeshRecord[meshCount]
+ *
+ * The payloads are the MeshBuffer sections byte for byte, so an
+ * uncompressed chunk goes from the mapped file into staging memory with
+ * one memcpy. Sections are split into chunks of at most SCENE_CHUNK_SIZE
+ * bytes which load, decompress and verify independently. */
+
+constexpr uint32_t SCENE_FILE_MAGIC = 0x43534b56; // "VKSC"
+constexpr uint32_t SCENE_FILE_VERSION = 2;
+constexpr uint64_t SCENE_CHUNK_ALIGNMENT = 256;
+constexpr uint64_t SCENE_CHUNK_SIZE = 4 * 1024 * 1024;
+
+enum SceneChunkFlags : uint32_t {
+    SCENE_CHUNK_COMPRESSED_LZ4 = 0x1
+};
+
+struct SceneFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t chunkCount;
+    uint32_t meshCount;
+    uint64_t tocOffset;
+    // of the table of contents and the mesh records
+    uint64_t tocHash;
+    uint64_t sectionSizes[MeshBuffer::SECTION_COUNT];
+};
+
+struct SceneChunk {
+    uint32_t section;
+    uint32_t flags;
+    // where the chunk goes inside its section
+    uint64_t sectionOffset;
+    uint64_t fileOffset;
+    uint64_t storedSize;
+    uint64_t size;
+    // HashBytes of the uncompressed bytes
+    uint64_t hash;
+};
+
+struct SceneMeshRecord {
+    uint32_t layout;
+    uint32_t indexType;
+    uint32_t indexCount;
+    uint32_t firstIndex;
+    int32_t  vertexOffset;
+    // bytes per vertex of the section holding the positions
+    uint32_t vertexStride;
+    // see Mesh, only meaningful for quantized meshes
+    float    boundsMin[3];
+    float    boundsExtent[3];
+};
+
+static_assert(sizeof(SceneFileHeader) == 32 + 8 * MeshBuffer::SECTION_COUNT,
+              "scene header must not contain padding");
+static_assert(sizeof(SceneChunk) == 48, "scene chunk must not contain padding");
+static_assert(sizeof(SceneMeshRecord) == 48,
+              "scene mesh record must not contain padding");
+
+
+/* Write every section queued in meshBuffer and the meshes Add returned
+ * for them. Chunks are LZ4 compressed where that makes them smaller. */
+void WriteSceneFile(const std::string &path, const MeshBuffer &meshBuffer,
+                    const std::vector<Mesh> &meshes, bool compress = true);
+
+#endif //VULKAN_TEST_SCENEFILE_HPP
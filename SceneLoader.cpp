@@ -0,0 +1,289 @@
+//
+// Created by Krisu on 2020/4/15.
+//
+
+#include "SceneLoader.hpp"
+#include "AllocationTracker.hpp"
+#include "Hash.hpp"
+#include "Lz4.hpp"
+#include "MappedFile.hpp"
+#include "VulkanUtils.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+// offset + size inside limit, without overflowing
+bool InRange(uint64_t offset, uint64_t size, uint64_t limit) {
+    return size <= limit && offset <= limit - size;
+}
+
+// indices inside their section and the first vertex inside the section
+// of the positions, the indices themselves are only known after loading
+bool IsRecordInBounds(const SceneMeshRecord &record,
+                      const SceneFileHeader &header) {
+    bool indices16 = record.indexType == VK_INDEX_TYPE_UINT16;
+    uint64_t indexSize = indices16 ? sizeof(uint16_t) : sizeof(uint32_t);
+    uint64_t indicesSize = header.sectionSizes[
+            indices16 ? MeshBuffer::INDICES_16 : MeshBuffer::INDICES_32];
+    if (!InRange(uint64_t(record.firstIndex) * indexSize,
+                 uint64_t(record.indexCount) * indexSize, indicesSize)) {
+        return false;
+    }
+
+    MeshBuffer::Section section = MeshBuffer::INTERLEAVED;
+    uint32_t stride = sizeof(Vertex);
+    switch (static_cast<VertexLayout>(record.layout)) {
+        case VertexLayout::Interleaved:
+            break;
+        case VertexLayout::Deinterleaved:
+            section = MeshBuffer::POSITIONS;
+            stride = sizeof(Vertex::position);
+            break;
+        case VertexLayout::Quantized:
+            section = MeshBuffer::QUANTIZED;
+            stride = record.vertexStride;
+            break;
+    }
+    return record.vertexStride == stride && stride > 0 &&
+           record.vertexOffset >= 0 &&
+           InRange(uint64_t(record.vertexOffset) * stride, stride,
+                   header.sectionSizes[section]);
+}
+
+}
+
+void SceneLoader::Init(VkPhysicalDevice physicalDevice, VkDevice device,
+                       const VkAllocationCallbacks *pAllocator,
+                       VkCommandPool commandPool, VkQueue queue,
+                       JobSystem &jobSystem, VkDeviceSize stagingSize) {
+    mPhysicalDevice = physicalDevice;
+    mDevice = device;
+    mAllocator = pAllocator;
+    mCommandPool = commandPool;
+    mQueue = queue;
+    mJobSystem = &jobSystem;
+
+    // a half has to hold the largest chunk
+    mHalfSize = std::max(stagingSize / 2, SCENE_CHUNK_SIZE);
+    CreateBuffer(mPhysicalDevice, mDevice, mAllocator, mHalfSize * 2,
+                 VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                 mStagingBuffer, mStagingMemory);
+    void *mapped;
+    vkMapMemory(mDevice, mStagingMemory, 0, mHalfSize * 2, 0, &mapped);
+    mStagingData = static_cast<uint8_t *>(mapped);
+
+    VkCommandBufferAllocateInfo allocateInfo{};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocateInfo.commandPool = mCommandPool;
+    allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocateInfo.commandBufferCount = 2;
+    {
+        AllocationTracker::ScopedTag tag(VK_OBJECT_TYPE_COMMAND_BUFFER);
+        if (vkAllocateCommandBuffers(mDevice, &allocateInfo,
+                                     mCommandBuffers) != VK_SUCCESS) {
+            throw std::runtime_error(
+                    "failed to allocate scene command buffers");
+        }
+    }
+
+    VkFenceCreateInfo fenceCreateInfo{};
+    fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    for (auto &fence : mFences) {
+        AllocationTracker::ScopedTag tag(VK_OBJECT_TYPE_FENCE);
+        if (vkCreateFence(mDevice, &fenceCreateInfo, mAllocator, &fence) !=
+            VK_SUCCESS) {
+            throw std::runtime_error("failed to create scene fence");
+        }
+    }
+}
+
+std::vector<Mesh> SceneLoader::Load(const std::string &path,
+                                    MeshBuffer &meshBuffer) {
+    MappedFile file(path);
+    const uint8_t *data = file.GetData();
+    size_t fileSize = file.GetSize();
+
+    SceneFileHeader header;
+    if (fileSize < sizeof(header)) {
+        throw std::runtime_error("scene file is truncated");
+    }
+    std::memcpy(&header, data, sizeof(header));
+    if (header.magic != SCENE_FILE_MAGIC) {
+        throw std::runtime_error("not a scene file");
+    }
+    if (header.version != SCENE_FILE_VERSION) {
+        throw std::runtime_error("unsupported scene file version");
+    }
+
+    // copied out, the mapping makes no alignment promises for a bad file
+    uint64_t chunksSize = uint64_t(header.chunkCount) * sizeof(SceneChunk);
+    uint64_t recordsSize =
+            uint64_t(header.meshCount) * sizeof(SceneMeshRecord);
+    if (!InRange(header.tocOffset, chunksSize + recordsSize, fileSize)) {
+        throw std::runtime_error("scene table of contents is truncated");
+    }
+    std::vector<SceneChunk> chunks(header.chunkCount);
+    std::vector<SceneMeshRecord> records(header.meshCount);
+    std::memcpy(chunks.data(), data + header.tocOffset, chunksSize);
+    std::memcpy(records.data(), data + header.tocOffset + chunksSize,
+                recordsSize);
+    if (HashBytes(records.data(), recordsSize,
+                  HashBytes(chunks.data(), chunksSize)) != header.tocHash) {
+        throw std::runtime_error("scene table of contents is corrupted");
+    }
+
+    for (const auto &chunk : chunks) {
+        bool compressed = chunk.flags & SCENE_CHUNK_COMPRESSED_LZ4;
+        if (chunk.section >= MeshBuffer::SECTION_COUNT ||
+            (chunk.flags & ~SCENE_CHUNK_COMPRESSED_LZ4) != 0 ||
+            chunk.size > SCENE_CHUNK_SIZE ||
+            (!compressed && chunk.storedSize != chunk.size) ||
+            !InRange(chunk.sectionOffset, chunk.size,
+                     header.sectionSizes[chunk.section]) ||
+            !InRange(chunk.fileOffset, chunk.storedSize, fileSize)) {
+            throw std::runtime_error("scene chunk is out of bounds");
+        }
+    }
+
+    std::vector<Mesh> meshes;
+    for (const auto &record : records) {
+        if (record.layout > static_cast<uint32_t>(VertexLayout::Quantized) ||
+            (record.indexType != VK_INDEX_TYPE_UINT16 &&
+             record.indexType != VK_INDEX_TYPE_UINT32)) {
+            throw std::runtime_error("scene mesh record is invalid");
+        }
+        if (!IsRecordInBounds(record, header)) {
+            throw std::runtime_error("scene mesh record is out of bounds");
+        }
+        Mesh mesh;
+        mesh.layout = static_cast<VertexLayout>(record.layout);
+        mesh.indexType = static_cast<VkIndexType>(record.indexType);
+        mesh.indexCount = record.indexCount;
+        mesh.firstIndex = record.firstIndex;
+        mesh.vertexOffset = record.vertexOffset;
+        std::copy(record.boundsMin, record.boundsMin + 3, mesh.boundsMin);
+        std::copy(record.boundsExtent, record.boundsExtent + 3,
+                  mesh.boundsExtent);
+        meshes.push_back(mesh);
+    }
+
+    VkDeviceSize sectionSizes[MeshBuffer::SECTION_COUNT];
+    std::copy(std::begin(header.sectionSizes), std::end(header.sectionSizes),
+              sectionSizes);
+    meshBuffer.Allocate(mPhysicalDevice, mDevice, mAllocator, sectionSizes);
+
+    // fill one half while the other one is copied
+    try {
+        int half = 0;
+        std::vector<StagedChunk> batch;
+        VkDeviceSize staged = 0;
+        for (size_t i = 0; i <= chunks.size(); i++) {
+            bool last = i == chunks.size();
+            if (last || staged + chunks[i].size > mHalfSize) {
+                if (!batch.empty()) {
+                    Wait(half);
+                    LoadBatch(data, batch);
+                    SubmitBatch(half, batch, meshBuffer);
+                    half ^= 1;
+                }
+                batch.clear();
+                staged = 0;
+            }
+            if (last) {
+                break;
+            }
+            batch.push_back({&chunks[i], mHalfSize * half + staged});
+            // 16 byte aligned copies are the fast ones on most hardware
+            staged = (staged + chunks[i].size + 15) / 16 * 16;
+        }
+    } catch (...) {
+        // the staging buffer may still be in use
+        WaitIdle();
+        throw;
+    }
+    WaitIdle();
+    return meshes;
+}
+
+void SceneLoader::Destroy() {
+    if (mDevice == VK_NULL_HANDLE) {
+        return;
+    }
+    for (auto &fence : mFences) {
+        vkDestroyFence(mDevice, fence, mAllocator);
+    }
+    vkFreeCommandBuffers(mDevice, mCommandPool, 2, mCommandBuffers);
+    vkDestroyBuffer(mDevice, mStagingBuffer, mAllocator);
+    vkFreeMemory(mDevice, mStagingMemory, mAllocator);
+    mDevice = VK_NULL_HANDLE;
+}
+
+void SceneLoader::LoadBatch(const uint8_t *fileData,
+                            const std::vector<StagedChunk> &batch) {
+    mJobSystem->ParallelFor(batch.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            const SceneChunk &chunk = *batch[i].chunk;
+            const uint8_t *src = fileData + chunk.fileOffset;
+            uint8_t *dst = mStagingData + batch[i].stagingOffset;
+            if (chunk.flags & SCENE_CHUNK_COMPRESSED_LZ4) {
+                if (!Lz4Decompress(src, chunk.storedSize, dst, chunk.size)) {
+                    throw std::runtime_error(
+                            "failed to decompress scene chunk");
+                }
+            } else {
+                std::memcpy(dst, src, chunk.size);
+            }
+            if (HashBytes(dst, chunk.size) != chunk.hash) {
+                throw std::runtime_error("scene chunk is corrupted");
+            }
+        }
+    });
+}
+
+void SceneLoader::SubmitBatch(int half, const std::vector<StagedChunk> &batch,
+                              const MeshBuffer &meshBuffer) {
+    std::vector<VkBufferCopy> regions;
+    for (const auto &staged : batch) {
+        const SceneChunk &chunk = *staged.chunk;
+        auto section = static_cast<MeshBuffer::Section>(chunk.section);
+        regions.push_back({staged.stagingOffset,
+                           meshBuffer.GetSectionOffset(section) +
+                           chunk.sectionOffset, chunk.size});
+    }
+
+    VkCommandBuffer commandBuffer = mCommandBuffers[half];
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+    vkCmdCopyBuffer(commandBuffer, mStagingBuffer, meshBuffer.GetBuffer(),
+                    regions.size(), regions.data());
+    vkEndCommandBuffer(commandBuffer);
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    if (vkQueueSubmit(mQueue, 1, &submitInfo, mFences[half]) != VK_SUCCESS) {
+        throw std::runtime_error("failed to submit scene upload");
+    }
+    mInFlight[half] = true;
+}
+
+void SceneLoader::Wait(int half) {
+    if (mInFlight[half]) {
+        vkWaitForFences(mDevice, 1, &mFences[half], VK_TRUE, UINT64_MAX);
+        vkResetFences(mDevice, 1, &mFences[half]);
+        mInFlight[half] = false;
+    }
+}
+
+void SceneLoader::WaitIdle() {
+    Wait(0);
+    Wait(1);
+}
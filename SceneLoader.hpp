@@ -0,0 +1,76 @@
+//
+// Created by Krisu on 2020/4/15.
+//
+
+#ifndef VULKAN_TEST_SCENELOADER_HPP
+#define VULKAN_TEST_SCENELOADER_HPP
+
+#include <vulkan/vulkan.h>
+
+#include "JobSystem.hpp"
+#include "MeshBuffer.hpp"
+#include "SceneFile.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+/* Streams scene files into a MeshBuffer. The file is mapped, never read
+ * as a whole. Chunks are gathered into one half of a persistently mapped
+ * staging buffer, decompressed and hash checked on the job system, then
+ * copied to the device while the next batch fills the other half. */
+class SceneLoader {
+public:
+    /* commandPool must allow resetting its command buffers */
+    void Init(VkPhysicalDevice physicalDevice, VkDevice device,
+              const VkAllocationCallbacks *pAllocator,
+              VkCommandPool commandPool, VkQueue queue,
+              JobSystem &jobSystem,
+              VkDeviceSize stagingSize = DEFAULT_STAGING_SIZE);
+
+    /* Replaces whatever meshBuffer held, throws on a malformed file or a
+     * chunk failing its hash */
+    std::vector<Mesh> Load(const std::string &path, MeshBuffer &meshBuffer);
+
+    void Destroy();
+
+    constexpr static const VkDeviceSize DEFAULT_STAGING_SIZE =
+            32 * 1024 * 1024;
+
+private:
+    struct StagedChunk {
+        const SceneChunk *chunk;
+        VkDeviceSize      stagingOffset;
+    };
+
+    void LoadBatch(const uint8_t *fileData,
+                   const std::vector<StagedChunk> &batch);
+
+    void SubmitBatch(int half, const std::vector<StagedChunk> &batch,
+                     const MeshBuffer &meshBuffer);
+
+    /* Until the copy out of half is done */
+    void Wait(int half);
+
+    void WaitIdle();
+
+private:
+    VkPhysicalDevice             mPhysicalDevice = VK_NULL_HANDLE;
+    VkDevice                     mDevice = VK_NULL_HANDLE;
+    const VkAllocationCallbacks *mAllocator = nullptr;
+    VkQueue                      mQueue = VK_NULL_HANDLE;
+    JobSystem                   *mJobSystem = nullptr;
+
+    VkBuffer       mStagingBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory mStagingMemory = VK_NULL_HANDLE;
+    uint8_t       *mStagingData = nullptr;
+    VkDeviceSize   mHalfSize = 0;
+
+    VkCommandPool   mCommandPool = VK_NULL_HANDLE;
+    VkCommandBuffer mCommandBuffers[2]{};
+    VkFence         mFences[2]{};
+    bool            mInFlight[2]{};
+};
+
+#endif //VULKAN_TEST_SCENELOADER_HPP
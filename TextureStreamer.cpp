@@ -0,0 +1,692 @@
+//
+// Created by Krisu on 2020/4/15.
+//
+
+#include "TextureStreamer.hpp"
+#include "AllocationTracker.hpp"
+#include "VulkanUtils.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+// buffer offsets of image copies must be a multiple of the block size
+VkDeviceSize AlignStaging(VkDeviceSize offset) {
+    return (offset + 15) / 16 * 16;
+}
+
+}
+
+void TextureStreamer::Init(VkPhysicalDevice physicalDevice, VkDevice device,
+                           const VkAllocationCallbacks *pAllocator,
+                           VkQueue queue, uint32_t queueFamilyIndex,
+                           JobSystem &jobSystem, BindlessHeap &bindlessHeap,
+                           MipGenerator &mipGenerator,
+                           const Settings &settings,
+                           uint32_t framesInFlight) {
+    mPhysicalDevice = physicalDevice;
+    mDevice = device;
+    mAllocator = pAllocator;
+    mQueue = queue;
+    mJobSystem = &jobSystem;
+    mBindlessHeap = &bindlessHeap;
+    mMipGenerator = &mipGenerator;
+    mSettings = settings;
+    mFramesInFlight = framesInFlight;
+
+    VkCommandPoolCreateInfo poolCreateInfo{};
+    poolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolCreateInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    poolCreateInfo.queueFamilyIndex = queueFamilyIndex;
+    {
+        AllocationTracker::ScopedTag tag(VK_OBJECT_TYPE_COMMAND_POOL);
+        if (vkCreateCommandPool(mDevice, &poolCreateInfo, mAllocator,
+                                &mCommandPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create texture command pool");
+        }
+    }
+
+    mSlots = std::vector<Slot>(std::max(mSettings.stagingSlots, 1u));
+    VkCommandBufferAllocateInfo allocateInfo{};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocateInfo.commandPool = mCommandPool;
+    allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocateInfo.commandBufferCount = 1;
+    VkFenceCreateInfo fenceCreateInfo{};
+    fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    for (auto &slot : mSlots) {
+        {
+            AllocationTracker::ScopedTag tag(VK_OBJECT_TYPE_COMMAND_BUFFER);
+            if (vkAllocateCommandBuffers(mDevice, &allocateInfo,
+                                         &slot.commandBuffer) != VK_SUCCESS) {
+                throw std::runtime_error(
+                        "failed to allocate texture command buffer");
+            }
+        }
+        AllocationTracker::ScopedTag tag(VK_OBJECT_TYPE_FENCE);
+        if (vkCreateFence(mDevice, &fenceCreateInfo, mAllocator,
+                          &slot.fence) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create texture fence");
+        }
+    }
+
+    // one per frame, read back once the frame is done
+    VkDeviceSize feedbackSize = mSettings.maxTextures * sizeof(uint32_t);
+    mFeedback.resize(mFramesInFlight);
+    for (auto &feedback : mFeedback) {
+        CreateBuffer(mPhysicalDevice, mDevice, mAllocator, feedbackSize,
+                     VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                     VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                     feedback.buffer, feedback.memory);
+        void *mapped;
+        vkMapMemory(mDevice, feedback.memory, 0, feedbackSize, 0, &mapped);
+        feedback.data = static_cast<uint32_t *>(mapped);
+        std::memset(feedback.data, 0xff, feedbackSize);
+        feedback.descriptor = mBindlessHeap->AddStorageBuffer(feedback.buffer);
+    }
+}
+
+void TextureStreamer::Destroy() {
+    if (mDevice == VK_NULL_HANDLE) {
+        return;
+    }
+    // jobs write into the staging buffers
+    mJobSystem->Wait();
+    for (auto &slot : mSlots) {
+        if (slot.state == SLOT_COPYING) {
+            vkWaitForFences(mDevice, 1, &slot.fence, VK_TRUE, UINT64_MAX);
+        }
+        if (slot.state != SLOT_FREE) {
+            vkDestroyImage(mDevice, slot.transfer.image, mAllocator);
+            vkFreeMemory(mDevice, slot.transfer.memory, mAllocator);
+        }
+        if (slot.staging != VK_NULL_HANDLE) {
+            vkDestroyBuffer(mDevice, slot.staging, mAllocator);
+            vkFreeMemory(mDevice, slot.stagingMemory, mAllocator);
+        }
+        vkDestroyFence(mDevice, slot.fence, mAllocator);
+    }
+    mSlots.clear();
+
+    for (auto &texture : mTextures) {
+        if (texture.image != VK_NULL_HANDLE) {
+            mBindlessHeap->RemoveSampledImage(texture.descriptor);
+            vkDestroyImageView(mDevice, texture.view, mAllocator);
+            vkDestroyImage(mDevice, texture.image, mAllocator);
+            vkFreeMemory(mDevice, texture.memory, mAllocator);
+        }
+    }
+    mTextures.clear();
+    mFreeHandles.clear();
+
+    for (auto &garbage : mGarbage) {
+        vkDestroyImageView(mDevice, garbage.view, mAllocator);
+        vkDestroyImage(mDevice, garbage.image, mAllocator);
+        vkFreeMemory(mDevice, garbage.memory, mAllocator);
+    }
+    mGarbage.clear();
+
+    for (auto &feedback : mFeedback) {
+        mBindlessHeap->RemoveStorageBuffer(feedback.descriptor);
+        vkDestroyBuffer(mDevice, feedback.buffer, mAllocator);
+        vkFreeMemory(mDevice, feedback.memory, mAllocator);
+    }
+    mFeedback.clear();
+
+    vkDestroyCommandPool(mDevice, mCommandPool, mAllocator);
+    mResidentBytes = 0;
+    mDevice = VK_NULL_HANDLE;
+}
+
+TextureHandle TextureStreamer::Add(TextureSource source) {
+    if (GetFormatBlock(source.format).bytes == 0) {
+        throw std::runtime_error("unsupported streamed texture format");
+    }
+    if (source.width == 0 || source.height == 0 || !source.readMip) {
+        throw std::runtime_error("streamed texture has no data");
+    }
+    uint32_t fullChain = static_cast<uint32_t>(std::floor(std::log2(
+            std::max(source.width, source.height)))) + 1;
+    source.mipCount = std::clamp(source.mipCount, 1u, fullChain);
+    if (source.generateMips &&
+        mMipGenerator->GetRequiredUsage(source.format, source.width,
+                                        source.height) == 0) {
+        throw std::runtime_error("failed to generate mips of texture format");
+    }
+
+    TextureHandle handle;
+    if (!mFreeHandles.empty()) {
+        handle = mFreeHandles.back();
+        mFreeHandles.pop_back();
+    } else {
+        if (mTextures.size() >= mSettings.maxTextures) {
+            throw std::runtime_error("too many streamed textures");
+        }
+        handle = mTextures.size();
+        mTextures.emplace_back();
+    }
+
+    Texture &texture = mTextures[handle];
+    texture = Texture{};
+    texture.source = std::move(source);
+    const TextureSource &added = texture.source;
+    texture.tailMip = added.generateMips ? 0 : added.mipCount - 1;
+    for (uint32_t mip = 0; mip < texture.tailMip; mip++) {
+        if (std::max(added.width >> mip, added.height >> mip) <=
+            mSettings.mipTailSize) {
+            texture.tailMip = mip;
+            break;
+        }
+    }
+    texture.residentMip = texture.tailMip;
+    texture.targetMip = texture.tailMip;
+    texture.desiredMip = texture.tailMip;
+    texture.lastRequested = mFrameCount;
+
+    // the tail is small, load it right away and wait for it. Until it is
+    // on the device the texture is not alive, so a reader or Vulkan error
+    // frees everything and hands the handle back.
+    Transfer transfer{handle, texture.tailMip};
+    VkBuffer staging = VK_NULL_HANDLE;
+    VkDeviceMemory stagingMemory = VK_NULL_HANDLE;
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    VkFence fence = VK_NULL_HANDLE;
+    try {
+        CreateTransferImage(transfer);
+        uint32_t tailMips = added.generateMips
+                            ? 1 : added.mipCount - texture.tailMip;
+        std::vector<VkDeviceSize> offsets(tailMips);
+        VkDeviceSize stagingSize = 0;
+        for (uint32_t i = 0; i < tailMips; i++) {
+            offsets[i] = stagingSize;
+            stagingSize = AlignStaging(stagingSize + GetMipSize(
+                    added.format, added.width, added.height,
+                    texture.tailMip + i));
+        }
+        CreateBuffer(mPhysicalDevice, mDevice, mAllocator, stagingSize,
+                     VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                     VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                     staging, stagingMemory);
+        void *mapped;
+        vkMapMemory(mDevice, stagingMemory, 0, stagingSize, 0, &mapped);
+        auto *stagingData = static_cast<uint8_t *>(mapped);
+        mJobSystem->ParallelFor(tailMips, 1, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                added.readMip(texture.tailMip + i, stagingData + offsets[i]);
+            }
+        });
+
+        VkCommandBufferAllocateInfo allocateInfo{};
+        allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocateInfo.commandPool = mCommandPool;
+        allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocateInfo.commandBufferCount = 1;
+        {
+            AllocationTracker::ScopedTag tag(VK_OBJECT_TYPE_COMMAND_BUFFER);
+            if (vkAllocateCommandBuffers(mDevice, &allocateInfo,
+                                         &commandBuffer) != VK_SUCCESS) {
+                commandBuffer = VK_NULL_HANDLE;
+                throw std::runtime_error(
+                        "failed to allocate texture command buffer");
+            }
+        }
+        VkFenceCreateInfo fenceCreateInfo{};
+        fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        {
+            AllocationTracker::ScopedTag tag(VK_OBJECT_TYPE_FENCE);
+            if (vkCreateFence(mDevice, &fenceCreateInfo, mAllocator,
+                              &fence) != VK_SUCCESS) {
+                fence = VK_NULL_HANDLE;
+                throw std::runtime_error("failed to create texture fence");
+            }
+        }
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        vkBeginCommandBuffer(commandBuffer, &beginInfo);
+        RecordTransfer(commandBuffer, transfer, staging, tailMips);
+        if (added.generateMips) {
+            mMipGenerator->Record(commandBuffer, transfer.image, added.format,
+                                  added.width, added.height, added.mipCount);
+        }
+        vkEndCommandBuffer(commandBuffer);
+        Submit(commandBuffer, fence);
+        vkWaitForFences(mDevice, 1, &fence, VK_TRUE, UINT64_MAX);
+
+        texture.alive = true;
+        Publish(transfer);
+    } catch (...) {
+        // nothing was submitted, or it finished, so no GPU work uses these
+        vkDestroyFence(mDevice, fence, mAllocator);
+        if (commandBuffer != VK_NULL_HANDLE) {
+            vkFreeCommandBuffers(mDevice, mCommandPool, 1, &commandBuffer);
+        }
+        vkDestroyBuffer(mDevice, staging, mAllocator);
+        vkFreeMemory(mDevice, stagingMemory, mAllocator);
+        vkDestroyImage(mDevice, transfer.image, mAllocator);
+        vkFreeMemory(mDevice, transfer.memory, mAllocator);
+        texture = Texture{};
+        mFreeHandles.push_back(handle);
+        throw;
+    }
+
+    vkDestroyFence(mDevice, fence, mAllocator);
+    vkFreeCommandBuffers(mDevice, mCommandPool, 1, &commandBuffer);
+    vkDestroyBuffer(mDevice, staging, mAllocator);
+    vkFreeMemory(mDevice, stagingMemory, mAllocator);
+    mResidentBytes += GetImageSize(added, texture.tailMip);
+    return handle;
+}
+
+void TextureStreamer::Remove(TextureHandle handle) {
+    Texture &texture = mTextures[handle];
+    mResidentBytes -= GetImageSize(texture.source, texture.targetMip);
+    texture.alive = false;
+    // otherwise the slot retires it when it is done
+    if (!texture.busy) {
+        Retire(handle);
+    }
+}
+
+void TextureStreamer::RequestMip(TextureHandle handle, uint32_t mip) {
+    Texture &texture = mTextures[handle];
+    texture.requestedMip = std::min(texture.requestedMip, mip);
+}
+
+void TextureStreamer::RequestScreenSize(TextureHandle handle, float pixels) {
+    const Texture &texture = mTextures[handle];
+    uint32_t size = std::max(texture.source.width, texture.source.height);
+    uint32_t mip = texture.tailMip;
+    if (pixels > 0.0f) {
+        float lod = std::floor(std::log2(size / pixels));
+        mip = static_cast<uint32_t>(std::clamp(
+                lod, 0.0f, static_cast<float>(texture.tailMip)));
+    }
+    RequestMip(handle, mip);
+}
+
+void TextureStreamer::NextFrame() {
+    mFrameCount++;
+    mFrameIndex = (mFrameIndex + 1) % mFramesInFlight;
+
+    // the frame that wrote this buffer is done
+    uint32_t *feedback = mFeedback[mFrameIndex].data;
+    for (TextureHandle handle = 0; handle < mTextures.size(); handle++) {
+        if (feedback[handle] != UINT32_MAX && mTextures[handle].alive) {
+            RequestMip(handle, feedback[handle]);
+        }
+    }
+    std::memset(feedback, 0xff, mTextures.size() * sizeof(uint32_t));
+
+    for (auto &slot : mSlots) {
+        int state = slot.state;
+        if (state == SLOT_FREE || state == SLOT_LOADING) {
+            continue;
+        }
+        Texture &texture = mTextures[slot.transfer.texture];
+        if (state == SLOT_COPYING &&
+            vkGetFenceStatus(mDevice, slot.fence) == VK_SUCCESS) {
+            vkResetFences(mDevice, 1, &slot.fence);
+            texture.busy = false;
+            Publish(slot.transfer);
+            slot.state = SLOT_FREE;
+        } else if (state == SLOT_LOADED) {
+            bool streamingIn = slot.transfer.topMip < texture.residentMip;
+            VkCommandBufferBeginInfo beginInfo{};
+            beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+            vkBeginCommandBuffer(slot.commandBuffer, &beginInfo);
+            RecordTransfer(slot.commandBuffer, slot.transfer, slot.staging,
+                           streamingIn ? 1 : 0);
+            vkEndCommandBuffer(slot.commandBuffer);
+            Submit(slot.commandBuffer, slot.fence);
+            slot.state = SLOT_COPYING;
+        } else if (state == SLOT_FAILED) {
+            vkDestroyImage(mDevice, slot.transfer.image, mAllocator);
+            vkFreeMemory(mDevice, slot.transfer.memory, mAllocator);
+            texture.busy = false;
+            if (texture.alive) {
+                // keep what is resident, do not try again every frame
+                mResidentBytes += GetImageSize(texture.source,
+                                               texture.residentMip);
+                mResidentBytes -= GetImageSize(texture.source,
+                                               texture.targetMip);
+                texture.targetMip = texture.residentMip;
+                texture.failed = true;
+            } else {
+                Retire(slot.transfer.texture);
+            }
+            slot.state = SLOT_FREE;
+        }
+    }
+
+    std::vector<TextureHandle> wanted;
+    for (TextureHandle handle = 0; handle < mTextures.size(); handle++) {
+        Texture &texture = mTextures[handle];
+        if (!texture.alive) {
+            continue;
+        }
+        if (texture.requestedMip != UINT32_MAX) {
+            texture.desiredMip = std::min(texture.requestedMip,
+                                          texture.tailMip);
+            texture.lastRequested = mFrameCount;
+            texture.requestedMip = UINT32_MAX;
+        }
+        if (!texture.busy && !texture.failed &&
+            texture.desiredMip < texture.residentMip) {
+            wanted.push_back(handle);
+        }
+    }
+
+    // recently used and far from what they want first, one mip at a time
+    std::sort(wanted.begin(), wanted.end(), [&](TextureHandle a,
+                                                 TextureHandle b) {
+        const Texture &ta = mTextures[a];
+        const Texture &tb = mTextures[b];
+        if (ta.lastRequested != tb.lastRequested) {
+            return ta.lastRequested > tb.lastRequested;
+        }
+        return ta.residentMip - ta.desiredMip > tb.residentMip - tb.desiredMip;
+    });
+    for (TextureHandle handle : wanted) {
+        const Texture &texture = mTextures[handle];
+        uint32_t topMip = texture.residentMip - 1;
+        VkDeviceSize growth = GetImageSize(texture.source, topMip) -
+                              GetImageSize(texture.source, texture.residentMip);
+        bool fits = true;
+        while (fits && mResidentBytes + growth > mSettings.budget) {
+            fits = EvictOne(handle);
+        }
+        if (!fits || !Schedule(handle, topMip)) {
+            break;
+        }
+    }
+
+    auto retired = std::remove_if(mGarbage.begin(), mGarbage.end(),
+                                  [&](const Garbage &garbage) {
+        if (mFrameCount < garbage.frame + mFramesInFlight) {
+            return false;
+        }
+        vkDestroyImageView(mDevice, garbage.view, mAllocator);
+        vkDestroyImage(mDevice, garbage.image, mAllocator);
+        vkFreeMemory(mDevice, garbage.memory, mAllocator);
+        return true;
+    });
+    mGarbage.erase(retired, mGarbage.end());
+}
+
+void TextureStreamer::RecordFeedbackBarrier(
+        VkCommandBuffer commandBuffer) const {
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer,
+                         VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                         VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0,
+                         nullptr, 0, nullptr);
+}
+
+VkDeviceSize TextureStreamer::GetImageSize(const TextureSource &source,
+                                           uint32_t topMip) const {
+    VkDeviceSize size = 0;
+    for (uint32_t mip = topMip; mip < source.mipCount; mip++) {
+        size += GetMipSize(source.format, source.width, source.height, mip);
+    }
+    return size;
+}
+
+bool TextureStreamer::Schedule(TextureHandle handle, uint32_t topMip) {
+    auto slot = std::find_if(mSlots.begin(), mSlots.end(),
+                             [](const Slot &slot) {
+        return slot.state == SLOT_FREE;
+    });
+    if (slot == mSlots.end()) {
+        return false;
+    }
+
+    Texture &texture = mTextures[handle];
+    texture.busy = true;
+    mResidentBytes += GetImageSize(texture.source, topMip);
+    mResidentBytes -= GetImageSize(texture.source, texture.targetMip);
+    texture.targetMip = topMip;
+    slot->transfer = Transfer{handle, topMip};
+    CreateTransferImage(slot->transfer);
+
+    if (topMip >= texture.residentMip) {
+        // evicting, everything is on the device already
+        slot->state = SLOT_LOADED;
+        return true;
+    }
+    EnsureStaging(*slot, GetMipSize(texture.source.format,
+                                    texture.source.width,
+                                    texture.source.height, topMip));
+    slot->state = SLOT_LOADING;
+    Slot *loading = &*slot;
+    mJobSystem->Submit([loading, readMip = texture.source.readMip, topMip] {
+        try {
+            readMip(topMip, loading->stagingData);
+            loading->state = SLOT_LOADED;
+        } catch (...) {
+            loading->state = SLOT_FAILED;
+        }
+    });
+    return true;
+}
+
+bool TextureStreamer::EvictOne(TextureHandle keep) {
+    TextureHandle victim = INVALID_TEXTURE_HANDLE;
+    for (TextureHandle handle = 0; handle < mTextures.size(); handle++) {
+        const Texture &texture = mTextures[handle];
+        // nothing asked for this frame loses mips
+        if (handle == keep || !texture.alive || texture.busy ||
+            texture.residentMip >= texture.tailMip ||
+            texture.lastRequested >= mFrameCount) {
+            continue;
+        }
+        if (victim == INVALID_TEXTURE_HANDLE ||
+            texture.lastRequested < mTextures[victim].lastRequested) {
+            victim = handle;
+        }
+    }
+    if (victim == INVALID_TEXTURE_HANDLE) {
+        return false;
+    }
+    return Schedule(victim, mTextures[victim].residentMip + 1);
+}
+
+void TextureStreamer::RecordTransfer(VkCommandBuffer commandBuffer,
+                                     const Transfer &transfer,
+                                     VkBuffer staging,
+                                     uint32_t stagedMips) const {
+    const Texture &texture = mTextures[transfer.texture];
+    const TextureSource &source = texture.source;
+    bool hasOld = texture.image != VK_NULL_HANDLE;
+
+    VkImageMemoryBarrier barriers[2]{};
+    for (auto &barrier : barriers) {
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0,
+                                    VK_REMAINING_MIP_LEVELS, 0, 1};
+    }
+    barriers[0].image = transfer.image;
+    barriers[0].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barriers[0].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barriers[1].image = texture.image;
+    barriers[1].oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barriers[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    // textures may be sampled in any stage of the frames before
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                         nullptr, hasOld ? 2 : 1, barriers);
+
+    auto extent = [&](uint32_t mip) {
+        return VkExtent3D{std::max(source.width >> mip, 1u),
+                          std::max(source.height >> mip, 1u), 1};
+    };
+    if (hasOld) {
+        std::vector<VkImageCopy> regions;
+        uint32_t shared = std::max(transfer.topMip, texture.residentMip);
+        for (uint32_t mip = shared; mip < source.mipCount; mip++) {
+            VkImageCopy region{};
+            region.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT,
+                                     mip - texture.residentMip, 0, 1};
+            region.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT,
+                                     mip - transfer.topMip, 0, 1};
+            region.extent = extent(mip);
+            regions.push_back(region);
+        }
+        vkCmdCopyImage(commandBuffer, texture.image,
+                       VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, transfer.image,
+                       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, regions.size(),
+                       regions.data());
+    }
+    if (stagedMips > 0) {
+        std::vector<VkBufferImageCopy> regions;
+        VkDeviceSize offset = 0;
+        for (uint32_t i = 0; i < stagedMips; i++) {
+            uint32_t mip = transfer.topMip + i;
+            VkBufferImageCopy region{};
+            region.bufferOffset = offset;
+            region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, i, 0, 1};
+            region.imageExtent = extent(mip);
+            regions.push_back(region);
+            offset = AlignStaging(offset + GetMipSize(
+                    source.format, source.width, source.height, mip));
+        }
+        vkCmdCopyBufferToImage(commandBuffer, staging, transfer.image,
+                               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                               regions.size(), regions.data());
+    }
+
+    barriers[0].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barriers[0].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barriers[0].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    // the old image is sampled until the new one is published
+    barriers[1].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barriers[1].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barriers[1].srcAccessMask = 0;
+    barriers[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0,
+                         nullptr, hasOld ? 2 : 1, barriers);
+}
+
+void TextureStreamer::Submit(VkCommandBuffer commandBuffer, VkFence fence) {
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    if (vkQueueSubmit(mQueue, 1, &submitInfo, fence) != VK_SUCCESS) {
+        throw std::runtime_error("failed to submit texture transfer");
+    }
+}
+
+void TextureStreamer::Publish(const Transfer &transfer) {
+    Texture &texture = mTextures[transfer.texture];
+    if (!texture.alive) {
+        Release(transfer.image, transfer.memory, VK_NULL_HANDLE);
+        Retire(transfer.texture);
+        return;
+    }
+
+    VkImageViewCreateInfo viewCreateInfo{};
+    viewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewCreateInfo.image = transfer.image;
+    viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewCreateInfo.format = texture.source.format;
+    viewCreateInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0,
+                                       VK_REMAINING_MIP_LEVELS, 0, 1};
+    VkImageView view;
+    {
+        AllocationTracker::ScopedTag tag(VK_OBJECT_TYPE_IMAGE_VIEW);
+        if (vkCreateImageView(mDevice, &viewCreateInfo, mAllocator, &view) !=
+            VK_SUCCESS) {
+            throw std::runtime_error("failed to create texture image view");
+        }
+    }
+
+    // frames in flight keep sampling the old descriptor and image
+    BindlessHandle descriptor = mBindlessHeap->AddSampledImage(view);
+    if (texture.image != VK_NULL_HANDLE) {
+        mBindlessHeap->RemoveSampledImage(texture.descriptor);
+        Release(texture.image, texture.memory, texture.view);
+    }
+    texture.image = transfer.image;
+    texture.memory = transfer.memory;
+    texture.view = view;
+    texture.descriptor = descriptor;
+    texture.residentMip = transfer.topMip;
+}
+
+void TextureStreamer::Retire(TextureHandle handle) {
+    Texture &texture = mTextures[handle];
+    if (texture.image != VK_NULL_HANDLE) {
+        mBindlessHeap->RemoveSampledImage(texture.descriptor);
+        Release(texture.image, texture.memory, texture.view);
+    }
+    texture = Texture{};
+    mFreeHandles.push_back(handle);
+}
+
+void TextureStreamer::CreateTransferImage(Transfer &transfer) {
+    const TextureSource &source = mTextures[transfer.texture].source;
+    VkImageCreateInfo imageCreateInfo{};
+    imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageCreateInfo.format = source.format;
+    imageCreateInfo.extent = {std::max(source.width >> transfer.topMip, 1u),
+                              std::max(source.height >> transfer.topMip, 1u),
+                              1};
+    imageCreateInfo.mipLevels = source.mipCount - transfer.topMip;
+    imageCreateInfo.arrayLayers = 1;
+    imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    // later transfers copy out of it
+    imageCreateInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT |
+                            VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+                            VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    if (source.generateMips) {
+        imageCreateInfo.usage |= mMipGenerator->GetRequiredUsage(
+                source.format, source.width, source.height);
+    }
+    imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    CreateImage(mPhysicalDevice, mDevice, mAllocator, imageCreateInfo,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, transfer.image,
+                transfer.memory);
+}
+
+void TextureStreamer::Release(VkImage image, VkDeviceMemory memory,
+                              VkImageView view) {
+    mGarbage.push_back({mFrameCount, image, memory, view});
+}
+
+void TextureStreamer::EnsureStaging(Slot &slot, VkDeviceSize size) {
+    if (slot.stagingSize >= size) {
+        return;
+    }
+    if (slot.staging != VK_NULL_HANDLE) {
+        vkDestroyBuffer(mDevice, slot.staging, mAllocator);
+        vkFreeMemory(mDevice, slot.stagingMemory, mAllocator);
+    }
+    CreateBuffer(mPhysicalDevice, mDevice, mAllocator, size,
+                 VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                 slot.staging, slot.stagingMemory);
+    void *mapped;
+    vkMapMemory(mDevice, slot.stagingMemory, 0, size, 0, &mapped);
+    slot.stagingData = static_cast<uint8_t *>(mapped);
+    slot.stagingSize = size;
+}
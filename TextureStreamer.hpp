@@ -0,0 +1,225 @@
+//
+// Created by Krisu on 2020/4/15.
+//
+
+#ifndef VULKAN_TEST_TEXTURESTREAMER_HPP
+#define VULKAN_TEST_TEXTURESTREAMER_HPP
+
+#include <vulkan/vulkan.h>
+
+#include "BindlessHeap.hpp"
+#include "JobSystem.hpp"
+#include "MipGenerator.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+
+using TextureHandle = uint32_t;
+
+constexpr TextureHandle INVALID_TEXTURE_HANDLE = UINT32_MAX;
+
+/* Where the mips of a 2D texture come from */
+struct TextureSource {
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t mipCount = 1;
+    // fill dst with GetMipSize bytes of mip, runs on job system workers
+    std::function<void(uint32_t mip, uint8_t *dst)> readMip;
+    // only mip 0 is read, the others are generated on the GPU. Such
+    // textures are always fully resident.
+    bool generateMips = false;
+};
+
+/* Keeps the small mips of every texture resident and streams the larger
+ * ones in as they are needed, within a memory budget.
+ *
+ * A texture is an image holding the mips from its top resident one down.
+ * Streaming in a mip or evicting some creates an image with the new mip
+ * range, copies the levels both share on the GPU and swaps the bindless
+ * descriptor once the copy is done, so shaders always see a complete
+ * chain and need no clamping. The mip data is read into staging memory
+ * on the job system, only the copy commands are recorded on the calling
+ * thread.
+ *
+ * Demand comes from RequestMip / RequestScreenSize or from shaders
+ * writing the mip they want into the feedback buffer, see
+ * shaders/texture_feedback.glsl. When the budget is reached the least
+ * recently requested textures lose their top mips first. */
+class TextureStreamer {
+public:
+    struct Settings {
+        VkDeviceSize budget = 256 * 1024 * 1024;
+        // mips no larger than this in either dimension stay resident
+        uint32_t     mipTailSize = 128;
+        // mips loading or copying at the same time
+        uint32_t     stagingSlots = 4;
+        // entries of the feedback buffer, handles must stay below it
+        uint32_t     maxTextures = 4096;
+    };
+
+    /* queue must be the one the frames sampling the textures are
+     * submitted to, queueFamilyIndex its family */
+    void Init(VkPhysicalDevice physicalDevice, VkDevice device,
+              const VkAllocationCallbacks *pAllocator, VkQueue queue,
+              uint32_t queueFamilyIndex, JobSystem &jobSystem,
+              BindlessHeap &bindlessHeap, MipGenerator &mipGenerator,
+              const Settings &settings,
+              uint32_t framesInFlight);
+
+    void Destroy();
+
+    /* Loads the mip tail before returning */
+    TextureHandle Add(TextureSource source);
+
+    void Remove(TextureHandle handle);
+
+    /* Ask for mip to be resident, the highest request of a frame wins */
+    void RequestMip(TextureHandle handle, uint32_t mip);
+
+    /* Ask for the mip matching a texture covering pixels on screen along
+     * its longer side */
+    void RequestScreenSize(TextureHandle handle, float pixels);
+
+    /* Call once per frame after the frame's fence was waited on. Reads the
+     * frame's feedback, finishes copies and schedules new ones. */
+    void NextFrame();
+
+    /* Make the frame's feedback writes visible to the host, record at the
+     * end of the frame */
+    void RecordFeedbackBarrier(VkCommandBuffer commandBuffer) const;
+
+    /* Bindless index to sample the texture with this frame, changes when
+     * its resident mips do */
+    BindlessHandle GetDescriptor(TextureHandle handle) const {
+        return mTextures[handle].descriptor;
+    }
+
+    /* Bindless storage buffer of the current frame's feedback */
+    BindlessHandle GetFeedbackBuffer() const {
+        return mFeedback[mFrameIndex].descriptor;
+    }
+
+    uint32_t GetResidentMip(TextureHandle handle) const {
+        return mTextures[handle].residentMip;
+    }
+
+    VkDeviceSize GetResidentBytes() const { return mResidentBytes; }
+
+private:
+    struct Texture {
+        TextureSource  source;
+        bool           alive = false;
+        // a slot is working on it
+        bool           busy = false;
+        // lost its source, only the resident mips stay
+        bool           failed = false;
+        uint32_t       tailMip = 0;
+        uint32_t       residentMip = 0;
+        // residentMip once the running transfer is done
+        uint32_t       targetMip = 0;
+        uint32_t       desiredMip = 0;
+        // lowest mip asked for since the last NextFrame
+        uint32_t       requestedMip = UINT32_MAX;
+        uint64_t       lastRequested = 0;
+        VkImage        image = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkImageView    view = VK_NULL_HANDLE;
+        BindlessHandle descriptor = INVALID_BINDLESS_HANDLE;
+    };
+
+    // the new image of a texture while it is filled
+    struct Transfer {
+        TextureHandle  texture = INVALID_TEXTURE_HANDLE;
+        uint32_t       topMip = 0;
+        VkImage        image = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+    };
+
+    enum SlotState {
+        SLOT_FREE, SLOT_LOADING, SLOT_LOADED, SLOT_FAILED, SLOT_COPYING
+    };
+
+    struct Slot {
+        std::atomic<int> state{SLOT_FREE};
+        Transfer         transfer;
+        VkBuffer         staging = VK_NULL_HANDLE;
+        VkDeviceMemory   stagingMemory = VK_NULL_HANDLE;
+        uint8_t         *stagingData = nullptr;
+        VkDeviceSize     stagingSize = 0;
+        VkCommandBuffer  commandBuffer = VK_NULL_HANDLE;
+        VkFence          fence = VK_NULL_HANDLE;
+    };
+
+    struct FeedbackBuffer {
+        VkBuffer       buffer = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        uint32_t      *data = nullptr;
+        BindlessHandle descriptor = INVALID_BINDLESS_HANDLE;
+    };
+
+    struct Garbage {
+        uint64_t       frame;
+        VkImage        image;
+        VkDeviceMemory memory;
+        VkImageView    view;
+    };
+
+    VkDeviceSize GetImageSize(const TextureSource &source,
+                              uint32_t topMip) const;
+
+    /* Start moving texture to topMip, false when no slot is free */
+    bool Schedule(TextureHandle handle, uint32_t topMip);
+
+    /* Evict from the least recently requested texture other than keep,
+     * false when nothing is left to evict */
+    bool EvictOne(TextureHandle keep);
+
+    /* New image of transfer, the staged mips are copied from staging */
+    void RecordTransfer(VkCommandBuffer commandBuffer,
+                        const Transfer &transfer, VkBuffer staging,
+                        uint32_t stagedMips) const;
+
+    void Submit(VkCommandBuffer commandBuffer, VkFence fence);
+
+    /* Swap the texture over to the transfer's image */
+    void Publish(const Transfer &transfer);
+
+    /* The texture's images go once no frame uses them, its handle is
+     * free again */
+    void Retire(TextureHandle handle);
+
+    void CreateTransferImage(Transfer &transfer);
+
+    void Release(VkImage image, VkDeviceMemory memory, VkImageView view);
+
+    void EnsureStaging(Slot &slot, VkDeviceSize size);
+
+private:
+    VkPhysicalDevice             mPhysicalDevice = VK_NULL_HANDLE;
+    VkDevice                     mDevice = VK_NULL_HANDLE;
+    const VkAllocationCallbacks *mAllocator = nullptr;
+    VkQueue                      mQueue = VK_NULL_HANDLE;
+    JobSystem                   *mJobSystem = nullptr;
+    BindlessHeap                *mBindlessHeap = nullptr;
+    MipGenerator                *mMipGenerator = nullptr;
+    Settings                     mSettings;
+    uint32_t                     mFramesInFlight = 1;
+
+    VkCommandPool               mCommandPool = VK_NULL_HANDLE;
+    std::vector<Slot>           mSlots;
+    std::vector<FeedbackBuffer> mFeedback;
+    uint32_t                    mFrameIndex = 0;
+    uint64_t                    mFrameCount = 0;
+
+    std::vector<Texture>       mTextures;
+    std::vector<TextureHandle> mFreeHandles;
+    std::vector<Garbage>       mGarbage;
+    // texel bytes of the images once the running transfers are done
+    VkDeviceSize               mResidentBytes = 0;
+};
+
+#endif //VULKAN_TEST_TEXTURESTREAMER_HPP
@@ -0,0 +1,366 @@
+//
+// Created by Krisu on 2020/4/16.
+//
+
+#include "TransformHierarchy.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define TRANSFORM_HIERARCHY_SSE2
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define TRANSFORM_HIERARCHY_NEON
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+// nodes per job, a multiple of the four computed at once
+constexpr size_t UPDATE_BATCH_SIZE = 4096;
+
+// just enough of a four float vector for the kernel below
+#if defined(TRANSFORM_HIERARCHY_SSE2)
+using Float4 = __m128;
+
+inline Float4 Load(const float *p) { return _mm_loadu_ps(p); }
+inline void Store(float *p, Float4 v) { _mm_storeu_ps(p, v); }
+inline Float4 Splat(float f) { return _mm_set1_ps(f); }
+inline Float4 Add(Float4 a, Float4 b) { return _mm_add_ps(a, b); }
+inline Float4 Sub(Float4 a, Float4 b) { return _mm_sub_ps(a, b); }
+inline Float4 Mul(Float4 a, Float4 b) { return _mm_mul_ps(a, b); }
+
+inline void Transpose(Float4 &a, Float4 &b, Float4 &c, Float4 &d) {
+    _MM_TRANSPOSE4_PS(a, b, c, d);
+}
+#elif defined(TRANSFORM_HIERARCHY_NEON)
+using Float4 = float32x4_t;
+
+inline Float4 Load(const float *p) { return vld1q_f32(p); }
+inline void Store(float *p, Float4 v) { vst1q_f32(p, v); }
+inline Float4 Splat(float f) { return vdupq_n_f32(f); }
+inline Float4 Add(Float4 a, Float4 b) { return vaddq_f32(a, b); }
+inline Float4 Sub(Float4 a, Float4 b) { return vsubq_f32(a, b); }
+inline Float4 Mul(Float4 a, Float4 b) { return vmulq_f32(a, b); }
+
+inline void Transpose(Float4 &a, Float4 &b, Float4 &c, Float4 &d) {
+    float32x4x2_t ab = vtrnq_f32(a, b);
+    float32x4x2_t cd = vtrnq_f32(c, d);
+    a = vcombine_f32(vget_low_f32(ab.val[0]), vget_low_f32(cd.val[0]));
+    b = vcombine_f32(vget_low_f32(ab.val[1]), vget_low_f32(cd.val[1]));
+    c = vcombine_f32(vget_high_f32(ab.val[0]), vget_high_f32(cd.val[0]));
+    d = vcombine_f32(vget_high_f32(ab.val[1]), vget_high_f32(cd.val[1]));
+}
+#else
+struct Float4 {
+    float v[4];
+};
+
+inline Float4 Load(const float *p) { return {{p[0], p[1], p[2], p[3]}}; }
+inline void Store(float *p, Float4 v) { std::copy(v.v, v.v + 4, p); }
+inline Float4 Splat(float f) { return {{f, f, f, f}}; }
+
+inline Float4 Add(Float4 a, Float4 b) {
+    return {{a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2],
+             a.v[3] + b.v[3]}};
+}
+
+inline Float4 Sub(Float4 a, Float4 b) {
+    return {{a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2],
+             a.v[3] - b.v[3]}};
+}
+
+inline Float4 Mul(Float4 a, Float4 b) {
+    return {{a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2],
+             a.v[3] * b.v[3]}};
+}
+
+inline void Transpose(Float4 &a, Float4 &b, Float4 &c, Float4 &d) {
+    Float4 rows[4]{a, b, c, d};
+    Float4 *columns[4]{&a, &b, &c, &d};
+    for (int column = 0; column < 4; column++) {
+        for (int row = 0; row < 4; row++) {
+            columns[column]->v[row] = rows[row].v[column];
+        }
+    }
+}
+#endif
+
+// translation, rotation and scale components, four nodes from each
+enum LocalComponent {
+    TX, TY, TZ, RX, RY, RZ, RW, SX, SY, SZ, LOCAL_COMPONENT_COUNT
+};
+
+/* World matrices of four nodes: the local matrices T * R * S, times the
+ * parent world matrices unless they are roots. Matrices are 3x4 row
+ * major, worlds[lane] receives lane's. */
+void ComputeWorld4(const float *const local[LOCAL_COMPONENT_COUNT],
+                   const float *parentWorlds[4], float *worlds[4]) {
+    Float4 x = Load(local[RX]), y = Load(local[RY]), z = Load(local[RZ]);
+    Float4 w = Load(local[RW]);
+    Float4 x2 = Add(x, x), y2 = Add(y, y), z2 = Add(z, z);
+    Float4 xx = Mul(x, x2), yy = Mul(y, y2), zz = Mul(z, z2);
+    Float4 xy = Mul(x, y2), xz = Mul(x, z2), yz = Mul(y, z2);
+    Float4 wx = Mul(w, x2), wy = Mul(w, y2), wz = Mul(w, z2);
+    Float4 one = Splat(1.0f);
+    Float4 sx = Load(local[SX]), sy = Load(local[SY]), sz = Load(local[SZ]);
+
+    // one value of four matrices per element
+    Float4 l[3][4]{
+            {Mul(Sub(one, Add(yy, zz)), sx), Mul(Sub(xy, wz), sy),
+             Mul(Add(xz, wy), sz), Load(local[TX])},
+            {Mul(Add(xy, wz), sx), Mul(Sub(one, Add(xx, zz)), sy),
+             Mul(Sub(yz, wx), sz), Load(local[TY])},
+            {Mul(Sub(xz, wy), sx), Mul(Add(yz, wx), sy),
+             Mul(Sub(one, Add(xx, yy)), sz), Load(local[TZ])}
+    };
+
+    Float4 world[3][4];
+    if (parentWorlds == nullptr) {
+        std::copy(&l[0][0], &l[0][0] + 12, &world[0][0]);
+    } else {
+        for (int row = 0; row < 3; row++) {
+            Float4 p[4]{Load(parentWorlds[0] + 4 * row),
+                        Load(parentWorlds[1] + 4 * row),
+                        Load(parentWorlds[2] + 4 * row),
+                        Load(parentWorlds[3] + 4 * row)};
+            Transpose(p[0], p[1], p[2], p[3]);
+            for (int column = 0; column < 4; column++) {
+                world[row][column] = Add(
+                        Add(Mul(p[0], l[0][column]), Mul(p[1], l[1][column])),
+                        Mul(p[2], l[2][column]));
+            }
+            world[row][3] = Add(world[row][3], p[3]);
+        }
+    }
+
+    for (int row = 0; row < 3; row++) {
+        Float4 r[4]{world[row][0], world[row][1], world[row][2],
+                    world[row][3]};
+        Transpose(r[0], r[1], r[2], r[3]);
+        for (int lane = 0; lane < 4; lane++) {
+            Store(worlds[lane] + 4 * row, r[lane]);
+        }
+    }
+}
+
+/* values[slot] = old values[order[slot]], stride values per slot */
+template<typename T>
+void Permute(std::vector<T> &values, const std::vector<uint32_t> &order,
+             size_t stride) {
+    std::vector<T> permuted(values.size());
+    for (size_t slot = 0; slot < order.size(); slot++) {
+        std::copy(values.begin() + order[slot] * stride,
+                  values.begin() + (order[slot] + 1) * stride,
+                  permuted.begin() + slot * stride);
+    }
+    values.swap(permuted);
+}
+
+}
+
+void TransformHierarchy::Init(JobSystem &jobSystem) {
+    mJobSystem = &jobSystem;
+}
+
+uint32_t TransformHierarchy::AddNode(uint32_t parent) {
+    auto id = static_cast<uint32_t>(mParents.size());
+    if (parent != NO_PARENT && parent >= id) {
+        throw std::runtime_error("failed to add node, unknown parent!");
+    }
+    auto slot = static_cast<uint32_t>(mIds.size());
+    mParents.push_back(parent);
+    mSlots.push_back(slot);
+    mIds.push_back(id);
+    mParentSlots.push_back(parent == NO_PARENT ? NO_PARENT : mSlots[parent]);
+    mTranslationX.push_back(0.0f);
+    mTranslationY.push_back(0.0f);
+    mTranslationZ.push_back(0.0f);
+    mRotationX.push_back(0.0f);
+    mRotationY.push_back(0.0f);
+    mRotationZ.push_back(0.0f);
+    mRotationW.push_back(1.0f);
+    mScaleX.push_back(1.0f);
+    mScaleY.push_back(1.0f);
+    mScaleZ.push_back(1.0f);
+    mDirty.push_back(1);
+    mWorld.resize(mWorld.size() + 12);
+    mSorted = false;
+    mAnyDirty = true;
+    return id;
+}
+
+void TransformHierarchy::SetLocal(uint32_t node, const float translation[3],
+                                  const float rotation[4],
+                                  const float scale[3]) {
+    SetTranslation(node, translation);
+    SetRotation(node, rotation);
+    SetScale(node, scale);
+}
+
+void TransformHierarchy::SetTranslation(uint32_t node,
+                                        const float translation[3]) {
+    uint32_t slot = mSlots[node];
+    mTranslationX[slot] = translation[0];
+    mTranslationY[slot] = translation[1];
+    mTranslationZ[slot] = translation[2];
+    mDirty[slot] = 1;
+    mAnyDirty = true;
+}
+
+void TransformHierarchy::SetRotation(uint32_t node, const float rotation[4]) {
+    uint32_t slot = mSlots[node];
+    mRotationX[slot] = rotation[0];
+    mRotationY[slot] = rotation[1];
+    mRotationZ[slot] = rotation[2];
+    mRotationW[slot] = rotation[3];
+    mDirty[slot] = 1;
+    mAnyDirty = true;
+}
+
+void TransformHierarchy::SetScale(uint32_t node, const float scale[3]) {
+    uint32_t slot = mSlots[node];
+    mScaleX[slot] = scale[0];
+    mScaleY[slot] = scale[1];
+    mScaleZ[slot] = scale[2];
+    mDirty[slot] = 1;
+    mAnyDirty = true;
+}
+
+void TransformHierarchy::GetWorldMatrix(uint32_t node,
+                                        float matrix[16]) const {
+    const float *world = GetWorldMatrix(node);
+    for (int column = 0; column < 4; column++) {
+        for (int row = 0; row < 3; row++) {
+            matrix[column * 4 + row] = world[row * 4 + column];
+        }
+        matrix[column * 4 + 3] = column == 3 ? 1.0f : 0.0f;
+    }
+}
+
+void TransformHierarchy::Sort() {
+    // parents come before their children by id, so one pass finds depths
+    size_t count = mParents.size();
+    std::vector<uint32_t> depths(count);
+    mLevels.assign(1, 0);
+    for (size_t id = 0; id < count; id++) {
+        uint32_t parent = mParents[id];
+        depths[id] = parent == NO_PARENT ? 0 : depths[parent] + 1;
+        if (depths[id] + 1 >= mLevels.size()) {
+            mLevels.resize(depths[id] + 2, 0);
+        }
+        mLevels[depths[id] + 1]++;
+    }
+    for (size_t level = 1; level < mLevels.size(); level++) {
+        mLevels[level] += mLevels[level - 1];
+    }
+
+    // stable within a level, so siblings stay next to each other
+    std::vector<size_t> next(mLevels.begin(), mLevels.end() - 1);
+    std::vector<uint32_t> order(count);
+    for (size_t id = 0; id < count; id++) {
+        size_t slot = next[depths[id]]++;
+        order[slot] = mSlots[id];
+        mSlots[id] = slot;
+    }
+
+    Permute(mTranslationX, order, 1);
+    Permute(mTranslationY, order, 1);
+    Permute(mTranslationZ, order, 1);
+    Permute(mRotationX, order, 1);
+    Permute(mRotationY, order, 1);
+    Permute(mRotationZ, order, 1);
+    Permute(mRotationW, order, 1);
+    Permute(mScaleX, order, 1);
+    Permute(mScaleY, order, 1);
+    Permute(mScaleZ, order, 1);
+    Permute(mDirty, order, 1);
+    Permute(mWorld, order, 12);
+    for (size_t id = 0; id < count; id++) {
+        uint32_t slot = mSlots[id];
+        uint32_t parent = mParents[id];
+        mIds[slot] = id;
+        mParentSlots[slot] = parent == NO_PARENT ? NO_PARENT : mSlots[parent];
+    }
+    mSorted = true;
+}
+
+void TransformHierarchy::Update() {
+    if (!mSorted) {
+        Sort();
+    }
+    if (!mAnyDirty) {
+        return;
+    }
+    for (size_t level = 0; level + 1 < mLevels.size(); level++) {
+        size_t begin = mLevels[level];
+        size_t count = mLevels[level + 1] - begin;
+        bool roots = level == 0;
+        if (count <= UPDATE_BATCH_SIZE) {
+            UpdateRange(begin, begin + count, roots);
+        } else {
+            mJobSystem->ParallelFor(count, UPDATE_BATCH_SIZE,
+                                    [&](size_t first, size_t last) {
+                                        UpdateRange(begin + first,
+                                                    begin + last, roots);
+                                    });
+        }
+    }
+    std::fill(mDirty.begin(), mDirty.end(), 0);
+    mAnyDirty = false;
+}
+
+void TransformHierarchy::UpdateRange(size_t begin, size_t end, bool roots) {
+    const std::vector<float> *components[LOCAL_COMPONENT_COUNT]{
+            &mTranslationX, &mTranslationY, &mTranslationZ,
+            &mRotationX, &mRotationY, &mRotationZ, &mRotationW,
+            &mScaleX, &mScaleY, &mScaleZ
+    };
+    for (size_t first = begin; first < end; first += 4) {
+        size_t lanes = std::min<size_t>(4, end - first);
+
+        // a node is dirty when it or any of its ancestors changed, the
+        // parents' flags are final since their level is done
+        bool dirty = false;
+        for (size_t slot = first; slot < first + lanes; slot++) {
+            if (!roots) {
+                mDirty[slot] |= mDirty[mParentSlots[slot]];
+            }
+            dirty |= mDirty[slot] != 0;
+        }
+        if (!dirty) {
+            continue;
+        }
+
+        // clean nodes in the batch come out the same as before; a short
+        // batch repeats its last node in the missing lanes
+        float padded[LOCAL_COMPONENT_COUNT][4];
+        float discarded[12];
+        const float *local[LOCAL_COMPONENT_COUNT];
+        const float *parentWorlds[4];
+        float *worlds[4];
+        for (int component = 0; component < LOCAL_COMPONENT_COUNT;
+             component++) {
+            const float *values = components[component]->data() + first;
+            if (lanes == 4) {
+                local[component] = values;
+            } else {
+                for (size_t lane = 0; lane < 4; lane++) {
+                    padded[component][lane] =
+                            values[std::min(lane, lanes - 1)];
+                }
+                local[component] = padded[component];
+            }
+        }
+        for (size_t lane = 0; lane < 4; lane++) {
+            size_t slot = first + std::min(lane, lanes - 1);
+            if (!roots) {
+                parentWorlds[lane] = mWorld.data() + 12 * mParentSlots[slot];
+            }
+            worlds[lane] = lane < lanes ? mWorld.data() + 12 * slot
+                                        : discarded;
+        }
+        ComputeWorld4(local, roots ? nullptr : parentWorlds, worlds);
+    }
+}
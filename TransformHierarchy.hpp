@@ -0,0 +1,94 @@
+//
+// Created by Krisu on 2020/4/16.
+//
+
+#ifndef VULKAN_TEST_TRANSFORMHIERARCHY_HPP
+#define VULKAN_TEST_TRANSFORMHIERARCHY_HPP
+
+#include "JobSystem.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+/* Local and world transforms of a tree of nodes, meant for scenes of
+ * around a million of them.
+ *
+ * Local transforms are translation, rotation quaternion and scale, each
+ * component in an array of its own. Nodes are kept sorted by depth, so a
+ * level is a contiguous run whose parents all sit in the runs before it.
+ * Update walks the levels in order and computes world matrices four
+ * nodes at a time with SSE2 or NEON, splitting big levels over the
+ * JobSystem. Only nodes whose local transform changed since the last
+ * Update, and their descendants, are computed again.
+ *
+ * World matrices are affine 3x4, row major: the VkTransformMatrixKHR
+ * layout. Nodes are referred to by the id AddNode returns, which stays
+ * the same when the nodes are sorted again. */
+class TransformHierarchy {
+public:
+    constexpr static const uint32_t NO_PARENT = UINT32_MAX;
+
+    void Init(JobSystem &jobSystem);
+
+    /* A node with an identity local transform, parent must have been
+     * added before */
+    uint32_t AddNode(uint32_t parent = NO_PARENT);
+
+    /* rotation is a unit quaternion x, y, z, w */
+    void SetLocal(uint32_t node, const float translation[3],
+                  const float rotation[4], const float scale[3]);
+
+    void SetTranslation(uint32_t node, const float translation[3]);
+
+    /* The setters below leave the rest of the local transform as it is */
+    void SetRotation(uint32_t node, const float rotation[4]);
+
+    void SetScale(uint32_t node, const float scale[3]);
+
+    /* Compute the world matrices of every changed subtree */
+    void Update();
+
+    /* The 12 floats of the node's world matrix as of the last Update */
+    const float *GetWorldMatrix(uint32_t node) const {
+        return mWorld.data() + 12 * mSlots[node];
+    }
+
+    /* The world matrix as a column major 4x4, like CullView */
+    void GetWorldMatrix(uint32_t node, float matrix[16]) const;
+
+    uint32_t GetNodeCount() const { return mParents.size(); }
+
+    uint32_t GetLevelCount() const { return mLevels.size() - 1; }
+
+private:
+    /* Put the nodes back in depth order after AddNode */
+    void Sort();
+
+    /* Nodes [begin, end) of one level */
+    void UpdateRange(size_t begin, size_t end, bool roots);
+
+private:
+    JobSystem *mJobSystem = nullptr;
+
+    // by id
+    std::vector<uint32_t> mParents;
+    std::vector<uint32_t> mSlots;
+
+    // by slot, in depth order once sorted
+    std::vector<uint32_t> mIds;
+    std::vector<uint32_t> mParentSlots;
+    std::vector<float>    mTranslationX, mTranslationY, mTranslationZ;
+    std::vector<float>    mRotationX, mRotationY, mRotationZ, mRotationW;
+    std::vector<float>    mScaleX, mScaleY, mScaleZ;
+    std::vector<uint8_t>  mDirty;
+    std::vector<float>    mWorld;
+
+    // first slot of each level, and the slot count at the end
+    std::vector<size_t> mLevels{0};
+    bool                mSorted = true;
+    bool                mAnyDirty = false;
+};
+
+#endif //VULKAN_TEST_TRANSFORMHIERARCHY_HPP
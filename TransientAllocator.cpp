@@ -0,0 +1,284 @@
+//
+// Created by Krisu on 2020/4/10.
+//
+
+#include "TransientAllocator.hpp"
+#include "AllocationTracker.hpp"
+#include "Hash.hpp"
+#include "VulkanUtils.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+
+void TransientAllocator::Init(VkPhysicalDevice physicalDevice,
+                              VkDevice device,
+                              const VkAllocationCallbacks *pAllocator,
+                              uint32_t framesInFlight) {
+    mPhysicalDevice = physicalDevice;
+    mDevice = device;
+    mAllocator = pAllocator;
+    mFramesInFlight = framesInFlight;
+}
+
+std::vector<TransientImage> TransientAllocator::Realize(
+        const std::vector<TransientImageDesc> &descs) {
+    uint64_t key = HashDescs(descs);
+    if (key == mKey && mCurrent.images.size() == descs.size()) {
+        return mCurrent.images;
+    }
+
+    // frames still in flight may use the old images
+    if (!mCurrent.images.empty()) {
+        mCurrent.framesLeft = mFramesInFlight;
+        mRetired.push_back(std::move(mCurrent));
+        mCurrent = {};
+    }
+    mKey = key;
+    mReport = {};
+    mReport.imageCount = descs.size();
+
+    size_t count = descs.size();
+    mCurrent.images.resize(count);
+    std::vector<VkMemoryRequirements> requirements(count);
+    std::vector<bool> lazy(count, false);
+
+    for (size_t i = 0; i < count; i++) {
+        const auto &desc = descs[i];
+        VkImageCreateInfo imageCreateInfo{};
+        imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageCreateInfo.format = desc.format;
+        imageCreateInfo.extent = {desc.extent.width, desc.extent.height, 1};
+        imageCreateInfo.mipLevels = 1;
+        imageCreateInfo.arrayLayers = 1;
+        imageCreateInfo.samples = desc.samples;
+        imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageCreateInfo.usage = desc.usage;
+        if (desc.attachmentOnly) {
+            imageCreateInfo.usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+        }
+        imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        AllocationTracker::ScopedTag tag(VK_OBJECT_TYPE_IMAGE);
+        if (vkCreateImage(mDevice, &imageCreateInfo, mAllocator,
+                          &mCurrent.images[i].image) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create transient image " +
+                                     desc.name);
+        }
+        vkGetImageMemoryRequirements(mDevice, mCurrent.images[i].image,
+                                     &requirements[i]);
+        lazy[i] = desc.attachmentOnly &&
+                  FindMemoryType(mPhysicalDevice,
+                                 requirements[i].memoryTypeBits,
+                                 VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT)
+                          .has_value();
+    }
+
+    // largest first, every block is as big as the first image placed in it
+    std::vector<size_t> order(count);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return requirements[a].size > requirements[b].size;
+    });
+
+    std::vector<Block> blocks;
+    std::vector<size_t> blockOf(count);
+    std::vector<VkDeviceSize> offsetOf(count);
+    for (size_t i : order) {
+        if (lazy[i]) {
+            continue;
+        }
+        const auto &desc = descs[i];
+        mReport.unaliasedBytes += requirements[i].size;
+
+        bool placed = false;
+        for (size_t b = 0; b < blocks.size() && !placed; b++) {
+            Block &block = blocks[b];
+            VkDeviceSize offset;
+            if ((requirements[i].memoryTypeBits &
+                 (1u << block.memoryTypeIndex)) &&
+                FindOffset(block, requirements[i], desc.firstPass,
+                           desc.lastPass, offset)) {
+                block.placements.push_back({offset, requirements[i].size,
+                                            desc.firstPass, desc.lastPass});
+                blockOf[i] = b;
+                offsetOf[i] = offset;
+                placed = true;
+            }
+        }
+        if (!placed) {
+            auto memoryType = FindMemoryType(
+                    mPhysicalDevice, requirements[i].memoryTypeBits,
+                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+            if (!memoryType.has_value()) {
+                throw std::runtime_error(
+                        "no device local memory for transient image " +
+                        desc.name);
+            }
+            Block block;
+            block.memoryTypeIndex = memoryType.value();
+            block.size = requirements[i].size;
+            block.placements.push_back({0, requirements[i].size,
+                                        desc.firstPass, desc.lastPass});
+            blockOf[i] = blocks.size();
+            offsetOf[i] = 0;
+            blocks.push_back(block);
+        }
+    }
+
+    AllocationTracker::ScopedTag tag(VK_OBJECT_TYPE_DEVICE_MEMORY);
+    for (auto &block : blocks) {
+        VkMemoryAllocateInfo allocateInfo{};
+        allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocateInfo.allocationSize = block.size;
+        allocateInfo.memoryTypeIndex = block.memoryTypeIndex;
+        if (vkAllocateMemory(mDevice, &allocateInfo, mAllocator,
+                             &block.memory) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate transient memory");
+        }
+        mCurrent.memories.push_back(block.memory);
+        mReport.aliasedBytes += block.size;
+    }
+    mReport.blockCount = blocks.size();
+
+    for (size_t i = 0; i < count; i++) {
+        VkDeviceMemory memory;
+        VkDeviceSize offset = 0;
+        if (lazy[i]) {
+            // dedicated, the driver commits pages only if it has to
+            VkMemoryAllocateInfo allocateInfo{};
+            allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+            allocateInfo.allocationSize = requirements[i].size;
+            allocateInfo.memoryTypeIndex = FindMemoryType(
+                    mPhysicalDevice, requirements[i].memoryTypeBits,
+                    VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT).value();
+            if (vkAllocateMemory(mDevice, &allocateInfo, mAllocator,
+                                 &memory) != VK_SUCCESS) {
+                throw std::runtime_error(
+                        "failed to allocate lazily allocated memory");
+            }
+            mCurrent.memories.push_back(memory);
+            mReport.lazyImageCount++;
+        } else {
+            memory = blocks[blockOf[i]].memory;
+            offset = offsetOf[i];
+        }
+        vkBindImageMemory(mDevice, mCurrent.images[i].image, memory, offset);
+
+        VkImageViewCreateInfo imageViewCreateInfo{};
+        imageViewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        imageViewCreateInfo.image = mCurrent.images[i].image;
+        imageViewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        imageViewCreateInfo.format = descs[i].format;
+        imageViewCreateInfo.subresourceRange = {descs[i].aspect, 0, 1, 0, 1};
+
+        AllocationTracker::ScopedTag viewTag(VK_OBJECT_TYPE_IMAGE_VIEW);
+        if (vkCreateImageView(mDevice, &imageViewCreateInfo, mAllocator,
+                              &mCurrent.images[i].view) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create transient image view");
+        }
+    }
+
+    return mCurrent.images;
+}
+
+void TransientAllocator::NextFrame() {
+    for (auto it = mRetired.begin(); it != mRetired.end();) {
+        if (it->framesLeft == 0) {
+            Destroy(*it);
+            it = mRetired.erase(it);
+        } else {
+            it->framesLeft--;
+            ++it;
+        }
+    }
+}
+
+void TransientAllocator::Release() {
+    Destroy(mCurrent);
+    mCurrent = {};
+    for (auto &allocation : mRetired) {
+        Destroy(allocation);
+    }
+    mRetired.clear();
+    mKey = 0;
+}
+
+void TransientAllocator::PrintReport(std::ostream &os) const {
+    os << "Transient images: " << mReport.imageCount << " ("
+       << mReport.lazyImageCount << " lazily allocated), "
+       << mReport.unaliasedBytes << " B without aliasing, "
+       << mReport.aliasedBytes << " B in " << mReport.blockCount
+       << " aliased blocks\n";
+}
+
+uint64_t TransientAllocator::HashDescs(
+        const std::vector<TransientImageDesc> &descs) {
+    uint64_t hash = HashCombine(HASH_SEED, descs.size());
+    for (const auto &desc : descs) {
+        hash = HashCombine(hash, desc.format);
+        hash = HashCombine(hash, desc.extent.width);
+        hash = HashCombine(hash, desc.extent.height);
+        hash = HashCombine(hash, desc.aspect);
+        hash = HashCombine(hash, desc.samples);
+        hash = HashCombine(hash, desc.usage);
+        hash = HashCombine(hash, desc.firstPass);
+        hash = HashCombine(hash, desc.lastPass);
+        hash = HashCombine(hash, desc.attachmentOnly);
+    }
+    return hash;
+}
+
+void TransientAllocator::Destroy(Allocation &allocation) {
+    for (auto &image : allocation.images) {
+        vkDestroyImageView(mDevice, image.view, mAllocator);
+        vkDestroyImage(mDevice, image.image, mAllocator);
+    }
+    for (auto memory : allocation.memories) {
+        vkFreeMemory(mDevice, memory, mAllocator);
+    }
+    allocation.images.clear();
+    allocation.memories.clear();
+}
+
+bool TransientAllocator::FindOffset(const Block &block,
+                                    const VkMemoryRequirements &requirements,
+                                    int firstPass, int lastPass,
+                                    VkDeviceSize &offset) {
+    // images alive at the same time must not overlap in memory
+    std::vector<const Placement *> conflicts;
+    for (const auto &placement : block.placements) {
+        if (placement.firstPass <= lastPass &&
+            firstPass <= placement.lastPass) {
+            conflicts.push_back(&placement);
+        }
+    }
+
+    // try the start of the block and the end of every conflicting image
+    std::vector<VkDeviceSize> candidates{0};
+    for (const Placement *conflict : conflicts) {
+        VkDeviceSize end = conflict->offset + conflict->size;
+        VkDeviceSize alignment = requirements.alignment;
+        candidates.push_back((end + alignment - 1) / alignment * alignment);
+    }
+    std::sort(candidates.begin(), candidates.end());
+
+    for (VkDeviceSize candidate : candidates) {
+        if (candidate + requirements.size > block.size) {
+            break;
+        }
+        bool overlaps = std::any_of(
+                conflicts.begin(), conflicts.end(),
+                [&](const Placement *conflict) {
+                    return candidate < conflict->offset + conflict->size &&
+                           conflict->offset < candidate + requirements.size;
+                });
+        if (!overlaps) {
+            offset = candidate;
+            return true;
+        }
+    }
+    return false;
+}
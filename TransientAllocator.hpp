@@ -0,0 +1,112 @@
+//
+// Created by Krisu on 2020/4/10.
+//
+
+#ifndef VULKAN_TEST_TRANSIENTALLOCATOR_HPP
+#define VULKAN_TEST_TRANSIENTALLOCATOR_HPP
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+
+/* An image that only lives between two passes of one frame */
+struct TransientImageDesc {
+    std::string           name;
+    VkFormat              format = VK_FORMAT_UNDEFINED;
+    VkExtent2D            extent{0, 0};
+    VkImageAspectFlags    aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+    VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+    VkImageUsageFlags     usage = 0;
+    // alive passes using the image, inclusive
+    int                   firstPass = 0;
+    int                   lastPass = 0;
+    // only used as an attachment inside a single pass, never stored
+    bool                  attachmentOnly = false;
+};
+
+struct TransientImage {
+    VkImage     image = VK_NULL_HANDLE;
+    VkImageView view = VK_NULL_HANDLE;
+};
+
+
+/* Places transient images with disjoint lifetimes on the same
+ * VkDeviceMemory. Attachment-only images go to lazily allocated memory
+ * instead, where the tiler may never back them at all. The placement is
+ * kept as long as the requested set does not change. */
+class TransientAllocator {
+public:
+    struct Report {
+        size_t       imageCount = 0;
+        size_t       lazyImageCount = 0;
+        size_t       blockCount = 0;
+        VkDeviceSize unaliasedBytes = 0;
+        VkDeviceSize aliasedBytes = 0;
+    };
+
+    /* framesInFlight: how long replaced allocations are kept alive */
+    void Init(VkPhysicalDevice physicalDevice, VkDevice device,
+              const VkAllocationCallbacks *pAllocator,
+              uint32_t framesInFlight);
+
+    /* Images for descs, in the same order. Reuses the previous placement
+     * when descs did not change. */
+    std::vector<TransientImage> Realize(
+            const std::vector<TransientImageDesc> &descs);
+
+    /* Call once per frame after the frame's fence was waited on */
+    void NextFrame();
+
+    void Release();
+
+    const Report &GetReport() const { return mReport; }
+
+    void PrintReport(std::ostream &os) const;
+
+private:
+    struct Placement {
+        VkDeviceSize offset;
+        VkDeviceSize size;
+        int          firstPass;
+        int          lastPass;
+    };
+
+    struct Block {
+        VkDeviceMemory         memory = VK_NULL_HANDLE;
+        uint32_t               memoryTypeIndex;
+        VkDeviceSize           size;
+        std::vector<Placement> placements;
+    };
+
+    struct Allocation {
+        std::vector<TransientImage> images;
+        std::vector<VkDeviceMemory> memories;
+        uint32_t                    framesLeft = 0;
+    };
+
+    static uint64_t HashDescs(const std::vector<TransientImageDesc> &descs);
+
+    void Destroy(Allocation &allocation);
+
+    static bool FindOffset(const Block &block,
+                           const VkMemoryRequirements &requirements,
+                           int firstPass, int lastPass,
+                           VkDeviceSize &offset);
+
+private:
+    VkPhysicalDevice             mPhysicalDevice = VK_NULL_HANDLE;
+    VkDevice                     mDevice = VK_NULL_HANDLE;
+    const VkAllocationCallbacks *mAllocator = nullptr;
+    uint32_t                     mFramesInFlight = 1;
+
+    uint64_t                mKey = 0;
+    Allocation              mCurrent;
+    std::vector<Allocation> mRetired;
+    Report                  mReport;
+};
+
+#endif //VULKAN_TEST_TRANSIENTALLOCATOR_HPP
@@ -0,0 +1,154 @@
+//
+// Created by Krisu on 2020/4/6.
+//
+
+#include "ValidationLogger.hpp"
+
+#include <chrono>
+
+ValidationLogger::ValidationLogger(std::ostream &output, size_t capacity)
+        : mOutput(output) {
+    size_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    mSlots = std::make_unique<Slot[]>(size);
+    mMask = size - 1;
+    for (size_t i = 0; i < size; i++) {
+        mSlots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+ValidationLogger::~ValidationLogger() {
+    Stop();
+}
+
+void ValidationLogger::Start() {
+    if (mRunning.exchange(true)) {
+        return;
+    }
+    mThread = std::thread(&ValidationLogger::Run, this);
+}
+
+void ValidationLogger::Stop() {
+    if (!mRunning.exchange(false)) {
+        return;
+    }
+    mWake.notify_one();
+    mThread.join();
+    Drain();
+
+    for (const auto &[key, record] : mRecords) {
+        if (record.count > 1) {
+            mOutput << "Validation layer: [" << SeverityName(record.severity)
+                    << "] " << record.name << " repeated "
+                    << record.count << " times\n";
+        }
+    }
+    uint64_t dropped = DroppedCount();
+    if (dropped != 0) {
+        mOutput << "Validation layer: " << dropped
+                << " messages dropped, queue was full\n";
+    }
+    mOutput.flush();
+    mRecords.clear();
+}
+
+bool ValidationLogger::Submit(
+        VkDebugUtilsMessageSeverityFlagBitsEXT severity,
+        VkDebugUtilsMessageTypeFlagsEXT type,
+        const VkDebugUtilsMessengerCallbackDataEXT *pCallbackData) {
+    if ((severity & mSeverityFilter.load(std::memory_order_relaxed)) == 0 ||
+        (type & mTypeFilter.load(std::memory_order_relaxed)) == 0) {
+        return false;
+    }
+
+    // claim a slot, see Vyukov's bounded MPMC queue
+    Slot *slot;
+    size_t pos = mEnqueuePos.load(std::memory_order_relaxed);
+    for (;;) {
+        slot = &mSlots[pos & mMask];
+        size_t sequence = slot->sequence.load(std::memory_order_acquire);
+        auto diff = static_cast<intptr_t>(sequence) -
+                    static_cast<intptr_t>(pos);
+        if (diff == 0) {
+            if (mEnqueuePos.compare_exchange_weak(pos, pos + 1,
+                                                  std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            mDropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        } else {
+            pos = mEnqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    // slot strings keep their capacity, so this rarely allocates
+    slot->severity = severity;
+    slot->type = type;
+    slot->messageId = pCallbackData->messageIdNumber;
+    slot->messageIdName.assign(pCallbackData->pMessageIdName != nullptr
+                               ? pCallbackData->pMessageIdName : "");
+    slot->message.assign(pCallbackData->pMessage != nullptr
+                         ? pCallbackData->pMessage : "");
+    slot->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+bool ValidationLogger::Pop(Slot &out) {
+    Slot &slot = mSlots[mDequeuePos & mMask];
+    if (slot.sequence.load(std::memory_order_acquire) != mDequeuePos + 1) {
+        return false;
+    }
+    out.severity = slot.severity;
+    out.type = slot.type;
+    out.messageId = slot.messageId;
+    out.messageIdName.swap(slot.messageIdName);
+    out.message.swap(slot.message);
+    slot.sequence.store(mDequeuePos + mMask + 1, std::memory_order_release);
+    mDequeuePos++;
+    return true;
+}
+
+void ValidationLogger::Drain() {
+    bool printed = false;
+    while (Pop(mScratch)) {
+        // messages without an id are folded by their text
+        std::string key = mScratch.messageIdName.empty()
+                          ? mScratch.message
+                          : mScratch.messageIdName + "#" +
+                            std::to_string(mScratch.messageId);
+        auto it = mRecords.find(key);
+        if (it != mRecords.end()) {
+            it->second.count++;
+            continue;
+        }
+        mRecords.emplace(key, MessageRecord{mScratch.severity, key, 1});
+        mOutput << "Validation layer: [" << SeverityName(mScratch.severity)
+                << "] " << mScratch.message << '\n';
+        printed = true;
+    }
+    if (printed) {
+        mOutput.flush();
+    }
+}
+
+void ValidationLogger::Run() {
+    while (mRunning.load(std::memory_order_relaxed)) {
+        Drain();
+        std::unique_lock<std::mutex> lock(mWakeMutex);
+        mWake.wait_for(lock, std::chrono::milliseconds(5));
+    }
+}
+
+const char *ValidationLogger::SeverityName(
+        VkDebugUtilsMessageSeverityFlagBitsEXT severity) {
+    switch (severity) {
+        case VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT: return "verbose";
+        case VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT:    return "info";
+        case VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT: return "warning";
+        case VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT:   return "error";
+        default:                                              return "?";
+    }
+}
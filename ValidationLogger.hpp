@@ -0,0 +1,111 @@
+//
+// Created by Krisu on 2020/4/6.
+//
+
+#ifndef VULKAN_TEST_VALIDATIONLOGGER_HPP
+#define VULKAN_TEST_VALIDATIONLOGGER_HPP
+
+#include <vulkan/vulkan.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+
+/* Takes validation messages off the driver thread: the debug callback only
+ * filters and copies the message into a lock-free ring, a background thread
+ * drains it, folds repeated message ids together and prints. */
+class ValidationLogger {
+public:
+    explicit ValidationLogger(std::ostream &output, size_t capacity = 1024);
+
+    ~ValidationLogger();
+
+    ValidationLogger(const ValidationLogger &) = delete;
+
+    ValidationLogger &operator=(const ValidationLogger &) = delete;
+
+    void Start();
+
+    /* Drains what is left and prints how often each message repeated */
+    void Stop();
+
+    /* Called from the debug callback, never blocks. Returns false when the
+     * message was filtered out or the queue was full. */
+    bool Submit(VkDebugUtilsMessageSeverityFlagBitsEXT severity,
+                VkDebugUtilsMessageTypeFlagsEXT type,
+                const VkDebugUtilsMessengerCallbackDataEXT *pCallbackData);
+
+    /* Filters can be changed at any time, from any thread */
+    void SetSeverityFilter(VkDebugUtilsMessageSeverityFlagsEXT severities) {
+        mSeverityFilter.store(severities, std::memory_order_relaxed);
+    }
+
+    void SetTypeFilter(VkDebugUtilsMessageTypeFlagsEXT types) {
+        mTypeFilter.store(types, std::memory_order_relaxed);
+    }
+
+    uint64_t DroppedCount() const {
+        return mDropped.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Slot {
+        std::atomic<size_t>                    sequence{0};
+        VkDebugUtilsMessageSeverityFlagBitsEXT severity;
+        VkDebugUtilsMessageTypeFlagsEXT        type;
+        int32_t                                messageId;
+        std::string                            messageIdName;
+        std::string                            message;
+    };
+
+    struct MessageRecord {
+        VkDebugUtilsMessageSeverityFlagBitsEXT severity;
+        std::string                            name;
+        uint64_t                               count;
+    };
+
+    bool Pop(Slot &out);
+
+    void Drain();
+
+    void Run();
+
+    static const char *SeverityName(
+            VkDebugUtilsMessageSeverityFlagBitsEXT severity);
+
+private:
+    std::ostream &mOutput;
+
+    // bounded multi-producer ring, capacity is a power of two
+    std::unique_ptr<Slot[]> mSlots;
+    size_t                  mMask;
+    std::atomic<size_t>     mEnqueuePos{0};
+    size_t                  mDequeuePos = 0;
+
+    std::atomic<uint32_t> mSeverityFilter{
+            VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT |
+            VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT};
+    std::atomic<uint32_t> mTypeFilter{
+            VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT |
+            VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
+            VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT};
+    std::atomic<uint64_t> mDropped{0};
+
+    // only touched by the logger thread
+    std::unordered_map<std::string, MessageRecord> mRecords;
+    Slot                                           mScratch;
+
+    std::thread             mThread;
+    std::atomic<bool>       mRunning{false};
+    std::mutex              mWakeMutex;
+    std::condition_variable mWake;
+};
+
+#endif //VULKAN_TEST_VALIDATIONLOGGER_HPP
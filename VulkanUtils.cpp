@@ -0,0 +1,228 @@
+//
+// Created by Krisu on 2020/4/10.
+//
+
+#include "VulkanUtils.hpp"
+#include "AllocationTracker.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+std::optional<uint32_t> FindMemoryType(VkPhysicalDevice physicalDevice,
+                                       uint32_t typeFilter,
+                                       VkMemoryPropertyFlags properties) {
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+        if ((typeFilter & (1u << i)) &&
+            (memoryProperties.memoryTypes[i].propertyFlags & properties) ==
+            properties) {
+            return i;
+        }
+    }
+    return std::nullopt;
+}
+
+void CreateBuffer(VkPhysicalDevice physicalDevice, VkDevice device,
+                  const VkAllocationCallbacks *pAllocator, VkDeviceSize size,
+                  VkBufferUsageFlags usage, VkMemoryPropertyFlags properties,
+                  VkBuffer &buffer, VkDeviceMemory &memory) {
+    VkBufferCreateInfo bufferCreateInfo{};
+    bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferCreateInfo.size = size;
+    bufferCreateInfo.usage = usage;
+    bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    {
+        AllocationTracker::ScopedTag tag(VK_OBJECT_TYPE_BUFFER);
+        if (vkCreateBuffer(device, &bufferCreateInfo, pAllocator, &buffer) !=
+            VK_SUCCESS) {
+            throw std::runtime_error("failed to create buffer");
+        }
+    }
+
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(device, buffer, &requirements);
+    auto memoryType = FindMemoryType(physicalDevice,
+                                     requirements.memoryTypeBits, properties);
+    if (!memoryType.has_value()) {
+        throw std::runtime_error("failed to find a memory type for buffer");
+    }
+
+    VkMemoryAllocateInfo allocateInfo{};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocateInfo.allocationSize = requirements.size;
+    allocateInfo.memoryTypeIndex = memoryType.value();
+    {
+        AllocationTracker::ScopedTag tag(VK_OBJECT_TYPE_DEVICE_MEMORY);
+        if (vkAllocateMemory(device, &allocateInfo, pAllocator, &memory) !=
+            VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate buffer memory");
+        }
+    }
+    vkBindBufferMemory(device, buffer, memory, 0);
+}
+
+void CreateImage(VkPhysicalDevice physicalDevice, VkDevice device,
+                 const VkAllocationCallbacks *pAllocator,
+                 const VkImageCreateInfo &createInfo,
+                 VkMemoryPropertyFlags properties, VkImage &image,
+                 VkDeviceMemory &memory) {
+    {
+        AllocationTracker::ScopedTag tag(VK_OBJECT_TYPE_IMAGE);
+        if (vkCreateImage(device, &createInfo, pAllocator, &image) !=
+            VK_SUCCESS) {
+            throw std::runtime_error("failed to create image");
+        }
+    }
+
+    VkMemoryRequirements requirements;
+    vkGetImageMemoryRequirements(device, image, &requirements);
+    auto memoryType = FindMemoryType(physicalDevice,
+                                     requirements.memoryTypeBits, properties);
+    if (!memoryType.has_value()) {
+        throw std::runtime_error("failed to find a memory type for image");
+    }
+
+    VkMemoryAllocateInfo allocateInfo{};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocateInfo.allocationSize = requirements.size;
+    allocateInfo.memoryTypeIndex = memoryType.value();
+    {
+        AllocationTracker::ScopedTag tag(VK_OBJECT_TYPE_DEVICE_MEMORY);
+        if (vkAllocateMemory(device, &allocateInfo, pAllocator, &memory) !=
+            VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate image memory");
+        }
+    }
+    vkBindImageMemory(device, image, memory, 0);
+}
+
+FormatBlock GetFormatBlock(VkFormat format) {
+    switch (format) {
+        case VK_FORMAT_R8_UNORM:
+        case VK_FORMAT_R8_SRGB:
+            return {1, 1, 1};
+        case VK_FORMAT_R8G8_UNORM:
+        case VK_FORMAT_R8G8_SRGB:
+            return {1, 1, 2};
+        case VK_FORMAT_R8G8B8A8_UNORM:
+        case VK_FORMAT_R8G8B8A8_SRGB:
+        case VK_FORMAT_B8G8R8A8_UNORM:
+        case VK_FORMAT_B8G8R8A8_SRGB:
+            return {1, 1, 4};
+        case VK_FORMAT_R16G16B16A16_SFLOAT:
+            return {1, 1, 8};
+        case VK_FORMAT_R32G32B32A32_SFLOAT:
+            return {1, 1, 16};
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+        case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+        case VK_FORMAT_BC4_UNORM_BLOCK:
+        case VK_FORMAT_BC4_SNORM_BLOCK:
+        case VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK:
+        case VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK:
+        case VK_FORMAT_ETC2_R8G8B8A1_UNORM_BLOCK:
+        case VK_FORMAT_ETC2_R8G8B8A1_SRGB_BLOCK:
+        case VK_FORMAT_EAC_R11_UNORM_BLOCK:
+        case VK_FORMAT_EAC_R11_SNORM_BLOCK:
+            return {4, 4, 8};
+        case VK_FORMAT_BC2_UNORM_BLOCK:
+        case VK_FORMAT_BC2_SRGB_BLOCK:
+        case VK_FORMAT_BC3_UNORM_BLOCK:
+        case VK_FORMAT_BC3_SRGB_BLOCK:
+        case VK_FORMAT_BC5_UNORM_BLOCK:
+        case VK_FORMAT_BC5_SNORM_BLOCK:
+        case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+        case VK_FORMAT_BC6H_SFLOAT_BLOCK:
+        case VK_FORMAT_BC7_UNORM_BLOCK:
+        case VK_FORMAT_BC7_SRGB_BLOCK:
+        case VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK:
+        case VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK:
+        case VK_FORMAT_EAC_R11G11_UNORM_BLOCK:
+        case VK_FORMAT_EAC_R11G11_SNORM_BLOCK:
+            return {4, 4, 16};
+        default:
+            break;
+    }
+    // every ASTC block is 16 bytes, only its footprint differs
+    if (format >= VK_FORMAT_ASTC_4x4_UNORM_BLOCK &&
+        format <= VK_FORMAT_ASTC_12x12_SRGB_BLOCK) {
+        constexpr static const uint32_t footprints[][2]{
+                {4, 4}, {5, 4}, {5, 5}, {6, 5}, {6, 6}, {8, 5}, {8, 6},
+                {8, 8}, {10, 5}, {10, 6}, {10, 8}, {10, 10}, {12, 10},
+                {12, 12}
+        };
+        // UNORM and SRGB alternate
+        const auto &footprint =
+                footprints[(format - VK_FORMAT_ASTC_4x4_UNORM_BLOCK) / 2];
+        return {footprint[0], footprint[1], 16};
+    }
+    return {1, 1, 0};
+}
+
+VkDeviceSize GetMipSize(VkFormat format, uint32_t width, uint32_t height,
+                        uint32_t mip) {
+    FormatBlock block = GetFormatBlock(format);
+    uint32_t mipWidth = std::max(width >> mip, 1u);
+    uint32_t mipHeight = std::max(height >> mip, 1u);
+    VkDeviceSize blocksX = (mipWidth + block.width - 1) / block.width;
+    VkDeviceSize blocksY = (mipHeight + block.height - 1) / block.height;
+    return blocksX * blocksY * block.bytes;
+}
+
+void UploadBuffer(VkPhysicalDevice physicalDevice, VkDevice device,
+                  const VkAllocationCallbacks *pAllocator,
+                  VkCommandPool commandPool, VkQueue queue,
+                  const void *data, VkDeviceSize size, VkBuffer dstBuffer,
+                  VkDeviceSize dstOffset) {
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingMemory;
+    CreateBuffer(physicalDevice, device, pAllocator, size,
+                 VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                 stagingBuffer, stagingMemory);
+    void *mapped;
+    vkMapMemory(device, stagingMemory, 0, size, 0, &mapped);
+    std::memcpy(mapped, data, size);
+    vkUnmapMemory(device, stagingMemory);
+
+    VkCommandBufferAllocateInfo allocateInfo{};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocateInfo.commandPool = commandPool;
+    allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocateInfo.commandBufferCount = 1;
+    VkCommandBuffer commandBuffer;
+    {
+        AllocationTracker::ScopedTag tag(VK_OBJECT_TYPE_COMMAND_BUFFER);
+        if (vkAllocateCommandBuffers(device, &allocateInfo, &commandBuffer) !=
+            VK_SUCCESS) {
+            throw std::runtime_error(
+                    "failed to allocate upload command buffer");
+        }
+    }
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+    VkBufferCopy region{0, dstOffset, size};
+    vkCmdCopyBuffer(commandBuffer, stagingBuffer, dstBuffer, 1, &region);
+    vkEndCommandBuffer(commandBuffer);
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    if (vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+        throw std::runtime_error("failed to submit buffer upload");
+    }
+    vkQueueWaitIdle(queue);
+
+    vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+    vkDestroyBuffer(device, stagingBuffer, pAllocator);
+    vkFreeMemory(device, stagingMemory, pAllocator);
+}
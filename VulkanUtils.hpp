@@ -0,0 +1,55 @@
+//
+// Created by Krisu on 2020/4/10.
+//
+
+#ifndef VULKAN_TEST_VULKANUTILS_HPP
+#define VULKAN_TEST_VULKANUTILS_HPP
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <optional>
+
+
+/* Index of a memory type allowed by typeFilter that has all properties */
+std::optional<uint32_t> FindMemoryType(VkPhysicalDevice physicalDevice,
+                                       uint32_t typeFilter,
+                                       VkMemoryPropertyFlags properties);
+
+/* A buffer bound to its own allocation with the given properties */
+void CreateBuffer(VkPhysicalDevice physicalDevice, VkDevice device,
+                  const VkAllocationCallbacks *pAllocator, VkDeviceSize size,
+                  VkBufferUsageFlags usage, VkMemoryPropertyFlags properties,
+                  VkBuffer &buffer, VkDeviceMemory &memory);
+
+/* An image bound to its own allocation with the given properties */
+void CreateImage(VkPhysicalDevice physicalDevice, VkDevice device,
+                 const VkAllocationCallbacks *pAllocator,
+                 const VkImageCreateInfo &createInfo,
+                 VkMemoryPropertyFlags properties, VkImage &image,
+                 VkDeviceMemory &memory);
+
+/* Texels are stored in blocks of width x height taking bytes each,
+ * uncompressed formats have 1x1 blocks */
+struct FormatBlock {
+    uint32_t width = 1;
+    uint32_t height = 1;
+    uint32_t bytes = 0;
+};
+
+/* bytes is 0 for formats not listed here */
+FormatBlock GetFormatBlock(VkFormat format);
+
+/* Tightly packed size of a mip level of a width x height image */
+VkDeviceSize GetMipSize(VkFormat format, uint32_t width, uint32_t height,
+                        uint32_t mip);
+
+/* Copy data into a device local buffer through a staging buffer, waits
+ * for the copy to finish */
+void UploadBuffer(VkPhysicalDevice physicalDevice, VkDevice device,
+                  const VkAllocationCallbacks *pAllocator,
+                  VkCommandPool commandPool, VkQueue queue,
+                  const void *data, VkDeviceSize size, VkBuffer dstBuffer,
+                  VkDeviceSize dstOffset = 0);
+
+#endif //VULKAN_TEST_VULKANUTILS_HPP
@@ -0,0 +1,154 @@
+//
+// Created by Krisu on 2020/4/16.
+//
+
+#include "CpuCuller.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+
+// CullSpheres and CullBoxes on a million objects at every level this CPU
+// runs, about half of them visible. Each level has to give the indices
+// Scalar gives.
+
+namespace {
+
+constexpr size_t OBJECT_COUNT = 1000000;
+constexpr uint32_t ROUNDS = 20;
+
+int gFailures = 0;
+
+void Check(bool condition, const char *what) {
+    if (!condition) {
+        std::cout << "FAILED: " << what << "\n";
+        gFailures++;
+    }
+}
+
+struct Objects {
+    std::vector<float> centerX, centerY, centerZ;
+    std::vector<float> radius, extentX, extentY, extentZ;
+};
+
+/* Objects spread over a 20 unit cube around the origin */
+Objects MakeObjects(size_t count) {
+    std::mt19937 random(4);
+    std::uniform_real_distribution<float> position(-10.0f, 10.0f);
+    std::uniform_real_distribution<float> size(0.0f, 0.5f);
+    Objects objects;
+    for (std::vector<float> *values : {&objects.centerX, &objects.centerY,
+                                       &objects.centerZ}) {
+        values->resize(count);
+        for (float &value : *values) {
+            value = position(random);
+        }
+    }
+    for (std::vector<float> *values : {&objects.radius, &objects.extentX,
+                                       &objects.extentY, &objects.extentZ}) {
+        values->resize(count);
+        for (float &value : *values) {
+            value = size(random);
+        }
+    }
+    return objects;
+}
+
+/* The half of that cube with x above 0 */
+CullFrustum MakeFrustum() {
+    CullFrustum frustum{};
+    for (int axis = 0; axis < 3; axis++) {
+        frustum.planes[axis * 2][axis] = 1.0f;
+        frustum.planes[axis * 2 + 1][axis] = -1.0f;
+        frustum.planes[axis * 2][3] = 10.0f;
+        frustum.planes[axis * 2 + 1][3] = 10.0f;
+    }
+    frustum.planes[0][3] = 0.0f;
+    return frustum;
+}
+
+template<typename Fn>
+double TimeMedian(Fn &&fn) {
+    std::vector<double> times;
+    for (uint32_t round = 0; round < ROUNDS; round++) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        std::chrono::duration<double, std::milli> elapsed =
+                std::chrono::steady_clock::now() - start;
+        times.push_back(elapsed.count());
+    }
+    std::nth_element(times.begin(), times.begin() + times.size() / 2,
+                     times.end());
+    return times[times.size() / 2];
+}
+
+void PrintTime(const char *what, double milliseconds, uint32_t visible) {
+    std::cout << "  " << std::left << std::setw(16) << what << std::right
+              << std::fixed << std::setprecision(3) << milliseconds
+              << " ms  " << std::setprecision(1)
+              << OBJECT_COUNT / milliseconds / 1000.0 << " M objects/s  "
+              << visible << " visible\n";
+}
+
+}
+
+int main() {
+    Objects objects = MakeObjects(OBJECT_COUNT);
+    CullSphereBounds spheres{objects.centerX.data(), objects.centerY.data(),
+                             objects.centerZ.data(), objects.radius.data(),
+                             OBJECT_COUNT};
+    CullBoxBounds boxes{objects.centerX.data(), objects.centerY.data(),
+                        objects.centerZ.data(), objects.extentX.data(),
+                        objects.extentY.data(), objects.extentZ.data(),
+                        OBJECT_COUNT};
+    CullFrustum frustum = MakeFrustum();
+    std::cout << OBJECT_COUNT << " objects, median of " << ROUNDS
+              << " rounds\n";
+
+    const char *names[]{"Scalar", "SSE4.1", "AVX2"};
+    std::vector<uint32_t> visible(OBJECT_COUNT);
+    std::vector<uint32_t> scalarSpheres, scalarBoxes;
+    for (CpuCullLevel level : {CpuCullLevel::Scalar, CpuCullLevel::SSE41,
+                               CpuCullLevel::AVX2}) {
+        // faster levels than this CPU runs would only time a lower one
+        if (level > GetCpuCullLevel()) {
+            std::cout << "  " << names[static_cast<int>(level)]
+                      << " is not supported here\n";
+            continue;
+        }
+        std::cout << names[static_cast<int>(level)] << "\n";
+
+        uint32_t count = 0;
+        double ms = TimeMedian([&] {
+            count = CullSpheres(frustum, spheres, visible.data(), level);
+        });
+        PrintTime("CullSpheres", ms, count);
+        std::vector<uint32_t> culled(visible.begin(),
+                                     visible.begin() + count);
+        if (level == CpuCullLevel::Scalar) {
+            scalarSpheres = culled;
+        }
+        Check(culled == scalarSpheres, "CullSpheres agrees with Scalar");
+
+        ms = TimeMedian([&] {
+            count = CullBoxes(frustum, boxes, visible.data(), level);
+        });
+        PrintTime("CullBoxes", ms, count);
+        culled.assign(visible.begin(), visible.begin() + count);
+        if (level == CpuCullLevel::Scalar) {
+            scalarBoxes = culled;
+        }
+        Check(culled == scalarBoxes, "CullBoxes agrees with Scalar");
+    }
+
+    if (gFailures > 0) {
+        std::cout << gFailures << " checks failed\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,219 @@
+//
+// Created by Krisu on 2020/4/12.
+//
+
+#include "DescriptorUpdater.hpp"
+#include "VulkanUtils.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+
+// vkUpdateDescriptorSets against vkUpdateDescriptorSetWithTemplate for a
+// few thousand material sets, run on the first device found
+
+namespace {
+
+constexpr uint32_t SET_COUNT = 4096;
+constexpr uint32_t ROUNDS = 20;
+
+// the packed struct of the layout below, see DescriptorUpdater
+struct MaterialDescriptors {
+    VkDescriptorBufferInfo constants;
+    VkDescriptorBufferInfo instances;
+    VkDescriptorImageInfo  samplers[4];
+};
+
+struct Device {
+    VkInstance       instance = VK_NULL_HANDLE;
+    VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+    VkDevice         device = VK_NULL_HANDLE;
+    bool             core11 = false;
+};
+
+Device CreateDevice() {
+    Device result;
+
+    VkApplicationInfo appInfo{};
+    appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+    appInfo.pApplicationName = "descriptor-updater-bench";
+    appInfo.apiVersion = VK_API_VERSION_1_1;
+
+    VkInstanceCreateInfo instanceCreateInfo{};
+    instanceCreateInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+    instanceCreateInfo.pApplicationInfo = &appInfo;
+    if (vkCreateInstance(&instanceCreateInfo, nullptr, &result.instance) !=
+        VK_SUCCESS) {
+        throw std::runtime_error("failed to create instance");
+    }
+
+    uint32_t deviceCount = 1;
+    VkResult enumerated = vkEnumeratePhysicalDevices(
+            result.instance, &deviceCount, &result.physicalDevice);
+    if ((enumerated != VK_SUCCESS && enumerated != VK_INCOMPLETE) ||
+        deviceCount == 0) {
+        throw std::runtime_error("failed to find a GPU with Vulkan support");
+    }
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(result.physicalDevice, &properties);
+    result.core11 = properties.apiVersion >= VK_API_VERSION_1_1;
+    std::cout << properties.deviceName << "\n";
+
+    // descriptor updates need no queue, any family does
+    float priority = 1.0f;
+    VkDeviceQueueCreateInfo queueCreateInfo{};
+    queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    queueCreateInfo.queueFamilyIndex = 0;
+    queueCreateInfo.queueCount = 1;
+    queueCreateInfo.pQueuePriorities = &priority;
+
+    VkDeviceCreateInfo deviceCreateInfo{};
+    deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    deviceCreateInfo.queueCreateInfoCount = 1;
+    deviceCreateInfo.pQueueCreateInfos = &queueCreateInfo;
+    if (vkCreateDevice(result.physicalDevice, &deviceCreateInfo, nullptr,
+                       &result.device) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create logical device");
+    }
+    return result;
+}
+
+/* Nanoseconds per set for updating every set ROUNDS times */
+double TimeUpdates(DescriptorUpdater &updater, VkDescriptorSetLayout layout,
+                   const std::vector<VkDescriptorSet> &sets,
+                   const std::vector<MaterialDescriptors> &data) {
+    // one round to warm up caches and the driver
+    for (size_t i = 0; i < sets.size(); i++) {
+        updater.Update(sets[i], layout, data[i]);
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t round = 0; round < ROUNDS; round++) {
+        for (size_t i = 0; i < sets.size(); i++) {
+            updater.Update(sets[i], layout, data[i]);
+        }
+    }
+    std::chrono::duration<double, std::nano> elapsed =
+            std::chrono::steady_clock::now() - start;
+    return elapsed.count() / (static_cast<double>(ROUNDS) * sets.size());
+}
+
+}
+
+int main() {
+    Device device = CreateDevice();
+    VkDevice vkDevice = device.device;
+
+    std::vector<VkDescriptorSetLayoutBinding> bindings = {
+            {0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1,
+             VK_SHADER_STAGE_ALL_GRAPHICS, nullptr},
+            {1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1,
+             VK_SHADER_STAGE_ALL_GRAPHICS, nullptr},
+            {2, VK_DESCRIPTOR_TYPE_SAMPLER, 4,
+             VK_SHADER_STAGE_FRAGMENT_BIT, nullptr},
+    };
+    VkDescriptorSetLayoutCreateInfo layoutCreateInfo{};
+    layoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutCreateInfo.bindingCount = bindings.size();
+    layoutCreateInfo.pBindings = bindings.data();
+    VkDescriptorSetLayout layout;
+    if (vkCreateDescriptorSetLayout(vkDevice, &layoutCreateInfo, nullptr,
+                                    &layout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create descriptor set layout");
+    }
+
+    VkDescriptorPoolSize poolSizes[] {
+            {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, SET_COUNT},
+            {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, SET_COUNT},
+            {VK_DESCRIPTOR_TYPE_SAMPLER, 4 * SET_COUNT},
+    };
+    VkDescriptorPoolCreateInfo poolCreateInfo{};
+    poolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolCreateInfo.maxSets = SET_COUNT;
+    poolCreateInfo.poolSizeCount = 3;
+    poolCreateInfo.pPoolSizes = poolSizes;
+    VkDescriptorPool pool;
+    if (vkCreateDescriptorPool(vkDevice, &poolCreateInfo, nullptr, &pool) !=
+        VK_SUCCESS) {
+        throw std::runtime_error("failed to create descriptor pool");
+    }
+
+    std::vector<VkDescriptorSetLayout> layouts(SET_COUNT, layout);
+    std::vector<VkDescriptorSet> sets(SET_COUNT);
+    VkDescriptorSetAllocateInfo allocateInfo{};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocateInfo.descriptorPool = pool;
+    allocateInfo.descriptorSetCount = SET_COUNT;
+    allocateInfo.pSetLayouts = layouts.data();
+    if (vkAllocateDescriptorSets(vkDevice, &allocateInfo, sets.data()) !=
+        VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate descriptor sets");
+    }
+
+    // every set points at its own slice of one buffer
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(device.physicalDevice, &properties);
+    VkDeviceSize slice = std::max<VkDeviceSize>(
+            256, std::max(properties.limits.minUniformBufferOffsetAlignment,
+                          properties.limits.minStorageBufferOffsetAlignment));
+    VkBuffer buffer;
+    VkDeviceMemory memory;
+    CreateBuffer(device.physicalDevice, vkDevice, nullptr, slice * SET_COUNT,
+                 VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT |
+                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer, memory);
+
+    VkSamplerCreateInfo samplerCreateInfo{};
+    samplerCreateInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerCreateInfo.magFilter = VK_FILTER_LINEAR;
+    samplerCreateInfo.minFilter = VK_FILTER_LINEAR;
+    samplerCreateInfo.maxLod = VK_LOD_CLAMP_NONE;
+    VkSampler sampler;
+    if (vkCreateSampler(vkDevice, &samplerCreateInfo, nullptr, &sampler) !=
+        VK_SUCCESS) {
+        throw std::runtime_error("failed to create texture sampler");
+    }
+
+    std::vector<MaterialDescriptors> data(SET_COUNT);
+    for (uint32_t i = 0; i < SET_COUNT; i++) {
+        data[i].constants = {buffer, slice * i, 64};
+        data[i].instances = {buffer, slice * i, slice};
+        for (auto &info : data[i].samplers) {
+            info = {sampler, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_UNDEFINED};
+        }
+    }
+
+    DescriptorUpdater writes;
+    writes.Init(vkDevice, nullptr, false, false);
+    writes.RegisterLayout(layout, bindings);
+    if (writes.GetDataSize(layout) != sizeof(MaterialDescriptors)) {
+        throw std::runtime_error("packed struct does not match the layout");
+    }
+    std::cout << SET_COUNT << " sets, " << ROUNDS << " rounds\n";
+    std::cout << "vkUpdateDescriptorSets:            "
+              << TimeUpdates(writes, layout, sets, data) << " ns/set\n";
+    writes.Clear();
+
+    if (device.core11) {
+        DescriptorUpdater templates;
+        templates.Init(vkDevice, nullptr, true, true);
+        templates.RegisterLayout(layout, bindings);
+        std::cout << "vkUpdateDescriptorSetWithTemplate: "
+                  << TimeUpdates(templates, layout, sets, data)
+                  << " ns/set\n";
+        templates.Clear();
+    } else {
+        std::cout << "no Vulkan 1.1, update templates skipped\n";
+    }
+
+    vkDestroySampler(vkDevice, sampler, nullptr);
+    vkDestroyBuffer(vkDevice, buffer, nullptr);
+    vkFreeMemory(vkDevice, memory, nullptr);
+    vkDestroyDescriptorPool(vkDevice, pool, nullptr);
+    vkDestroyDescriptorSetLayout(vkDevice, layout, nullptr);
+    vkDestroyDevice(vkDevice, nullptr);
+    vkDestroyInstance(device.instance, nullptr);
+    return 0;
+}
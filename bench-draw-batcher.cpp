@@ -0,0 +1,192 @@
+//
+// Created by Krisu on 2020/4/16.
+//
+
+#include "DrawBatcher.hpp"
+#include "JobSystem.hpp"
+#include "RadixSort.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+
+// std::stable_sort, RadixSort and ParallelRadixSort on the sort keys of
+// 100k draws, then BuildStream merging them. Every sort has to give the
+// order of std::stable_sort, equal keys included.
+
+namespace {
+
+constexpr uint32_t ITEM_COUNT = 100000;
+constexpr uint32_t ROUNDS = 50;
+// a mat4 per item
+constexpr uint32_t INSTANCE_SIZE = 64;
+constexpr size_t MAX_INSTANCES = 1024;
+
+int gFailures = 0;
+
+void Check(bool condition, const char *what) {
+    if (!condition) {
+        std::cout << "FAILED: " << what << "\n";
+        gFailures++;
+    }
+}
+
+/* Random draws over a few pipelines, materials and meshes, about a dozen
+ * items per draw. Depth is coarse, so plenty of keys are equal. */
+std::vector<SortEntry> MakeEntries(uint32_t count) {
+    std::mt19937 random(1);
+    std::uniform_int_distribution<uint32_t> pipeline(0, 3);
+    std::uniform_int_distribution<uint32_t> material(0, 31);
+    std::uniform_int_distribution<uint32_t> mesh(0, 63);
+    std::uniform_int_distribution<uint32_t> depth(0, 63);
+    std::vector<SortEntry> entries(count);
+    for (uint32_t i = 0; i < count; i++) {
+        entries[i].key = DrawBatcher::PackKey(pipeline(random),
+                                              material(random), mesh(random),
+                                              depth(random));
+        entries[i].index = i;
+    }
+    return entries;
+}
+
+bool SameOrder(const std::vector<SortEntry> &a,
+               const std::vector<SortEntry> &b) {
+    return a.size() == b.size() &&
+           std::equal(a.begin(), a.end(), b.begin(),
+                      [](const SortEntry &x, const SortEntry &y) {
+                          return x.key == y.key && x.index == y.index;
+                      });
+}
+
+/* Median milliseconds of ROUNDS runs of fn on fresh copies of entries,
+ * sorted holds the last result */
+template<typename Fn>
+double TimeSort(const std::vector<SortEntry> &entries,
+                std::vector<SortEntry> &sorted, Fn &&fn) {
+    std::vector<double> times;
+    for (uint32_t round = 0; round < ROUNDS; round++) {
+        sorted = entries;
+        auto start = std::chrono::steady_clock::now();
+        fn(sorted);
+        std::chrono::duration<double, std::milli> elapsed =
+                std::chrono::steady_clock::now() - start;
+        times.push_back(elapsed.count());
+    }
+    std::nth_element(times.begin(), times.begin() + times.size() / 2,
+                     times.end());
+    return times[times.size() / 2];
+}
+
+void PrintTime(const char *what, double milliseconds) {
+    std::cout << "  " << std::left << std::setw(24) << what << std::right
+              << std::fixed << std::setprecision(3) << milliseconds
+              << " ms  " << std::setprecision(1)
+              << ITEM_COUNT / milliseconds / 1000.0 << " M items/s\n";
+}
+
+/* Draws have to cover the sorted items in order, with their instance
+ * data, and split only at key changes or MAX_INSTANCES */
+void CheckStream(const std::vector<SortEntry> &sorted,
+                 const std::vector<uint8_t> &instanceData,
+                 const RenderCommandStream &stream) {
+    size_t item = 0;
+    bool covered = true;
+    bool merged = true;
+    for (size_t i = 0; i < stream.commands.size() && covered; i++) {
+        const RenderCommand &command = stream.commands[i];
+        uint64_t group = sorted[item].key >> DrawBatcher::DEPTH_BITS;
+        covered = command.instanceCount > 0 &&
+                  command.instanceOffset == item * INSTANCE_SIZE &&
+                  command.pipeline == group >> 32 &&
+                  command.material == ((group >> 16) & 0xffff) &&
+                  command.mesh == (group & 0xffff);
+        for (uint32_t j = 0; j < command.instanceCount && covered; j++) {
+            const SortEntry &entry = sorted[item + j];
+            covered = entry.key >> DrawBatcher::DEPTH_BITS == group &&
+                      std::memcmp(&stream.instanceData[(item + j) *
+                                                       INSTANCE_SIZE],
+                                  &instanceData[entry.index * INSTANCE_SIZE],
+                                  INSTANCE_SIZE) == 0;
+        }
+        item += command.instanceCount;
+        // the next draw starts a new key or the last one was full
+        if (item < sorted.size() &&
+            sorted[item].key >> DrawBatcher::DEPTH_BITS == group) {
+            merged = merged && command.instanceCount == MAX_INSTANCES;
+        }
+    }
+    Check(covered && item == sorted.size(),
+          "draws hold every item with its instance data in order");
+    Check(merged, "draws only split at key changes or when full");
+}
+
+}
+
+int main() {
+    std::vector<SortEntry> entries = MakeEntries(ITEM_COUNT);
+    std::cout << ITEM_COUNT << " items, median of " << ROUNDS
+              << " rounds\n";
+
+    std::vector<SortEntry> reference;
+    PrintTime("std::stable_sort", TimeSort(
+            entries, reference, [](std::vector<SortEntry> &sorted) {
+                std::stable_sort(sorted.begin(), sorted.end(),
+                                 [](const SortEntry &a, const SortEntry &b) {
+                                     return a.key < b.key;
+                                 });
+            }));
+
+    std::vector<SortEntry> sorted;
+    std::vector<SortEntry> scratch;
+    PrintTime("RadixSort", TimeSort(
+            entries, sorted, [&](std::vector<SortEntry> &sorting) {
+                RadixSort(sorting, scratch);
+            }));
+    Check(SameOrder(sorted, reference), "RadixSort is stable");
+
+    for (uint32_t threads : {1u, 2u, 4u, 8u}) {
+        JobSystem jobSystem(threads);
+        double ms = TimeSort(
+                entries, sorted, [&](std::vector<SortEntry> &sorting) {
+                    ParallelRadixSort(sorting, scratch, jobSystem);
+                });
+        std::string what = "ParallelRadixSort x" + std::to_string(threads);
+        PrintTime(what.c_str(), ms);
+        Check(SameOrder(sorted, reference), "ParallelRadixSort is stable");
+    }
+
+    std::vector<uint8_t> instanceData(ITEM_COUNT * INSTANCE_SIZE);
+    std::mt19937 random(2);
+    for (auto &byte : instanceData) {
+        byte = static_cast<uint8_t>(random());
+    }
+    RenderCommandStream stream;
+    std::vector<double> times;
+    for (uint32_t round = 0; round < ROUNDS; round++) {
+        stream.Clear();
+        auto start = std::chrono::steady_clock::now();
+        DrawBatcher::BuildStream(reference.data(), reference.size(),
+                                 instanceData.data(), INSTANCE_SIZE,
+                                 MAX_INSTANCES, stream);
+        std::chrono::duration<double, std::milli> elapsed =
+                std::chrono::steady_clock::now() - start;
+        times.push_back(elapsed.count());
+    }
+    std::nth_element(times.begin(), times.begin() + times.size() / 2,
+                     times.end());
+    PrintTime("BuildStream", times[times.size() / 2]);
+    std::cout << "  " << stream.commands.size() << " draws\n";
+    CheckStream(reference, instanceData, stream);
+
+    if (gFailures > 0) {
+        std::cout << gFailures << " checks failed\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,114 @@
+//
+// Created by Krisu on 2020/4/14.
+//
+
+#include "MeshOptimizer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+
+// ACMR / ATVR of a shuffled sphere before and after each MeshOptimizer
+// pass, and how long the passes take
+
+namespace {
+
+constexpr float PI = 3.14159265358979f;
+
+struct Sphere {
+    std::vector<float>    positions;
+    std::vector<uint32_t> indices;
+};
+
+/* A UV sphere of rings x segments quads, triangles in random order like
+ * an exporter that does not care */
+Sphere MakeShuffledSphere(uint32_t rings, uint32_t segments) {
+    Sphere sphere;
+    for (uint32_t r = 0; r <= rings; r++) {
+        float theta = PI * r / rings;
+        for (uint32_t s = 0; s <= segments; s++) {
+            float phi = 2.0f * PI * s / segments;
+            sphere.positions.push_back(std::sin(theta) * std::cos(phi));
+            sphere.positions.push_back(std::cos(theta));
+            sphere.positions.push_back(std::sin(theta) * std::sin(phi));
+        }
+    }
+
+    std::vector<uint32_t> triangles;
+    for (uint32_t r = 0; r < rings; r++) {
+        for (uint32_t s = 0; s < segments; s++) {
+            uint32_t a = r * (segments + 1) + s;
+            uint32_t b = a + segments + 1;
+            triangles.insert(triangles.end(), {a, b, a + 1, a + 1, b, b + 1});
+        }
+    }
+    std::vector<uint32_t> order(triangles.size() / 3);
+    for (uint32_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    std::shuffle(order.begin(), order.end(), std::mt19937(42));
+    for (uint32_t triangle : order) {
+        sphere.indices.insert(sphere.indices.end(),
+                              triangles.begin() + triangle * 3,
+                              triangles.begin() + triangle * 3 + 3);
+    }
+    return sphere;
+}
+
+template<typename Fn>
+double TimeMilliseconds(Fn &&fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    std::chrono::duration<double, std::milli> elapsed =
+            std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+void PrintStats(const char *step, const std::vector<uint32_t> &indices,
+                size_t vertexCount, double milliseconds) {
+    VertexCacheStats stats = AnalyzeVertexCache(indices, vertexCount);
+    std::cout << "  " << std::left << std::setw(12) << step << std::right
+              << std::fixed << std::setprecision(3)
+              << "ACMR " << stats.acmr << "  ATVR " << stats.atvr
+              << std::setprecision(2) << "  " << milliseconds << " ms\n";
+}
+
+void Run(uint32_t rings, uint32_t segments) {
+    Sphere sphere = MakeShuffledSphere(rings, segments);
+    size_t vertexCount = sphere.positions.size() / 3;
+    std::cout << rings << "x" << segments << " sphere, "
+              << sphere.indices.size() / 3 << " triangles, " << vertexCount
+              << " vertices\n";
+    PrintStats("shuffled", sphere.indices, vertexCount, 0.0);
+
+    double ms = TimeMilliseconds([&] {
+        OptimizeVertexCache(sphere.indices, vertexCount);
+    });
+    PrintStats("cache", sphere.indices, vertexCount, ms);
+
+    ms = TimeMilliseconds([&] {
+        OptimizeOverdraw(sphere.indices, sphere.positions.data(),
+                         vertexCount, 3 * sizeof(float));
+    });
+    PrintStats("overdraw", sphere.indices, vertexCount, ms);
+
+    // renumbering leaves the cache behaviour as it is
+    std::vector<uint32_t> remap;
+    ms = TimeMilliseconds([&] {
+        remap = OptimizeVertexFetch(sphere.indices, vertexCount);
+    });
+    PrintStats("fetch", sphere.indices, vertexCount, ms);
+}
+
+}
+
+int main() {
+    Run(100, 100);
+    Run(256, 256);
+    return 0;
+}
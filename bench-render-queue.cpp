@@ -0,0 +1,191 @@
+//
+// Created by Krisu on 2020/4/16.
+//
+
+#include "RenderQueue.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+
+// RenderQueue::Build across thread counts: keys, ParallelRadixSort and
+// the per-thread streams. The streams put together have to match one
+// stream built from std::stable_sort on one thread.
+
+namespace {
+
+constexpr uint32_t ROUNDS = 20;
+constexpr uint32_t INSTANCE_SIZE = 64;
+constexpr size_t MAX_INSTANCES = 1024;
+constexpr float MAX_DEPTH = 200.0f;
+
+int gFailures = 0;
+
+void Check(bool condition, const char *what) {
+    if (!condition) {
+        std::cout << "FAILED: " << what << "\n";
+        gFailures++;
+    }
+}
+
+struct Scene {
+    std::vector<float>    positionX, positionY, positionZ;
+    std::vector<uint32_t> pipelines, materials, meshes;
+    std::vector<uint8_t>  instances;
+
+    RenderQueueObjects GetObjects() const {
+        RenderQueueObjects objects;
+        objects.positionX = positionX.data();
+        objects.positionY = positionY.data();
+        objects.positionZ = positionZ.data();
+        objects.pipelines = pipelines.data();
+        objects.materials = materials.data();
+        objects.meshes = meshes.data();
+        objects.instances = instances.data();
+        objects.count = positionX.size();
+        return objects;
+    }
+};
+
+/* Objects in front of the camera out to MAX_DEPTH over a few pipelines,
+ * materials and meshes */
+Scene MakeScene(size_t count) {
+    std::mt19937 random(3);
+    std::uniform_real_distribution<float> side(-100.0f, 100.0f);
+    std::uniform_real_distribution<float> depth(0.0f, MAX_DEPTH);
+    std::uniform_int_distribution<uint32_t> pipeline(0, 7);
+    std::uniform_int_distribution<uint32_t> material(0, 63);
+    std::uniform_int_distribution<uint32_t> mesh(0, 63);
+    Scene scene;
+    for (size_t i = 0; i < count; i++) {
+        scene.positionX.push_back(side(random));
+        scene.positionY.push_back(side(random));
+        scene.positionZ.push_back(depth(random));
+        scene.pipelines.push_back(pipeline(random));
+        scene.materials.push_back(material(random));
+        scene.meshes.push_back(mesh(random));
+    }
+    scene.instances.resize(count * INSTANCE_SIZE);
+    for (auto &byte : scene.instances) {
+        byte = static_cast<uint8_t>(random());
+    }
+    return scene;
+}
+
+/* Looking down +z, clip w is the view distance */
+CullView MakeView() {
+    CullView view{};
+    view.viewProjection[0] = 1.0f;
+    view.viewProjection[5] = 1.0f;
+    view.viewProjection[10] = 1.0f;
+    view.viewProjection[11] = 1.0f;
+    return view;
+}
+
+template<typename Fn>
+double TimeMedian(Fn &&fn) {
+    std::vector<double> times;
+    for (uint32_t round = 0; round < ROUNDS; round++) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        std::chrono::duration<double, std::milli> elapsed =
+                std::chrono::steady_clock::now() - start;
+        times.push_back(elapsed.count());
+    }
+    std::nth_element(times.begin(), times.begin() + times.size() / 2,
+                     times.end());
+    return times[times.size() / 2];
+}
+
+void PrintTime(const char *what, size_t count, double milliseconds,
+               size_t streams) {
+    std::cout << "  " << std::left << std::setw(16) << what << std::right
+              << std::fixed << std::setprecision(3) << milliseconds
+              << " ms  " << std::setprecision(1)
+              << count / milliseconds / 1000.0 << " M items/s  " << streams
+              << " streams\n";
+}
+
+/* The streams replayed one after another against a single stream */
+void CheckStreams(const std::vector<RenderCommandStream> &streams,
+                  const RenderCommandStream &reference) {
+    std::vector<RenderCommand> commands;
+    std::vector<uint8_t> instanceData;
+    for (const auto &stream : streams) {
+        for (RenderCommand command : stream.commands) {
+            command.instanceOffset += instanceData.size();
+            commands.push_back(command);
+        }
+        instanceData.insert(instanceData.end(), stream.instanceData.begin(),
+                            stream.instanceData.end());
+    }
+    bool same = commands.size() == reference.commands.size();
+    for (size_t i = 0; i < commands.size() && same; i++) {
+        const RenderCommand &a = commands[i];
+        const RenderCommand &b = reference.commands[i];
+        same = a.pipeline == b.pipeline && a.material == b.material &&
+               a.mesh == b.mesh && a.instanceCount == b.instanceCount &&
+               a.instanceOffset == b.instanceOffset;
+    }
+    Check(same, "the streams hold the draws of a single sorted stream");
+    Check(instanceData == reference.instanceData,
+          "the streams hold the instances in sorted order");
+}
+
+void Run(size_t count) {
+    Scene scene = MakeScene(count);
+    RenderQueueObjects objects = scene.GetObjects();
+    CullView view = MakeView();
+    std::cout << count << " objects, median of " << ROUNDS << " rounds\n";
+
+    // everything on the calling thread with the standard library sort
+    std::vector<SortEntry> keys(count);
+    RenderCommandStream reference;
+    double ms = TimeMedian([&] {
+        const float depthPlane[4]{0.0f, 0.0f, 1.0f, 0.0f};
+        RenderQueue::GenerateKeys(objects, 0, count, depthPlane,
+                                  DrawBatcher::MAX_DEPTH / MAX_DEPTH,
+                                  keys.data());
+        std::stable_sort(keys.begin(), keys.end(),
+                         [](const SortEntry &a, const SortEntry &b) {
+                             return a.key < b.key;
+                         });
+        reference.Clear();
+        DrawBatcher::BuildStream(keys.data(), keys.size(),
+                                 scene.instances.data(), INSTANCE_SIZE,
+                                 MAX_INSTANCES, reference);
+    });
+    PrintTime("stable_sort", count, ms, 1);
+
+    // the calling thread takes part, workers + 1 threads
+    for (uint32_t workers : {1u, 3u, 7u}) {
+        JobSystem jobSystem(workers);
+        RenderQueue queue;
+        queue.Init(jobSystem, INSTANCE_SIZE);
+        ms = TimeMedian([&] {
+            queue.Build(objects, view, MAX_DEPTH, MAX_INSTANCES);
+        });
+        std::string what = std::to_string(jobSystem.GetConcurrency()) +
+                           " threads";
+        PrintTime(what.c_str(), count, ms, queue.GetStreams().size());
+        CheckStreams(queue.GetStreams(), reference);
+    }
+    std::cout << "  " << reference.commands.size() << " draws\n";
+}
+
+}
+
+int main() {
+    Run(100000);
+    Run(1000000);
+    if (gFailures > 0) {
+        std::cout << gFailures << " checks failed\n";
+        return 1;
+    }
+    return 0;
+}
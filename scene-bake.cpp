@@ -0,0 +1,148 @@
+//
+// Created by Krisu on 2020/4/15.
+//
+
+#include "MeshBuffer.hpp"
+#include "MeshOptimizer.hpp"
+#include "SceneFile.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+// Bakes Wavefront OBJ files into a scene file the demo loads, one mesh
+// per file in the order given:
+//
+//     scene-bake scene.vksc model.obj ...
+//
+// Without any OBJ file the demo's triangle is baked. Only positions and
+// faces are read, polygons are fanned into triangles and vertices are
+// colored by where they sit inside the mesh bounds.
+
+namespace {
+
+struct ObjMesh {
+    std::vector<Vertex>   vertices;
+    std::vector<uint32_t> indices;
+};
+
+/* Position index of a face corner like 3, 3/1 or 3//2, negative ones
+ * count back from the last position */
+uint32_t ParseCorner(const std::string &corner, size_t positionCount) {
+    long index = std::strtol(corner.c_str(), nullptr, 10);
+    if (index < 0) {
+        index += static_cast<long>(positionCount) + 1;
+    }
+    if (index < 1 || static_cast<size_t>(index) > positionCount) {
+        throw std::runtime_error("face refers to a missing vertex: " +
+                                 corner);
+    }
+    return static_cast<uint32_t>(index - 1);
+}
+
+ObjMesh LoadObj(const std::string &path) {
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("failed to open " + path);
+    }
+
+    ObjMesh mesh;
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream tokens(line);
+        std::string type;
+        tokens >> type;
+        if (type == "v") {
+            Vertex vertex{};
+            tokens >> vertex.position[0] >> vertex.position[1] >>
+                   vertex.position[2];
+            mesh.vertices.push_back(vertex);
+        } else if (type == "f") {
+            std::vector<uint32_t> face;
+            std::string corner;
+            while (tokens >> corner) {
+                face.push_back(ParseCorner(corner, mesh.vertices.size()));
+            }
+            for (size_t i = 2; i < face.size(); i++) {
+                mesh.indices.insert(mesh.indices.end(),
+                                    {face[0], face[i - 1], face[i]});
+            }
+        }
+    }
+    if (mesh.indices.empty()) {
+        throw std::runtime_error(path + " has no faces");
+    }
+
+    float low[3], high[3];
+    for (int axis = 0; axis < 3; axis++) {
+        low[axis] = high[axis] = mesh.vertices[0].position[axis];
+        for (const auto &vertex : mesh.vertices) {
+            low[axis] = std::min(low[axis], vertex.position[axis]);
+            high[axis] = std::max(high[axis], vertex.position[axis]);
+        }
+    }
+    for (auto &vertex : mesh.vertices) {
+        for (int axis = 0; axis < 3; axis++) {
+            float extent = high[axis] - low[axis];
+            vertex.color[axis] = extent > 0.0f
+                                 ? (vertex.position[axis] - low[axis]) /
+                                   extent
+                                 : 1.0f;
+        }
+    }
+    return mesh;
+}
+
+ObjMesh MakeTriangle() {
+    ObjMesh mesh;
+    mesh.vertices = {
+            {{0.0f,  -0.5f, 0.0f}, {1.0f, 0.0f, 0.0f}},
+            {{0.5f,  0.5f,  0.0f}, {0.0f, 1.0f, 0.0f}},
+            {{-0.5f, 0.5f,  0.0f}, {0.0f, 0.0f, 1.0f}}
+    };
+    mesh.indices = {0, 1, 2};
+    return mesh;
+}
+
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        std::cerr << "usage: " << argv[0] << " out.vksc [model.obj ...]\n";
+        return 1;
+    }
+
+    try {
+        std::vector<ObjMesh> inputs;
+        for (int i = 2; i < argc; i++) {
+            inputs.push_back(LoadObj(argv[i]));
+        }
+        if (inputs.empty()) {
+            inputs.push_back(MakeTriangle());
+        }
+
+        // the demo draws deinterleaved vertices
+        MeshBuffer meshBuffer;
+        std::vector<Mesh> meshes;
+        for (auto &input : inputs) {
+            OptimizeMesh(input.vertices, input.indices);
+            meshes.push_back(meshBuffer.Add(input.vertices, input.indices,
+                                            VertexLayout::Deinterleaved));
+            std::cout << "mesh " << meshes.size() - 1 << ": "
+                      << input.vertices.size() << " vertices, "
+                      << input.indices.size() / 3 << " triangles\n";
+        }
+        WriteSceneFile(argv[1], meshBuffer, meshes);
+        std::cout << "wrote " << argv[1] << "\n";
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
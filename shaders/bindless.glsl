@@ -0,0 +1,19 @@
+// Global descriptor heap, see BindlessHeap.hpp for the binding numbers.
+// Handles are plain indices, pass them in push constants or instance data.
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout(set = 0, binding = 0) uniform texture2D bindlessTextures[];
+layout(set = 0, binding = 2) uniform sampler bindlessSamplers[];
+
+// storage buffers are declared per type, e.g.
+// BINDLESS_STORAGE_BUFFER(Transforms, mat4 transforms[]);
+#define BINDLESS_STORAGE_BUFFER(Name, Members) \
+    layout(std430, set = 0, binding = 1) readonly buffer Name { Members; } \
+    bindless##Name[]
+
+// nonuniformEXT when the handle may differ inside a draw
+vec4 SampleBindless(uint textureHandle, uint samplerHandle, vec2 uv) {
+    return texture(sampler2D(bindlessTextures[nonuniformEXT(textureHandle)],
+                             bindlessSamplers[nonuniformEXT(samplerHandle)]),
+                   uv);
+}
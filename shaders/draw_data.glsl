@@ -0,0 +1,16 @@
+// Per-draw data from DrawDataStream, declare the block matching the path
+// the data takes on the C++ side. set is the draw data set index.
+//
+// DRAW_DATA_PUSH(DrawData, mat4 model;)
+// DRAW_DATA_UNIFORM(1, DrawData, mat4 model; vec4 color;)
+// DRAW_DATA_STORAGE(1, DrawData, mat4 models[];)
+
+#define DRAW_DATA_PUSH(Name, Members) \
+    layout(push_constant) uniform Name { Members } drawData
+
+#define DRAW_DATA_UNIFORM(Set, Name, Members) \
+    layout(std140, set = Set, binding = 0) uniform Name { Members } drawData
+
+#define DRAW_DATA_STORAGE(Set, Name, Members) \
+    layout(std430, set = Set, binding = 1) readonly buffer Name { Members } \
+    drawData
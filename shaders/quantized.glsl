@@ -0,0 +1,25 @@
+// Decoding side of MeshPacker, the vertex formats do the unorm / snorm /
+// half conversion, only the bounds and the octahedral mapping are left.
+//
+// layout(location = 0) in vec4 inPosition;  R16G16B16A16_UNORM
+// layout(location = 1) in vec2 inNormal;    R8G8_SNORM or R16G16_SNORM
+// layout(location = 2) in vec2 inTangent;   R8G8_SNORM or R16G16_SNORM
+// layout(location = 3) in vec2 inUv;        R16G16_SFLOAT
+
+vec3 DequantizePosition(vec4 position, vec3 boundsMin, vec3 boundsExtent) {
+    return boundsMin + position.xyz * boundsExtent;
+}
+
+vec3 OctDecode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0) {
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0,
+                                        n.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(n);
+}
+
+// xyz tangent, w bitangent sign, the sign is stored in the position's w
+vec4 DecodeTangent(vec2 tangent, vec4 position) {
+    return vec4(OctDecode(tangent), position.w * 2.0 - 1.0);
+}
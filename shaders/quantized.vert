@@ -0,0 +1,25 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+#include "draw_data.glsl"
+#include "quantized.glsl"
+
+// PackMesh vertices with positions, normals and uvs
+layout (location = 0) in vec4 inPosition;
+layout (location = 1) in vec2 inNormal;
+layout (location = 3) in vec2 inUv;
+
+layout (location = 0) out vec3 fragColor;
+layout (location = 1) out vec2 fragUv;
+
+// the mesh's bounds, see QuantizedDrawData
+DRAW_DATA_PUSH(DrawData, vec4 boundsMin; vec4 boundsExtent;);
+
+void main() {
+    vec3 position = DequantizePosition(inPosition, drawData.boundsMin.xyz,
+                                       drawData.boundsExtent.xyz);
+    gl_Position = vec4(position, 1.0);
+    fragColor = OctDecode(inNormal) * 0.5 + 0.5;
+    fragUv = inUv;
+}
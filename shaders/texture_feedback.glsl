@@ -0,0 +1,20 @@
+// Mip feedback for TextureStreamer, include after bindless.glsl. The
+// buffer handle is TextureStreamer::GetFeedbackBuffer, it holds the lowest
+// mip asked for per texture handle. Fragment shaders only, the writes
+// need the fragmentStoresAndAtomics and
+// shaderStorageBufferArrayNonUniformIndexing features.
+
+layout(std430, set = 0, binding = 1) buffer TextureFeedback {
+    uint minMip[];
+} bindlessTextureFeedback[];
+
+// fullSize is the size of mip 0, not of what is resident
+void RequestTextureMip(uint feedbackHandle, uint textureHandle, vec2 uv,
+                       vec2 fullSize) {
+    vec2 dx = dFdx(uv * fullSize);
+    vec2 dy = dFdy(uv * fullSize);
+    float lod = 0.5 * log2(max(dot(dx, dx), dot(dy, dy)));
+    atomicMin(bindlessTextureFeedback[nonuniformEXT(feedbackHandle)]
+                      .minMip[textureHandle],
+              uint(max(lod, 0.0)));
+}
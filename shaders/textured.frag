@@ -0,0 +1,28 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+#include "bindless.glsl"
+#include "draw_data.glsl"
+#ifdef FEEDBACK
+#include "texture_feedback.glsl"
+#endif
+
+layout(location = 1) in vec2 fragUv;
+
+layout(location = 0) out vec4 outColor;
+
+// QuantizedDrawData followed by StreamedTextureDrawData
+DRAW_DATA_PUSH(DrawData, vec4 boundsMin; vec4 boundsExtent;
+               uint textureHandle; uint samplerHandle; uint feedbackHandle;
+               uint streamedTexture; vec2 textureSize;);
+
+void main() {
+#ifdef FEEDBACK
+    RequestTextureMip(drawData.feedbackHandle, drawData.streamedTexture,
+                      fragUv, drawData.textureSize);
+#endif
+    vec4 texel = SampleBindless(drawData.textureHandle,
+                                drawData.samplerHandle, fragUv);
+    outColor = vec4(texel.rgb, 1.0);
+}
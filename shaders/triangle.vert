@@ -1,21 +1,13 @@
 #version 450
-#extension GL_ARB_seperate_shader_objects : enable
+#extension GL_ARB_separate_shader_objects : enable
 
-layout (location = 0) out vec3 fragColor;
-
-vec2 position[3] = vec2[](
-    vec2(0.0, -0.5),
-    vec2(0.5, 0.5),
-    vec2(-0.5, 0.5)
-);
+// binding 0 holds the positions, binding 1 the colors
+layout (location = 0) in vec3 inPosition;
+layout (location = 1) in vec3 inColor;
 
-vec3 colors[3] = vec3[](
-    vec3(1.0, 0.0, 0.0),
-    vec3(0.0, 1.0, 0.0),
-    vec3(0.0, 0.0, 1.0)
-);
+layout (location = 0) out vec3 fragColor;
 
 void main() {
-    gl_Position = vec4(position[gl_VertexIndex], 0.0, 1.0);
-    fragColor = colors[gl_VertexIndex];
-}
\ No newline at end of file
+    gl_Position = vec4(inPosition, 1.0);
+    fragColor = inColor;
+}
@@ -0,0 +1,245 @@
+//
+// Created by Krisu on 2020/4/16.
+//
+
+#include "CpuCuller.hpp"
+
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <vector>
+
+
+// CullSpheres and CullBoxes give the same index lists at every level
+// this CPU runs as at Scalar: counts around multiples of 4 and 8, NaN
+// bounds, and frustums seeing everything or nothing. Nothing is written
+// to visible past the object count.
+
+namespace {
+
+constexpr uint32_t SENTINEL = 0xdeadbeef;
+// enough past the count for a whole AVX2 batch to land there
+constexpr size_t GUARD = 8;
+
+int gFailures = 0;
+
+void Check(bool condition, const char *what) {
+    if (!condition) {
+        std::cout << "FAILED: " << what << "\n";
+        gFailures++;
+    }
+}
+
+/* Bounds of count objects, each array sized exactly count */
+struct Objects {
+    std::vector<float> centerX, centerY, centerZ;
+    std::vector<float> radius, extentX, extentY, extentZ;
+
+    CullSphereBounds GetSpheres() const {
+        return {centerX.data(), centerY.data(), centerZ.data(),
+                radius.data(), centerX.size()};
+    }
+
+    CullBoxBounds GetBoxes() const {
+        return {centerX.data(), centerY.data(), centerZ.data(),
+                extentX.data(), extentY.data(), extentZ.data(),
+                centerX.size()};
+    }
+};
+
+Objects MakeObjects(size_t count, std::mt19937 &random) {
+    std::uniform_real_distribution<float> position(-2.0f, 2.0f);
+    std::uniform_real_distribution<float> size(0.0f, 0.6f);
+    Objects objects;
+    for (size_t i = 0; i < count; i++) {
+        objects.centerX.push_back(position(random));
+        objects.centerY.push_back(position(random));
+        objects.centerZ.push_back(position(random));
+        objects.radius.push_back(size(random));
+        objects.extentX.push_back(size(random));
+        objects.extentY.push_back(size(random));
+        objects.extentZ.push_back(size(random));
+    }
+    return objects;
+}
+
+/* Six random normalized planes at distance around 1 from the origin */
+CullFrustum MakeFrustum(std::mt19937 &random) {
+    std::uniform_real_distribution<float> value(-1.0f, 1.0f);
+    CullFrustum frustum{};
+    for (auto &plane : frustum.planes) {
+        float length = 0.0f;
+        for (int i = 0; i < 3; i++) {
+            plane[i] = value(random);
+            length += plane[i] * plane[i];
+        }
+        for (int i = 0; i < 3; i++) {
+            plane[i] /= std::sqrt(length);
+        }
+        plane[3] = 1.0f + 0.5f * value(random);
+    }
+    return frustum;
+}
+
+/* Planes along the axes, distance away from the origin; a negative
+ * distance leaves nothing inside */
+CullFrustum MakeBoxFrustum(float distance) {
+    CullFrustum frustum{};
+    for (int axis = 0; axis < 3; axis++) {
+        frustum.planes[axis * 2][axis] = 1.0f;
+        frustum.planes[axis * 2 + 1][axis] = -1.0f;
+        frustum.planes[axis * 2][3] = distance;
+        frustum.planes[axis * 2 + 1][3] = distance;
+    }
+    return frustum;
+}
+
+std::vector<uint32_t> CullSpheresAt(const CullFrustum &frustum,
+                                    const Objects &objects,
+                                    CpuCullLevel level) {
+    CullSphereBounds bounds = objects.GetSpheres();
+    std::vector<uint32_t> visible(bounds.count + GUARD, SENTINEL);
+    uint32_t count = CullSpheres(frustum, bounds, visible.data(), level);
+    for (size_t i = bounds.count; i < visible.size(); i++) {
+        Check(visible[i] == SENTINEL, "CullSpheres stays inside visible");
+    }
+    visible.resize(count);
+    return visible;
+}
+
+std::vector<uint32_t> CullBoxesAt(const CullFrustum &frustum,
+                                  const Objects &objects,
+                                  CpuCullLevel level) {
+    CullBoxBounds bounds = objects.GetBoxes();
+    std::vector<uint32_t> visible(bounds.count + GUARD, SENTINEL);
+    uint32_t count = CullBoxes(frustum, bounds, visible.data(), level);
+    for (size_t i = bounds.count; i < visible.size(); i++) {
+        Check(visible[i] == SENTINEL, "CullBoxes stays inside visible");
+    }
+    visible.resize(count);
+    return visible;
+}
+
+/* Every level agrees with Scalar, which is returned */
+struct Culled {
+    std::vector<uint32_t> spheres;
+    std::vector<uint32_t> boxes;
+};
+
+Culled CullAtEveryLevel(const CullFrustum &frustum, const Objects &objects) {
+    Culled scalar{CullSpheresAt(frustum, objects, CpuCullLevel::Scalar),
+                  CullBoxesAt(frustum, objects, CpuCullLevel::Scalar)};
+    for (CpuCullLevel level : {CpuCullLevel::SSE41, CpuCullLevel::AVX2}) {
+        Check(CullSpheresAt(frustum, objects, level) == scalar.spheres,
+              "spheres are culled the same at every level");
+        Check(CullBoxesAt(frustum, objects, level) == scalar.boxes,
+              "boxes are culled the same at every level");
+    }
+    return scalar;
+}
+
+bool IsSorted(const std::vector<uint32_t> &indices, size_t count) {
+    for (size_t i = 0; i < indices.size(); i++) {
+        if (indices[i] >= count || (i > 0 && indices[i] <= indices[i - 1])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void TestCounts() {
+    std::mt19937 random(1);
+    // every remainder of 4 and 8 a few times over, then some bigger ones
+    std::vector<size_t> counts(40);
+    std::iota(counts.begin(), counts.end(), 0);
+    counts.insert(counts.end(), {63, 64, 65, 255, 256, 257, 1001, 4099});
+    for (size_t count : counts) {
+        for (int round = 0; round < 4; round++) {
+            Objects objects = MakeObjects(count, random);
+            Culled culled = CullAtEveryLevel(MakeFrustum(random), objects);
+            Check(IsSorted(culled.spheres, count) &&
+                  IsSorted(culled.boxes, count),
+                  "visible indices are in order and in range");
+        }
+    }
+}
+
+void TestNan() {
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    std::mt19937 random(2);
+    for (size_t count : {1, 5, 13, 100}) {
+        Objects objects = MakeObjects(count, random);
+        // NaN in each value of some object in turn, every value a chance
+        // to land in any lane
+        std::vector<float> *values[7]{
+                &objects.centerX, &objects.centerY, &objects.centerZ,
+                &objects.radius, &objects.extentX, &objects.extentY,
+                &objects.extentZ
+        };
+        for (size_t i = 0; i < count; i += 3) {
+            (*values[i % 7])[i] = nan;
+        }
+        // everything else is inside, so exactly the NaN ones are culled:
+        // a NaN center hits both, a NaN radius or extent only its kind
+        std::vector<uint32_t> spheres, boxes;
+        for (uint32_t i = 0; i < count; i++) {
+            bool nanValue = i % 3 == 0;
+            if (!nanValue || i % 7 > 3) {
+                spheres.push_back(i);
+            }
+            if (!nanValue || i % 7 == 3) {
+                boxes.push_back(i);
+            }
+        }
+        Culled culled = CullAtEveryLevel(MakeBoxFrustum(100.0f), objects);
+        Check(culled.spheres == spheres, "spheres with NaN bounds are culled");
+        Check(culled.boxes == boxes, "boxes with NaN bounds are culled");
+
+        CullAtEveryLevel(MakeFrustum(random), objects);
+    }
+
+    // a NaN plane culls everything
+    Objects objects = MakeObjects(37, random);
+    CullFrustum frustum = MakeBoxFrustum(100.0f);
+    frustum.planes[4][3] = nan;
+    Culled culled = CullAtEveryLevel(frustum, objects);
+    Check(culled.spheres.empty() && culled.boxes.empty(),
+          "a NaN plane culls everything");
+}
+
+void TestAllOrNone() {
+    std::mt19937 random(3);
+    for (size_t count : {0, 1, 3, 4, 7, 8, 9, 31, 33, 1000}) {
+        Objects objects = MakeObjects(count, random);
+        std::vector<uint32_t> all(count);
+        std::iota(all.begin(), all.end(), 0);
+
+        Culled culled = CullAtEveryLevel(MakeBoxFrustum(100.0f), objects);
+        Check(culled.spheres == all && culled.boxes == all,
+              "everything inside a big frustum is visible");
+
+        culled = CullAtEveryLevel(MakeBoxFrustum(-100.0f), objects);
+        Check(culled.spheres.empty() && culled.boxes.empty(),
+              "nothing is inside an empty frustum");
+    }
+}
+
+}
+
+int main() {
+    const char *names[]{"Scalar", "SSE4.1", "AVX2"};
+    std::cout << "levels up to "
+              << names[static_cast<int>(GetCpuCullLevel())]
+              << " run here, the others are lowered to it\n";
+    TestCounts();
+    TestNan();
+    TestAllOrNone();
+    if (gFailures > 0) {
+        std::cout << gFailures << " checks failed\n";
+        return 1;
+    }
+    std::cout << "cpu cull ok\n";
+    return 0;
+}
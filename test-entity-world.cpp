@@ -0,0 +1,263 @@
+//
+// Created by Krisu on 2020/4/16.
+//
+
+#include "EntityWorld.hpp"
+
+#include <atomic>
+#include <iostream>
+#include <random>
+#include <vector>
+
+
+// EntityWorld under random creates, destroys, adds and removes checked
+// against a plain model of the entities: components keep their values
+// through moves between archetypes and chunks, queries visit each live
+// entity once, stale handles stay dead. Then an EntityCommandBuffer
+// filled from a ParallelForEach is played back.
+
+namespace {
+
+constexpr uint32_t ENTITY_COUNT = 20000;
+constexpr uint32_t OPERATION_COUNT = 60000;
+
+int gFailures = 0;
+
+void Check(bool condition, const char *what) {
+    if (!condition) {
+        std::cout << "FAILED: " << what << "\n";
+        gFailures++;
+    }
+}
+
+struct Position {
+    float x, y, z;
+};
+
+struct Velocity {
+    float v[3];
+};
+
+struct Tag {
+    uint8_t value;
+};
+
+// big enough to change the chunk capacity of its archetypes
+struct Payload {
+    double values[5];
+};
+
+struct Model {
+    Entity   entity;
+    bool     alive = true;
+    float    x = 0.0f;
+    bool     hasVelocity = false;
+    float    velocity = 0.0f;
+    bool     hasPayload = false;
+};
+
+class Tester {
+public:
+    void Create(bool withVelocity) {
+        Model model;
+        model.x = static_cast<float>(mModels.size());
+        model.hasVelocity = withVelocity;
+        model.velocity = model.x * 2.0f;
+        Position position{model.x, 0.0f, 0.0f};
+        model.entity = withVelocity
+                       ? mWorld.Create(position,
+                                       Velocity{{model.velocity, 0.0f, 0.0f}})
+                       : mWorld.Create(position);
+        mModels.push_back(model);
+    }
+
+    void RandomOperation() {
+        Model &model = mModels[mRandom() % mModels.size()];
+        switch (mRandom() % 5) {
+            case 0:
+                // twice on some, which has to do nothing
+                mWorld.Destroy(model.entity);
+                model.alive = false;
+                break;
+            case 1:
+                if (model.alive) {
+                    model.velocity += 1.0f;
+                    mWorld.Add(model.entity,
+                               Velocity{{model.velocity, 0.0f, 0.0f}});
+                    model.hasVelocity = true;
+                }
+                break;
+            case 2:
+                mWorld.Remove<Velocity>(model.entity);
+                model.hasVelocity = false;
+                break;
+            case 3:
+                if (model.alive) {
+                    mWorld.Add(model.entity, Payload{{1.0, 2.0, 3.0, 4.0,
+                                                      5.0}});
+                    model.hasPayload = true;
+                }
+                break;
+            case 4:
+                Create(mRandom() % 2 == 0);
+                break;
+        }
+    }
+
+    void CheckModels() {
+        uint32_t alive = 0, withVelocity = 0;
+        bool same = true;
+        for (const Model &model : mModels) {
+            if (!model.alive) {
+                same = same && !mWorld.IsAlive(model.entity) &&
+                       mWorld.Get<Position>(model.entity) == nullptr;
+                continue;
+            }
+            alive++;
+            withVelocity += model.hasVelocity;
+            const Position *position = mWorld.Get<Position>(model.entity);
+            const Velocity *velocity = mWorld.Get<Velocity>(model.entity);
+            same = same && mWorld.IsAlive(model.entity) &&
+                   position != nullptr && position->x == model.x &&
+                   (velocity != nullptr) == model.hasVelocity &&
+                   (!model.hasVelocity || velocity->v[0] == model.velocity) &&
+                   mWorld.Has<Payload>(model.entity) == model.hasPayload;
+        }
+        Check(same, "entities keep their components through the churn");
+        Check(mWorld.GetEntityCount() == alive,
+              "the entity count is the live entities");
+
+        // every live entity once, at the address Get gives
+        uint32_t visited = 0;
+        bool atGet = true;
+        mWorld.ForEach<Position>([&](uint32_t count, const Entity *entities,
+                                     Position *positions) {
+            for (uint32_t i = 0; i < count; i++) {
+                atGet = atGet &&
+                        mWorld.Get<Position>(entities[i]) == &positions[i];
+            }
+            visited += count;
+        });
+        Check(visited == alive, "a query visits every live entity");
+        Check(atGet, "a query gives the components Get gives");
+
+        visited = 0;
+        mWorld.ForEach<Position, Velocity>(
+                [&](uint32_t count, const Entity *, Position *, Velocity *) {
+                    visited += count;
+                });
+        Check(visited == withVelocity,
+              "a query visits only the entities with all its components");
+    }
+
+    EntityWorld &GetWorld() { return mWorld; }
+
+private:
+    EntityWorld        mWorld;
+    std::vector<Model> mModels;
+    std::mt19937       mRandom{5};
+};
+
+void TestChurn() {
+    Tester tester;
+    for (uint32_t i = 0; i < ENTITY_COUNT; i++) {
+        tester.Create(i % 3 != 0);
+    }
+    tester.CheckModels();
+    for (uint32_t i = 0; i < OPERATION_COUNT; i++) {
+        tester.RandomOperation();
+    }
+    tester.CheckModels();
+}
+
+void TestStaleHandles() {
+    EntityWorld world;
+    Entity first = world.Create(Position{1.0f, 0.0f, 0.0f});
+    world.Destroy(first);
+    Entity second = world.Create(Position{2.0f, 0.0f, 0.0f});
+    Check(second.index == first.index, "a destroyed entity's slot is reused");
+    Check(!world.IsAlive(first) && world.Get<Position>(first) == nullptr,
+          "a handle to a reused slot stays dead");
+    Check(world.Get<Position>(second)->x == 2.0f,
+          "the new entity has its own components");
+}
+
+void TestPlayback() {
+    EntityWorld world;
+    JobSystem jobSystem(3);
+    std::vector<Entity> entities;
+    for (uint32_t i = 0; i < ENTITY_COUNT; i++) {
+        entities.push_back(
+                i % 2 == 0 ? world.Create(Position{1.0f, 0.0f, 0.0f},
+                                          Velocity{{1.0f, 0.0f, 0.0f}})
+                           : world.Create(Position{1.0f, 0.0f, 0.0f}));
+    }
+
+    // every moving entity is replaced by a tagged one, the others get
+    // tagged; recorded from several threads at once
+    EntityCommandBuffer commands;
+    std::atomic<uint32_t> moving{0};
+    world.ParallelForEach<Position, Velocity>(
+            jobSystem, [&](uint32_t count, const Entity *chunkEntities,
+                           Position *, Velocity *) {
+                for (uint32_t i = 0; i < count; i++) {
+                    commands.Destroy(chunkEntities[i]);
+                    commands.Create(Tag{7}, Position{3.0f, 0.0f, 0.0f});
+                }
+                moving += count;
+            });
+    for (uint32_t i = 1; i < ENTITY_COUNT; i += 2) {
+        commands.Add(entities[i], Tag{9});
+    }
+    // commands on entities destroyed earlier in the buffer are skipped
+    commands.Add(entities[0], Tag{9});
+    commands.Remove<Position>(entities[0]);
+    commands.Destroy(entities[0]);
+    Check(world.GetEntityCount() == ENTITY_COUNT,
+          "recording leaves the world as it is");
+    commands.Playback(world);
+
+    uint32_t created = 0, tagged = 0, wrong = 0;
+    world.ForEach<Tag, Position>([&](uint32_t count, const Entity *,
+                                     Tag *tags, Position *positions) {
+        for (uint32_t i = 0; i < count; i++) {
+            if (tags[i].value == 7 && positions[i].x == 3.0f) {
+                created++;
+            } else if (tags[i].value == 9 && positions[i].x == 1.0f) {
+                tagged++;
+            } else {
+                wrong++;
+            }
+        }
+    });
+    uint32_t velocities = 0;
+    world.ForEach<Velocity>([&](uint32_t count, const Entity *, Velocity *) {
+        velocities += count;
+    });
+    Check(moving == ENTITY_COUNT / 2, "the query saw the moving entities");
+    Check(created == moving && velocities == 0,
+          "the moving entities were replaced");
+    Check(tagged == ENTITY_COUNT / 2 && wrong == 0,
+          "the other entities were tagged");
+    Check(world.GetEntityCount() == ENTITY_COUNT,
+          "playback created as many as it destroyed");
+
+    // played back commands are gone
+    commands.Playback(world);
+    Check(world.GetEntityCount() == ENTITY_COUNT,
+          "a second playback does nothing");
+}
+
+}
+
+int main() {
+    TestChurn();
+    TestStaleHandles();
+    TestPlayback();
+    if (gFailures > 0) {
+        std::cout << gFailures << " checks failed\n";
+        return 1;
+    }
+    std::cout << "entity world ok\n";
+    return 0;
+}
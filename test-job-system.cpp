@@ -0,0 +1,140 @@
+//
+// Created by Krisu on 2020/4/14.
+//
+
+#include "JobSystem.hpp"
+
+#include <atomic>
+#include <future>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+
+// ParallelFor waits for its own batches only, keeps exceptions apart
+// from the other jobs and can be nested inside jobs
+
+namespace {
+
+int gFailures = 0;
+
+void Check(bool condition, const char *what) {
+    if (!condition) {
+        std::cout << "FAILED: " << what << "\n";
+        gFailures++;
+    }
+}
+
+void TestCoverage() {
+    JobSystem jobSystem(3);
+    for (size_t count : {0, 1, 7, 64, 1000}) {
+        std::vector<std::atomic<int>> visits(count);
+        jobSystem.ParallelFor(count, 16, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                visits[i]++;
+            }
+        });
+        bool once = true;
+        for (auto &visit : visits) {
+            once = once && visit == 1;
+        }
+        Check(once, "every index is visited exactly once");
+    }
+}
+
+void TestUnrelatedJobs() {
+    JobSystem jobSystem(1);
+    // keeps the only worker busy until ParallelFor is done
+    std::promise<void> started;
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    jobSystem.Submit([&started, released] {
+        started.set_value();
+        released.wait();
+    });
+    started.get_future().wait();
+
+    std::atomic<size_t> sum{0};
+    jobSystem.ParallelFor(100, 10, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            sum += i;
+        }
+    });
+    Check(sum == 4950, "ParallelFor returns while another job runs");
+    release.set_value();
+    jobSystem.Wait();
+}
+
+void TestExceptions() {
+    JobSystem jobSystem(2);
+    jobSystem.Submit([] { throw std::runtime_error("unrelated"); });
+    bool threw = false;
+    try {
+        jobSystem.ParallelFor(8, 1, [](size_t, size_t) {});
+    } catch (const std::exception &) {
+        threw = true;
+    }
+    Check(!threw, "ParallelFor ignores exceptions of other jobs");
+    try {
+        jobSystem.Wait();
+    } catch (const std::exception &) {
+        threw = true;
+    }
+    Check(threw, "Wait rethrows the exception of a submitted job");
+
+    threw = false;
+    try {
+        jobSystem.ParallelFor(8, 1, [](size_t begin, size_t) {
+            if (begin == 5) {
+                throw std::runtime_error("batch");
+            }
+        });
+    } catch (const std::exception &) {
+        threw = true;
+    }
+    Check(threw, "ParallelFor rethrows the exception of its batch");
+    threw = false;
+    try {
+        jobSystem.Wait();
+    } catch (const std::exception &) {
+        threw = true;
+    }
+    Check(!threw, "the batch exception is not rethrown twice");
+}
+
+void TestNested() {
+    // more outer batches than threads, every worker ends up waiting
+    // inside a job
+    JobSystem jobSystem(2);
+    std::atomic<size_t> total{0};
+    jobSystem.ParallelFor(16, 1, [&](size_t, size_t) {
+        jobSystem.ParallelFor(16, 1, [&](size_t, size_t) { total++; });
+    });
+    Check(total == 256, "nested ParallelFor finishes");
+
+    std::atomic<size_t> submitted{0};
+    for (int i = 0; i < 8; i++) {
+        jobSystem.Submit([&] {
+            jobSystem.ParallelFor(4, 1, [&](size_t, size_t) {
+                submitted++;
+            });
+        });
+    }
+    jobSystem.Wait();
+    Check(submitted == 32, "ParallelFor inside submitted jobs finishes");
+}
+
+}
+
+int main() {
+    TestCoverage();
+    TestUnrelatedJobs();
+    TestExceptions();
+    TestNested();
+    if (gFailures > 0) {
+        std::cout << gFailures << " checks failed\n";
+        return 1;
+    }
+    std::cout << "job system ok\n";
+    return 0;
+}
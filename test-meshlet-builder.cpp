@@ -0,0 +1,333 @@
+//
+// Created by Krisu on 2020/4/16.
+//
+
+#include "MeshletBuilder.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+
+// BuildMeshlets keeps every triangle exactly once within the meshlet
+// limits, copes with degenerate triangles and odd limits, and its cones
+// never cull a meshlet with a triangle facing the camera
+
+namespace {
+
+constexpr float PI = 3.14159265358979f;
+
+int gFailures = 0;
+
+void Check(bool condition, const char *what) {
+    if (!condition) {
+        std::cout << "FAILED: " << what << "\n";
+        gFailures++;
+    }
+}
+
+struct Mesh {
+    std::vector<float>    positions;
+    std::vector<uint32_t> indices;
+
+    size_t GetVertexCount() const { return positions.size() / 3; }
+};
+
+/* A UV sphere of rings x segments quads */
+Mesh MakeSphere(uint32_t rings, uint32_t segments) {
+    Mesh sphere;
+    for (uint32_t r = 0; r <= rings; r++) {
+        float theta = PI * r / rings;
+        for (uint32_t s = 0; s <= segments; s++) {
+            float phi = 2.0f * PI * s / segments;
+            sphere.positions.push_back(std::sin(theta) * std::cos(phi));
+            sphere.positions.push_back(std::cos(theta));
+            sphere.positions.push_back(std::sin(theta) * std::sin(phi));
+        }
+    }
+    for (uint32_t r = 0; r < rings; r++) {
+        for (uint32_t s = 0; s < segments; s++) {
+            uint32_t a = r * (segments + 1) + s;
+            uint32_t b = a + segments + 1;
+            sphere.indices.insert(sphere.indices.end(),
+                                  {a, b, a + 1, a + 1, b, b + 1});
+        }
+    }
+    return sphere;
+}
+
+/* A bumpy height field, its meshlets get narrow cones */
+Mesh MakeTerrain(uint32_t size) {
+    Mesh terrain;
+    for (uint32_t z = 0; z <= size; z++) {
+        for (uint32_t x = 0; x <= size; x++) {
+            float u = static_cast<float>(x) / size;
+            float v = static_cast<float>(z) / size;
+            terrain.positions.push_back(u * 4.0f - 2.0f);
+            terrain.positions.push_back(
+                    0.3f * std::sin(u * 9.0f) * std::cos(v * 7.0f));
+            terrain.positions.push_back(v * 4.0f - 2.0f);
+        }
+    }
+    for (uint32_t z = 0; z < size; z++) {
+        for (uint32_t x = 0; x < size; x++) {
+            uint32_t a = z * (size + 1) + x;
+            uint32_t b = a + size + 1;
+            terrain.indices.insert(terrain.indices.end(),
+                                   {a, a + 1, b, a + 1, b + 1, b});
+        }
+    }
+    return terrain;
+}
+
+/* Triangles between random vertices, no locality at all */
+Mesh MakeSoup(uint32_t vertexCount, uint32_t triangleCount) {
+    std::mt19937 random(7);
+    std::uniform_real_distribution<float> coordinate(-1.0f, 1.0f);
+    std::uniform_int_distribution<uint32_t> vertex(0, vertexCount - 1);
+    Mesh soup;
+    for (uint32_t i = 0; i < vertexCount * 3; i++) {
+        soup.positions.push_back(coordinate(random));
+    }
+    for (uint32_t i = 0; i < triangleCount * 3; i++) {
+        soup.indices.push_back(vertex(random));
+    }
+    return soup;
+}
+
+MeshletData Build(const Mesh &mesh,
+                  uint32_t maxVertices = MAX_MESHLET_VERTICES,
+                  uint32_t maxTriangles = MAX_MESHLET_TRIANGLES) {
+    return BuildMeshlets(mesh.indices, mesh.positions.data(),
+                         mesh.GetVertexCount(), 3 * sizeof(float),
+                         maxVertices, maxTriangles);
+}
+
+/* Limits, local indices and that the meshlets hand back exactly the
+ * triangles they were given */
+void CheckMeshlets(const Mesh &mesh, const MeshletData &data,
+                   uint32_t maxVertices, uint32_t maxTriangles) {
+    Check(data.bounds.size() == data.meshlets.size(),
+          "every meshlet has bounds");
+    bool limits = true;
+    bool locals = true;
+    bool unique = true;
+    size_t triangleCount = 0;
+    for (const auto &meshlet : data.meshlets) {
+        limits = limits && meshlet.vertexCount <= maxVertices &&
+                 meshlet.triangleCount <= maxTriangles &&
+                 meshlet.triangleCount > 0 &&
+                 meshlet.vertexOffset + meshlet.vertexCount <=
+                 data.vertices.size() &&
+                 (meshlet.triangleOffset + meshlet.triangleCount) * 3 <=
+                 data.triangles.size();
+        if (!limits) {
+            break;
+        }
+        for (uint32_t i = 0; i < meshlet.triangleCount * 3; i++) {
+            locals = locals &&
+                     data.triangles[meshlet.triangleOffset * 3 + i] <
+                     meshlet.vertexCount;
+        }
+        std::vector<uint32_t> vertices(
+                data.vertices.begin() + meshlet.vertexOffset,
+                data.vertices.begin() + meshlet.vertexOffset +
+                meshlet.vertexCount);
+        std::sort(vertices.begin(), vertices.end());
+        unique = unique &&
+                 std::adjacent_find(vertices.begin(), vertices.end()) ==
+                 vertices.end();
+        triangleCount += meshlet.triangleCount;
+    }
+    Check(limits, "meshlets stay within the vertex and triangle limits");
+    Check(locals, "local indices point at the meshlet's vertices");
+    Check(unique, "a vertex appears once per meshlet");
+    Check(triangleCount * 3 == mesh.indices.size(),
+          "the meshlets hold as many triangles as the mesh");
+
+    // corners keep their order, so the triangles can be compared as they
+    // are
+    std::vector<uint32_t> indices = GetMeshletIndices(data);
+    using Triangle = std::array<uint32_t, 3>;
+    auto toTriangles = [](const std::vector<uint32_t> &list) {
+        std::vector<Triangle> triangles;
+        for (size_t i = 0; i + 2 < list.size(); i += 3) {
+            triangles.push_back({list[i], list[i + 1], list[i + 2]});
+        }
+        std::sort(triangles.begin(), triangles.end());
+        return triangles;
+    };
+    Check(toTriangles(indices) == toTriangles(mesh.indices),
+          "every input triangle appears exactly once");
+}
+
+/* Camera positions all around the mesh and close to it. A meshlet the
+ * cone test culls must not have a triangle facing the camera. */
+void CheckCones(const Mesh &mesh, const MeshletData &data,
+                size_t &culledCount) {
+    std::mt19937 random(11);
+    std::uniform_real_distribution<float> coordinate(-3.0f, 3.0f);
+    std::vector<std::array<float, 3>> cameras;
+    for (int i = 0; i < 200; i++) {
+        cameras.push_back({coordinate(random), coordinate(random),
+                           coordinate(random)});
+    }
+    // just outside the surface, where the apex test matters most
+    for (size_t i = 0; i < mesh.GetVertexCount(); i += 97) {
+        const float *p = &mesh.positions[i * 3];
+        cameras.push_back({p[0] * 1.05f, p[1] * 1.05f + 0.05f, p[2] * 1.05f});
+    }
+
+    bool wrong = false;
+    for (size_t m = 0; m < data.meshlets.size() && !wrong; m++) {
+        const Meshlet &meshlet = data.meshlets[m];
+        const MeshletBounds &bounds = data.bounds[m];
+        for (const auto &camera : cameras) {
+            float view[3];
+            for (int k = 0; k < 3; k++) {
+                view[k] = bounds.center[k] - camera[k];
+            }
+            float distance = std::sqrt(view[0] * view[0] + view[1] * view[1] +
+                                       view[2] * view[2]);
+            float along = view[0] * bounds.coneAxis[0] +
+                          view[1] * bounds.coneAxis[1] +
+                          view[2] * bounds.coneAxis[2];
+            if (along < bounds.coneCutoff * distance + bounds.radius) {
+                continue;
+            }
+            culledCount++;
+
+            for (uint32_t t = 0; t < meshlet.triangleCount; t++) {
+                const float *c[3];
+                for (int j = 0; j < 3; j++) {
+                    uint8_t local =
+                            data.triangles[(meshlet.triangleOffset + t) * 3 +
+                                           j];
+                    uint32_t vertex =
+                            data.vertices[meshlet.vertexOffset + local];
+                    c[j] = &mesh.positions[vertex * 3];
+                }
+                // clockwise front faces, the builder's normal
+                float e1[3], e2[3], toCamera[3];
+                for (int k = 0; k < 3; k++) {
+                    e1[k] = c[2][k] - c[0][k];
+                    e2[k] = c[1][k] - c[0][k];
+                    toCamera[k] = camera[k] - c[0][k];
+                }
+                float normal[3] = {e1[1] * e2[2] - e1[2] * e2[1],
+                                   e1[2] * e2[0] - e1[0] * e2[2],
+                                   e1[0] * e2[1] - e1[1] * e2[0]};
+                float facing = normal[0] * toCamera[0] +
+                               normal[1] * toCamera[1] +
+                               normal[2] * toCamera[2];
+                if (facing > 1e-6f) {
+                    wrong = true;
+                }
+            }
+        }
+    }
+    Check(!wrong, "cones never cull a meshlet with a front facing triangle");
+}
+
+void TestMeshes() {
+    size_t culled = 0;
+    for (const Mesh &mesh : {MakeSphere(40, 60), MakeTerrain(48),
+                             MakeSoup(500, 3000)}) {
+        MeshletData data = Build(mesh);
+        CheckMeshlets(mesh, data, MAX_MESHLET_VERTICES,
+                      MAX_MESHLET_TRIANGLES);
+        CheckCones(mesh, data, culled);
+    }
+    // otherwise the cone check proves nothing
+    Check(culled > 0, "some meshlets are cone culled");
+}
+
+void TestDegenerate() {
+    // repeated corners, a point, and triangles sharing nothing with them
+    Mesh mesh = MakeSphere(4, 6);
+    size_t vertexCount = mesh.GetVertexCount();
+    std::vector<uint32_t> degenerate{0, 0, 1, 2, 3, 2, 4, 4, 4, 5, 6, 5};
+    mesh.indices.insert(mesh.indices.begin() + 6, degenerate.begin(),
+                        degenerate.end());
+    MeshletData data = Build(mesh);
+    CheckMeshlets(mesh, data, MAX_MESHLET_VERTICES, MAX_MESHLET_TRIANGLES);
+
+    // a point takes a single meshlet vertex
+    Mesh points;
+    points.positions.assign(vertexCount * 3, 0.0f);
+    for (uint32_t i = 0; i < 10; i++) {
+        points.indices.insert(points.indices.end(), {i, i, i});
+    }
+    data = Build(points, 3, 124);
+    CheckMeshlets(points, data, 3, 124);
+    Check(data.meshlets.size() == 4, "three points fill a 3 vertex meshlet");
+
+    // nothing faces anywhere, nothing may be culled
+    data = Build(points);
+    bool open = true;
+    for (const auto &bounds : data.bounds) {
+        open = open && bounds.coneCutoff == 1.0f;
+    }
+    Check(open, "degenerate meshlets get a cone that never culls");
+}
+
+void TestLimits() {
+    Mesh sphere = MakeSphere(20, 30);
+    // one triangle per meshlet at the smallest limits
+    MeshletData data = Build(sphere, 3, 1);
+    CheckMeshlets(sphere, data, 3, 1);
+    Check(data.meshlets.size() == sphere.indices.size() / 3,
+          "one triangle per meshlet at 3 vertices");
+    data = Build(sphere, 3, 124);
+    CheckMeshlets(sphere, data, 3, 124);
+
+    // local indices still fit a byte at the largest vertex limit
+    data = Build(sphere, 256, 512);
+    CheckMeshlets(sphere, data, 256, 512);
+    for (uint32_t maxVertices : {4u, 5u, 63u, 64u, 65u, 255u}) {
+        data = Build(sphere, maxVertices, 124);
+        CheckMeshlets(sphere, data, maxVertices, 124);
+    }
+
+    Mesh empty;
+    empty.positions = sphere.positions;
+    Check(Build(empty).meshlets.empty(), "no triangles give no meshlets");
+
+    auto throws = [](const Mesh &mesh, uint32_t maxVertices,
+                     uint32_t maxTriangles) {
+        try {
+            Build(mesh, maxVertices, maxTriangles);
+        } catch (const std::runtime_error &) {
+            return true;
+        }
+        return false;
+    };
+    Check(throws(sphere, 2, 124), "fewer than 3 vertices throws");
+    Check(throws(sphere, 257, 124), "more than 256 vertices throws");
+    Check(throws(sphere, 64, 0), "no triangles per meshlet throws");
+    Mesh broken = sphere;
+    broken.indices.push_back(0);
+    Check(throws(broken, 64, 124), "a partial triangle throws");
+    broken.indices.insert(broken.indices.end(),
+                          {1, static_cast<uint32_t>(
+                                  sphere.GetVertexCount())});
+    Check(throws(broken, 64, 124), "an index past the vertices throws");
+}
+
+}
+
+int main() {
+    TestMeshes();
+    TestDegenerate();
+    TestLimits();
+    if (gFailures > 0) {
+        std::cout << gFailures << " checks failed\n";
+        return 1;
+    }
+    std::cout << "meshlet builder ok\n";
+    return 0;
+}
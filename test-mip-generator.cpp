@@ -0,0 +1,512 @@
+//
+// Created by Krisu on 2020/4/16.
+//
+
+#include "DescriptorAllocator.hpp"
+#include "DescriptorUpdater.hpp"
+#include "MipGenerator.hpp"
+#include "VulkanUtils.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+
+// Mips from MipGenerator against a CPU box filter of the level above,
+// run on the first device found, through the compute path and through
+// the blit fallback. Odd sizes are only compared on the compute path,
+// blits of those filter differently. Record is timed on both paths with
+// timestamps, or around the whole submit when the queue has none, so a
+// run on a software ICD such as lavapipe gives the ms per size.
+
+namespace {
+
+constexpr VkFormat FORMAT = VK_FORMAT_R8G8B8A8_UNORM;
+// rounding to 8 bits on both sides, the compute path keeps floats
+// between levels
+constexpr int MAX_ERROR = 2;
+constexpr const char *DOWNSAMPLE_SHADER_PATH = "shaders/downsample.spv";
+// median of these many runs per size and path
+constexpr uint32_t TIMING_ROUNDS = 5;
+
+int gFailures = 0;
+
+void Check(bool condition, const char *what) {
+    if (!condition) {
+        std::cout << "FAILED: " << what << "\n";
+        gFailures++;
+    }
+}
+
+struct Device {
+    VkInstance       instance = VK_NULL_HANDLE;
+    VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+    VkDevice         device = VK_NULL_HANDLE;
+    VkQueue          queue = VK_NULL_HANDLE;
+    uint32_t         queueFamily = 0;
+    bool             storageWithoutFormat = false;
+    // 0 when the queue family has no timestamps
+    uint32_t         timestampValidBits = 0;
+    float            timestampPeriod = 0.0f;
+};
+
+Device CreateDevice() {
+    Device result;
+
+    VkApplicationInfo appInfo{};
+    appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+    appInfo.pApplicationName = "mip-generator-test";
+    appInfo.apiVersion = VK_API_VERSION_1_0;
+
+    VkInstanceCreateInfo instanceCreateInfo{};
+    instanceCreateInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+    instanceCreateInfo.pApplicationInfo = &appInfo;
+    if (vkCreateInstance(&instanceCreateInfo, nullptr, &result.instance) !=
+        VK_SUCCESS) {
+        throw std::runtime_error("failed to create instance");
+    }
+
+    uint32_t deviceCount = 1;
+    VkResult enumerated = vkEnumeratePhysicalDevices(
+            result.instance, &deviceCount, &result.physicalDevice);
+    if ((enumerated != VK_SUCCESS && enumerated != VK_INCOMPLETE) ||
+        deviceCount == 0) {
+        throw std::runtime_error("failed to find a GPU with Vulkan support");
+    }
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(result.physicalDevice, &properties);
+    std::cout << properties.deviceName << "\n";
+
+    // blits need graphics, the downsampler compute
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(result.physicalDevice,
+                                             &familyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> families(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(result.physicalDevice,
+                                             &familyCount, families.data());
+    const VkQueueFlags needed = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT;
+    auto family = std::find_if(families.begin(), families.end(),
+                               [needed](const VkQueueFamilyProperties &f) {
+                                   return (f.queueFlags & needed) == needed;
+                               });
+    if (family == families.end()) {
+        throw std::runtime_error("failed to find a graphics queue family");
+    }
+    result.queueFamily = std::distance(families.begin(), family);
+    result.timestampValidBits = family->timestampValidBits;
+    result.timestampPeriod = properties.limits.timestampPeriod;
+
+    float priority = 1.0f;
+    VkDeviceQueueCreateInfo queueCreateInfo{};
+    queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    queueCreateInfo.queueFamilyIndex = result.queueFamily;
+    queueCreateInfo.queueCount = 1;
+    queueCreateInfo.pQueuePriorities = &priority;
+
+    VkPhysicalDeviceFeatures supportedFeatures;
+    vkGetPhysicalDeviceFeatures(result.physicalDevice, &supportedFeatures);
+    VkPhysicalDeviceFeatures deviceFeatures{};
+    deviceFeatures.shaderStorageImageWriteWithoutFormat =
+            supportedFeatures.shaderStorageImageWriteWithoutFormat;
+    result.storageWithoutFormat =
+            supportedFeatures.shaderStorageImageWriteWithoutFormat;
+
+    VkDeviceCreateInfo deviceCreateInfo{};
+    deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    deviceCreateInfo.queueCreateInfoCount = 1;
+    deviceCreateInfo.pQueueCreateInfos = &queueCreateInfo;
+    deviceCreateInfo.pEnabledFeatures = &deviceFeatures;
+    if (vkCreateDevice(result.physicalDevice, &deviceCreateInfo, nullptr,
+                       &result.device) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create logical device");
+    }
+    vkGetDeviceQueue(result.device, result.queueFamily, 0, &result.queue);
+    return result;
+}
+
+uint32_t GetMipCount(uint32_t width, uint32_t height) {
+    uint32_t count = 1;
+    while (std::max(width, height) >> count) {
+        count++;
+    }
+    return count;
+}
+
+/* The filter downsample.comp documents: a texel averages the 2x2 block
+ * below it, reads past the last row or column are clamped */
+std::vector<uint8_t> Downsample(const std::vector<uint8_t> &source,
+                                uint32_t width, uint32_t height) {
+    uint32_t mipWidth = std::max(width / 2, 1u);
+    uint32_t mipHeight = std::max(height / 2, 1u);
+    std::vector<uint8_t> mip(mipWidth * mipHeight * 4);
+    for (uint32_t y = 0; y < mipHeight; y++) {
+        uint32_t y0 = std::min(y * 2, height - 1);
+        uint32_t y1 = std::min(y * 2 + 1, height - 1);
+        for (uint32_t x = 0; x < mipWidth; x++) {
+            uint32_t x0 = std::min(x * 2, width - 1);
+            uint32_t x1 = std::min(x * 2 + 1, width - 1);
+            for (uint32_t c = 0; c < 4; c++) {
+                float sum = source[(y0 * width + x0) * 4 + c] +
+                            source[(y0 * width + x1) * 4 + c] +
+                            source[(y1 * width + x0) * 4 + c] +
+                            source[(y1 * width + x1) * 4 + c];
+                mip[(y * mipWidth + x) * 4 + c] =
+                        static_cast<uint8_t>(sum / 4.0f + 0.5f);
+            }
+        }
+    }
+    return mip;
+}
+
+class MipTester {
+public:
+    /* Without compute the generator only has its blit fallback */
+    MipTester(const Device &device, bool compute) : mDevice(device) {
+        VkCommandPoolCreateInfo poolCreateInfo{};
+        poolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolCreateInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        poolCreateInfo.queueFamilyIndex = device.queueFamily;
+        if (vkCreateCommandPool(device.device, &poolCreateInfo, nullptr,
+                                &mCommandPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create command pool");
+        }
+
+        if (device.timestampValidBits > 0) {
+            VkQueryPoolCreateInfo queryPoolCreateInfo{};
+            queryPoolCreateInfo.sType =
+                    VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+            queryPoolCreateInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+            queryPoolCreateInfo.queryCount = 2;
+            if (vkCreateQueryPool(device.device, &queryPoolCreateInfo,
+                                  nullptr, &mQueryPool) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create query pool");
+            }
+        }
+
+        mDescriptorAllocator.Init(device.device, nullptr, 1);
+        mDescriptorUpdater.Init(device.device, nullptr, false, false);
+        // blits only without the shader or the feature it needs
+        std::vector<char> shaderCode;
+        std::ifstream file(DOWNSAMPLE_SHADER_PATH, std::ios::binary);
+        if (compute && device.storageWithoutFormat && file) {
+            shaderCode.assign(std::istreambuf_iterator<char>(file),
+                              std::istreambuf_iterator<char>());
+        }
+        mMipGenerator.Init(device.physicalDevice, device.device, nullptr,
+                           mDescriptorAllocator, mDescriptorUpdater,
+                           shaderCode, 1);
+    }
+
+    ~MipTester() {
+        mMipGenerator.Destroy();
+        mDescriptorUpdater.Clear();
+        mDescriptorAllocator.Release();
+        if (mQueryPool != VK_NULL_HANDLE) {
+            vkDestroyQueryPool(mDevice.device, mQueryPool, nullptr);
+        }
+        vkDestroyCommandPool(mDevice.device, mCommandPool, nullptr);
+    }
+
+    bool UsesCompute(uint32_t width, uint32_t height) const {
+        return mMipGenerator.GetRequiredUsage(FORMAT, width, height) &
+               VK_IMAGE_USAGE_STORAGE_BIT;
+    }
+
+    bool HasTimestamps() const { return mQueryPool != VK_NULL_HANDLE; }
+
+    /* Every level after MipGenerator::Record, mip 0 is source. The
+     * milliseconds Record took on the GPU, or the whole submit without
+     * timestamps. */
+    std::vector<std::vector<uint8_t>> Generate(
+            const std::vector<uint8_t> &source, uint32_t width,
+            uint32_t height, double &milliseconds);
+
+private:
+    const Device       &mDevice;
+    VkCommandPool       mCommandPool = VK_NULL_HANDLE;
+    VkQueryPool         mQueryPool = VK_NULL_HANDLE;
+    DescriptorAllocator mDescriptorAllocator;
+    DescriptorUpdater   mDescriptorUpdater;
+    MipGenerator        mMipGenerator;
+};
+
+std::vector<std::vector<uint8_t>> MipTester::Generate(
+        const std::vector<uint8_t> &source, uint32_t width,
+        uint32_t height, double &milliseconds) {
+    VkDevice device = mDevice.device;
+    uint32_t mipCount = GetMipCount(width, height);
+    VkImageUsageFlags usage = mMipGenerator.GetRequiredUsage(FORMAT, width,
+                                                             height);
+    if (usage == 0) {
+        throw std::runtime_error("failed to generate mips of the format");
+    }
+
+    VkImageCreateInfo imageCreateInfo{};
+    imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageCreateInfo.format = FORMAT;
+    imageCreateInfo.extent = {width, height, 1};
+    imageCreateInfo.mipLevels = mipCount;
+    imageCreateInfo.arrayLayers = 1;
+    imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageCreateInfo.usage = usage | VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+                            VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkImage image;
+    VkDeviceMemory imageMemory;
+    CreateImage(mDevice.physicalDevice, device, nullptr, imageCreateInfo,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image, imageMemory);
+
+    // mip 0 goes up and every level comes back through the same buffer
+    std::vector<VkDeviceSize> offsets(mipCount);
+    VkDeviceSize bufferSize = 0;
+    for (uint32_t mip = 0; mip < mipCount; mip++) {
+        offsets[mip] = bufferSize;
+        bufferSize += GetMipSize(FORMAT, width, height, mip);
+    }
+    VkBuffer buffer;
+    VkDeviceMemory bufferMemory;
+    CreateBuffer(mDevice.physicalDevice, device, nullptr, bufferSize,
+                 VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+                 VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                 buffer, bufferMemory);
+    void *mapped;
+    vkMapMemory(device, bufferMemory, 0, bufferSize, 0, &mapped);
+    auto *data = static_cast<uint8_t *>(mapped);
+    std::memcpy(data, source.data(), source.size());
+
+    VkCommandBufferAllocateInfo allocateInfo{};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocateInfo.commandPool = mCommandPool;
+    allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocateInfo.commandBufferCount = 1;
+    VkCommandBuffer commandBuffer;
+    if (vkAllocateCommandBuffers(device, &allocateInfo, &commandBuffer) !=
+        VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate command buffer");
+    }
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+    if (HasTimestamps()) {
+        vkCmdResetQueryPool(commandBuffer, mQueryPool, 0, 2);
+    }
+
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, mipCount, 0, 1};
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                         nullptr, 1, &barrier);
+    VkBufferImageCopy upload{};
+    upload.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+    upload.imageExtent = {width, height, 1};
+    vkCmdCopyBufferToImage(commandBuffer, buffer, image,
+                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &upload);
+
+    // Record wants every level readable by shaders
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT |
+                            VK_ACCESS_TRANSFER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT |
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                         nullptr, 1, &barrier);
+    // the first timestamp waits for the upload, the second for Record
+    if (HasTimestamps()) {
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                            mQueryPool, 0);
+    }
+    mMipGenerator.Record(commandBuffer, image, FORMAT, width, height,
+                         mipCount);
+    if (HasTimestamps()) {
+        vkCmdWriteTimestamp(commandBuffer,
+                            VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                            mQueryPool, 1);
+    }
+
+    barrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                         nullptr, 1, &barrier);
+    std::vector<VkBufferImageCopy> readbacks(mipCount);
+    for (uint32_t mip = 0; mip < mipCount; mip++) {
+        readbacks[mip].bufferOffset = offsets[mip];
+        readbacks[mip].imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, mip, 0,
+                                           1};
+        readbacks[mip].imageExtent = {std::max(width >> mip, 1u),
+                                      std::max(height >> mip, 1u), 1};
+    }
+    vkCmdCopyImageToBuffer(commandBuffer, image,
+                           VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, buffer,
+                           mipCount, readbacks.data());
+    VkMemoryBarrier hostBarrier{};
+    hostBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    hostBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &hostBarrier, 0,
+                         nullptr, 0, nullptr);
+    vkEndCommandBuffer(commandBuffer);
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    auto start = std::chrono::steady_clock::now();
+    if (vkQueueSubmit(mDevice.queue, 1, &submitInfo, VK_NULL_HANDLE) !=
+        VK_SUCCESS) {
+        throw std::runtime_error("failed to submit mip generation");
+    }
+    vkQueueWaitIdle(mDevice.queue);
+    std::chrono::duration<double, std::milli> elapsed =
+            std::chrono::steady_clock::now() - start;
+    milliseconds = elapsed.count();
+    if (HasTimestamps()) {
+        uint64_t timestamps[2];
+        if (vkGetQueryPoolResults(device, mQueryPool, 0, 2,
+                                  sizeof(timestamps), timestamps,
+                                  sizeof(uint64_t),
+                                  VK_QUERY_RESULT_64_BIT |
+                                  VK_QUERY_RESULT_WAIT_BIT) != VK_SUCCESS) {
+            throw std::runtime_error("failed to read timestamps");
+        }
+        uint64_t mask = mDevice.timestampValidBits >= 64
+                        ? ~uint64_t(0)
+                        : (uint64_t(1) << mDevice.timestampValidBits) - 1;
+        uint64_t ticks = (timestamps[1] - timestamps[0]) & mask;
+        milliseconds = ticks * double(mDevice.timestampPeriod) / 1e6;
+    }
+
+    std::vector<std::vector<uint8_t>> levels(mipCount);
+    for (uint32_t mip = 0; mip < mipCount; mip++) {
+        levels[mip].assign(data + offsets[mip],
+                           data + offsets[mip] +
+                           GetMipSize(FORMAT, width, height, mip));
+    }
+
+    // the views of the frame go on the next one
+    mMipGenerator.NextFrame();
+    mDescriptorAllocator.NextFrame();
+    vkFreeCommandBuffers(device, mCommandPool, 1, &commandBuffer);
+    vkDestroyBuffer(device, buffer, nullptr);
+    vkFreeMemory(device, bufferMemory, nullptr);
+    vkDestroyImage(device, image, nullptr);
+    vkFreeMemory(device, imageMemory, nullptr);
+    return levels;
+}
+
+/* Noise on top of a gradient, so both the smooth and the sharp parts
+ * of the filter show */
+std::vector<uint8_t> MakeSource(uint32_t width, uint32_t height) {
+    std::mt19937 random(width * 31 + height);
+    std::uniform_int_distribution<int> noise(-48, 48);
+    std::vector<uint8_t> texels(width * height * 4);
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+            int base[4] = {static_cast<int>(255 * x / width),
+                           static_cast<int>(255 * y / height), 128, 255};
+            for (uint32_t c = 0; c < 4; c++) {
+                texels[(y * width + x) * 4 + c] = static_cast<uint8_t>(
+                        std::clamp(base[c] + noise(random), 0, 255));
+            }
+        }
+    }
+    return texels;
+}
+
+/* Check and time one size on one path, blits of odd sizes are only
+ * timed */
+void TestSize(MipTester &tester, uint32_t width, uint32_t height) {
+    bool compute = tester.UsesCompute(width, height);
+    std::cout << "  " << width << "x" << height
+              << (compute ? " compute" : " blit");
+    bool powerOfTwo = (width & (width - 1)) == 0 &&
+                      (height & (height - 1)) == 0;
+    std::vector<uint8_t> source = MakeSource(width, height);
+
+    std::vector<double> times(TIMING_ROUNDS);
+    auto levels = tester.Generate(source, width, height, times[0]);
+    for (uint32_t round = 1; round < TIMING_ROUNDS; round++) {
+        tester.Generate(source, width, height, times[round]);
+    }
+    std::nth_element(times.begin(), times.begin() + times.size() / 2,
+                     times.end());
+    Check(levels.size() == GetMipCount(width, height),
+          "every level is read back");
+    std::cout << ", " << levels.size() << " mips, " << std::fixed
+              << std::setprecision(3) << times[times.size() / 2] << " ms";
+    if (!compute && !powerOfTwo) {
+        std::cout << ", not compared\n";
+        return;
+    }
+
+    int worst = 0;
+    for (uint32_t mip = 1; mip < levels.size(); mip++) {
+        // against the GPU's own level above, so errors do not add up
+        std::vector<uint8_t> reference = Downsample(
+                levels[mip - 1], std::max(width >> (mip - 1), 1u),
+                std::max(height >> (mip - 1), 1u));
+        Check(reference.size() == levels[mip].size(),
+              "mip has the size of the reference");
+        for (size_t i = 0; i < reference.size() && i < levels[mip].size();
+             i++) {
+            worst = std::max(worst, std::abs(reference[i] - levels[mip][i]));
+        }
+    }
+    std::cout << ", max error " << worst << "/255\n";
+    Check(worst <= MAX_ERROR, "mips match the CPU reference");
+}
+
+}
+
+int main() {
+    Device device = CreateDevice();
+    for (bool compute : {true, false}) {
+        MipTester tester(device, compute);
+        std::cout << (compute ? "downsampler" : "blits only") << ", "
+                  << (tester.HasTimestamps() ? "Record timed on the GPU"
+                                             : "whole submit timed")
+                  << ", median of " << TIMING_ROUNDS << "\n";
+        // one tile, several tiles, the last group pass and odd sizes
+        TestSize(tester, 64, 64);
+        TestSize(tester, 256, 256);
+        TestSize(tester, 2048, 1024);
+        TestSize(tester, 1000, 600);
+        TestSize(tester, 301, 77);
+        TestSize(tester, 1, 129);
+    }
+    vkDestroyDevice(device.device, nullptr);
+    vkDestroyInstance(device.instance, nullptr);
+
+    if (gFailures > 0) {
+        std::cout << gFailures << " checks failed\n";
+        return 1;
+    }
+    std::cout << "mip generator ok\n";
+    return 0;
+}
@@ -0,0 +1,109 @@
+//
+// Created by Krisu on 2020/4/7.
+//
+
+#include "RenderPassCache.hpp"
+
+#include <iostream>
+#include <utility>
+
+
+// the keys of RenderPassCache, checked without a device
+
+namespace {
+
+int gFailures = 0;
+
+void Check(bool condition, const char *what) {
+    if (!condition) {
+        std::cout << "FAILED: " << what << "\n";
+        gFailures++;
+    }
+}
+
+RenderPassDesc MakeSwapChainPass() {
+    AttachmentDesc color;
+    color.format = VK_FORMAT_B8G8R8A8_SRGB;
+    color.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    color.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    color.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+    AttachmentDesc depth;
+    depth.format = VK_FORMAT_D32_SFLOAT;
+    depth.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depth.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    SubpassDesc subpass;
+    subpass.colorAttachments = {0};
+    subpass.depthAttachment = 1;
+
+    RenderPassDesc desc;
+    desc.attachments = {color, depth};
+    desc.subpasses = {subpass};
+    return desc;
+}
+
+void TestRenderPassKeys() {
+    RenderPassDesc desc = MakeSwapChainPass();
+    RenderPassDesc copy = MakeSwapChainPass();
+    Check(desc == copy, "equal descriptions compare equal");
+    Check(desc.Hash() == copy.Hash(), "equal descriptions hash equal");
+
+    // FNV-1a over the field values, the same on every run and platform
+    Check(desc.Hash() == 0xf4e57d7ee37e2c86ull, "render pass key is stable");
+
+    RenderPassDesc changed = MakeSwapChainPass();
+    changed.attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    Check(!(changed == desc), "load op changes the description");
+    Check(changed.Hash() != desc.Hash(), "load op changes the key");
+
+    changed = MakeSwapChainPass();
+    changed.attachments[1].finalLayout =
+            VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+    Check(changed.Hash() != desc.Hash(), "final layout changes the key");
+
+    changed = MakeSwapChainPass();
+    changed.subpasses[0].depthAttachment = VK_ATTACHMENT_UNUSED;
+    Check(!(changed == desc), "depth attachment changes the description");
+    Check(changed.Hash() != desc.Hash(), "depth attachment changes the key");
+
+    // the same values split differently between the arrays
+    RenderPassDesc twoColors = MakeSwapChainPass();
+    twoColors.subpasses[0].colorAttachments = {0, 1};
+    twoColors.subpasses[0].depthAttachment = VK_ATTACHMENT_UNUSED;
+    Check(twoColors.Hash() != desc.Hash(), "attachment counts are hashed");
+}
+
+void TestFramebufferKeys() {
+    FramebufferDesc desc;
+    desc.renderPass = (VkRenderPass) 0x10;
+    desc.attachments = {(VkImageView) 0x20, (VkImageView) 0x30};
+    desc.extent = {800, 600};
+
+    FramebufferDesc copy = desc;
+    Check(desc == copy, "equal framebuffers compare equal");
+    Check(desc.Hash() == copy.Hash(), "equal framebuffers hash equal");
+    Check(desc.Hash() == 0xee7b63a2142646c3ull, "framebuffer key is stable");
+
+    FramebufferDesc resized = desc;
+    resized.extent = {600, 800};
+    Check(!(resized == desc), "extent changes the framebuffer");
+    Check(resized.Hash() != desc.Hash(), "swapped extent changes the key");
+
+    FramebufferDesc reordered = desc;
+    std::swap(reordered.attachments[0], reordered.attachments[1]);
+    Check(reordered.Hash() != desc.Hash(), "view order changes the key");
+}
+
+}
+
+int main() {
+    TestRenderPassKeys();
+    TestFramebufferKeys();
+    if (gFailures > 0) {
+        std::cout << gFailures << " checks failed\n";
+        return 1;
+    }
+    std::cout << "render pass cache keys ok\n";
+    return 0;
+}
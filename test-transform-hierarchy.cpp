@@ -0,0 +1,219 @@
+//
+// Created by Krisu on 2020/4/16.
+//
+
+#include "TransformHierarchy.hpp"
+
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+
+// TransformHierarchy's world matrices against a plain recursive product
+// of T * R * S, on a random forest big enough to split levels over the
+// JobSystem, after partial changes and after adding nodes. SetRotation
+// and SetScale must keep the rest of the local transform.
+
+namespace {
+
+constexpr uint32_t NODE_COUNT = 20011;
+constexpr uint32_t ROOT_COUNT = 7;
+constexpr double MAX_ERROR = 1e-4;
+
+int gFailures = 0;
+
+void Check(bool condition, const char *what) {
+    if (!condition) {
+        std::cout << "FAILED: " << what << "\n";
+        gFailures++;
+    }
+}
+
+struct Local {
+    float translation[3]{0.0f, 0.0f, 0.0f};
+    float rotation[4]{0.0f, 0.0f, 0.0f, 1.0f};
+    float scale[3]{1.0f, 1.0f, 1.0f};
+};
+
+/* 3x4 row major, like GetWorldMatrix */
+struct Matrix {
+    float m[12];
+};
+
+Matrix ToMatrix(const Local &local) {
+    float x = local.rotation[0], y = local.rotation[1];
+    float z = local.rotation[2], w = local.rotation[3];
+    float rotation[3][3]{
+            {1 - 2 * (y * y + z * z), 2 * (x * y - w * z), 2 * (x * z + w * y)},
+            {2 * (x * y + w * z), 1 - 2 * (x * x + z * z), 2 * (y * z - w * x)},
+            {2 * (x * z - w * y), 2 * (y * z + w * x), 1 - 2 * (x * x + y * y)}
+    };
+    Matrix matrix;
+    for (int row = 0; row < 3; row++) {
+        for (int column = 0; column < 3; column++) {
+            matrix.m[row * 4 + column] =
+                    rotation[row][column] * local.scale[column];
+        }
+        matrix.m[row * 4 + 3] = local.translation[row];
+    }
+    return matrix;
+}
+
+Matrix Multiply(const Matrix &a, const Matrix &b) {
+    Matrix product;
+    for (int row = 0; row < 3; row++) {
+        for (int column = 0; column < 4; column++) {
+            float value = column == 3 ? a.m[row * 4 + 3] : 0.0f;
+            for (int k = 0; k < 3; k++) {
+                value += a.m[row * 4 + k] * b.m[k * 4 + column];
+            }
+            product.m[row * 4 + column] = value;
+        }
+    }
+    return product;
+}
+
+class Tester {
+public:
+    explicit Tester(JobSystem &jobSystem) {
+        mHierarchy.Init(jobSystem);
+    }
+
+    void AddNode(uint32_t parent) {
+        mHierarchy.AddNode(parent);
+        mParents.push_back(parent);
+        mLocals.emplace_back();
+    }
+
+    uint32_t GetNodeCount() const { return mParents.size(); }
+
+    uint32_t GetRandomNode() { return mRandom() % mParents.size(); }
+
+    void SetRandomLocal(uint32_t node) {
+        Local &local = mLocals[node];
+        for (float &t : local.translation) {
+            t = mSigned(mRandom);
+        }
+        SetRandomRotation(node);
+        for (float &s : local.scale) {
+            s = 1.0f + 0.1f * mSigned(mRandom);
+        }
+        mHierarchy.SetLocal(node, local.translation, local.rotation,
+                            local.scale);
+    }
+
+    void SetRandomRotation(uint32_t node) {
+        float *rotation = mLocals[node].rotation;
+        float length = 0.0f;
+        for (int i = 0; i < 4; i++) {
+            rotation[i] = mSigned(mRandom);
+            length += rotation[i] * rotation[i];
+        }
+        for (int i = 0; i < 4; i++) {
+            rotation[i] /= std::sqrt(length);
+        }
+        mHierarchy.SetRotation(node, rotation);
+    }
+
+    void SetRandomScale(uint32_t node) {
+        float *scale = mLocals[node].scale;
+        for (int i = 0; i < 3; i++) {
+            scale[i] = 0.5f + mSigned(mRandom) * 0.25f;
+        }
+        mHierarchy.SetScale(node, scale);
+    }
+
+    void SetRandomTranslation(uint32_t node) {
+        float *translation = mLocals[node].translation;
+        for (int i = 0; i < 3; i++) {
+            translation[i] = mSigned(mRandom);
+        }
+        mHierarchy.SetTranslation(node, translation);
+    }
+
+    /* Update and compare every node, parents come before children */
+    void CheckWorlds(const char *what) {
+        mHierarchy.Update();
+        std::vector<Matrix> worlds(mParents.size());
+        double maxError = 0.0;
+        for (size_t node = 0; node < mParents.size(); node++) {
+            Matrix local = ToMatrix(mLocals[node]);
+            uint32_t parent = mParents[node];
+            worlds[node] = parent == TransformHierarchy::NO_PARENT
+                           ? local : Multiply(worlds[parent], local);
+            const float *world = mHierarchy.GetWorldMatrix(node);
+            for (int i = 0; i < 12; i++) {
+                double expected = worlds[node].m[i];
+                maxError = std::max(maxError,
+                                    std::fabs(world[i] - expected) /
+                                    (1.0 + std::fabs(expected)));
+            }
+        }
+        Check(maxError < MAX_ERROR, what);
+    }
+
+    const TransformHierarchy &GetHierarchy() const { return mHierarchy; }
+
+private:
+    TransformHierarchy    mHierarchy;
+    std::vector<uint32_t> mParents;
+    std::vector<Local>    mLocals;
+    std::mt19937          mRandom{1};
+    std::uniform_real_distribution<float> mSigned{-1.0f, 1.0f};
+};
+
+}
+
+int main() {
+    JobSystem jobSystem(3);
+    Tester tester(jobSystem);
+
+    // parents are picked at random among the nodes added before
+    std::mt19937 random(2);
+    for (uint32_t i = 0; i < NODE_COUNT; i++) {
+        tester.AddNode(i < ROOT_COUNT ? TransformHierarchy::NO_PARENT
+                                      : random() % i);
+    }
+    for (uint32_t i = 0; i < NODE_COUNT; i++) {
+        tester.SetRandomLocal(i);
+    }
+    tester.CheckWorlds("world matrices after SetLocal");
+    Check(tester.GetHierarchy().GetLevelCount() > 1,
+          "the forest has more than one level");
+
+    for (int i = 0; i < 50; i++) {
+        tester.SetRandomLocal(tester.GetRandomNode());
+    }
+    tester.CheckWorlds("world matrices after changing a few nodes");
+
+    for (int i = 0; i < 50; i++) {
+        tester.SetRandomRotation(tester.GetRandomNode());
+    }
+    tester.CheckWorlds("SetRotation keeps translation and scale");
+
+    for (int i = 0; i < 50; i++) {
+        tester.SetRandomScale(tester.GetRandomNode());
+    }
+    tester.CheckWorlds("SetScale keeps translation and rotation");
+
+    for (int i = 0; i < 50; i++) {
+        tester.SetRandomTranslation(tester.GetRandomNode());
+    }
+    tester.CheckWorlds("SetTranslation keeps rotation and scale");
+
+    // new nodes get sorted in between the old ones
+    for (int i = 0; i < 100; i++) {
+        tester.AddNode(random() % tester.GetNodeCount());
+    }
+    tester.CheckWorlds("world matrices after adding nodes");
+
+    tester.CheckWorlds("world matrices after an Update with no change");
+
+    if (gFailures > 0) {
+        std::cout << gFailures << " checks failed\n";
+        return 1;
+    }
+    std::cout << "transform hierarchy ok\n";
+    return 0;
+}